@@ -0,0 +1,333 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Alert Actions
+	What happens when a sensor (or rule) becomes critical.  A
+	    command starting with '@' is a built-in action which
+	    writes to sysfs/cgroupfs directly instead of starting
+	    a shell:
+
+	     @cpufreq VALUE       scaling_max_freq of every cpufreq
+	                          policy (kHz, or N% of cpuinfo_max_freq)
+	     @pwm HWMON/PWM VALUE fan PWM under class/hwmon, e.g.
+	                          "@pwm hwmon2/pwm1 200" (0-255); the
+	                          channel is switched to manual control
+	     @freeze CGROUP       freeze a cgroup v2 group, e.g.
+	                          "@freeze user.slice/batch.slice"
+
+	    VALUE is either a constant or FROM:TO@SPAN, which ramps
+	    linearly from FROM at the critical temperature to TO at
+	    SPAN degrees above it (e.g. "@pwm hwmon2/pwm1 150:255@10";
+	    for @cpufreq either both ends or neither end take a %).
+	    Ramps are re-applied while the sensor stays critical.
+	    When the alert clears, the previous contents of every
+	    file written are restored.
+
+	    All paths are relative to the sysfs root (default /sys,
+	    see --sysfs-root) so the actions can be exercised on a
+	    fake directory tree.
+
+	Anything else is a shell command for the CommandExecutor.
+****************************************************************/
+#ifndef ALERTS_ACTIONS_HPP_
+#define ALERTS_ACTIONS_HPP_
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include "CommandExecutor.hpp"
+
+/** @brief A parsed built-in action */
+struct NativeAction {
+	enum class Type : unsigned char {
+		CpuFreq,
+		Pwm,
+		Freeze
+	} Kind = Type::Freeze;
+	std::string Target;     ///<Pwm: HWMON/PWM, Freeze: cgroup path
+	float From = 0;         ///<Value at the critical temperature
+	float To = 0;           ///<Value at Critical + Span
+	float Span = 0;         ///<0: constant value
+	bool Percent = false;   ///<CpuFreq: values are % of cpuinfo_max_freq
+
+	/** @brief Parse "VALUE" or "FROM:TO@SPAN" (FROM and TO both with a %, or neither) */
+	static bool ParseValue(std::string const &Text, NativeAction &Out) {
+		char const *P = Text.c_str();
+		char *End;
+		Out.From = std::strtof(P, &End);
+		if (End == P) return false;
+		Out.Percent = (*End == '%');
+		if (Out.Percent) End++;
+		Out.To = Out.From;
+		if (*End == ':') {
+			P = End + 1;
+			Out.To = std::strtof(P, &End);
+			if (End == P) return false;
+			bool ToPercent = (*End == '%');
+			if (ToPercent) End++;
+			if (ToPercent != Out.Percent) return false;   //A ramp between kHz and % makes no sense
+			if (*End != '@') return false;
+			P = End + 1;
+			Out.Span = std::strtof(P, &End);
+			if (End == P || Out.Span <= 0) return false;
+		}
+		return *End == '\0';
+	}
+
+	/** @brief Parse an '@' command
+	 * @returns false (with Error set) if Text is not a valid built-in action
+	 */
+	static bool Parse(std::string const &Text, NativeAction &Out, std::string &Error) {
+		std::vector<std::string> Words;
+		std::size_t Pos = 0;
+		while ((Pos = Text.find_first_not_of(" \t", Pos)) != std::string::npos) {
+			std::size_t End = Text.find_first_of(" \t", Pos);
+			Words.push_back(Text.substr(Pos, End - Pos));
+			Pos = End;
+		}
+		if (Words.empty()) { Error = "empty action"; return false; }
+		if (Words[0] == "@cpufreq" && Words.size() == 2) {
+			Out.Kind = Type::CpuFreq;
+			if (!ParseValue(Words[1], Out)) { Error = "invalid value '" + Words[1] + "'"; return false; }
+		}
+		else if (Words[0] == "@pwm" && Words.size() == 3) {
+			Out.Kind = Type::Pwm;
+			Out.Target = Words[1];
+			if (!ParseValue(Words[2], Out) || Out.Percent) { Error = "invalid value '" + Words[2] + "'"; return false; }
+		}
+		else if (Words[0] == "@freeze" && Words.size() == 2) {
+			Out.Kind = Type::Freeze;
+			Out.Target = Words[1];
+		}
+		else {
+			Error = "expected '@cpufreq VALUE', '@pwm HWMON/PWM VALUE' or '@freeze CGROUP'";
+			return false;
+		}
+		if (Out.Target.find("..") != std::string::npos) { Error = "'..' is not allowed in paths"; return false; }
+		return true;
+	}
+
+	/** @brief The value to write for a reading of Temp against a critical temperature of Critical */
+	float Value(float Temp, float Critical) const {
+		if (Span <= 0 || std::isnan(Critical)) return From;
+		float t = std::min(1.0f, std::max(0.0f, (Temp - Critical) / Span));
+		return From + (To - From) * t;
+	}
+};
+
+class AlertActions {
+private:
+	/** @brief A file an action wants written */
+	struct Write {
+		std::string Path;
+		std::string Value;
+		bool Optional;        ///<Silently skipped if the file doesn't exist
+	};
+	/** @brief A file written by an active action */
+	struct Written {
+		std::string Path;
+		std::string Current;
+	};
+	struct Active {
+		NativeAction const *Action;
+		std::vector<Written> Files;
+	};
+	/** @brief Original contents of a file, kept until the last action using it clears */
+	struct Saved {
+		std::string Previous;
+		unsigned Users;
+	};
+	CommandExecutor &m_Executor;
+	std::string m_Root = "/sys";
+	std::mutex m_Lock;   ///<Fire/Update/Clear may be called from the GTK thread
+	std::unordered_map<std::string,NativeAction> m_Parsed;   ///<Command text -> action
+	std::unordered_map<std::string,bool> m_Invalid;          ///<Commands already reported as invalid
+	std::unordered_map<std::string,Active> m_Active;         ///<Key -> applied action
+	std::unordered_map<std::string,Saved> m_Saved;           ///<Path -> contents before any action
+
+	static bool ReadFile(std::string const &Path, std::string &Out) {
+		int FD = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (FD < 0) return false;
+		char Buffer[256];
+		ssize_t N = read(FD, Buffer, sizeof(Buffer));
+		close(FD);
+		if (N < 0) return false;
+		Out.assign(Buffer, N);
+		while (!Out.empty() && (Out.back() == '\n' || Out.back() == ' ')) Out.pop_back();
+		return true;
+	}
+	static bool WriteFile(std::string const &Path, std::string const &Value) {
+		int FD = open(Path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);   //O_TRUNC is ignored by sysfs but keeps fake trees honest
+		if (FD < 0) return false;
+		bool Ok = write(FD, Value.data(), Value.size()) == (ssize_t)Value.size();
+		return (close(FD) == 0) && Ok;
+	}
+	static std::vector<std::string> Glob(std::string const &Pattern) {
+		std::vector<std::string> Ret;
+		glob_t G;
+		if (glob(Pattern.c_str(), 0, nullptr, &G) == 0) {
+			for (std::size_t i = 0; i != G.gl_pathc; i++) Ret.push_back(G.gl_pathv[i]);
+		}
+		globfree(&G);
+		return Ret;
+	}
+
+	/** @brief Files and values an action writes for the given reading */
+	std::vector<Write> Plan(NativeAction const &A, float Temp, float Critical) const {
+		std::vector<Write> Ret;
+		float V = A.Value(Temp, Critical);
+		switch (A.Kind) {
+		case NativeAction::Type::CpuFreq:
+			for (auto const &Policy : Glob(m_Root + "/devices/system/cpu/cpufreq/policy*")) {
+				long kHz = std::lround(V);
+				if (A.Percent) {
+					std::string Max;
+					if (!ReadFile(Policy + "/cpuinfo_max_freq", Max)) continue;
+					kHz = std::lround(std::atol(Max.c_str()) * V / 100.0);
+				}
+				Ret.push_back({Policy + "/scaling_max_freq", std::to_string(kHz), false});
+			}
+			break;
+		case NativeAction::Type::Pwm: {
+			std::string Path = m_Root + "/class/hwmon/" + A.Target;
+			Ret.push_back({Path + "_enable", "1", true});   //manual control
+			Ret.push_back({Path, std::to_string(std::lround(std::min(255.0f, std::max(0.0f, V)))), false});
+			break;
+		}
+		case NativeAction::Type::Freeze:
+			Ret.push_back({m_Root + "/fs/cgroup/" + A.Target + "/cgroup.freeze", "1", false});
+			break;
+		}
+		return Ret;
+	}
+
+	/** @brief Write the planned values, remembering what was there first (m_Lock held) */
+	void Apply(std::string const &Key, Active &Entry, float Temp, float Critical) {
+		for (auto const &i : Plan(*Entry.Action, Temp, Critical)) {
+			auto IT = std::find_if(Entry.Files.begin(), Entry.Files.end(), [&i](Written const &W){ return W.Path == i.Path; });
+			if (IT != Entry.Files.end() && IT->Current == i.Value) continue;
+			if (IT == Entry.Files.end()) {
+				auto S = m_Saved.find(i.Path);
+				if (S == m_Saved.end()) {
+					std::string Previous;
+					if (!ReadFile(i.Path, Previous)) {
+						if (!i.Optional) std::cerr << "Action for " << Key << ": cannot read " << i.Path << "\n";
+						continue;
+					}
+					S = m_Saved.emplace(i.Path, Saved{Previous, 0}).first;
+				}
+				S->second.Users++;
+				Entry.Files.push_back({i.Path, ""});
+				IT = Entry.Files.end() - 1;
+			}
+			if (!WriteFile(i.Path, i.Value)) {
+				std::cerr << "Action for " << Key << ": cannot write " << i.Path << "\n";
+				continue;
+			}
+			IT->Current = i.Value;
+		}
+	}
+
+	/** @brief The parsed action for an '@' command (nullptr if invalid; m_Lock held) */
+	NativeAction const *Lookup(std::string const &Key, std::string const &Command) {
+		auto IT = m_Parsed.find(Command);
+		if (IT != m_Parsed.end()) return &IT->second;
+		if (m_Invalid.count(Command)) return nullptr;
+		NativeAction A;
+		std::string Error;
+		if (!NativeAction::Parse(Command, A, Error)) {
+			std::cerr << "Invalid action for " << Key << " (" << Command << "): " << Error << "\n";
+			m_Invalid[Command] = true;
+			return nullptr;
+		}
+		return &m_Parsed.emplace(Command, A).first->second;
+	}
+public:
+	explicit AlertActions(CommandExecutor &Executor) : m_Executor(Executor) {}
+	/** @brief Put back everything still applied */
+	~AlertActions() {
+		std::vector<std::string> Keys;
+		for (auto const &i : m_Active) Keys.push_back(i.first);
+		for (auto const &i : Keys) Clear(i);
+	}
+
+	/** @brief Directory that stands in for /sys */
+	void SetSysfsRoot(std::string const &Root) {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		m_Root = Root;
+		while (m_Root.size() > 1 && m_Root.back() == '/') m_Root.pop_back();
+	}
+
+	/** @brief Check Command without running it (for validating configuration up front) */
+	static bool Validate(std::string const &Command, std::string &Error) {
+		if (Command.empty() || Command[0] != '@') return true;
+		NativeAction A;
+		return NativeAction::Parse(Command, A, Error);
+	}
+
+	/** @brief Key became critical: start Command
+	 * @param Temp      The reading that triggered the alert
+	 * @param Critical  The threshold it crossed (NaN if unknown; ramps use their FROM value)
+	 */
+	void Fire(std::string const &Key, std::string const &Command, float Temp, float Critical) {
+		if (Command.empty()) return;
+		if (Command[0] != '@') {
+			m_Executor.Submit(Key, Command);
+			return;
+		}
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		NativeAction const *A = Lookup(Key, Command);
+		if (A == nullptr) return;
+		Active &Entry = m_Active[Key];
+		Entry.Action = A;
+		Apply(Key, Entry, Temp, Critical);
+	}
+
+	/** @brief Key is still critical: follow the temperature with ramped values */
+	void Update(std::string const &Key, float Temp, float Critical) {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		auto IT = m_Active.find(Key);
+		if (IT == m_Active.end() || IT->second.Action->Span <= 0) return;
+		Apply(Key, IT->second, Temp, Critical);
+	}
+
+	/** @brief Key is no longer critical: restore whatever its action changed */
+	void Clear(std::string const &Key) {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		auto IT = m_Active.find(Key);
+		if (IT == m_Active.end()) return;
+		//Restore in reverse (pwm value before switching back to automatic control);
+		//a file shared with another active action is restored when that one clears
+		for (auto W = IT->second.Files.rbegin(); W != IT->second.Files.rend(); ++W) {
+			auto S = m_Saved.find(W->Path);
+			if (S == m_Saved.end() || --S->second.Users != 0) continue;
+			if (!WriteFile(W->Path, S->second.Previous))
+				std::cerr << "Action for " << Key << ": cannot restore " << W->Path << "\n";
+			m_Saved.erase(S);
+		}
+		m_Active.erase(IT);
+	}
+};
+
+#endif //ALERTS_ACTIONS_HPP_
@@ -0,0 +1,86 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Alert Configuration
+	An immutable snapshot of the files that configure the
+	    alerts (the -f critical temperatures and the --rules
+	    file), resolved against the sensor list.  The files are
+	    reloaded into a new snapshot when they change (see
+	    Config/ConfigWatcher.hpp); a snapshot is only built if
+	    everything in it is valid.
+****************************************************************/
+#ifndef ALERTS_ALERTCONFIG_HPP_
+#define ALERTS_ALERTCONFIG_HPP_
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Config/ConfigFile.hpp"
+#include "Actions.hpp"
+#include "RuleEngine.hpp"
+#include "ThresholdTable.hpp"
+
+struct AlertConfig {
+	std::vector<float> Criticals;    ///<Critical temperature of each sensor (NaN: none; empty: no thresholds file)
+	std::vector<AlertRule> Rules;
+};
+
+/** @brief Read, parse and validate the alert configuration
+ * @param ThresholdsPath  Critical temperatures file (empty: none)
+ * @param RulesPath       Rules file (empty: none)
+ * @param SensorNames     Sensor list to resolve the thresholds against
+ * @returns The new configuration, or null (with Error set) if anything in it is invalid
+ * @note Safe to call from any thread
+ */
+inline std::shared_ptr<const AlertConfig> LoadAlertConfig(std::string const &ThresholdsPath, std::string const &RulesPath,
+                                                          std::vector<std::string> const &SensorNames, std::string &Error) {
+	auto Config = std::make_shared<AlertConfig>();
+	std::string Data;
+	if (ThresholdsPath.length() > 0) {
+		ThresholdTable Thresholds;
+		if (!ReadWholeFile(ThresholdsPath, Data)) {
+			Error = ThresholdsPath + ": " + strerror(errno);
+			return nullptr;
+		}
+		if (!Thresholds.Parse(Data, Error)) {
+			Error = ThresholdsPath + ": " + Error;
+			return nullptr;
+		}
+		Thresholds.Resolve(SensorNames);
+		Config->Criticals = Thresholds.Values();
+	}
+	if (RulesPath.length() > 0) {
+		if (!ReadWholeFile(RulesPath, Data)) {
+			Error = RulesPath + ": " + strerror(errno);
+			return nullptr;
+		}
+		std::istringstream In(Data);
+		if (!RuleEngine::Parse(In, RulesPath, Config->Rules)) {
+			Error = RulesPath + ": invalid rules";
+			return nullptr;
+		}
+		for (auto const &Rule : Config->Rules) {
+			if (!AlertActions::Validate(Rule.Command, Error)) {
+				Error = "invalid action in rule '" + Rule.Text + "': " + Error;
+				return nullptr;
+			}
+		}
+	}
+	return Config;
+}
+
+#endif //ALERTS_ALERTCONFIG_HPP_
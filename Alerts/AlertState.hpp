@@ -0,0 +1,242 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Alert State Machine
+	Tracks the alert level of every sensor so that actions run
+	    once per excursion instead of once per sample.
+
+	      Normal ---> Warning ---> Critical ---> Cooldown
+	        ^            |                          |
+	        +------------+--------------------------+
+
+	     -Warning is entered at Critical - WarningBand, or (with a
+	      Horizon) as soon as the sensor is predicted to reach
+	      Critical within Horizon seconds (History/ThermalPredictor.hpp),
+	      so that it is raised before the crossing
+	     -a level is only left once the temperature has dropped
+	      Hysteresis degrees below the threshold that raised it
+	     -a change of level must be wanted for MinDwell seconds
+	      (debounce) before it happens
+	     -leaving Critical enters Cooldown; Critical cannot be
+	      re-entered until RearmDelay seconds later
+
+	AlertTracker is fed one sample (or one snapshot) at a time
+	    and reports the transitions it made.  Snapshots are first
+	    run through the SIMD threshold kernel; sensors that are
+	    idle (Normal, nothing pending) and below their warning
+	    threshold are skipped 64 at a time.
+****************************************************************/
+#ifndef ALERTS_ALERTSTATE_HPP_
+#define ALERTS_ALERTSTATE_HPP_
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../Types.hpp"
+#include "ThresholdKernel.hpp"
+
+enum class AlertLevel : unsigned char {
+	Normal,
+	Warning,
+	Critical,
+	Cooldown
+};
+
+inline char const *AlertLevelName(AlertLevel Level) {
+	switch (Level) {
+	case AlertLevel::Normal:   return "normal";
+	case AlertLevel::Warning:  return "warning";
+	case AlertLevel::Critical: return "critical";
+	case AlertLevel::Cooldown: return "cooldown";
+	}
+	return "";
+}
+
+/** @brief User-tunable behaviour of the alert state machine */
+struct AlertPolicy {
+	float WarningBand = 5;     ///<Degrees below the critical temperature at which Warning starts
+	float Hysteresis = 2;      ///<Degrees a reading must fall below a threshold before the level drops
+	double MinDwell = 0;       ///<Seconds a new level must persist before it is entered
+	double RearmDelay = 30;    ///<Seconds after leaving Critical before it can fire again
+	double Horizon = 0;        ///<Seconds: warn when Critical is predicted this soon (0: only on temperature)
+};
+
+/** @brief A change of level made by AlertTracker */
+struct AlertTransition {
+	std::size_t Sensor;
+	AlertLevel From;
+	AlertLevel To;
+	float Value;   ///<The reading which caused the transition
+};
+
+class AlertTracker {
+private:
+	struct State {
+		AlertLevel Level = AlertLevel::Normal;
+		AlertLevel Pending = AlertLevel::Normal;   ///<Level wanted by the most recent samples
+		double PendingSince = 0;                   ///<When Pending was first wanted
+		double LeftCritical = 0;                   ///<When Cooldown was entered
+	};
+	AlertPolicy m_Policy;
+	std::vector<State> m_States;
+	std::vector<AlertTransition> m_Transitions;
+	std::vector<uint64_t> m_Busy;          ///<Bit set: sensor is not idle and must be evaluated
+	std::vector<uint64_t> m_WarningBits;   ///<Kernel output for the current snapshot
+	std::vector<uint64_t> m_CriticalBits;
+	std::vector<float> m_Padded;           ///<Critical temperatures padded with NaN to the snapshot size
+
+	void Grow(std::size_t NSensors) {
+		if (m_States.size() < NSensors) m_States.resize(NSensors);
+		m_Busy.resize(ThresholdKernel::Words(m_States.size()), 0);
+	}
+	void MarkBusy(std::size_t Sensor) {
+		State const &S = m_States[Sensor];
+		uint64_t const Bit = (uint64_t)1 << (Sensor % 64);
+		if (S.Level == AlertLevel::Normal && S.Pending == AlertLevel::Normal) m_Busy[Sensor/64] &= ~Bit;
+		else m_Busy[Sensor/64] |= Bit;
+	}
+
+	/** @brief The level a reading asks for, given the current level and the predicted seconds to Critical */
+	AlertLevel Target(State const &S, float Value, float Critical, double Time, float Eta) const {
+		if (std::isnan(Critical)) return AlertLevel::Normal;
+		float const Warning = Critical - m_Policy.WarningBand;
+		float const H = m_Policy.Hysteresis;
+		bool const Predicted = m_Policy.Horizon > 0 && Eta <= m_Policy.Horizon;
+		switch (S.Level) {
+		case AlertLevel::Normal:
+			if (Value >= Critical) return AlertLevel::Critical;
+			if (Value >= Warning || Predicted) return AlertLevel::Warning;
+			return AlertLevel::Normal;
+		case AlertLevel::Warning:
+			if (Value >= Critical) return AlertLevel::Critical;
+			if (Value < Warning - H && !Predicted) return AlertLevel::Normal;
+			return AlertLevel::Warning;
+		case AlertLevel::Critical:
+			if (Value < Critical - H) return AlertLevel::Cooldown;
+			return AlertLevel::Critical;
+		case AlertLevel::Cooldown:
+			if (Time - S.LeftCritical < m_Policy.RearmDelay) return AlertLevel::Cooldown;
+			if (Value >= Critical) return AlertLevel::Critical;
+			if (Value >= Warning || Predicted) return AlertLevel::Warning;
+			return AlertLevel::Normal;
+		}
+		return S.Level;
+	}
+public:
+	/** @brief Seconds on a monotonic clock, for callers without their own sample times */
+	static double Now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	AlertTracker() = default;
+	explicit AlertTracker(AlertPolicy const &Policy) : m_Policy(Policy) {}
+
+	void SetPolicy(AlertPolicy const &Policy) {
+		m_Policy = Policy;
+	}
+	AlertPolicy const &GetPolicy() const {
+		return m_Policy;
+	}
+
+	/** @brief Set the number of sensors tracked (new sensors start Normal) */
+	void Resize(std::size_t NSensors) {
+		m_States.resize(NSensors);
+		m_Busy.resize(ThresholdKernel::Words(NSensors), 0);
+		for (std::size_t i = 0; i != NSensors; i++) MarkBusy(i);
+	}
+	std::size_t Size() const {
+		return m_States.size();
+	}
+
+	AlertLevel Level(std::size_t Sensor) const {
+		return (Sensor < m_States.size()) ? m_States[Sensor].Level : AlertLevel::Normal;
+	}
+
+	/** @brief Feed one reading to the state machine
+	 * @param Sensor    Sensor id (the tracker grows as needed)
+	 * @param Value     Temperature reading
+	 * @param Critical  Critical temperature of the sensor (NaN: no threshold)
+	 * @param Time      Time of the reading in seconds
+	 * @param Out       If not null, receives the transition made (if any)
+	 * @param Eta       Predicted seconds until Value reaches Critical (see AlertPolicy::Horizon)
+	 * @returns Whether the level changed
+	 */
+	bool Update(std::size_t Sensor, float Value, float Critical, double Time, AlertTransition *Out = nullptr, float Eta = INFINITY) {
+		Grow(Sensor + 1);
+		State &S = m_States[Sensor];
+		AlertLevel Want = Target(S, Value, Critical, Time, Eta);
+		bool Changed = false;
+		if (Want == S.Level) {
+			S.Pending = Want;
+		}
+		else {
+			if (Want != S.Pending) {
+				S.Pending = Want;
+				S.PendingSince = Time;
+			}
+			if (Time - S.PendingSince >= m_Policy.MinDwell) {
+				AlertLevel From = S.Level;
+				S.Level = Want;
+				if (Want == AlertLevel::Cooldown) S.LeftCritical = Time;
+				if (Out != nullptr) *Out = {Sensor, From, Want, Value};
+				Changed = true;
+			}
+		}
+		MarkBusy(Sensor);
+		return Changed;
+	}
+
+	/** @brief Feed a whole snapshot; Critical[i] is the threshold of sensor i (missing entries: NaN)
+	 * @param Eta  If not null, predicted seconds until each sensor reaches Critical (used with a Horizon)
+	 * @returns The transitions made by this snapshot (valid until the next call)
+	 */
+	std::vector<AlertTransition> const &Update(SensorSnapshot const &Snapshot, std::vector<float> const &Critical, std::vector<float> const *Eta = nullptr) {
+		m_Transitions.clear();
+		std::size_t const N = Snapshot.Values.size();
+		Grow(N);
+		float const *Crit = Critical.data();
+		if (Critical.size() < N) {
+			m_Padded.assign(Critical.begin(), Critical.end());
+			m_Padded.resize(N, NAN);
+			Crit = m_Padded.data();
+		}
+		m_WarningBits.resize(ThresholdKernel::Words(N));
+		m_CriticalBits.resize(ThresholdKernel::Words(N));
+		//A negative band would put warning above critical; the critical mask covers that case
+		ThresholdKernel::Evaluate(Snapshot.Values.data(), Crit, N, m_Policy.WarningBand, m_WarningBits.data(), m_CriticalBits.data());
+		//Sensors heading for Critical want Warning too
+		bool const Predicting = Eta != nullptr && Eta->size() >= N && m_Policy.Horizon > 0;
+		if (Predicting) {
+			for (std::size_t i = 0; i != N; i++)
+				if ((*Eta)[i] <= m_Policy.Horizon) m_WarningBits[i / 64] |= (uint64_t)1 << (i % 64);
+		}
+		for (std::size_t w = 0; w != m_WarningBits.size(); w++) {
+			uint64_t Todo = m_WarningBits[w] | m_CriticalBits[w] | m_Busy[w];
+			while (Todo != 0) {
+				std::size_t i = w * 64 + __builtin_ctzll(Todo);
+				Todo &= Todo - 1;
+				if (i >= N) break;
+				AlertTransition T;
+				if (Update(i, Snapshot.Values[i], Crit[i], Snapshot.Time, &T, Predicting ? (*Eta)[i] : INFINITY)) m_Transitions.push_back(T);
+			}
+		}
+		return m_Transitions;
+	}
+};
+
+#endif //ALERTS_ALERTSTATE_HPP_
@@ -0,0 +1,252 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Command Executor
+	Runs the user's alert commands without blocking the caller
+	    and without letting them pile up:
+	     -commands are started with posix_spawn("/bin/sh -c ...")
+	      in their own process group
+	     -at most MaxInFlight commands run at once; the rest wait
+	      in a FIFO queue
+	     -each command is submitted under a key (normally the
+	      sensor name); a key which is already running or queued
+	      is not submitted again
+	     -children are reaped from the event loop through a
+	      pidfd, or by polling waitpid() on kernels without
+	      pidfd_open
+	     -a command running longer than Timeout is sent SIGTERM,
+	      and SIGKILL if it is still alive KillGrace later
+
+	Submit() may be called from any thread; everything else
+	    happens on the thread running the event loop.
+****************************************************************/
+#ifndef ALERTS_COMMANDEXECUTOR_HPP_
+#define ALERTS_COMMANDEXECUTOR_HPP_
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "../Core/EventLoop.hpp"
+
+extern char **environ;
+
+class CommandExecutor {
+public:
+	struct Limits {
+		unsigned MaxInFlight = 4;                           ///<Commands allowed to run at the same time
+		std::chrono::milliseconds Timeout{30000};           ///<Time before a command is sent SIGTERM
+		std::chrono::milliseconds KillGrace{2000};          ///<Time between SIGTERM and SIGKILL
+		std::chrono::milliseconds ReapInterval{250};        ///<Housekeeping period (deadlines, waitpid fallback)
+	};
+private:
+	struct Job {
+		std::string Key;
+		pid_t Pid = -1;
+		int PidFd = -1;                         ///<-1 when pidfd_open is unavailable
+		EventLoop::Clock::time_point Deadline;  ///<When to escalate next
+		bool Terminated = false;                ///<SIGTERM already sent
+	};
+	struct Request {
+		std::string Key;
+		std::string Command;
+	};
+	EventLoop &m_Loop;
+	Limits m_Limits;
+	std::mutex m_Lock;               ///<Guards m_Running and m_Queue
+	std::vector<Job> m_Running;
+	std::deque<Request> m_Queue;
+	unsigned m_Timer = 0;
+
+	static int PidfdOpen(pid_t Pid) {
+#ifdef SYS_pidfd_open
+		return (int)syscall(SYS_pidfd_open, Pid, 0);
+#else
+		(void)Pid;
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	/** @brief Start queued commands while there is room (m_Lock held) */
+	void StartQueued() {
+		while (!m_Queue.empty() && m_Running.size() < m_Limits.MaxInFlight) {
+			Request Next = std::move(m_Queue.front());
+			m_Queue.pop_front();
+			Spawn(Next);
+		}
+	}
+
+	/** @brief posix_spawn a shell for R (m_Lock held) */
+	void Spawn(Request const &R) {
+		posix_spawn_file_actions_t Actions;
+		posix_spawnattr_t Attr;
+		posix_spawn_file_actions_init(&Actions);
+		posix_spawn_file_actions_addopen(&Actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+		posix_spawn_file_actions_addopen(&Actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+		posix_spawnattr_init(&Attr);
+		//Own process group, so that escalation reaches anything the shell started
+		posix_spawnattr_setpgroup(&Attr, 0);
+		short Flags = POSIX_SPAWN_SETPGROUP;
+#ifdef POSIX_SPAWN_USEVFORK
+		Flags |= POSIX_SPAWN_USEVFORK;
+#endif
+		posix_spawnattr_setflags(&Attr, Flags);
+
+		char const *Argv[] = {"/bin/sh", "-c", R.Command.c_str(), nullptr};
+		pid_t Pid;
+		int Err = posix_spawn(&Pid, "/bin/sh", &Actions, &Attr, const_cast<char* const*>(Argv), environ);
+		posix_spawn_file_actions_destroy(&Actions);
+		posix_spawnattr_destroy(&Attr);
+		if (Err != 0) {
+			std::cerr << "Failed to run command for " << R.Key << ": " << strerror(Err) << "\n";
+			return;
+		}
+
+		Job J;
+		J.Key = R.Key;
+		J.Pid = Pid;
+		J.PidFd = PidfdOpen(Pid);
+		J.Deadline = EventLoop::Clock::now() + m_Limits.Timeout;
+		if (J.PidFd >= 0) {
+			fcntl(J.PidFd, F_SETFD, FD_CLOEXEC);
+			m_Loop.AddFd(J.PidFd, POLLIN, [this,Pid](short){ Reap(Pid); });
+		}
+		m_Running.push_back(std::move(J));
+	}
+
+	/** @brief Collect Pid if it has exited (m_Lock not held) */
+	void Reap(pid_t Pid) {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		TryReap(Pid);
+		StartQueued();
+	}
+
+	/** @brief waitpid() without blocking; forget the job if it has exited (m_Lock held) */
+	bool TryReap(pid_t Pid) {
+		int Status;
+		pid_t Ret = waitpid(Pid, &Status, WNOHANG);
+		if (Ret == 0) return false;
+		if (Ret < 0 && errno == EINTR) return false;
+		for (auto IT = m_Running.begin(); IT != m_Running.end(); ++IT) {
+			if (IT->Pid != Pid) continue;
+			if (IT->PidFd >= 0) {
+				m_Loop.RemoveFd(IT->PidFd);
+				close(IT->PidFd);
+			}
+			m_Running.erase(IT);
+			break;
+		}
+		return true;
+	}
+
+	/** @brief Periodic housekeeping: poll children without a pidfd and escalate overdue ones */
+	void Housekeeping() {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		EventLoop::Clock::time_point Now = EventLoop::Clock::now();
+		std::vector<pid_t> Pids;
+		for (auto const &i : m_Running) Pids.push_back(i.Pid);
+		for (pid_t Pid : Pids) {
+			if (TryReap(Pid)) continue;
+			for (auto &J : m_Running) {
+				if (J.Pid != Pid || J.Deadline > Now) continue;
+				if (!J.Terminated) {
+					std::cerr << "Command for " << J.Key << " timed out; terminating it\n";
+					kill(-J.Pid, SIGTERM);
+					J.Terminated = true;
+					J.Deadline = Now + m_Limits.KillGrace;
+				}
+				else {
+					kill(-J.Pid, SIGKILL);
+					J.Deadline = Now + m_Limits.KillGrace;
+				}
+			}
+		}
+		StartQueued();
+	}
+public:
+	explicit CommandExecutor(EventLoop &Loop) : CommandExecutor(Loop, Limits{}) {}
+	CommandExecutor(EventLoop &Loop, Limits L) : m_Loop(Loop), m_Limits(L) {
+		if (m_Limits.MaxInFlight == 0) m_Limits.MaxInFlight = 1;
+		m_Timer = m_Loop.AddTimer(m_Limits.ReapInterval, [this]{ Housekeeping(); });
+	}
+	/** @brief Kill and reap anything still running */
+	~CommandExecutor() {
+		m_Loop.RemoveTimer(m_Timer);
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		m_Queue.clear();
+		for (auto &J : m_Running) {
+			kill(-J.Pid, SIGKILL);
+			waitpid(J.Pid, nullptr, 0);
+			if (J.PidFd >= 0) {
+				m_Loop.RemoveFd(J.PidFd);
+				close(J.PidFd);
+			}
+		}
+		m_Running.clear();
+	}
+	CommandExecutor(CommandExecutor const &) = delete;
+	CommandExecutor &operator=(CommandExecutor const &) = delete;
+
+	/** @brief Run Command on behalf of Key, unless Key already has a command running or queued
+	 * @returns Whether the command was accepted
+	 * @note Thread-safe; the command is started from the event loop
+	 */
+	bool Submit(std::string const &Key, std::string const &Command) {
+		if (Command.empty()) return false;
+		{
+			std::lock_guard<std::mutex> Guard(m_Lock);
+			for (auto const &i : m_Running)
+				if (i.Key == Key) return false;
+			for (auto const &i : m_Queue)
+				if (i.Key == Key) return false;
+			m_Queue.push_back({Key, Command});
+		}
+		m_Loop.Post([this]{
+			std::lock_guard<std::mutex> Guard(m_Lock);
+			StartQueued();
+		});
+		return true;
+	}
+
+	/** @brief Whether Key has a command running or waiting to run */
+	bool Busy(std::string const &Key) {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		for (auto const &i : m_Running)
+			if (i.Key == Key) return true;
+		for (auto const &i : m_Queue)
+			if (i.Key == Key) return true;
+		return false;
+	}
+
+	/** @brief Number of commands currently running */
+	std::size_t Running() {
+		std::lock_guard<std::mutex> Guard(m_Lock);
+		return m_Running.size();
+	}
+};
+
+#endif //ALERTS_COMMANDEXECUTOR_HPP_
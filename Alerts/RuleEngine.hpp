@@ -0,0 +1,402 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Alert Rules
+	A small language for windowed alert conditions, one rule
+	    per line ('#' starts a comment):
+
+	    AGG(SENSORS[, WINDOW[, LIMIT]]) OP VALUE [for TIME] [do "COMMAND"]
+
+	     -AGG:     temp, avg, max, min, rate (degrees/second) or
+	               count_over (samples above LIMIT), or one of the
+	               smoothed statistics of History/OnlineStats.hpp,
+	               whose WINDOW is optional: ewma and stddev (WINDOW
+	               is the time constant, default 60s), slope
+	               (degrees/second) and accel (degrees/second^2),
+	               fitted over WINDOW (default: the last 7 samples)
+	     -SENSORS: sensor name or glob (fnmatch), optionally quoted;
+	               the rule is checked for every matching sensor
+	     -WINDOW, TIME: seconds, or with an s/m/h suffix
+	     -OP:      >, >=, <, <=
+	     -VALUE:   a number, or 'crit' (optionally +/- a number) for
+	               the sensor's critical temperature
+	     -COMMAND: run when the rule fires; defaults to -C
+
+	    e.g.  avg("Core *", 5m) > 85
+	          rate(*, 10) > 2 do "logger hot"
+	          max(nvme*, 30s) > crit - 5 for 30
+	          slope(Package*, 30s) > 0.5
+
+	Rules are parsed once when loaded and bound to sensor ids
+	    once per sensor list.  Each tick pushes one sample into
+	    each (shared) window aggregate and compares each bound
+	    rule once, so the cost is O(rules), not O(history).  A
+	    rule fires when its condition has held for TIME and fires
+	    again only after the condition has cleared (which is
+	    reported too, so that actions can be undone).  While an
+	    aggregate has no data (NaN, e.g. the sensor has been
+	    unreadable for the whole window) its rules neither fire
+	    nor clear.
+****************************************************************/
+#ifndef ALERTS_RULEENGINE_HPP_
+#define ALERTS_RULEENGINE_HPP_
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <fnmatch.h>
+#include "../Types.hpp"
+#include "WindowAggregate.hpp"
+
+/** @brief A parsed (but not yet bound) rule */
+struct AlertRule {
+	AggregateKind Kind = AggregateKind::Latest;
+	std::string Sensors;        ///<Name or glob
+	double Window = 0;          ///<Seconds
+	float Limit = 0;            ///<count_over threshold
+	enum class Compare : unsigned char { Greater, GreaterEqual, Less, LessEqual } Op = Compare::Greater;
+	bool RelativeToCrit = false;///<Value is an offset from the sensor's critical temperature
+	float Value = 0;
+	double For = 0;             ///<Seconds the condition must hold
+	std::string Command;        ///<Empty: use the default command
+	std::string Text;           ///<Source line, for messages
+};
+
+/** @brief A rule which fired (or cleared after firing) during RuleEngine::Evaluate */
+struct RuleFiring {
+	unsigned Rule;     ///<Index of the rule in load order
+	unsigned Sensor;   ///<Sensor id it fired for
+	float Value;       ///<Value of the aggregate
+	bool Cleared;      ///<The condition of a rule which had fired no longer holds
+};
+
+class RuleEngine {
+private:
+	struct Binding {
+		unsigned Rule;
+		unsigned Sensor;
+		unsigned Aggregate;         ///<Index into m_Aggregates
+		bool Holding = false;       ///<Condition currently true
+		bool Fired = false;         ///<Already fired during this excursion
+		double Since = 0;           ///<When the condition became true
+	};
+	std::vector<AlertRule> m_Rules;
+	std::vector<WindowAggregate> m_Aggregates;
+	std::vector<unsigned> m_AggregateSensor;   ///<Sensor feeding each aggregate
+	std::vector<Binding> m_Bindings;
+	std::vector<RuleFiring> m_Fired;
+
+	/** @brief Cursor over one line of rule text */
+	struct Scanner {
+		std::string const &Line;
+		std::size_t Pos = 0;
+		void Skip() {
+			while (Pos < Line.size() && std::isspace((unsigned char)Line[Pos])) Pos++;
+		}
+		bool Eat(char C) {
+			Skip();
+			if (Pos < Line.size() && Line[Pos] == C) { Pos++; return true; }
+			return false;
+		}
+		bool Done() {
+			Skip();
+			return Pos >= Line.size() || Line[Pos] == '#';
+		}
+		std::string Word() {
+			Skip();
+			std::size_t Start = Pos;
+			while (Pos < Line.size() && (std::isalnum((unsigned char)Line[Pos]) || Line[Pos] == '_')) Pos++;
+			return Line.substr(Start, Pos - Start);
+		}
+		bool Number(double &Out) {
+			Skip();
+			char const *Begin = Line.c_str() + Pos;
+			char *End;
+			Out = std::strtod(Begin, &End);
+			if (End == Begin) return false;
+			Pos += End - Begin;
+			return true;
+		}
+		/** @brief A number of seconds with an optional s/m/h suffix */
+		bool Duration(double &Out) {
+			if (!Number(Out)) return false;
+			if (Pos < Line.size()) {
+				switch (Line[Pos]) {
+				case 's': Pos++; break;
+				case 'm': Out *= 60; Pos++; break;
+				case 'h': Out *= 3600; Pos++; break;
+				}
+			}
+			return true;
+		}
+		/** @brief A quoted string, or bare text up to one of Stops */
+		bool Text(std::string &Out, char const *Stops) {
+			Skip();
+			Out.clear();
+			if (Pos < Line.size() && Line[Pos] == '"') {
+				std::size_t End = Line.find('"', Pos + 1);
+				if (End == std::string::npos) return false;
+				Out = Line.substr(Pos + 1, End - Pos - 1);
+				Pos = End + 1;
+				return true;
+			}
+			while (Pos < Line.size() && std::strchr(Stops, Line[Pos]) == nullptr) Out += Line[Pos++];
+			while (!Out.empty() && std::isspace((unsigned char)Out.back())) Out.pop_back();
+			return !Out.empty();
+		}
+	};
+
+	static bool ParseRule(std::string const &Line, AlertRule &Rule, std::string &Error) {
+		Scanner S{Line};
+		std::string Agg = S.Word();
+		if (Agg == "temp") Rule.Kind = AggregateKind::Latest;
+		else if (Agg == "avg") Rule.Kind = AggregateKind::Avg;
+		else if (Agg == "max") Rule.Kind = AggregateKind::Max;
+		else if (Agg == "min") Rule.Kind = AggregateKind::Min;
+		else if (Agg == "rate") Rule.Kind = AggregateKind::Rate;
+		else if (Agg == "count_over") Rule.Kind = AggregateKind::CountOver;
+		else if (Agg == "ewma") Rule.Kind = AggregateKind::Ewma;
+		else if (Agg == "stddev") Rule.Kind = AggregateKind::StdDev;
+		else if (Agg == "slope") Rule.Kind = AggregateKind::Slope;
+		else if (Agg == "accel") Rule.Kind = AggregateKind::Accel;
+		else { Error = "unknown aggregate '" + Agg + "'"; return false; }
+
+		if (!S.Eat('(') || !S.Text(Rule.Sensors, ",)")) { Error = "expected (SENSORS"; return false; }
+		if (S.Eat(',')) {
+			if (!S.Duration(Rule.Window)) { Error = "expected a window length"; return false; }
+			double Limit;
+			if (S.Eat(',')) {
+				if (!S.Number(Limit)) { Error = "expected a limit"; return false; }
+				Rule.Limit = (float)Limit;
+			}
+			else if (Rule.Kind == AggregateKind::CountOver) { Error = "count_over needs a limit"; return false; }
+		}
+		else if (Rule.Kind != AggregateKind::Latest && Rule.Kind < AggregateKind::Ewma) { Error = Agg + " needs a window length"; return false; }
+		if (!S.Eat(')')) { Error = "expected ')'"; return false; }
+
+		if (S.Eat('>')) Rule.Op = S.Eat('=') ? AlertRule::Compare::GreaterEqual : AlertRule::Compare::Greater;
+		else if (S.Eat('<')) Rule.Op = S.Eat('=') ? AlertRule::Compare::LessEqual : AlertRule::Compare::Less;
+		else { Error = "expected a comparison"; return false; }
+
+		double Value = 0;
+		std::size_t Mark = S.Pos;
+		if (S.Word() == "crit") {
+			Rule.RelativeToCrit = true;
+			bool Minus = S.Eat('-');
+			if (Minus || S.Eat('+')) {
+				if (!S.Number(Value)) { Error = "expected a number after crit"; return false; }
+				if (Minus) Value = -Value;
+			}
+		}
+		else {
+			S.Pos = Mark;
+			if (!S.Number(Value)) { Error = "expected a number or 'crit'"; return false; }
+		}
+		Rule.Value = (float)Value;
+
+		while (!S.Done()) {
+			std::string Key = S.Word();
+			if (Key == "for") {
+				if (!S.Duration(Rule.For)) { Error = "expected a duration after 'for'"; return false; }
+			}
+			else if (Key == "do") {
+				if (!S.Text(Rule.Command, "#")) { Error = "expected a command after 'do'"; return false; }
+			}
+			else { Error = "unexpected '" + Line.substr(S.Pos) + "'"; return false; }
+		}
+		Rule.Text = Line;
+		return true;
+	}
+
+	static bool Test(AlertRule::Compare Op, float A, float B) {
+		switch (Op) {
+		case AlertRule::Compare::Greater:      return A > B;
+		case AlertRule::Compare::GreaterEqual: return A >= B;
+		case AlertRule::Compare::Less:         return A < B;
+		case AlertRule::Compare::LessEqual:    return A <= B;
+		}
+		return false;
+	}
+	using AggregateKey = std::tuple<unsigned,AggregateKind,double,float>;
+
+	/** @brief Bind the rules, reusing (and removing from the maps) old aggregates and binding states that still apply */
+	void Bind(std::vector<std::string> const &SensorNames, std::map<AggregateKey,WindowAggregate> &OldAggregates,
+	          std::map<std::pair<std::string,unsigned>,Binding> &OldStates) {
+		m_Aggregates.clear();
+		m_AggregateSensor.clear();
+		m_Bindings.clear();
+		//Rules over the same sensor, aggregate and window share one aggregate
+		std::map<AggregateKey,unsigned> Shared;
+		for (unsigned r = 0; r != m_Rules.size(); r++) {
+			AlertRule const &Rule = m_Rules[r];
+			bool Matched = false;
+			for (unsigned s = 0; s != SensorNames.size(); s++) {
+				if (fnmatch(Rule.Sensors.c_str(), SensorNames[s].c_str(), 0) != 0) continue;
+				Matched = true;
+				AggregateKey Key = std::make_tuple(s, Rule.Kind, Rule.Window, Rule.Limit);
+				auto IT = Shared.find(Key);
+				if (IT == Shared.end()) {
+					IT = Shared.emplace(Key, (unsigned)m_Aggregates.size()).first;
+					auto Old = OldAggregates.find(Key);
+					if (Old != OldAggregates.end()) {
+						m_Aggregates.push_back(std::move(Old->second));
+						OldAggregates.erase(Old);
+					}
+					else m_Aggregates.emplace_back(Rule.Kind, Rule.Window, Rule.Limit);
+					m_AggregateSensor.push_back(s);
+				}
+				Binding B;
+				auto Old = OldStates.find(std::make_pair(Rule.Text, s));
+				if (Old != OldStates.end()) {
+					B = Old->second;
+					OldStates.erase(Old);
+				}
+				B.Rule = r;
+				B.Sensor = s;
+				B.Aggregate = IT->second;
+				m_Bindings.push_back(B);
+			}
+			if (!Matched) std::cerr << "Rule matches no sensors: " << Rule.Text << "\n";
+		}
+	}
+public:
+	/** @brief Parse rules from In, appending them to Out
+	 * @returns false (with a message on std::cerr) if any line is invalid; valid lines are still parsed
+	 */
+	static bool Parse(std::istream &In, std::string const &Source, std::vector<AlertRule> &Out) {
+		bool Ok = true;
+		std::string Line;
+		for (unsigned LineNo = 1; std::getline(In, Line); LineNo++) {
+			std::size_t First = Line.find_first_not_of(" \t\r");
+			if (First == std::string::npos || Line[First] == '#') continue;
+			if (Line.back() == '\r') Line.pop_back();
+			AlertRule Rule;
+			std::string Error;
+			if (!ParseRule(Line, Rule, Error)) {
+				std::cerr << Source << ":" << LineNo << ": " << Error << "\n";
+				Ok = false;
+				continue;
+			}
+			Out.push_back(Rule);
+		}
+		return Ok;
+	}
+	/** @brief Parse rules from In, appending them to the loaded rules */
+	bool Load(std::istream &In, std::string const &Source) {
+		return Parse(In, Source, m_Rules);
+	}
+	bool LoadFile(std::string const &Path) {
+		std::ifstream In(Path);
+		if (!In) {
+			std::cerr << "Could not open rules file " << Path << "\n";
+			return false;
+		}
+		return Load(In, Path);
+	}
+
+	/** @brief Resolve every rule against the sensor list, creating the aggregates it needs
+	 * @note Call again whenever the sensor list changes; window history is discarded
+	 */
+	void Bind(std::vector<std::string> const &SensorNames) {
+		std::map<AggregateKey,WindowAggregate> Aggregates;
+		std::map<std::pair<std::string,unsigned>,Binding> States;
+		Bind(SensorNames, Aggregates, States);
+	}
+
+	/** @brief Swap in a new set of rules (e.g. after the rules file changed)
+	 *
+	 * Aggregates that the new rules still need keep their window
+	 *     history, and rules whose text is unchanged keep their
+	 *     state, so a reload doesn't re-fire or forget anything.
+	 * @returns The old rules (and sensors) which had fired and no longer exist, so their actions can be undone
+	 */
+	std::vector<std::pair<AlertRule,unsigned>> Replace(std::vector<AlertRule> Rules, std::vector<std::string> const &SensorNames) {
+		std::map<AggregateKey,WindowAggregate> Aggregates;
+		std::map<std::pair<std::string,unsigned>,Binding> States;
+		for (auto const &B : m_Bindings) {
+			AlertRule const &Rule = m_Rules[B.Rule];
+			Aggregates.emplace(std::make_tuple(B.Sensor, Rule.Kind, Rule.Window, Rule.Limit), std::move(m_Aggregates[B.Aggregate]));
+			States.emplace(std::make_pair(Rule.Text, B.Sensor), B);
+		}
+		std::vector<AlertRule> Old = std::move(m_Rules);
+		m_Rules = std::move(Rules);
+		Bind(SensorNames, Aggregates, States);
+		std::vector<std::pair<AlertRule,unsigned>> Dropped;
+		for (auto const &S : States) {
+			if (S.second.Fired) Dropped.emplace_back(Old[S.second.Rule], S.second.Sensor);
+		}
+		return Dropped;
+	}
+
+	/** @brief Feed a snapshot and check every bound rule
+	 * @param Snapshot   Readings indexed by sensor id (as passed to Bind)
+	 * @param Critical   Critical temperature of each sensor (used by 'crit'; NaN or missing: rule is ignored)
+	 * @returns The rules which fired or cleared on this snapshot (valid until the next call)
+	 */
+	std::vector<RuleFiring> const &Evaluate(SensorSnapshot const &Snapshot, std::vector<float> const &Critical) {
+		m_Fired.clear();
+		for (unsigned a = 0; a != m_Aggregates.size(); a++) {
+			if (m_AggregateSensor[a] < Snapshot.Values.size())
+				m_Aggregates[a].Push(Snapshot.Time, Snapshot.Values[m_AggregateSensor[a]]);
+		}
+		for (auto &B : m_Bindings) {
+			AlertRule const &Rule = m_Rules[B.Rule];
+			float Limit = Rule.Value;
+			if (Rule.RelativeToCrit) {
+				float Crit = (B.Sensor < Critical.size()) ? Critical[B.Sensor] : NAN;
+				if (std::isnan(Crit)) continue;
+				Limit += Crit;
+			}
+			float Value = m_Aggregates[B.Aggregate].Value();
+			if (std::isnan(Value)) {
+				//No data: neither fire nor clear (a fired rule's action stays in place), but start holding over
+				B.Holding = false;
+				continue;
+			}
+			if (!Test(Rule.Op, Value, Limit)) {
+				if (B.Fired) m_Fired.push_back({B.Rule, B.Sensor, Value, true});
+				B.Holding = false;
+				B.Fired = false;
+				continue;
+			}
+			if (!B.Holding) {
+				B.Holding = true;
+				B.Since = Snapshot.Time;
+			}
+			if (!B.Fired && Snapshot.Time - B.Since >= Rule.For) {
+				B.Fired = true;
+				m_Fired.push_back({B.Rule, B.Sensor, Value, false});
+			}
+		}
+		return m_Fired;
+	}
+
+	std::size_t Size() const {
+		return m_Rules.size();
+	}
+	AlertRule const &Rule(unsigned Index) const {
+		return m_Rules[Index];
+	}
+};
+
+#endif //ALERTS_RULEENGINE_HPP_
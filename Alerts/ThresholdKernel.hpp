@@ -0,0 +1,116 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Threshold Kernel
+	Compares a contiguous array of readings against the
+	    per-sensor critical temperatures in one pass and
+	    produces two bitmasks (bit i of word i/64 = sensor i):
+	     -Warning:  Value >= Critical - Band
+	     -Critical: Value >= Critical
+	    A NaN critical temperature never sets a bit.
+
+	On x86 the AVX2 or SSE2 version is chosen at runtime
+	    (__builtin_cpu_supports); elsewhere the scalar loop is
+	    used and left to the compiler's auto-vectorizer.
+****************************************************************/
+#ifndef ALERTS_THRESHOLDKERNEL_HPP_
+#define ALERTS_THRESHOLDKERNEL_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAFETEMP_X86_KERNELS 1
+#endif
+
+namespace ThresholdKernel {
+	using KernelFunc = void (*)(float const*, float const*, std::size_t, float, uint64_t*, uint64_t*);
+
+	/** @brief Number of 64-bit mask words needed for N sensors */
+	inline std::size_t Words(std::size_t N) {
+		return (N + 63) / 64;
+	}
+
+	inline void Scalar(float const *Values, float const *Critical, std::size_t N, float Band, uint64_t *WarningBits, uint64_t *CriticalBits) {
+		std::memset(WarningBits, 0, Words(N) * sizeof(uint64_t));
+		std::memset(CriticalBits, 0, Words(N) * sizeof(uint64_t));
+		for (std::size_t i = 0; i != N; i++) {
+			WarningBits[i/64] |= (uint64_t)(Values[i] >= Critical[i] - Band) << (i%64);
+			CriticalBits[i/64] |= (uint64_t)(Values[i] >= Critical[i]) << (i%64);
+		}
+	}
+
+#if SAFETEMP_X86_KERNELS
+	__attribute__((target("sse2")))
+	inline void SSE2(float const *Values, float const *Critical, std::size_t N, float Band, uint64_t *WarningBits, uint64_t *CriticalBits) {
+		std::memset(WarningBits, 0, Words(N) * sizeof(uint64_t));
+		std::memset(CriticalBits, 0, Words(N) * sizeof(uint64_t));
+		__m128 const B = _mm_set1_ps(Band);
+		std::size_t i = 0;
+		for (; i + 4 <= N; i += 4) {
+			__m128 V = _mm_loadu_ps(Values + i);
+			__m128 C = _mm_loadu_ps(Critical + i);
+			uint64_t W = (uint64_t)_mm_movemask_ps(_mm_cmpge_ps(V, _mm_sub_ps(C, B)));
+			uint64_t X = (uint64_t)_mm_movemask_ps(_mm_cmpge_ps(V, C));
+			WarningBits[i/64] |= W << (i%64);
+			CriticalBits[i/64] |= X << (i%64);
+		}
+		for (; i != N; i++) {
+			WarningBits[i/64] |= (uint64_t)(Values[i] >= Critical[i] - Band) << (i%64);
+			CriticalBits[i/64] |= (uint64_t)(Values[i] >= Critical[i]) << (i%64);
+		}
+	}
+
+	__attribute__((target("avx2")))
+	inline void AVX2(float const *Values, float const *Critical, std::size_t N, float Band, uint64_t *WarningBits, uint64_t *CriticalBits) {
+		std::memset(WarningBits, 0, Words(N) * sizeof(uint64_t));
+		std::memset(CriticalBits, 0, Words(N) * sizeof(uint64_t));
+		__m256 const B = _mm256_set1_ps(Band);
+		std::size_t i = 0;
+		for (; i + 8 <= N; i += 8) {
+			__m256 V = _mm256_loadu_ps(Values + i);
+			__m256 C = _mm256_loadu_ps(Critical + i);
+			uint64_t W = (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(V, _mm256_sub_ps(C, B), _CMP_GE_OQ));
+			uint64_t X = (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(V, C, _CMP_GE_OQ));
+			WarningBits[i/64] |= W << (i%64);
+			CriticalBits[i/64] |= X << (i%64);
+		}
+		for (; i != N; i++) {
+			WarningBits[i/64] |= (uint64_t)(Values[i] >= Critical[i] - Band) << (i%64);
+			CriticalBits[i/64] |= (uint64_t)(Values[i] >= Critical[i]) << (i%64);
+		}
+	}
+#endif
+
+	/** @brief The fastest kernel supported by this CPU */
+	inline KernelFunc Select() {
+#if SAFETEMP_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return AVX2;
+		if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+		return Scalar;
+	}
+
+	/** @brief Fill WarningBits/CriticalBits (Words(N) each) for N readings */
+	inline void Evaluate(float const *Values, float const *Critical, std::size_t N, float Band, uint64_t *WarningBits, uint64_t *CriticalBits) {
+		static KernelFunc const Kernel = Select();
+		Kernel(Values, Critical, N, Band, WarningBits, CriticalBits);
+	}
+}
+
+#endif //ALERTS_THRESHOLDKERNEL_HPP_
@@ -0,0 +1,150 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Threshold Table
+	Critical temperatures loaded with -f.  Entries are separated
+	    by commas or new lines ('#' starts a comment) and are
+	    either
+	     -NAME=TEMP: applies to the sensor called NAME; NAME may
+	      be a glob (fnmatch), e.g. "Core *=85" or "*=95"
+	     -TEMP: positional; the n-th such entry applies to the
+	      n-th sensor (the original file format)
+
+	Entries are resolved once per sensor list (at startup and
+	    whenever the sensors are rescanned) into a dense array
+	    indexed by sensor id, so checking a reading is a plain
+	    array access.  A sensor takes, in order of preference:
+	     -the entry naming it exactly
+	     -the first glob matching it
+	     -its positional entry
+	     -for files with only positional entries, the lowest of
+	      them (as before); otherwise no threshold (NaN)
+****************************************************************/
+#ifndef ALERTS_THRESHOLDTABLE_HPP_
+#define ALERTS_THRESHOLDTABLE_HPP_
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fnmatch.h>
+
+class ThresholdTable {
+private:
+	struct Entry {
+		std::string Pattern;   ///<Sensor name or glob (empty for positional entries)
+		float Value;
+	};
+	std::vector<Entry> m_Named;
+	std::vector<float> m_Positional;
+	std::vector<float> m_Resolved;
+
+	static std::string Trim(std::string const &S) {
+		std::size_t Begin = S.find_first_not_of(" \t\r\n");
+		if (Begin == std::string::npos) return "";
+		std::size_t End = S.find_last_not_of(" \t\r\n");
+		return S.substr(Begin, End - Begin + 1);
+	}
+	static bool IsGlob(std::string const &S) {
+		return S.find_first_of("*?[") != std::string::npos;
+	}
+	static bool ParseValue(std::string const &S, float &Out) {
+		char *End;
+		Out = std::strtof(S.c_str(), &End);
+		return End != S.c_str() && *End == '\0';
+	}
+public:
+	/** @brief Parse the contents of a threshold file, replacing any previous entries
+	 * @param Error  Receives a description of the first invalid entry
+	 * @returns false if any entry is invalid
+	 */
+	bool Parse(std::string const &Text, std::string &Error) {
+		m_Named.clear();
+		m_Positional.clear();
+		m_Resolved.clear();
+		std::size_t Pos = 0;
+		while (Pos <= Text.size()) {
+			std::size_t End = Text.find_first_of(",\n", Pos);
+			if (End == std::string::npos) End = Text.size();
+			std::string Item = Text.substr(Pos, End - Pos);
+			Pos = End + 1;
+			std::size_t Comment = Item.find('#');
+			if (Comment != std::string::npos) Item.erase(Comment);
+			Item = Trim(Item);
+			if (Item.empty()) continue;
+
+			float Value;
+			std::size_t Eq = Item.rfind('=');
+			if (Eq == std::string::npos) {
+				if (!ParseValue(Item, Value)) { Error = "invalid temperature '" + Item + "'"; return false; }
+				m_Positional.push_back(Value);
+				continue;
+			}
+			std::string Name = Trim(Item.substr(0, Eq));
+			if (Name.empty() || !ParseValue(Trim(Item.substr(Eq + 1)), Value)) {
+				Error = "invalid entry '" + Item + "'";
+				return false;
+			}
+			m_Named.push_back({Name, Value});
+		}
+		return true;
+	}
+
+	/** @brief Build the per-sensor array for the given sensor list */
+	void Resolve(std::vector<std::string> const &SensorNames) {
+		float Fallback = NAN;
+		if (m_Named.empty()) {
+			for (float i : m_Positional)
+				if (std::isnan(Fallback) || i < Fallback) Fallback = i;
+		}
+		m_Resolved.assign(SensorNames.size(), Fallback);
+		for (std::size_t s = 0; s != SensorNames.size(); s++) {
+			if (s < m_Positional.size()) m_Resolved[s] = m_Positional[s];
+			bool Exact = false;
+			for (auto const &i : m_Named) {
+				if (!IsGlob(i.Pattern) && i.Pattern == SensorNames[s]) {
+					m_Resolved[s] = i.Value;
+					Exact = true;
+					break;
+				}
+			}
+			if (Exact) continue;
+			for (auto const &i : m_Named) {
+				if (IsGlob(i.Pattern) && fnmatch(i.Pattern.c_str(), SensorNames[s].c_str(), 0) == 0) {
+					m_Resolved[s] = i.Value;
+					break;
+				}
+			}
+		}
+	}
+
+	/** @brief Whether any thresholds were loaded */
+	bool Empty() const {
+		return m_Named.empty() && m_Positional.empty();
+	}
+
+	/** @brief Critical temperature of a sensor (NaN: none, or not resolved) */
+	float operator[](std::size_t Sensor) const {
+		return (Sensor < m_Resolved.size()) ? m_Resolved[Sensor] : NAN;
+	}
+
+	/** @brief The resolved array, indexed by sensor id */
+	std::vector<float> const &Values() const {
+		return m_Resolved;
+	}
+};
+
+#endif //ALERTS_THRESHOLDTABLE_HPP_
@@ -0,0 +1,159 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sliding Window Aggregates
+	Aggregates of one sensor's readings over the last N seconds,
+	    kept up to date as samples arrive so that reading them
+	    is O(1):
+	     -Avg:       running sum over the window
+	     -Max/Min:   monotonic deque (amortized O(1) per sample)
+	     -Rate:      (newest - oldest) / elapsed, degrees/second
+	     -CountOver: running count of samples above a threshold
+	     -Latest:    the newest sample (no window)
+	     -Ewma/StdDev/Slope/Accel: History/OnlineStats.hpp, with
+	                 the window as the time constant (Ewma, StdDev)
+	                 or the span of the fit (Slope, Accel); 0 uses
+	                 its defaults
+	    Unreadable (NaN) and infinite readings are left out of
+	    every window, as OnlineStats does; one would otherwise
+	    poison the running sum for as long as samples keep
+	    arriving.  With no data to go on (an empty window, fewer
+	    samples than the statistic needs, or no reading for a
+	    window's worth of time) the value is NaN, which no rule
+	    comparison passes.
+****************************************************************/
+#ifndef ALERTS_WINDOWAGGREGATE_HPP_
+#define ALERTS_WINDOWAGGREGATE_HPP_
+#include <cmath>
+#include <deque>
+#include "../History/OnlineStats.hpp"
+
+enum class AggregateKind : unsigned char {
+	Latest,
+	Avg,
+	Max,
+	Min,
+	Rate,
+	CountOver,
+	Ewma,
+	StdDev,
+	Slope,
+	Accel
+};
+
+class WindowAggregate {
+private:
+	struct Sample {
+		double Time;
+		float Value;
+	};
+	AggregateKind m_Kind;
+	double m_Window;              ///<Seconds of history kept
+	float m_Threshold;            ///<CountOver only
+	std::deque<Sample> m_Samples; ///<Everything inside the window (all kinds but Latest)
+	std::deque<Sample> m_Extreme; ///<Max/Min: candidates, monotonic in Value
+	double m_Sum = 0;             ///<Avg: sum of m_Samples
+	unsigned m_Count = 0;         ///<CountOver: samples above m_Threshold
+	float m_Latest = NAN;
+	OnlineStats m_Stats;          ///<Ewma/StdDev/Slope/Accel
+	double m_Now = -INFINITY;     ///<Ewma/StdDev/Slope/Accel: time of the newest reading...
+	double m_LastGood = -INFINITY; ///<...and of the newest finite one
+
+	bool Dominates(float A, float B) const {
+		return (m_Kind == AggregateKind::Max) ? A >= B : A <= B;
+	}
+	void Evict(double Now) {
+		while (!m_Samples.empty() && m_Samples.front().Time <= Now - m_Window) {
+			Sample const &Old = m_Samples.front();
+			m_Sum -= Old.Value;
+			if (Old.Value > m_Threshold) m_Count--;
+			m_Samples.pop_front();
+		}
+		while (!m_Extreme.empty() && m_Extreme.front().Time <= Now - m_Window)
+			m_Extreme.pop_front();
+		if (m_Samples.empty()) m_Sum = 0; //Don't let rounding errors accumulate forever
+	}
+public:
+	WindowAggregate(AggregateKind Kind, double Window, float Threshold = 0)
+		: m_Kind(Kind), m_Window(Window), m_Threshold(Threshold),
+		  m_Stats((Kind == AggregateKind::Slope || Kind == AggregateKind::Accel) ? OnlineStats(0, Window) : OnlineStats(Window)) {}
+
+	AggregateKind Kind() const { return m_Kind; }
+	double Window() const { return m_Window; }
+	float Threshold() const { return m_Threshold; }
+
+	/** @brief Add a reading; Time must not go backwards */
+	void Push(double Time, float Value) {
+		m_Latest = Value;
+		if (m_Kind == AggregateKind::Latest) return;
+		m_Now = Time;
+		if (!std::isfinite(Value)) {
+			//Still age out what has left the window
+			if (m_Kind < AggregateKind::Ewma) Evict(Time);
+			return;
+		}
+		if (m_Kind >= AggregateKind::Ewma) {
+			m_LastGood = Time;
+			m_Stats.Add(Time, Value);
+			return;
+		}
+		m_Samples.push_back({Time, Value});
+		m_Sum += Value;
+		if (Value > m_Threshold) m_Count++;
+		if (m_Kind == AggregateKind::Max || m_Kind == AggregateKind::Min) {
+			while (!m_Extreme.empty() && Dominates(Value, m_Extreme.back().Value))
+				m_Extreme.pop_back();
+			m_Extreme.push_back({Time, Value});
+		}
+		Evict(Time);
+	}
+
+	/** @brief Current value of the aggregate (NaN when there is no data for it) */
+	float Value() const {
+		switch (m_Kind) {
+		case AggregateKind::Latest:
+			return m_Latest;
+		case AggregateKind::Avg:
+			return m_Samples.empty() ? NAN : (float)(m_Sum / m_Samples.size());
+		case AggregateKind::Max:
+		case AggregateKind::Min:
+			return m_Extreme.empty() ? NAN : m_Extreme.front().Value;
+		case AggregateKind::Rate: {
+			if (m_Samples.size() < 2) return NAN;
+			double dt = m_Samples.back().Time - m_Samples.front().Time;
+			return (dt > 0) ? (float)((m_Samples.back().Value - m_Samples.front().Value) / dt) : NAN;
+		}
+		case AggregateKind::CountOver:
+			return m_Samples.empty() ? NAN : (float)m_Count;
+		case AggregateKind::Ewma:
+		case AggregateKind::StdDev:
+		case AggregateKind::Slope:
+		case AggregateKind::Accel: {
+			//Unreadable for longer than the statistic remembers: it only describes the past
+			if (m_Now - m_LastGood >= ((m_Window > 0) ? m_Window : m_Stats.TimeConstant())) return NAN;
+			//One sample has no spread (OnlineStats reports 0)
+			if (m_Kind == AggregateKind::StdDev && m_Stats.Count() < 2) return NAN;
+			double V = (m_Kind == AggregateKind::Ewma) ? m_Stats.Ewma() : (m_Kind == AggregateKind::StdDev) ? m_Stats.StdDev()
+			         : (m_Kind == AggregateKind::Slope) ? m_Stats.Slope() : m_Stats.Acceleration();
+			return (float)V;
+		}
+		}
+		return NAN;
+	}
+};
+
+#endif //ALERTS_WINDOWAGGREGATE_HPP_
@@ -0,0 +1,174 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Config File I/O
+	Helpers shared by the text (TempSafe.cfg) and binary
+	    (TempSafe_GUI.cfg) configuration files:
+	     -ReadWholeFile: the file in one read() (sized by fstat)
+	     -ConfigLines: a single-pass tokenizer over the buffer
+	      which hands out string_views (no per-field allocation)
+	     -WriteFileIfChanged: skips the write when the content
+	      hash matches what is on disk; otherwise writes a temp
+	      file in the same directory and rename()s it over the
+	      old one, so readers never see a half-written file
+****************************************************************/
+#ifndef CONFIG_CONFIGFILE_HPP_
+#define CONFIG_CONFIGFILE_HPP_
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** @brief 64-bit FNV-1a hash of a buffer */
+inline uint64_t ContentHash(std::string_view Data) {
+	uint64_t Hash = 14695981039346656037ULL;
+	for (unsigned char C : Data) {
+		Hash ^= C;
+		Hash *= 1099511628211ULL;
+	}
+	return Hash;
+}
+
+/** @brief Read the whole of Path into Out
+ * @returns false (errno set) if the file could not be read
+ */
+inline bool ReadWholeFile(std::string const &Path, std::string &Out) {
+	int FD = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (FD < 0) return false;
+	struct stat St;
+	if (fstat(FD, &St) != 0) {
+		close(FD);
+		return false;
+	}
+	//st_size is a hint (0 for procfs/sysfs); keep reading until EOF
+	Out.resize(St.st_size > 0 ? (std::size_t)St.st_size : 4096);
+	std::size_t Used = 0;
+	while (true) {
+		if (Used == Out.size()) Out.resize(Out.size() * 2);
+		ssize_t N = read(FD, &Out[Used], Out.size() - Used);
+		if (N < 0 && errno == EINTR) continue;
+		if (N < 0) {
+			int Err = errno;
+			close(FD);
+			errno = Err;
+			return false;
+		}
+		if (N == 0) break;
+		Used += N;
+	}
+	close(FD);
+	Out.resize(Used);
+	return true;
+}
+
+/** @brief Write Content to Path unless the file already holds exactly that
+ * @param LastHash  Optional: hash of what was last loaded/written; if it matches,
+ *                  the file is not even read.  Updated on success.
+ * @returns false (errno set) if the file could not be written
+ */
+inline bool WriteFileIfChanged(std::string const &Path, std::string_view Content, uint64_t *LastHash = nullptr) {
+	uint64_t Hash = ContentHash(Content);
+	if (LastHash != nullptr && *LastHash == Hash) return true;
+	std::string Existing;
+	if (ReadWholeFile(Path, Existing) && ContentHash(Existing) == Hash && Existing == Content) {
+		if (LastHash != nullptr) *LastHash = Hash;
+		return true;
+	}
+
+	std::string Temp = Path + ".XXXXXX";
+	int FD = mkostemp(&Temp[0], O_CLOEXEC);
+	if (FD < 0) return false;
+	std::size_t Done = 0;
+	while (Done != Content.size()) {
+		ssize_t N = write(FD, Content.data() + Done, Content.size() - Done);
+		if (N < 0 && errno == EINTR) continue;
+		if (N < 0) break;
+		Done += N;
+	}
+	struct stat St;
+	if (stat(Path.c_str(), &St) == 0) fchmod(FD, St.st_mode & 07777);  //Keep the old file's permissions
+	else fchmod(FD, 0644);
+	bool Ok = Done == Content.size() && fsync(FD) == 0;
+	int Err = errno;
+	if (close(FD) != 0) Ok = false;
+	if (!Ok || rename(Temp.c_str(), Path.c_str()) != 0) {
+		Err = errno;
+		unlink(Temp.c_str());
+		errno = Err;
+		return false;
+	}
+	if (LastHash != nullptr) *LastHash = Hash;
+	return true;
+}
+
+/** @brief Single-pass tokenizer for comma-separated config lines
+ * @note The views point into the buffer passed to the constructor
+ */
+class ConfigLines {
+private:
+	std::string_view m_Data;
+	std::size_t m_Pos = 0;
+	unsigned m_LineNo = 0;
+public:
+	explicit ConfigLines(std::string_view Data) : m_Data(Data) {}
+
+	/** @brief Split the next non-empty line into at most NFields fields; the last field takes the rest of the line
+	 * @returns The number of fields found, or 0 at the end of the data
+	 */
+	unsigned Next(std::string_view *Fields, unsigned NFields) {
+		while (m_Pos < m_Data.size()) {
+			std::size_t End = m_Data.find('\n', m_Pos);
+			if (End == std::string_view::npos) End = m_Data.size();
+			std::string_view Line = m_Data.substr(m_Pos, End - m_Pos);
+			m_Pos = End + 1;
+			m_LineNo++;
+			if (!Line.empty() && Line.back() == '\r') Line.remove_suffix(1);
+			if (Line.empty()) continue;
+			unsigned N = 0;
+			while (N + 1 < NFields) {
+				std::size_t Comma = Line.find(',');
+				if (Comma == std::string_view::npos) break;
+				Fields[N++] = Line.substr(0, Comma);
+				Line.remove_prefix(Comma + 1);
+			}
+			Fields[N++] = Line;
+			return N;
+		}
+		return 0;
+	}
+
+	/** @brief Line number of the line returned by the last Next() */
+	unsigned LineNo() const {
+		return m_LineNo;
+	}
+};
+
+/** @brief Parse a whole field as a number (no allocation, no locale) */
+template <typename T>
+bool ParseField(std::string_view Field, T &Out) {
+	while (!Field.empty() && Field.front() == ' ') Field.remove_prefix(1);
+	while (!Field.empty() && Field.back() == ' ') Field.remove_suffix(1);
+	auto Result = std::from_chars(Field.data(), Field.data() + Field.size(), Out);
+	return Result.ec == std::errc() && Result.ptr == Field.data() + Field.size();
+}
+
+#endif //CONFIG_CONFIGFILE_HPP_
@@ -0,0 +1,195 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Config Watcher
+	Keeps an immutable, reference-counted snapshot of some
+	    configuration and replaces it when its files change:
+	     -the files' directories are watched with inotify from
+	      the event loop (editors usually write a new file and
+	      rename it, so the files themselves can't be watched)
+	     -changes are debounced, then the loader runs on a
+	      background thread; sampling carries on meanwhile
+	     -a config the loader rejects is reported and dropped;
+	      the old one stays in use
+	     -a good one is swapped in atomically; readers call
+	      Current() once per tick and use that snapshot
+
+	The loader must be safe to run on another thread.
+****************************************************************/
+#ifndef CONFIG_CONFIGWATCHER_HPP_
+#define CONFIG_CONFIGWATCHER_HPP_
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "../Core/EventLoop.hpp"
+
+template <typename ConfigType>
+class ConfigWatcher {
+public:
+	using Snapshot = std::shared_ptr<const ConfigType>;
+	using Loader = std::function<Snapshot(std::string &Error)>;
+private:
+	struct Watch {
+		int WD;
+		std::string Dir;
+		std::vector<std::string> Names;   ///<Files of interest in Dir
+	};
+	EventLoop &m_Loop;
+	Loader m_Load;
+	std::string m_What;               ///<For messages
+	int m_Inotify = -1;
+	std::vector<Watch> m_Watches;
+	Snapshot m_Current;               ///<Only accessed through std::atomic_load/store
+	std::thread m_Worker;
+	bool m_Loading = false;           ///<A reload is running (loop thread only)
+	bool m_Again = false;             ///<Files changed while it was running
+	unsigned m_Debounce = 0;          ///<Pending debounce timer (0: none)
+	std::chrono::milliseconds m_Delay{200};
+	std::shared_ptr<char> m_Alive = std::make_shared<char>(); ///<Posted results are dropped once we're gone
+
+	void OnEvents() {
+		alignas(inotify_event) char Buffer[4096];
+		bool Relevant = false;
+		ssize_t N;
+		while ((N = read(m_Inotify, Buffer, sizeof(Buffer))) > 0) {
+			for (char *P = Buffer; P < Buffer + N; ) {
+				inotify_event const *E = (inotify_event const*)P;
+				P += sizeof(inotify_event) + E->len;
+				if (E->len == 0) continue;
+				for (auto const &W : m_Watches) {
+					if (W.WD != E->wd) continue;
+					for (auto const &Name : W.Names)
+						if (Name == E->name) Relevant = true;
+				}
+			}
+		}
+		if (!Relevant || m_Debounce != 0) return;
+		m_Debounce = m_Loop.AddTimer(m_Delay, [this]{
+			m_Debounce = 0;
+			StartReload();
+		}, false);
+	}
+
+	void StartReload() {
+		if (m_Loading) {
+			m_Again = true;
+			return;
+		}
+		if (m_Worker.joinable()) m_Worker.join();
+		m_Loading = true;
+		std::weak_ptr<char> Alive = m_Alive;
+		m_Worker = std::thread([this, Alive]{
+			std::string Error;
+			Snapshot Next;
+			try {
+				Next = m_Load(Error);
+			}
+			catch (std::exception const &E) {
+				Error = E.what();
+			}
+			m_Loop.Post([this, Alive, Next, Error]{
+				if (!Alive.expired()) Finished(Next, Error);
+			});
+		});
+	}
+
+	void Finished(Snapshot Next, std::string const &Error) {
+		m_Loading = false;
+		if (Next) {
+			std::atomic_store(&m_Current, Next);
+			std::cerr << "Reloaded " << m_What << "\n";
+		}
+		else {
+			std::cerr << "Keeping the previous " << m_What << ": " << Error << "\n";
+		}
+		if (m_Again) {
+			m_Again = false;
+			StartReload();
+		}
+	}
+public:
+	/** @param What  Description of the configuration, for messages */
+	ConfigWatcher(EventLoop &Loop, std::string const &What, Loader Load)
+		: m_Loop(Loop), m_Load(std::move(Load)), m_What(What) {}
+	~ConfigWatcher() {
+		m_Alive.reset();
+		if (m_Worker.joinable()) m_Worker.join();
+		if (m_Debounce != 0) m_Loop.RemoveTimer(m_Debounce);
+		if (m_Inotify >= 0) {
+			m_Loop.RemoveFd(m_Inotify);
+			close(m_Inotify);
+		}
+	}
+	ConfigWatcher(ConfigWatcher const &) = delete;
+	ConfigWatcher &operator=(ConfigWatcher const &) = delete;
+
+	/** @brief Load the configuration now, on this thread
+	 * @returns false (with Error set) if the loader rejected it
+	 */
+	bool Load(std::string &Error) {
+		Snapshot Next = m_Load(Error);
+		if (!Next) return false;
+		std::atomic_store(&m_Current, Next);
+		return true;
+	}
+
+	/** @brief Reload whenever Path is created, rewritten or replaced */
+	bool WatchFile(std::string const &Path) {
+		if (Path.empty()) return false;
+		if (m_Inotify < 0) {
+			m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (m_Inotify < 0) {
+				std::cerr << "Cannot watch " << m_What << " for changes: " << strerror(errno) << "\n";
+				return false;
+			}
+			m_Loop.AddFd(m_Inotify, POLLIN, [this](short){ OnEvents(); });
+		}
+		std::size_t Slash = Path.rfind('/');
+		std::string Dir = (Slash == std::string::npos) ? "." : (Slash == 0 ? "/" : Path.substr(0, Slash));
+		std::string Name = (Slash == std::string::npos) ? Path : Path.substr(Slash + 1);
+		int WD = inotify_add_watch(m_Inotify, Dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+		if (WD < 0) {
+			std::cerr << "Cannot watch " << Dir << ": " << strerror(errno) << "\n";
+			return false;
+		}
+		for (auto &W : m_Watches) {
+			if (W.WD == WD) {
+				W.Names.push_back(Name);
+				return true;
+			}
+		}
+		m_Watches.push_back({WD, Dir, {Name}});
+		return true;
+	}
+
+	/** @brief The configuration in use (may be null before the first successful load) */
+	Snapshot Current() const {
+		return std::atomic_load(&m_Current);
+	}
+};
+
+#endif //CONFIG_CONFIGWATCHER_HPP_
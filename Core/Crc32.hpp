@@ -0,0 +1,71 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+CRC-32C
+	The Castagnoli CRC used to check records on disk, computed
+	    eight bytes at a time from tables built on first use.
+****************************************************************/
+#ifndef CORE_CRC32_HPP_
+#define CORE_CRC32_HPP_
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Crc32C {
+	namespace Detail {
+		struct Tables {
+			uint32_t T[8][256];
+			Tables() {
+				for (uint32_t i = 0; i != 256; i++) {
+					uint32_t C = i;
+					for (int k = 0; k != 8; k++) C = (C & 1) ? (C >> 1) ^ 0x82F63B78u : C >> 1;
+					T[0][i] = C;
+				}
+				for (uint32_t i = 0; i != 256; i++)
+					for (int k = 1; k != 8; k++) T[k][i] = (T[k-1][i] >> 8) ^ T[0][T[k-1][i] & 0xFF];
+			}
+		};
+		inline Tables const &Get() {
+			static Tables const Instance;
+			return Instance;
+		}
+	}
+
+	/** @brief Continue a CRC (start with Crc = 0) over Size bytes of Data */
+	inline uint32_t Extend(uint32_t Crc, void const *Data, std::size_t Size) {
+		auto const &T = Detail::Get().T;
+		unsigned char const *P = static_cast<unsigned char const *>(Data);
+		Crc = ~Crc;
+		while (Size >= 8) {
+			uint32_t Lo, Hi;
+			std::memcpy(&Lo, P, 4);
+			std::memcpy(&Hi, P + 4, 4);
+			Lo ^= Crc;
+			Crc = T[7][Lo & 0xFF] ^ T[6][(Lo >> 8) & 0xFF] ^ T[5][(Lo >> 16) & 0xFF] ^ T[4][Lo >> 24] ^
+			      T[3][Hi & 0xFF] ^ T[2][(Hi >> 8) & 0xFF] ^ T[1][(Hi >> 16) & 0xFF] ^ T[0][Hi >> 24];
+			P += 8;
+			Size -= 8;
+		}
+		while (Size--) Crc = (Crc >> 8) ^ T[0][(Crc ^ *P++) & 0xFF];
+		return ~Crc;
+	}
+	inline uint32_t Compute(void const *Data, std::size_t Size) {
+		return Extend(0, Data, Size);
+	}
+}
+
+#endif //CORE_CRC32_HPP_
@@ -0,0 +1,251 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Event Loop
+	A small poll(2)-based event loop.  File descriptors and
+	    timers are registered with callbacks which are run on
+	    the thread calling RunOnce()/RunFor().
+
+	Other threads may hand work to the loop with Post(); the
+	    loop is woken through an eventfd.
+
+	Signals (SIGINT, SIGTERM, ...) can be handled on the loop
+	    thread with WatchSignals(): the handler only writes the
+	    signal number to a pipe the loop watches.  Stop() makes
+	    RunFor() return early, so that a caller can leave its
+	    main loop and let its destructors clean up.
+****************************************************************/
+#ifndef CORE_EVENTLOOP_HPP_
+#define CORE_EVENTLOOP_HPP_
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+class EventLoop {
+public:
+	using Clock = std::chrono::steady_clock;
+	using FdCallback = std::function<void(short Revents)>;
+	using Callback = std::function<void()>;
+private:
+	struct FdWatch {
+		int Fd;
+		short Events;
+		FdCallback OnReady;
+		bool Removed = false;
+	};
+	struct Timer {
+		unsigned Id;
+		Clock::time_point Due;
+		std::chrono::milliseconds Period;
+		bool Repeat;
+		Callback OnExpire;
+	};
+	std::vector<FdWatch> m_Fds;
+	std::vector<Timer> m_Timers;
+	unsigned m_NextTimerId = 1;
+	int m_WakeFd = -1;
+	std::mutex m_PostLock;
+	std::vector<Callback> m_Posted;   ///<Guarded by m_PostLock
+	int m_SignalPipe[2] = {-1, -1};
+	std::vector<std::pair<int,std::function<void(int)>>> m_SignalWatches;   ///<Signal, callback
+	bool m_Stopped = false;
+
+	/** @brief Write end of the signal pipe of the loop watching signals (one per process) */
+	static std::atomic<int> &SignalFd() {
+		static std::atomic<int> Fd{-1};
+		return Fd;
+	}
+	static void HandleSignal(int Signal) {
+		int Saved = errno;
+		unsigned char Byte = (unsigned char)Signal;
+		int Fd = SignalFd().load();
+		if (Fd >= 0 && write(Fd,&Byte,1) < 0) {} //A full pipe already has a wakeup pending
+		errno = Saved;
+	}
+
+	void RunPosted() {
+		std::vector<Callback> Posted;
+		{
+			std::lock_guard<std::mutex> Guard(m_PostLock);
+			Posted.swap(m_Posted);
+		}
+		for (auto &i : Posted) i();
+	}
+
+	void RunTimers() {
+		Clock::time_point Now = Clock::now();
+		//Callbacks may add or remove timers, so collect the due ones first
+		std::vector<unsigned> Due;
+		for (auto const &i : m_Timers)
+			if (i.Due <= Now) Due.push_back(i.Id);
+		for (unsigned Id : Due) {
+			auto IT = std::find_if(m_Timers.begin(),m_Timers.end(),[Id](Timer const &T){ return T.Id == Id; });
+			if (IT == m_Timers.end()) continue;
+			Callback OnExpire = IT->OnExpire;
+			if (IT->Repeat) IT->Due = Now + IT->Period;
+			else m_Timers.erase(IT);
+			OnExpire();
+		}
+	}
+
+	/** @brief Milliseconds until the next timer is due (capped at MaxWaitMs) */
+	int WaitTime(int MaxWaitMs) const {
+		Clock::time_point Now = Clock::now();
+		long Wait = MaxWaitMs;
+		for (auto const &i : m_Timers) {
+			long ms = std::chrono::duration_cast<std::chrono::milliseconds>(i.Due - Now).count();
+			Wait = std::min(Wait, std::max(0L, ms));
+		}
+		return (int)std::max(0L, Wait);
+	}
+public:
+	EventLoop() {
+		m_WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+	~EventLoop() {
+		if (m_SignalPipe[0] >= 0) {
+			for (auto const &W : m_SignalWatches) signal(W.first, SIG_DFL);
+			SignalFd() = -1;
+			close(m_SignalPipe[0]);
+			close(m_SignalPipe[1]);
+		}
+		if (m_WakeFd >= 0) close(m_WakeFd);
+	}
+	EventLoop(EventLoop const &) = delete;
+	EventLoop &operator=(EventLoop const &) = delete;
+
+	/** @brief Call OnReady whenever Fd has any of Events (POLLIN, POLLOUT, ...) pending */
+	void AddFd(int Fd, short Events, FdCallback OnReady) {
+		m_Fds.push_back({Fd, Events, std::move(OnReady)});
+	}
+	/** @brief Change the events watched for Fd */
+	void ModifyFd(int Fd, short Events) {
+		for (auto &i : m_Fds)
+			if (i.Fd == Fd && !i.Removed) i.Events = Events;
+	}
+	/** @brief Stop watching Fd (safe to call from within a callback) */
+	void RemoveFd(int Fd) {
+		for (auto &i : m_Fds)
+			if (i.Fd == Fd) i.Removed = true;
+	}
+
+	/** @brief Call OnExpire after Period (and every Period thereafter if Repeat)
+	 * @returns A timer id for RemoveTimer()
+	 */
+	unsigned AddTimer(std::chrono::milliseconds Period, Callback OnExpire, bool Repeat = true) {
+		unsigned Id = m_NextTimerId++;
+		m_Timers.push_back({Id, Clock::now() + Period, Period, Repeat, std::move(OnExpire)});
+		return Id;
+	}
+	void RemoveTimer(unsigned Id) {
+		m_Timers.erase(std::remove_if(m_Timers.begin(),m_Timers.end(),[Id](Timer const &T){ return T.Id == Id; }),m_Timers.end());
+	}
+
+	/** @brief Run Work on the loop thread at the next iteration (thread-safe) */
+	void Post(Callback Work) {
+		{
+			std::lock_guard<std::mutex> Guard(m_PostLock);
+			m_Posted.push_back(std::move(Work));
+		}
+		uint64_t One = 1;
+		if (m_WakeFd >= 0 && write(m_WakeFd,&One,sizeof(One)) < 0) {} //Counter saturation is harmless
+	}
+
+	/** @brief Call OnSignal(Signal) on the loop thread whenever one of Signals is delivered
+	 * @returns false if the pipe couldn't be made
+	 * @note Only one loop in a process may watch signals; the default
+	 *       actions are put back when it is destroyed
+	 */
+	bool WatchSignals(std::vector<int> const &Signals, std::function<void(int)> OnSignal) {
+		if (m_SignalPipe[0] < 0) {
+			if (pipe2(m_SignalPipe, O_NONBLOCK | O_CLOEXEC) != 0) return false;
+			int ReadFd = m_SignalPipe[0];
+			AddFd(ReadFd, POLLIN, [this,ReadFd](short) {
+				unsigned char Bytes[16];
+				ssize_t N;
+				while ((N = read(ReadFd,Bytes,sizeof(Bytes))) > 0)
+					for (ssize_t i = 0; i != N; i++)
+						for (auto const &W : m_SignalWatches)
+							if (W.first == Bytes[i]) W.second(Bytes[i]);
+			});
+			SignalFd() = m_SignalPipe[1];
+		}
+		struct sigaction Action{};
+		Action.sa_handler = &EventLoop::HandleSignal;
+		sigemptyset(&Action.sa_mask);
+		Action.sa_flags = SA_RESTART;
+		for (int i : Signals) {
+			m_SignalWatches.emplace_back(i, OnSignal);
+			sigaction(i, &Action, nullptr);
+		}
+		return true;
+	}
+
+	/** @brief Make RunFor() return (now and from then on) */
+	void Stop() {
+		m_Stopped = true;
+	}
+	bool Stopped() const {
+		return m_Stopped;
+	}
+
+	/** @brief Wait up to MaxWaitMs for one round of events and dispatch them */
+	void RunOnce(int MaxWaitMs) {
+		std::vector<pollfd> PollFds;
+		PollFds.reserve(m_Fds.size() + 1);
+		PollFds.push_back({m_WakeFd, POLLIN, 0});
+		for (auto const &i : m_Fds) PollFds.push_back({i.Fd, i.Events, 0});
+		int Ready = poll(PollFds.data(), PollFds.size(), WaitTime(MaxWaitMs));
+		if (Ready > 0) {
+			if (PollFds[0].revents & POLLIN) {
+				uint64_t Count;
+				if (read(m_WakeFd,&Count,sizeof(Count)) < 0) {}
+			}
+			//Callbacks may add watches; only dispatch the ones we polled
+			std::size_t const NPolled = PollFds.size() - 1;
+			for (std::size_t i = 0; i != NPolled; i++) {
+				if (PollFds[i+1].revents == 0 || m_Fds[i].Removed) continue;
+				FdCallback OnReady = m_Fds[i].OnReady;
+				OnReady(PollFds[i+1].revents);
+			}
+			m_Fds.erase(std::remove_if(m_Fds.begin(),m_Fds.end(),[](FdWatch const &W){ return W.Removed; }),m_Fds.end());
+		}
+		RunPosted();
+		RunTimers();
+	}
+
+	/** @brief Dispatch events for (about) Duration */
+	void RunFor(std::chrono::milliseconds Duration) {
+		Clock::time_point End = Clock::now() + Duration;
+		do {
+			long Left = m_Stopped ? 0 : std::chrono::duration_cast<std::chrono::milliseconds>(End - Clock::now()).count();
+			RunOnce((int)std::max(0L,Left));
+		} while (Clock::now() < End && !m_Stopped);
+	}
+};
+
+#endif //CORE_EVENTLOOP_HPP_
@@ -0,0 +1,360 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Compression
+	Lossy compression of sample series for long-term retention:
+	    of each sensor's readings only the points needed to
+	    redraw the rest by linear interpolation, to within a
+	    tolerance, are kept.  Sensors mostly sit within half a
+	    degree and lm_sensors quantises to 0.125-1 degree, so
+	    most readings can be dropped.
+
+	Select() picks the points of one sensor by either of
+	    -Deadband: a reading is kept when it has moved more than
+	     half the tolerance from the last one kept, along with
+	     the reading before it (so a steady stretch stays flat)
+	    -SwingingDoor: a reading is kept when the line from the
+	     last kept point to the next reading would pass further
+	     than the tolerance from any reading in between
+	    Either way no dropped reading is more than the tolerance
+	    from the interpolated line.  The first and last reading,
+	    the highest and lowest (the extremes are never smoothed
+	    away) and the edges of every run of unreadable (NaN)
+	    readings are always kept.
+
+	A chunk holds the readings of every sensor over a run of
+	    sample times, all of them 8-byte aligned:
+	    offset  type     field
+	         0  double   First        time of the first sample
+	         8  uint32   Bytes        size of the chunk
+	        12  uint32   Sensors      N
+	        16  uint32   Points       kept points, of all sensors
+	        20  uint32   Count        samples
+	        24  uint32   Offset[Count] ms from First to each sample
+	            uint32   Kept[N]      points of each sensor
+	            uint16   Index[Points] sample of each point, by
+	                                  sensor, padded to 4 bytes
+	            float    Value[Points] padded to 8 bytes
+	    Times are kept to the millisecond.  ChunkView decodes one
+	    into a row of values per sample time; between two kept
+	    points the values are interpolated (NaN if either is).
+****************************************************************/
+#ifndef HISTORY_COMPRESSION_HPP_
+#define HISTORY_COMPRESSION_HPP_
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fnmatch.h>
+
+namespace Compression {
+	enum class Method { None, Deadband, SwingingDoor };
+
+	constexpr std::size_t MaxChunkSamples = 65535;           ///<Index is 16 bits
+	constexpr double MaxChunkSpan = 4e6;                     ///<Seconds; Offset is 32 bits of ms
+
+	/** @brief The method and the tolerance of each sensor (a default and NAME=DEG overrides, NAME may be a glob) */
+	class Settings {
+	private:
+		Method m_Method = Method::None;
+		float m_Default = 0.5;
+		std::vector<std::pair<std::string, float>> m_Named;
+
+		static bool ParseTolerance(std::string const &Text, float &Out) {
+			char *End;
+			Out = std::strtof(Text.c_str(), &End);
+			return End != Text.c_str() && *End == 0 && Out >= 0;
+		}
+	public:
+		/** @brief "deadband" or "swinging-door" ("sdt"); "none" turns compression off */
+		bool SetMethod(std::string const &Name) {
+			if (Name == "deadband") m_Method = Method::Deadband;
+			else if (Name == "swinging-door" || Name == "sdt") m_Method = Method::SwingingDoor;
+			else if (Name == "none") m_Method = Method::None;
+			else return false;
+			return true;
+		}
+		/** @brief Comma-separated DEG (the default) and NAME=DEG entries; the first matching NAME wins
+		 * @returns false (with Error set, and nothing changed) if an entry can't be parsed
+		 */
+		bool SetTolerances(std::string const &List, std::string &Error) {
+			float Default = m_Default;
+			std::vector<std::pair<std::string, float>> Named;
+			std::size_t Start = 0;
+			while (Start <= List.size()) {
+				std::size_t Comma = List.find(',', Start);
+				if (Comma == std::string::npos) Comma = List.size();
+				std::string Item = List.substr(Start, Comma - Start);
+				Start = Comma + 1;
+				std::size_t Equals = Item.rfind('=');
+				float Value;
+				if (!ParseTolerance(Equals == std::string::npos ? Item : Item.substr(Equals + 1), Value)) {
+					Error = "bad tolerance \"" + Item + "\"";
+					return false;
+				}
+				if (Equals == std::string::npos) Default = Value;
+				else Named.emplace_back(Item.substr(0, Equals), Value);
+			}
+			m_Default = Default;
+			m_Named = std::move(Named);
+			return true;
+		}
+		Method GetMethod() const {
+			return m_Method;
+		}
+		bool Enabled() const {
+			return m_Method != Method::None;
+		}
+		/** @brief The tolerance of each of Names */
+		std::vector<float> Resolve(std::vector<std::string> const &Names) const {
+			std::vector<float> Out(Names.size(), m_Default);
+			for (std::size_t s = 0; s != Names.size(); s++) {
+				for (auto const &N : m_Named) {
+					if (N.first == Names[s] || fnmatch(N.first.c_str(), Names[s].c_str(), 0) == 0) {
+						Out[s] = N.second;
+						break;
+					}
+				}
+			}
+			return Out;
+		}
+	};
+
+	/** @brief Pick the readings of one sensor to keep
+	 * @param Values  Count readings, Stride floats apart, taken at Times (in order)
+	 * @param Kept    Set to the indices of the kept readings, in order
+	 */
+	inline void Select(Method How, float Tolerance, double const *Times, float const *Values, std::size_t Stride, std::size_t Count, std::vector<uint32_t> &Kept) {
+		Kept.clear();
+		if (Count == 0) return;
+		auto V = [&](std::size_t i) { return Values[i * Stride]; };
+		std::size_t Highest = Count, Lowest = Count;
+		for (std::size_t i = 0; i != Count; i++) {
+			if (std::isnan(V(i))) continue;
+			if (Highest == Count || V(i) > V(Highest)) Highest = i;
+			if (Lowest == Count || V(i) < V(Lowest)) Lowest = i;
+		}
+		std::size_t Anchor = 0;
+		double Lower = -INFINITY, Upper = INFINITY;   ///<Slopes from the anchor that pass every reading since it
+		auto Keep = [&](std::size_t i) {
+			Kept.push_back(i);
+			Anchor = i;
+			Lower = -INFINITY;
+			Upper = INFINITY;
+		};
+		/** Whether the line from the anchor to reading i is within tolerance of those in between */
+		auto Reaches = [&](std::size_t i) {
+			double Span = Times[i] - Times[Anchor];
+			if (Span <= 0) return i == Anchor + 1 && V(i) == V(Anchor);
+			if (How == Method::Deadband) return std::fabs(V(i) - V(Anchor)) <= Tolerance / 2;
+			double Slope = (V(i) - V(Anchor)) / Span;
+			return Slope >= Lower && Slope <= Upper;
+		};
+		Kept.push_back(0);
+		for (std::size_t i = 1; i != Count; i++) {
+			bool Missing = std::isnan(V(i));
+			bool Previous = (Kept.back() == i - 1);
+			if (Missing || std::isnan(V(Anchor))) {
+				//Keep both edges of a run of unreadable samples
+				if (!Previous && !std::isnan(V(i - 1)) != !Missing) Keep(i - 1);
+				if (!Missing || std::isnan(V(Anchor)) != Missing || i + 1 == Count || !std::isnan(V(i + 1))) Keep(i);
+				continue;
+			}
+			if (!Reaches(i)) {
+				if (!Previous) Keep(i - 1);
+				if (!Reaches(i)) {
+					Keep(i);
+					continue;
+				}
+			}
+			if (i + 1 == Count || i == Highest || i == Lowest) {
+				Keep(i);
+				continue;
+			}
+			double Span = Times[i] - Times[Anchor];
+			if (How == Method::SwingingDoor && Span > 0) {
+				Lower = std::max(Lower, (V(i) - Tolerance - V(Anchor)) / Span);
+				Upper = std::min(Upper, (V(i) + Tolerance - V(Anchor)) / Span);
+			}
+		}
+	}
+
+	inline std::size_t Align(std::size_t Bytes, std::size_t To) {
+		return (Bytes + To - 1) & ~(To - 1);
+	}
+
+	/** @brief Append a chunk of Count samples of Sensors sensors to Out
+	 * @param Times       Count sample times, in order, spanning less than MaxChunkSpan
+	 * @param Rows        Count rows of Sensors values
+	 * @param Tolerances  Of each sensor
+	 * @note Count must not exceed MaxChunkSamples
+	 */
+	inline void Encode(std::vector<unsigned char> &Out, Method How, float const *Tolerances, double const *Times, float const *Rows, std::size_t Count, std::size_t Sensors) {
+		std::vector<uint32_t> Kept, Counts(Sensors);
+		std::vector<uint16_t> Index;
+		std::vector<float> Values;
+		for (std::size_t s = 0; s != Sensors; s++) {
+			if (How == Method::None) {
+				Kept.resize(Count);
+				for (std::size_t i = 0; i != Count; i++) Kept[i] = i;
+			}
+			else Select(How, Tolerances[s], Times, Rows + s, Sensors, Count, Kept);
+			Counts[s] = Kept.size();
+			for (uint32_t i : Kept) {
+				Index.push_back(i);
+				Values.push_back(Rows[i * Sensors + s]);
+			}
+		}
+		std::size_t Start = Out.size();
+		std::size_t IndexAt = 24 + 4 * (Count + Sensors);
+		std::size_t ValuesAt = Align(IndexAt + 2 * Index.size(), 4);
+		std::size_t Bytes = Align(ValuesAt + 4 * Values.size(), 8);
+		Out.resize(Start + Bytes, 0);
+		unsigned char *C = Out.data() + Start;
+		uint32_t Header[4] = {(uint32_t)Bytes, (uint32_t)Sensors, (uint32_t)Index.size(), (uint32_t)Count};
+		std::memcpy(C, &Times[0], 8);
+		std::memcpy(C + 8, Header, 16);
+		for (std::size_t i = 0; i != Count; i++) {
+			uint32_t Ms = (uint32_t)std::llround((Times[i] - Times[0]) * 1000);
+			std::memcpy(C + 24 + 4 * i, &Ms, 4);
+		}
+		std::memcpy(C + 24 + 4 * Count, Counts.data(), 4 * Sensors);
+		std::memcpy(C + IndexAt, Index.data(), 2 * Index.size());
+		std::memcpy(C + ValuesAt, Values.data(), 4 * Values.size());
+	}
+
+	/** @brief A chunk in memory (e.g. mapped from a log), decoded on demand */
+	class ChunkView {
+	private:
+		unsigned char const *m_Data = nullptr;
+		double m_First = 0;
+		uint32_t m_Bytes = 0, m_Sensors = 0, m_Points = 0, m_Count = 0;
+
+		uint32_t const *Offsets() const {
+			return reinterpret_cast<uint32_t const *>(m_Data + 24);
+		}
+		uint32_t const *Kept() const {
+			return Offsets() + m_Count;
+		}
+		uint16_t const *Index() const {
+			return reinterpret_cast<uint16_t const *>(Kept() + m_Sensors);
+		}
+		float const *Values() const {
+			return reinterpret_cast<float const *>(m_Data + Align(24 + 4 * (m_Count + m_Sensors) + 2 * m_Points, 4));
+		}
+	public:
+		/** @brief Check the layout of the chunk at Data (8-byte aligned), of at most Size bytes
+		 * @returns false if it isn't a well-formed chunk of Sensors sensors
+		 */
+		bool Open(void const *Data, std::size_t Size, std::size_t Sensors) {
+			m_Data = nullptr;
+			if (Size < 24) return false;
+			unsigned char const *C = static_cast<unsigned char const *>(Data);
+			uint32_t Header[4];
+			std::memcpy(&m_First, C, 8);
+			std::memcpy(Header, C + 8, 16);
+			m_Bytes = Header[0];
+			m_Sensors = Header[1];
+			m_Points = Header[2];
+			m_Count = Header[3];
+			if (m_Sensors != Sensors || m_Count == 0 || m_Count > MaxChunkSamples || m_Bytes > Size || m_Bytes % 8 != 0 ||
+			    Align(Align(24 + 4 * ((std::size_t)m_Count + m_Sensors) + 2 * (std::size_t)m_Points, 4) + 4 * (std::size_t)m_Points, 8) != m_Bytes)
+				return false;
+			m_Data = C;
+			//Every sensor's points must start at the first sample, end at the last and be in order
+			uint32_t const *K = Kept();
+			uint16_t const *I = Index();
+			std::size_t Total = 0;
+			for (uint32_t s = 0; s != m_Sensors; s++) {
+				if (K[s] == 0 || K[s] > m_Points - Total || I[Total] != 0 || I[Total + K[s] - 1] != m_Count - 1) {
+					m_Data = nullptr;
+					return false;
+				}
+				for (uint32_t p = 1; p != K[s]; p++) {
+					if (I[Total + p] <= I[Total + p - 1]) {
+						m_Data = nullptr;
+						return false;
+					}
+				}
+				Total += K[s];
+			}
+			if (Total != m_Points) m_Data = nullptr;
+			return m_Data != nullptr;
+		}
+		std::size_t Bytes() const {
+			return m_Bytes;
+		}
+		std::size_t Count() const {
+			return m_Count;
+		}
+		std::size_t Points() const {
+			return m_Points;
+		}
+		double Time(std::size_t Sample) const {
+			return m_First + Offsets()[Sample] / 1000.0;
+		}
+		double First() const {
+			return m_First;
+		}
+		double Last() const {
+			return Time(m_Count - 1);
+		}
+
+		/** @brief Call Visit(Time, Values) for each sample in [From, To], oldest first
+		 * @returns The number of samples visited
+		 * @note Values is only valid during the call
+		 */
+		template <typename Visitor>
+		std::size_t ForEach(double From, double To, Visitor &&Visit) const {
+			if (m_Data == nullptr) return 0;
+			std::vector<float> Row(m_Sensors);
+			std::vector<uint32_t> Cursor(m_Sensors);     ///<Point at or before the current sample
+			std::vector<uint32_t> Start(m_Sensors);
+			uint32_t const *K = Kept();
+			uint16_t const *I = Index();
+			float const *V = Values();
+			for (uint32_t s = 0, Total = 0; s != m_Sensors; Total += K[s], s++) Cursor[s] = Start[s] = Total;
+			std::size_t N = 0;
+			for (uint32_t i = 0; i != m_Count; i++) {
+				double T = Time(i);
+				if (T > To) break;
+				for (uint32_t s = 0; s != m_Sensors; s++) {
+					uint32_t &P = Cursor[s];
+					if (P + 1 < Start[s] + K[s] && I[P + 1] <= i) P++;
+				}
+				if (T < From) continue;
+				for (uint32_t s = 0; s != m_Sensors; s++) {
+					uint32_t P = Cursor[s];
+					if (I[P] == i) Row[s] = V[P];
+					else {
+						double T0 = Time(I[P]), T1 = Time(I[P + 1]);
+						Row[s] = (T1 > T0) ? (float)(V[P] + (V[P + 1] - V[P]) * (T - T0) / (T1 - T0)) : V[P];
+					}
+				}
+				Visit(T, (float const *)Row.data());
+				N++;
+			}
+			return N;
+		}
+	};
+}
+
+#endif //HISTORY_COMPRESSION_HPP_
@@ -0,0 +1,343 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+History Store
+	The in-memory history of every sensor: a fixed-capacity
+	    ring of samples, stored by column (one time array and
+	    one value array per sensor) so that appending is O(N
+	    sensors) with no allocation and a range query touches
+	    only the samples it returns.
+
+	Times are wall-clock seconds (HistoryStore::Now()) so that
+	    they mean the same thing to every process.
+
+	With a memory budget (SetBudget()), history is kept for as
+	    long as the budget allows instead, in three tiers:
+	     -raw: the ring, sized to half of the budget
+	     -compressed: once the ring is full, its oldest
+	      ChunkSamples samples are compressed into a chunk
+	      (History/Compression.hpp); up to 3/8 of the budget
+	     -rollup: the oldest chunks are then reduced to the
+	      min, mean and max of each sensor per RollupSeconds;
+	      the rest of the budget, after which the oldest rows
+	      are evicted
+	    ForEach() runs over all three (a rollup row as its mean,
+	    at the start of its period).  GetUsage() reports the
+	    bytes each tier holds.
+****************************************************************/
+#ifndef HISTORY_HISTORYSTORE_HPP_
+#define HISTORY_HISTORYSTORE_HPP_
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "Compression.hpp"
+
+class HistoryStore {
+public:
+	/** @brief What each tier holds (bytes of samples; container overhead isn't counted) */
+	struct Usage {
+		std::size_t Raw = 0, Compressed = 0, Rollup = 0;
+		std::size_t RawSamples = 0, Chunks = 0, RollupRows = 0;
+		uint64_t Evicted = 0;          ///<Rollup rows dropped to stay within the budget
+		std::size_t Total() const {
+			return Raw + Compressed + Rollup;
+		}
+	};
+	static constexpr std::size_t ChunkSamples = 256;   ///<Samples demoted from the ring at a time
+	static constexpr std::size_t MaxCapacity = 4194304;
+	static constexpr std::size_t DefaultBudget = 256 << 20;  ///<For callers to apply when a fixed ring would need more
+
+	/** @brief Bytes held by a ring of Capacity samples of Sensors sensors */
+	static std::size_t RingBytes(std::size_t Capacity, std::size_t Sensors) {
+		return Capacity * (8 + 4 * Sensors);
+	}
+	/** @brief The smallest budget SetBudget() accepts for Sensors sensors */
+	static std::size_t MinBudget(std::size_t Sensors) {
+		return 2 * RingBytes(2 * ChunkSamples, Sensors);
+	}
+private:
+	std::vector<std::string> m_Names;
+	std::size_t m_Capacity = 0;
+	std::size_t m_Head = 0;         ///<Slot of the oldest sample
+	std::size_t m_Size = 0;
+	std::vector<double> m_Times;    ///<[Slot]
+	std::vector<float> m_Values;    ///<[Sensor * Capacity + Slot]
+
+	struct Chunk {
+		std::vector<unsigned char> Data;
+		double First, Last;
+	};
+	std::size_t m_Budget = 0;                  ///<Bytes (0: just the ring)
+	Compression::Method m_Method = Compression::Method::SwingingDoor;
+	std::vector<float> m_Tolerances;
+	double m_RollupSeconds = 300;
+	std::deque<Chunk> m_Chunks;
+	std::size_t m_ChunkBytes = 0;
+	std::deque<double> m_RollupTimes;          ///<Start of each row's period
+	std::deque<float> m_RollupValues;          ///<Per row: Min[Sensors], Mean[Sensors], Max[Sensors]
+	std::vector<uint32_t> m_RollupCounts;      ///<Samples of each sensor in the newest row
+	uint64_t m_Evicted = 0;
+
+	std::size_t Slot(std::size_t Index) const {
+		return (m_Head + Index) % m_Capacity;
+	}
+	std::size_t RawBytes() const {
+		return m_Capacity * (8 + 4 * m_Names.size());
+	}
+	std::size_t RollupBytes() const {
+		return m_RollupTimes.size() * (8 + 12 * m_Names.size());
+	}
+
+	/** @brief Compress the oldest samples of the full ring into a chunk, to make room */
+	void Demote() {
+		std::size_t const N = m_Names.size();
+		std::vector<double> Times;
+		std::vector<float> Rows;
+		for (std::size_t i = 0; i != std::min(ChunkSamples, m_Size); i++) {
+			std::size_t S = Slot(i);
+			//A chunk's times must be in order and within its span (the wall clock can be set back)
+			double Time = Times.empty() ? m_Times[S] : std::max(m_Times[S], Times.back());
+			if (!Times.empty() && Time - Times.front() >= Compression::MaxChunkSpan) break;
+			Times.push_back(Time);
+			for (std::size_t j = 0; j != N; j++) Rows.push_back(m_Values[j * m_Capacity + S]);
+		}
+		Chunk C;
+		Compression::Encode(C.Data, m_Method, m_Tolerances.data(), Times.data(), Rows.data(), Times.size(), N);
+		C.Data.shrink_to_fit();
+		C.First = Times.front();
+		C.Last = Times.back();
+		m_ChunkBytes += C.Data.size();
+		m_Chunks.push_back(std::move(C));
+		m_Head = (m_Head + Times.size()) % m_Capacity;
+		m_Size -= Times.size();
+		//Keep the tiers within their shares: chunks to rollups, then the oldest rollups out
+		while (m_ChunkBytes > m_Budget / 8 * 3 && !m_Chunks.empty()) {
+			Compression::ChunkView View;
+			Chunk &Oldest = m_Chunks.front();
+			if (View.Open(Oldest.Data.data(), Oldest.Data.size(), N))
+				View.ForEach(-INFINITY, INFINITY, [this](double Time, float const *Values) { RollUp(Time, Values); });
+			m_ChunkBytes -= Oldest.Data.size();
+			m_Chunks.pop_front();
+		}
+		while (!m_RollupTimes.empty() && RawBytes() + m_ChunkBytes + RollupBytes() > m_Budget) {
+			m_RollupTimes.pop_front();
+			m_RollupValues.erase(m_RollupValues.begin(), m_RollupValues.begin() + 3 * N);
+			m_Evicted++;
+		}
+	}
+
+	/** @brief Count a sample into the rollup row of its period */
+	void RollUp(double Time, float const *Values) {
+		std::size_t const N = m_Names.size();
+		double Period = std::floor(Time / m_RollupSeconds) * m_RollupSeconds;
+		if (m_RollupTimes.empty() || Period > m_RollupTimes.back()) {
+			m_RollupTimes.push_back(Period);
+			m_RollupValues.insert(m_RollupValues.end(), 3 * N, NAN);
+			m_RollupCounts.assign(N, 0);
+		}
+		std::size_t Row = m_RollupValues.size() - 3 * N;
+		for (std::size_t s = 0; s != N; s++) {
+			float V = Values[s];
+			if (std::isnan(V)) continue;
+			float &Min = m_RollupValues[Row + s], &Mean = m_RollupValues[Row + N + s], &Max = m_RollupValues[Row + 2 * N + s];
+			uint32_t Count = ++m_RollupCounts[s];
+			if (Count == 1) Min = Mean = Max = V;
+			else {
+				Min = std::min(Min, V);
+				Max = std::max(Max, V);
+				Mean += (V - Mean) / Count;
+			}
+		}
+	}
+	/** @brief Index (0 = oldest) of the first sample at or after Time */
+	std::size_t LowerBound(double Time) const {
+		std::size_t Lo = 0, Hi = m_Size;
+		while (Lo < Hi) {
+			std::size_t Mid = (Lo + Hi) / 2;
+			if (m_Times[Slot(Mid)] < Time) Lo = Mid + 1;
+			else Hi = Mid;
+		}
+		return Lo;
+	}
+public:
+	HistoryStore() = default;
+	/** @param Capacity  Number of samples kept; older ones are overwritten */
+	HistoryStore(std::vector<std::string> const &Names, std::size_t Capacity) {
+		Reset(Names, Capacity);
+	}
+
+	/** @brief Wall-clock time in seconds since the epoch */
+	static double Now() {
+		return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	/** @brief Discard everything and start over for a new sensor list */
+	void Reset(std::vector<std::string> const &Names, std::size_t Capacity) {
+		m_Names = Names;
+		m_Capacity = std::max<std::size_t>(Capacity, 1);
+		m_Head = 0;
+		m_Size = 0;
+		m_Times.assign(m_Capacity, 0);
+		m_Values.assign(m_Names.size() * m_Capacity, 0);
+		m_Chunks.clear();
+		m_ChunkBytes = 0;
+		m_RollupTimes.clear();
+		m_RollupValues.clear();
+		m_Evicted = 0;
+		if (m_Budget != 0) m_Tolerances.resize(m_Names.size(), 0.5);
+	}
+
+	/** @brief Keep history within Bytes, in tiers, instead of a fixed number of samples (discards what is held)
+	 * @param How            Method and tolerances of the compressed tier (swinging-door if none)
+	 * @param RollupSeconds  Period of a rollup row
+	 * @returns false if Bytes can't even hold a ring of 2 * ChunkSamples samples
+	 */
+	bool SetBudget(std::size_t Bytes, Compression::Settings const &How, double RollupSeconds = 300) {
+		if (Bytes < MinBudget(m_Names.size())) return false;
+		std::size_t Capacity = std::min(Bytes / 2 / RingBytes(1, m_Names.size()), MaxCapacity);
+		m_Budget = Bytes;
+		m_Method = How.Enabled() ? How.GetMethod() : Compression::Method::SwingingDoor;
+		m_Tolerances = How.Resolve(m_Names);
+		m_RollupSeconds = std::max(RollupSeconds, 1.0);
+		Reset(m_Names, Capacity);
+		return true;
+	}
+	std::size_t Budget() const {
+		return m_Budget;
+	}
+
+	/** @brief Add a sample of every sensor (Values indexed like Names()); samples must arrive in time order */
+	void Append(double Time, float const *Values) {
+		if (m_Budget != 0 && m_Size == m_Capacity) Demote();
+		std::size_t S;
+		if (m_Size < m_Capacity) S = Slot(m_Size++);
+		else {
+			S = m_Head;
+			m_Head = (m_Head + 1) % m_Capacity;
+		}
+		m_Times[S] = Time;
+		for (std::size_t i = 0; i != m_Names.size(); i++)
+			m_Values[i * m_Capacity + S] = Values[i];
+	}
+	void Append(double Time, std::vector<float> const &Values) {
+		if (Values.size() < m_Names.size()) return;
+		Append(Time, Values.data());
+	}
+
+	/** @brief Insert older samples (e.g. restored from disk) ahead of the ones already held
+	 * @param Times   N times in order; only those before FirstTime() are used
+	 * @param Values  N rows of values indexed like Names()
+	 * @note When everything doesn't fit, the oldest samples are the ones dropped; nothing
+	 *       is added once samples have been demoted from the ring
+	 */
+	void Backfill(double const *Times, float const *Values, std::size_t N) {
+		if (!m_Chunks.empty() || !m_RollupTimes.empty()) return;
+		std::size_t Used = N;
+		while (Used > 0 && m_Size > 0 && Times[Used - 1] >= FirstTime()) Used--;
+		std::size_t Keep = std::min(m_Size, m_Capacity);
+		std::size_t Take = std::min(Used, m_Capacity - Keep);
+		if (Take == 0) return;
+		std::vector<double> OldTimes(Keep);
+		std::vector<float> OldValues(Keep * m_Names.size());
+		for (std::size_t i = 0; i != Keep; i++) {
+			OldTimes[i] = m_Times[Slot(i)];
+			for (std::size_t j = 0; j != m_Names.size(); j++) OldValues[i * m_Names.size() + j] = m_Values[j * m_Capacity + Slot(i)];
+		}
+		m_Head = 0;
+		m_Size = 0;
+		for (std::size_t i = Used - Take; i != Used; i++) Append(Times[i], Values + i * m_Names.size());
+		for (std::size_t i = 0; i != Keep; i++) Append(OldTimes[i], OldValues.data() + i * m_Names.size());
+	}
+
+	/** @brief Call Visit(Time, Values) for each sample with From <= Time <= To, oldest first
+	 * @note Values is only valid during the call
+	 */
+	template <typename Visitor>
+	std::size_t ForEach(double From, double To, Visitor &&Visit) const {
+		std::vector<float> Row(m_Names.size());
+		std::size_t N = 0;
+		for (std::size_t r = 0; r != m_RollupTimes.size(); r++) {
+			if (m_RollupTimes[r] < From) continue;
+			if (m_RollupTimes[r] > To) return N;
+			auto Mean = m_RollupValues.begin() + (3 * r + 1) * m_Names.size();
+			std::copy(Mean, Mean + m_Names.size(), Row.begin());
+			Visit(m_RollupTimes[r], (float const *)Row.data());
+			N++;
+		}
+		for (auto const &C : m_Chunks) {
+			if (C.Last < From) continue;
+			if (C.First > To) return N;
+			Compression::ChunkView View;
+			if (View.Open(C.Data.data(), C.Data.size(), m_Names.size())) N += View.ForEach(From, To, Visit);
+		}
+		for (std::size_t i = LowerBound(From); i < m_Size; i++, N++) {
+			std::size_t S = Slot(i);
+			if (m_Times[S] > To) break;
+			for (std::size_t j = 0; j != m_Names.size(); j++) Row[j] = m_Values[j * m_Capacity + S];
+			Visit(m_Times[S], Row.data());
+		}
+		return N;
+	}
+
+	std::vector<std::string> const &Names() const {
+		return m_Names;
+	}
+	std::size_t Size() const {
+		return m_Size;
+	}
+	std::size_t Capacity() const {
+		return m_Capacity;
+	}
+	bool Empty() const {
+		return m_Size == 0;
+	}
+	/** @brief Time of the oldest sample in the ring/the newest sample (0 if empty) */
+	double FirstTime() const {
+		return m_Size ? m_Times[m_Head] : 0;
+	}
+	/** @brief Time of the oldest sample in any tier (0 if empty) */
+	double OldestTime() const {
+		if (!m_RollupTimes.empty()) return m_RollupTimes.front();
+		if (!m_Chunks.empty()) return m_Chunks.front().First;
+		return FirstTime();
+	}
+	Usage GetUsage() const {
+		Usage U;
+		U.Raw = RawBytes();
+		U.Compressed = m_ChunkBytes;
+		U.Rollup = RollupBytes();
+		U.RawSamples = m_Size;
+		U.Chunks = m_Chunks.size();
+		U.RollupRows = m_RollupTimes.size();
+		U.Evicted = m_Evicted;
+		return U;
+	}
+	double LastTime() const {
+		return m_Size ? m_Times[Slot(m_Size - 1)] : 0;
+	}
+	/** @brief Newest value of a sensor */
+	float Latest(std::size_t Sensor) const {
+		return m_Size ? m_Values[Sensor * m_Capacity + Slot(m_Size - 1)] : 0;
+	}
+};
+
+#endif //HISTORY_HISTORYSTORE_HPP_
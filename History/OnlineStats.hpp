@@ -0,0 +1,198 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Online Statistics
+	Per-sensor statistics that are updated in O(1) per sample
+	    and never grow:
+
+	     -Ewma:      exponentially weighted moving average with a
+	                 time constant of TimeConstant seconds (the
+	                 weight follows the actual gap between samples)
+	     -Variance:  exponentially weighted variance about it
+	     -Smoothed, Slope, Acceleration: value and first and
+	                 second derivatives (degrees/s, degrees/s^2) at
+	                 the newest sample, from a least-squares
+	                 quadratic over the last samples (the last
+	                 DefaultPoints, or those of the last FitSpan
+	                 seconds, at most MaxPoints)
+
+	The quadratic fit is a Savitzky-Golay filter evaluated at the
+	    end of the window: with evenly spaced samples it reduces to
+	    the usual fixed coefficients.  It is solved from the sample
+	    times, so jitter in the tick, a changed interval or a gap
+	    don't skew the derivatives.
+****************************************************************/
+#ifndef HISTORY_ONLINESTATS_HPP_
+#define HISTORY_ONLINESTATS_HPP_
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ThermalPredictor.hpp"
+
+class OnlineStats {
+public:
+	static constexpr double DefaultTimeConstant = 60;
+	static constexpr unsigned DefaultPoints = 7;
+	static constexpr unsigned MaxPoints = 32;
+private:
+	double m_TimeConstant;
+	double m_FitSpan;                ///<0: the last DefaultPoints samples
+	double m_Times[MaxPoints];       ///<Ring of the newest samples
+	float m_Values[MaxPoints];
+	unsigned m_Head = 0;             ///<Slot of the next sample
+	unsigned m_Size = 0;
+	uint64_t m_Count = 0;
+	double m_Ewma = NAN;
+	double m_Variance = NAN;
+	double m_Smoothed = NAN;
+	double m_Slope = NAN;
+	double m_Acceleration = NAN;
+
+	/** @brief Fit the quadratic to the newest samples */
+	void Fit() {
+		unsigned Newest = (m_Head + MaxPoints - 1) % MaxPoints;
+		double T0 = m_Times[Newest], Y0 = m_Values[Newest];
+		unsigned Limit = (m_FitSpan > 0) ? MaxPoints : DefaultPoints;
+		unsigned N = 0;
+		while (N < m_Size && N < Limit) {
+			unsigned Slot = (Newest + MaxPoints - N) % MaxPoints;
+			if (m_FitSpan > 0 && T0 - m_Times[Slot] > m_FitSpan) break;
+			N++;
+		}
+		double Span = T0 - m_Times[(Newest + MaxPoints - (N - 1)) % MaxPoints];
+		m_Smoothed = Y0;
+		m_Slope = NAN;
+		m_Acceleration = NAN;
+		if (N < 2 || !(Span > 0)) return;
+		//Times scaled to [-1, 0] and values relative to the newest keep the sums well conditioned
+		double S[5] = {0, 0, 0, 0, 0}, R[3] = {0, 0, 0};
+		for (unsigned k = 0; k != N; k++) {
+			unsigned Slot = (Newest + MaxPoints - k) % MaxPoints;
+			double U = (m_Times[Slot] - T0) / Span, Y = m_Values[Slot] - Y0, P = 1;
+			for (unsigned e = 0; e != 5; e++) {
+				if (e < 3) R[e] += P * Y;
+				S[e] += P;
+				P *= U;
+			}
+		}
+		if (N >= 3) {
+			//Normal equations of a + bU + cU^2, by Cramer's rule
+			double Det = S[0] * (S[2] * S[4] - S[3] * S[3]) - S[1] * (S[1] * S[4] - S[3] * S[2]) + S[2] * (S[1] * S[3] - S[2] * S[2]);
+			if (std::fabs(Det) > 1e-12 * S[0] * S[0] * S[0]) {
+				double A = R[0] * (S[2] * S[4] - S[3] * S[3]) - S[1] * (R[1] * S[4] - S[3] * R[2]) + S[2] * (R[1] * S[3] - S[2] * R[2]);
+				double B = S[0] * (R[1] * S[4] - R[2] * S[3]) - R[0] * (S[1] * S[4] - S[3] * S[2]) + S[2] * (S[1] * R[2] - R[1] * S[2]);
+				double C = S[0] * (S[2] * R[2] - S[3] * R[1]) - S[1] * (S[1] * R[2] - R[1] * S[2]) + R[0] * (S[1] * S[3] - S[2] * S[2]);
+				m_Smoothed = Y0 + A / Det;
+				m_Slope = B / Det / Span;
+				m_Acceleration = 2 * C / Det / (Span * Span);
+				return;
+			}
+		}
+		//Too few (distinct) times for a curve: a straight line
+		double Det = S[0] * S[2] - S[1] * S[1];
+		if (std::fabs(Det) <= 1e-12 * S[0] * S[0]) return;
+		m_Smoothed = Y0 + (R[0] * S[2] - S[1] * R[1]) / Det;
+		m_Slope = (S[0] * R[1] - S[1] * R[0]) / Det / Span;
+	}
+public:
+	/** @param TimeConstant  Seconds of memory of the average and variance
+	 *  @param FitSpan       Seconds of samples the derivatives are fitted to (0: the last DefaultPoints samples)
+	 */
+	OnlineStats(double TimeConstant = DefaultTimeConstant, double FitSpan = 0)
+		: m_TimeConstant(TimeConstant > 0 ? TimeConstant : DefaultTimeConstant), m_FitSpan(FitSpan > 0 ? FitSpan : 0) {}
+
+	/** @brief Add a reading (NaN values are skipped); a time earlier than the last one starts over */
+	void Add(double Time, float Value) {
+		if (std::isnan(Value)) return;
+		unsigned Newest = (m_Head + MaxPoints - 1) % MaxPoints;
+		if (m_Size > 0 && Time < m_Times[Newest]) Clear();
+		if (m_Count == 0) {
+			m_Ewma = Value;
+			m_Variance = 0;
+		}
+		else {
+			double Alpha = 1 - std::exp(-(Time - m_Times[Newest]) / m_TimeConstant);
+			double Delta = Value - m_Ewma;
+			m_Ewma += Alpha * Delta;
+			m_Variance = (1 - Alpha) * (m_Variance + Alpha * Delta * Delta);
+		}
+		m_Times[m_Head] = Time;
+		m_Values[m_Head] = Value;
+		m_Head = (m_Head + 1) % MaxPoints;
+		if (m_Size < MaxPoints) m_Size++;
+		m_Count++;
+		Fit();
+	}
+	void Clear() {
+		m_Head = m_Size = 0;
+		m_Count = 0;
+		m_Ewma = m_Variance = m_Smoothed = m_Slope = m_Acceleration = NAN;
+	}
+
+	/** @brief Values are NaN until there have been enough samples (one; two for Slope, three for Acceleration) */
+	double Ewma() const { return m_Ewma; }
+	double Variance() const { return m_Variance; }
+	double StdDev() const { return std::sqrt(m_Variance); }
+	double Smoothed() const { return m_Smoothed; }
+	double Slope() const { return m_Slope; }
+	double Acceleration() const { return m_Acceleration; }
+	uint64_t Count() const { return m_Count; }
+	double TimeConstant() const { return m_TimeConstant; }
+	double FitSpan() const { return m_FitSpan; }
+};
+
+/** @brief OnlineStats and a ThermalPredictor for every sensor of a snapshot */
+class SensorStats {
+private:
+	std::vector<OnlineStats> m_Sensors;
+	std::vector<ThermalPredictor> m_Models;
+public:
+	SensorStats() = default;
+	SensorStats(std::size_t Sensors, double TimeConstant = OnlineStats::DefaultTimeConstant, double FitSpan = 0)
+		: m_Sensors(Sensors, OnlineStats(TimeConstant, FitSpan)), m_Models(Sensors) {}
+
+	/** @brief Add a sample of every sensor (NaN values are skipped) */
+	void Add(double Time, float const *Values) {
+		for (std::size_t s = 0; s != m_Sensors.size(); s++) {
+			if (std::isnan(Values[s])) continue;
+			m_Sensors[s].Add(Time, Values[s]);
+			m_Models[s].Add(Time, Values[s]);
+		}
+	}
+	void Add(double Time, std::vector<float> const &Values) {
+		if (Values.size() >= m_Sensors.size()) Add(Time, Values.data());
+	}
+
+	OnlineStats const &operator[](std::size_t Sensor) const {
+		return m_Sensors[Sensor];
+	}
+	ThermalPredictor const &Model(std::size_t Sensor) const {
+		return m_Models[Sensor];
+	}
+	/** @brief Out[i]: predicted seconds until sensor i reaches Critical[i] (INFINITY: not expected, or no threshold) */
+	void TimeToCritical(std::vector<float> const &Critical, std::vector<float> &Out) const {
+		Out.resize(m_Models.size());
+		for (std::size_t s = 0; s != m_Models.size(); s++)
+			Out[s] = (s < Critical.size()) ? (float)m_Models[s].TimeTo(Critical[s], m_Sensors[s].Smoothed()) : INFINITY;
+	}
+	std::size_t Size() const {
+		return m_Sensors.size();
+	}
+};
+
+#endif //HISTORY_ONLINESTATS_HPP_
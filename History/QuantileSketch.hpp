@@ -0,0 +1,204 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Quantile Sketch
+	A DDSketch: values are counted in logarithmic bins, so any
+	    quantile is answered to within a relative error of
+	    Accuracy (1% by default) of the true value, sketches of
+	    different periods can be merged exactly, and adding a
+	    value is O(1).
+
+	Memory is bounded by MaxBins per sign; when a sketch would
+	    need more, its bins nearest zero are folded together
+	    (the high quantiles, which matter for temperatures,
+	    keep their accuracy).  With the defaults 20-100 degrees
+	    takes about 80 bins.
+****************************************************************/
+#ifndef HISTORY_QUANTILESKETCH_HPP_
+#define HISTORY_QUANTILESKETCH_HPP_
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class QuantileSketch {
+public:
+	static constexpr double DefaultAccuracy = 0.01;
+	static constexpr std::size_t DefaultMaxBins = 2048;
+private:
+	/** @brief Counts of a contiguous range of bin indices */
+	struct Store {
+		std::vector<uint64_t> Counts;
+		int Offset = 0;          ///<Bin index of Counts[0]
+		uint64_t Total = 0;
+
+		int Top() const {
+			return Offset + (int)Counts.size() - 1;
+		}
+		void Add(int Index, uint64_t N, std::size_t MaxBins) {
+			if (Counts.empty()) {
+				Counts.assign(1, 0);
+				Offset = Index;
+			}
+			else if (Index < Offset) {
+				//Too far below what's kept: count it in the lowest bin allowed
+				if ((std::size_t)(Top() - Index) >= MaxBins) Index = Top() - (int)MaxBins + 1;
+				if (Index < Offset) {
+					Counts.insert(Counts.begin(), Offset - Index, 0);
+					Offset = Index;
+				}
+			}
+			else if (Index > Top()) {
+				if ((std::size_t)(Index - Offset) >= MaxBins) {
+					//Fold the lowest bins into the new lowest one
+					std::size_t Drop = std::min<std::size_t>(Index - (int)MaxBins + 1 - Offset, Counts.size());
+					uint64_t Folded = 0;
+					for (std::size_t i = 0; i != Drop; i++) Folded += Counts[i];
+					Counts.erase(Counts.begin(), Counts.begin() + Drop);
+					Offset = Index - (int)MaxBins + 1;
+					if (Counts.empty()) Counts.assign(1, 0);
+					Counts[0] += Folded;
+				}
+				Counts.resize(Index - Offset + 1, 0);
+			}
+			Counts[Index - Offset] += N;
+			Total += N;
+		}
+		void Merge(Store const &Other, std::size_t MaxBins) {
+			for (std::size_t i = 0; i != Other.Counts.size(); i++)
+				if (Other.Counts[i] != 0) Add(Other.Offset + (int)i, Other.Counts[i], MaxBins);
+		}
+		void Clear() {
+			Counts.clear();
+			Offset = 0;
+			Total = 0;
+		}
+	};
+
+	double m_Accuracy;
+	double m_Gamma;
+	double m_Multiplier;         ///<1 / ln(Gamma)
+	std::size_t m_MaxBins;
+	Store m_Positive;
+	Store m_Negative;            ///<Indexed by -Value
+	uint64_t m_Zero = 0;
+	uint64_t m_Count = 0;
+	double m_Sum = 0;
+	double m_Min = INFINITY, m_Max = -INFINITY;
+
+	static constexpr double MinIndexable = 1e-6; ///<Smaller magnitudes count as zero
+
+	int Index(double Magnitude) const {
+		return (int)std::ceil(std::log(Magnitude) * m_Multiplier);
+	}
+	/** @brief The value a bin stands for (relative error at most Accuracy to any value in it) */
+	double Value(int Index) const {
+		return 2 * std::pow(m_Gamma, Index) / (m_Gamma + 1);
+	}
+public:
+	explicit QuantileSketch(double Accuracy = DefaultAccuracy, std::size_t MaxBins = DefaultMaxBins)
+		: m_Accuracy(Accuracy), m_Gamma((1 + Accuracy) / (1 - Accuracy)), m_Multiplier(1 / std::log(m_Gamma)), m_MaxBins(std::max<std::size_t>(MaxBins, 1)) {}
+
+	void Add(double V, uint64_t N = 1) {
+		if (std::isnan(V) || N == 0) return;
+		if (V > MinIndexable) m_Positive.Add(Index(V), N, m_MaxBins);
+		else if (V < -MinIndexable) m_Negative.Add(Index(-V), N, m_MaxBins);
+		else m_Zero += N;
+		m_Count += N;
+		m_Sum += V * N;
+		m_Min = std::min(m_Min, V);
+		m_Max = std::max(m_Max, V);
+	}
+
+	/** @brief Add everything counted by Other (which must have the same accuracy) */
+	void Merge(QuantileSketch const &Other) {
+		if (Other.m_Count == 0) return;
+		m_Positive.Merge(Other.m_Positive, m_MaxBins);
+		m_Negative.Merge(Other.m_Negative, m_MaxBins);
+		m_Zero += Other.m_Zero;
+		m_Count += Other.m_Count;
+		m_Sum += Other.m_Sum;
+		m_Min = std::min(m_Min, Other.m_Min);
+		m_Max = std::max(m_Max, Other.m_Max);
+	}
+
+	/** @brief Forget everything (keeping the memory for reuse) */
+	void Clear() {
+		m_Positive.Clear();
+		m_Negative.Clear();
+		m_Zero = m_Count = 0;
+		m_Sum = 0;
+		m_Min = INFINITY;
+		m_Max = -INFINITY;
+	}
+
+	/** @brief The Q quantile (0 <= Q <= 1); NaN when empty */
+	double Quantile(double Q) const {
+		if (m_Count == 0) return NAN;
+		if (Q <= 0) return m_Min;
+		if (Q >= 1) return m_Max;
+		double Rank = Q * (m_Count - 1);
+		double Result = m_Min;
+		uint64_t Seen = 0;
+		//Most negative first: the negative store from its highest index down
+		if (Rank < m_Negative.Total) {
+			for (std::size_t i = m_Negative.Counts.size(); i-- > 0;) {
+				Seen += m_Negative.Counts[i];
+				if (Seen > Rank) {
+					Result = -Value(m_Negative.Offset + (int)i);
+					break;
+				}
+			}
+		}
+		else if (Rank < m_Negative.Total + m_Zero) Result = 0;
+		else {
+			Seen = m_Negative.Total + m_Zero;
+			Result = m_Max;
+			for (std::size_t i = 0; i != m_Positive.Counts.size(); i++) {
+				Seen += m_Positive.Counts[i];
+				if (Seen > Rank) {
+					Result = Value(m_Positive.Offset + (int)i);
+					break;
+				}
+			}
+		}
+		return std::min(std::max(Result, m_Min), m_Max);
+	}
+
+	uint64_t Count() const {
+		return m_Count;
+	}
+	double Sum() const {
+		return m_Sum;
+	}
+	double Min() const {
+		return m_Min;
+	}
+	double Max() const {
+		return m_Max;
+	}
+	double Accuracy() const {
+		return m_Accuracy;
+	}
+	/** @brief Bins in use (a measure of the memory held) */
+	std::size_t Bins() const {
+		return m_Positive.Counts.size() + m_Negative.Counts.size();
+	}
+};
+
+#endif //HISTORY_QUANTILESKETCH_HPP_
@@ -0,0 +1,763 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sample Log
+	A durable, append-only log of samples: a directory of
+	    segment files named by a 16-digit sequence number
+	    (0000000000000001.log, ...).  Everything is in host
+	    byte order and 8-byte aligned so that a mapped segment
+	    can be read in place.
+
+	Segment:
+	    offset  type     field
+	         0  uint32   Magic        0x474C5453 ("STLG")
+	         4  uint16   Version      1 (2: compressed)
+	         6  uint16   HeaderSize   64
+	         8  uint32   Sensors      N
+	        12  uint32   RecordSize   8 + 4N, rounded up to 8
+	        16  uint32   NamesSize    bytes of the name table
+	        20  uint32   HeaderCrc    CRC-32C of the header (with
+	                                  this field 0) and name table
+	        24  uint64   Sequence
+	        32  double   Created      seconds since the epoch
+	        40  (reserved to 64)
+	        64  name table: N NUL-terminated names, padded to 8
+	    followed by blocks, one per commit:
+	         0  uint32   Magic        0x314B4C42 ("BLK1")
+	         4  uint32   Count        records in the block
+	         8  uint32   CountCheck   ~Count
+	        12  uint32   Crc          CRC-32C of the records
+	        16  Count records: double Time, float Value[N]
+	            (NaN: unreadable), padding to RecordSize
+	    or, in a compressed (version 2) segment:
+	         0  uint32   Magic        0x314B4843 ("CHK1")
+	         4  uint32   Count        samples in the chunk
+	         8  uint32   CountCheck   ~Count
+	        12  uint32   Crc          CRC-32C of the chunk
+	        16  a chunk of Count samples of the N sensors (see
+	            History/Compression.hpp)
+
+	Writer batches samples and writes each batch as one block
+	    (group commit), followed by fdatasync, once it holds
+	    Limits::BatchRecords samples or its oldest sample is
+	    Limits::BatchAge old.  On reopening, anything after the
+	    last intact block of the newest segment (a block torn
+	    by a crash) is truncated, so a crash loses at most the
+	    batch being written.  A new segment is started when the
+	    current one would exceed Limits::SegmentBytes, is older
+	    than Limits::SegmentAge, or the sensor list changes.
+	    Only one Writer may use a directory: it holds an flock on
+	    the file LOCK in it for as long as it is open (including
+	    while compacting), and a second one fails to Open().
+	    With compression on (SetCompression()), each segment the
+	    writer has finished with is rewritten compressed, in
+	    chunks of CompactSamples samples, on a worker thread
+	    (Compact()); the segment being written stays as it is,
+	    so durability is unchanged.
+
+	Segment maps a segment read-only and checks every block's
+	    CRC once; readers get pointers into the mapping.  Reader
+	    does the same for a whole directory, or only for the
+	    newest segments when just the recent past is wanted
+	    (ReadTail() copies that out by sensor name).  Readers
+	    see the samples of compressed segments as they were
+	    taken, with each reading interpolated from the points
+	    kept.
+****************************************************************/
+#ifndef HISTORY_SAMPLELOG_HPP_
+#define HISTORY_SAMPLELOG_HPP_
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "Compression.hpp"
+#include "../Core/Crc32.hpp"
+
+namespace SampleLog {
+	constexpr uint32_t Magic = 0x474C5453;
+	constexpr uint32_t BlockMagic = 0x314B4C42;
+	constexpr uint32_t ChunkMagic = 0x314B4843;
+	constexpr uint16_t Version = 1;
+	constexpr uint16_t CompressedVersion = 2;
+	constexpr std::size_t CompactSamples = 4096;     ///<Per chunk of a compressed segment
+
+	struct SegmentHeader {
+		uint32_t Magic;
+		uint16_t Version;
+		uint16_t HeaderSize;
+		uint32_t Sensors;
+		uint32_t RecordSize;
+		uint32_t NamesSize;
+		uint32_t HeaderCrc;
+		uint64_t Sequence;
+		double Created;
+		uint8_t Reserved[24];
+	};
+	static_assert(sizeof(SegmentHeader) == 64, "SegmentHeader is part of the on-disk format");
+
+	struct BlockHeader {
+		uint32_t Magic;
+		uint32_t Count;
+		uint32_t CountCheck;
+		uint32_t Crc;
+	};
+	static_assert(sizeof(BlockHeader) == 16, "BlockHeader is part of the on-disk format");
+
+	inline std::size_t RecordSize(std::size_t Sensors) {
+		return (8 + 4 * Sensors + 7) & ~std::size_t(7);
+	}
+
+	/** @brief The path of segment Sequence in Dir */
+	inline std::string SegmentPath(std::string const &Dir, uint64_t Sequence) {
+		char Name[32];
+		snprintf(Name, sizeof(Name), "/%016llu.log", (unsigned long long)Sequence);
+		return Dir + Name;
+	}
+
+	/** @brief The header and name table of a segment */
+	inline std::vector<unsigned char> SegmentHead(std::vector<std::string> const &Names, uint64_t Sequence, double Created, uint16_t Format = Version) {
+		std::vector<unsigned char> Head(sizeof(SegmentHeader));
+		for (auto const &Name : Names) Head.insert(Head.end(), Name.c_str(), Name.c_str() + Name.size() + 1);
+		Head.resize((Head.size() + 7) & ~std::size_t(7), 0);
+		SegmentHeader H{};
+		H.Magic = Magic;
+		H.Version = Format;
+		H.HeaderSize = sizeof(SegmentHeader);
+		H.Sensors = Names.size();
+		H.RecordSize = RecordSize(Names.size());
+		H.NamesSize = Head.size() - sizeof(SegmentHeader);
+		H.Sequence = Sequence;
+		H.Created = Created;
+		H.HeaderCrc = Crc32C::Extend(Crc32C::Compute(&H, sizeof(H)), Head.data() + sizeof(H), H.NamesSize);
+		std::memcpy(Head.data(), &H, sizeof(H));
+		return Head;
+	}
+
+	/** @brief Sequence numbers of the segments in Dir, in order */
+	inline std::vector<uint64_t> ListSegments(std::string const &Dir) {
+		std::vector<uint64_t> Out;
+		DIR *D = opendir(Dir.c_str());
+		if (D == nullptr) return Out;
+		while (dirent *E = readdir(D)) {
+			char const *Name = E->d_name;
+			if (strlen(Name) != 20 || strcmp(Name + 16, ".log") != 0 || strspn(Name, "0123456789") != 16) continue;
+			Out.push_back(strtoull(Name, nullptr, 10));
+		}
+		closedir(D);
+		std::sort(Out.begin(), Out.end());
+		return Out;
+	}
+
+	/** @brief fsync the directory holding Path, so that a file created or renamed in it survives a crash */
+	inline void SyncDirectoryOf(std::string const &Path) {
+		std::string Dir = Path.substr(0, Path.rfind('/') + 1);
+		int DirFd = open(Dir.empty() ? "." : Dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (DirFd >= 0) {
+			fsync(DirFd);
+			close(DirFd);
+		}
+	}
+
+	/** @brief A read-only mapping of one segment */
+	class Segment {
+	public:
+		struct Block {
+			std::size_t Offset;   ///<Of the first record (or of the chunk)
+			uint32_t Count;
+			double First, Last;   ///<Times of the first and last record
+			uint32_t Bytes = 0;   ///<Of the chunk, in a compressed segment
+		};
+	private:
+		std::string m_Path;
+		unsigned char const *m_Data = nullptr;
+		std::size_t m_Mapped = 0;
+		std::size_t m_End = 0;                ///<End of the last intact block
+		SegmentHeader m_Header{};
+		std::vector<std::string> m_Names;
+		std::vector<Block> m_Blocks;
+		double m_Start = NAN;                 ///<Time of the first record
+
+		void Unmap() {
+			if (m_Data != nullptr) munmap(const_cast<unsigned char *>(m_Data), m_Mapped);
+			m_Data = nullptr;
+			m_Mapped = 0;
+		}
+
+		/** @brief Check and index the blocks from m_End on */
+		void Scan() {
+			if (Compressed()) {
+				ScanChunks();
+				return;
+			}
+			std::size_t const RecordBytes = m_Header.RecordSize;
+			while (m_End + sizeof(BlockHeader) <= m_Mapped) {
+				BlockHeader B;
+				std::memcpy(&B, m_Data + m_End, sizeof(B));
+				if (B.Magic != BlockMagic || B.CountCheck != ~B.Count || B.Count == 0) break;
+				std::size_t Offset = m_End + sizeof(BlockHeader);
+				if ((m_Mapped - Offset) / RecordBytes < B.Count) break;
+				if (Crc32C::Compute(m_Data + Offset, B.Count * RecordBytes) != B.Crc) break;
+				m_Blocks.push_back({Offset, B.Count, TimeAt(Offset), TimeAt(Offset + (B.Count - 1) * RecordBytes)});
+				m_End = Offset + B.Count * RecordBytes;
+			}
+		}
+		void ScanChunks() {
+			while (m_End + sizeof(BlockHeader) + 24 <= m_Mapped) {
+				BlockHeader B;
+				std::memcpy(&B, m_Data + m_End, sizeof(B));
+				if (B.Magic != ChunkMagic || B.CountCheck != ~B.Count || B.Count == 0) break;
+				std::size_t Offset = m_End + sizeof(BlockHeader);
+				uint32_t Bytes;
+				std::memcpy(&Bytes, m_Data + Offset + 8, 4);
+				if (Bytes > m_Mapped - Offset || Crc32C::Compute(m_Data + Offset, Bytes) != B.Crc) break;
+				Compression::ChunkView Chunk;
+				if (!Chunk.Open(m_Data + Offset, Bytes, m_Header.Sensors) || Chunk.Count() != B.Count) break;
+				m_Blocks.push_back({Offset, B.Count, Chunk.First(), Chunk.Last(), Bytes});
+				m_End = Offset + Bytes;
+			}
+		}
+		double TimeAt(std::size_t Offset) const {
+			return *reinterpret_cast<double const *>(m_Data + Offset);
+		}
+	public:
+		Segment() = default;
+		~Segment() {
+			Unmap();
+		}
+		Segment(Segment const &) = delete;
+		Segment &operator=(Segment const &) = delete;
+
+		/** @brief Map Path and (unless IndexBlocks is false) index its intact blocks
+		 * @returns false (with Error set) if the file or its header can't be used
+		 * @note Without IndexBlocks only the header and names are read, so that a
+		 *       segment can be ruled out cheaply; call Index() before reading it
+		 */
+		bool Open(std::string const &Path, std::string &Error, bool IndexBlocks = true) {
+			Unmap();
+			m_Path = Path;
+			m_Names.clear();
+			m_Blocks.clear();
+			m_End = 0;
+			m_Start = NAN;
+			int Fd = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (Fd < 0) {
+				Error = Path + ": " + strerror(errno);
+				return false;
+			}
+			struct stat St;
+			if (fstat(Fd, &St) != 0 || (std::size_t)St.st_size < sizeof(SegmentHeader)) {
+				close(Fd);
+				Error = Path + ": too short";
+				return false;
+			}
+			void *Map = mmap(nullptr, St.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+			close(Fd);
+			if (Map == MAP_FAILED) {
+				Error = Path + ": " + strerror(errno);
+				return false;
+			}
+			m_Data = static_cast<unsigned char const *>(Map);
+			m_Mapped = St.st_size;
+			std::memcpy(&m_Header, m_Data, sizeof(m_Header));
+			SegmentHeader Check = m_Header;
+			Check.HeaderCrc = 0;
+			if (m_Header.Magic != Magic || (m_Header.Version != Version && m_Header.Version != CompressedVersion) || m_Header.HeaderSize != sizeof(SegmentHeader) ||
+			    m_Header.RecordSize != RecordSize(m_Header.Sensors) || m_Header.NamesSize % 8 != 0 ||
+			    m_Mapped - sizeof(SegmentHeader) < m_Header.NamesSize ||
+			    Crc32C::Extend(Crc32C::Compute(&Check, sizeof(Check)), m_Data + sizeof(SegmentHeader), m_Header.NamesSize) != m_Header.HeaderCrc) {
+				Unmap();
+				Error = Path + ": not a sample log segment (or its header is damaged)";
+				return false;
+			}
+			char const *Name = reinterpret_cast<char const *>(m_Data + sizeof(SegmentHeader));
+			char const *NamesEnd = Name + m_Header.NamesSize;
+			for (uint32_t i = 0; i != m_Header.Sensors && Name < NamesEnd; i++) {
+				m_Names.emplace_back(Name, strnlen(Name, NamesEnd - Name));
+				Name += m_Names.back().size() + 1;
+			}
+			if (m_Names.size() != m_Header.Sensors) {
+				Unmap();
+				Error = Path + ": damaged name table";
+				return false;
+			}
+			m_End = sizeof(SegmentHeader) + m_Header.NamesSize;
+			if (IndexBlocks) Scan();
+			else if (m_End + sizeof(BlockHeader) + m_Header.RecordSize <= m_Mapped) {
+				//Peek at the first record (unchecked) so the segment can be placed in time
+				BlockHeader B;
+				std::memcpy(&B, m_Data + m_End, sizeof(B));
+				if (B.Magic == (Compressed() ? ChunkMagic : BlockMagic) && B.CountCheck == ~B.Count && B.Count != 0) m_Start = TimeAt(m_End + sizeof(BlockHeader));
+			}
+			return true;
+		}
+
+		/** @brief Check and index the blocks (when opened without IndexBlocks) */
+		void Index() {
+			if (m_Data != nullptr) Scan();
+		}
+
+		/** @brief Pick up blocks appended since Open() (a writer may still be adding to the segment) */
+		bool Refresh() {
+			struct stat St;
+			if (m_Data == nullptr || stat(m_Path.c_str(), &St) != 0 || (std::size_t)St.st_size <= m_Mapped) return false;
+			int Fd = open(m_Path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (Fd < 0) return false;
+			void *Map = mmap(nullptr, St.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+			close(Fd);
+			if (Map == MAP_FAILED) return false;
+			std::size_t Blocks = m_Blocks.size();
+			Unmap();
+			m_Data = static_cast<unsigned char const *>(Map);
+			m_Mapped = St.st_size;
+			Scan();
+			return m_Blocks.size() != Blocks;
+		}
+
+		std::string const &Path() const {
+			return m_Path;
+		}
+		uint64_t Sequence() const {
+			return m_Header.Sequence;
+		}
+		double Created() const {
+			return m_Header.Created;
+		}
+		/** @brief Whether the segment has been compressed (Compact()) */
+		bool Compressed() const {
+			return m_Header.Version == CompressedVersion;
+		}
+		std::vector<std::string> const &Names() const {
+			return m_Names;
+		}
+		std::vector<Block> const &Blocks() const {
+			return m_Blocks;
+		}
+		/** @brief Bytes up to the end of the last intact block */
+		std::size_t Size() const {
+			return m_End;
+		}
+		bool Empty() const {
+			return m_Blocks.empty();
+		}
+		double FirstTime() const {
+			return m_Blocks.empty() ? m_Start : m_Blocks.front().First;
+		}
+		double LastTime() const {
+			return m_Blocks.empty() ? NAN : m_Blocks.back().Last;
+		}
+		std::size_t Records() const {
+			std::size_t N = 0;
+			for (auto const &B : m_Blocks) N += B.Count;
+			return N;
+		}
+
+		/** @brief Call Visit(Time, Values) for each record of Which in [From, To]
+		 * @returns The number of records visited
+		 * @note Values is only valid during the call (a chunk is decoded into a buffer)
+		 */
+		template <typename Visitor>
+		std::size_t ForEach(Block const &Which, double From, double To, Visitor &&Visit) const {
+			if (Which.Bytes != 0) {
+				Compression::ChunkView Chunk;
+				Chunk.Open(m_Data + Which.Offset, Which.Bytes, m_Header.Sensors);
+				return Chunk.ForEach(From, To, Visit);
+			}
+			std::size_t N = 0;
+			unsigned char const *Record = m_Data + Which.Offset;
+			for (uint32_t i = 0; i != Which.Count; i++, Record += m_Header.RecordSize) {
+				double Time = *reinterpret_cast<double const *>(Record);
+				if (Time < From) continue;
+				if (Time > To) break;
+				Visit(Time, reinterpret_cast<float const *>(Record + 8));
+				N++;
+			}
+			return N;
+		}
+		template <typename Visitor>
+		std::size_t ForEach(double From, double To, Visitor &&Visit) const {
+			std::size_t N = 0;
+			for (auto const &B : m_Blocks) {
+				if (B.Last < From) continue;
+				if (B.First > To) break;
+				N += ForEach(B, From, To, Visit);
+			}
+			return N;
+		}
+	};
+
+	/** @brief Every readable segment of a log directory */
+	class Reader {
+	private:
+		std::string m_Dir;
+		std::vector<std::unique_ptr<Segment>> m_Segments;
+	public:
+		/** @brief Map the segments in Dir (damaged ones are reported and skipped)
+		 * @param From  Skip segments that only hold samples from before this time
+		 */
+		bool Open(std::string const &Dir, double From = -INFINITY) {
+			m_Dir = Dir;
+			m_Segments.clear();
+			struct stat St;
+			if (stat(Dir.c_str(), &St) != 0 || !S_ISDIR(St.st_mode)) return false;
+			//Segments are in time order, so work back from the newest
+			std::vector<uint64_t> Sequences = ListSegments(Dir);
+			for (auto IT = Sequences.rbegin(); IT != Sequences.rend(); ++IT) {
+				std::string Error;
+				auto S = std::make_unique<Segment>();
+				if (!S->Open(SegmentPath(Dir, *IT), Error)) {
+					std::cerr << "Skipping " << Error << "\n";
+					continue;
+				}
+				bool Older = !S->Empty() && S->FirstTime() <= From;
+				m_Segments.insert(m_Segments.begin(), std::move(S));
+				if (Older) break;
+			}
+			return true;
+		}
+		std::vector<std::unique_ptr<Segment>> const &Segments() const {
+			return m_Segments;
+		}
+		/** @brief Visit(Segment, Time, Values) for each record in [From, To], oldest first */
+		template <typename Visitor>
+		std::size_t ForEach(double From, double To, Visitor &&Visit) const {
+			std::size_t N = 0;
+			for (auto const &S : m_Segments) {
+				if (S->Empty() || S->LastTime() < From || S->FirstTime() > To) continue;
+				N += S->ForEach(From, To, [&](double Time, float const *Values){ Visit(*S, Time, Values); });
+			}
+			return N;
+		}
+	};
+
+	/** @brief Samples taken from a log, by sensor */
+	struct Tail {
+		std::vector<double> Times;
+		std::vector<float> Values;   ///<[Sample * Sensors + Sensor]; NaN where a segment lacks the sensor
+	};
+
+	/** @brief Read the samples of Names taken since From, oldest first */
+	inline Tail ReadTail(std::string const &Dir, std::vector<std::string> const &Names, double From) {
+		Tail Out;
+		Reader Log;
+		if (!Log.Open(Dir, From)) return Out;
+		for (auto const &S : Log.Segments()) {
+			std::vector<int> Column(Names.size(), -1);
+			for (std::size_t i = 0; i != Names.size(); i++) {
+				auto IT = std::find(S->Names().begin(), S->Names().end(), Names[i]);
+				if (IT != S->Names().end()) Column[i] = IT - S->Names().begin();
+			}
+			S->ForEach(From, INFINITY, [&](double Time, float const *Values) {
+				if (!Out.Times.empty() && Time <= Out.Times.back()) return;
+				Out.Times.push_back(Time);
+				for (int C : Column) Out.Values.push_back(C < 0 ? NAN : Values[C]);
+			});
+		}
+		return Out;
+	}
+
+	/** @brief Rewrite the segment at Path compressed (a no-op if it already is)
+	 * @param Stop  Abandon the work (leaving the segment as it was) once this is set
+	 * @returns false (with Error set, unless stopped) if it couldn't be done
+	 * @note The segment must be finished with: nothing may still be appending to it
+	 */
+	inline bool Compact(std::string const &Path, Compression::Settings const &How, std::string &Error, std::atomic<bool> const *Stop = nullptr) {
+		Segment Raw;
+		if (!Raw.Open(Path, Error, false)) return false;
+		if (Raw.Compressed() || !How.Enabled()) return true;
+		Raw.Index();
+		std::size_t const N = Raw.Names().size();
+		std::vector<float> Tolerances = How.Resolve(Raw.Names());
+		std::string Temp = Path + ".tmp";
+		int Fd = open(Temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (Fd < 0) {
+			Error = Temp + ": " + strerror(errno);
+			return false;
+		}
+		std::vector<unsigned char> Out = SegmentHead(Raw.Names(), Raw.Sequence(), Raw.Created(), CompressedVersion);
+		std::vector<double> Times;
+		std::vector<float> Rows;
+		bool Failed = false;
+		auto Write = [&]() {
+			if (!Failed && write(Fd, Out.data(), Out.size()) != (ssize_t)Out.size()) Failed = true;
+			Out.clear();
+		};
+		auto Flush = [&]() {
+			if (Times.empty()) return;
+			std::size_t Start = Out.size();
+			Out.resize(Start + sizeof(BlockHeader));
+			Compression::Encode(Out, How.GetMethod(), Tolerances.data(), Times.data(), Rows.data(), Times.size(), N);
+			BlockHeader B{ChunkMagic, (uint32_t)Times.size(), ~(uint32_t)Times.size(), Crc32C::Compute(Out.data() + Start + sizeof(BlockHeader), Out.size() - Start - sizeof(BlockHeader))};
+			std::memcpy(Out.data() + Start, &B, sizeof(B));
+			Times.clear();
+			Rows.clear();
+			if (Out.size() >= (1 << 20)) Write();
+		};
+		Raw.ForEach(-INFINITY, INFINITY, [&](double Time, float const *Values) {
+			//A chunk's samples must be in order (the wall clock can be set back) and fit its 32-bit offsets
+			if (!Times.empty() && (Times.size() == CompactSamples || Time < Times.back() || Time - Times.front() >= Compression::MaxChunkSpan)) Flush();
+			Times.push_back(Time);
+			Rows.insert(Rows.end(), Values, Values + N);
+		});
+		Flush();
+		Write();
+		if (Failed || fdatasync(Fd) != 0 || (Stop != nullptr && *Stop)) {
+			if (Failed) Error = Temp + ": " + strerror(errno);
+			close(Fd);
+			unlink(Temp.c_str());
+			return false;
+		}
+		close(Fd);
+		if (rename(Temp.c_str(), Path.c_str()) != 0) {
+			Error = Path + ": " + strerror(errno);
+			unlink(Temp.c_str());
+			return false;
+		}
+		SyncDirectoryOf(Path);
+		return true;
+	}
+
+	class Writer {
+	public:
+		struct Limits {
+			std::size_t BatchRecords = 256;          ///<Commit once this many samples are waiting
+			double BatchAge = 30;                    ///<...or the oldest has waited this long (seconds)
+			std::size_t SegmentBytes = 64 << 20;     ///<Start a new segment before exceeding this
+			double SegmentAge = 86400;               ///<...or once the current one is this old (seconds)
+			bool Sync = true;                        ///<fdatasync after each commit
+		};
+	private:
+		Limits m_Limits;
+		std::string m_Dir;
+		std::vector<std::string> m_Names;
+		std::size_t m_RecordSize = 0;
+		int m_Fd = -1;
+		int m_LockFd = -1;                           ///<flock'ed DIR/LOCK
+		uint64_t m_Sequence = 0;
+		double m_Created = 0;
+		std::size_t m_Size = 0;                      ///<Of the current segment
+		std::vector<unsigned char> m_Batch;          ///<Preallocated; BatchRecords records
+		std::size_t m_Batched = 0;
+		double m_BatchStart = 0;                     ///<Wall-clock time of the oldest batched sample
+		uint64_t m_Committed = 0;
+		Compression::Settings m_Compression;
+		std::thread m_Compactor;
+		std::atomic<bool> m_Compacting{false};
+		std::atomic<bool> m_Stop{false};
+
+		static double WallNow() {
+			timespec T;
+			clock_gettime(CLOCK_REALTIME, &T);
+			return T.tv_sec + T.tv_nsec / 1e9;
+		}
+
+		void CloseSegment() {
+			if (m_Fd >= 0) close(m_Fd);
+			m_Fd = -1;
+		}
+
+		bool NewSegment() {
+			CloseSegment();
+			m_Sequence++;
+			std::string Path = SegmentPath(m_Dir, m_Sequence);
+			m_Created = WallNow();
+			std::vector<unsigned char> Head = SegmentHead(m_Names, m_Sequence, m_Created);
+			m_Fd = open(Path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+			if (m_Fd < 0 || write(m_Fd, Head.data(), Head.size()) != (ssize_t)Head.size() || (m_Limits.Sync && fdatasync(m_Fd) != 0)) {
+				std::cerr << "Cannot create " << Path << ": " << strerror(errno) << "\n";
+				CloseSegment();
+				return false;
+			}
+			if (m_Limits.Sync) SyncDirectoryOf(Path);
+			m_Size = Head.size();
+			return true;
+		}
+
+		/** @brief Continue the newest segment if it matches, cutting off anything after its last intact block */
+		bool Resume(uint64_t Sequence) {
+			std::string Path = SegmentPath(m_Dir, Sequence);
+			Segment Last;
+			std::string Error;
+			if (!Last.Open(Path, Error)) {
+				//A crash while creating it: nothing in it was ever committed
+				std::cerr << "Discarding " << Error << "\n";
+				unlink(Path.c_str());
+				return false;
+			}
+			if (Last.Compressed() || Last.Names() != m_Names || WallNow() - Last.Created() >= m_Limits.SegmentAge || Last.Size() >= m_Limits.SegmentBytes)
+				return false;
+			m_Fd = open(Path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+			if (m_Fd < 0) return false;
+			struct stat St;
+			if (fstat(m_Fd, &St) == 0 && (std::size_t)St.st_size != Last.Size()) {
+				std::cerr << Path << ": discarding " << St.st_size - Last.Size() << " bytes after the last intact block\n";
+				if (ftruncate(m_Fd, Last.Size()) != 0) {
+					CloseSegment();
+					return false;
+				}
+			}
+			m_Created = Last.Created();
+			m_Size = Last.Size();
+			return true;
+		}
+
+		/** @brief Compress the segments before the current one, on a worker thread */
+		void CompactOlder() {
+			if (!m_Compression.Enabled() || m_Compacting) return;
+			if (m_Compactor.joinable()) m_Compactor.join();
+			m_Compacting = true;
+			m_Compactor = std::thread([this, Dir = m_Dir, Before = m_Sequence, How = m_Compression]{
+				for (uint64_t Sequence : ListSegments(Dir)) {
+					if (Sequence >= Before || m_Stop) break;
+					std::string Error;
+					if (!Compact(SegmentPath(Dir, Sequence), How, Error, &m_Stop) && !Error.empty())
+						std::cerr << "Cannot compress " << Error << "\n";
+				}
+				m_Compacting = false;
+			});
+		}
+	public:
+		Writer() : Writer(Limits()) {}
+		explicit Writer(Limits L) : m_Limits(L) {}
+		~Writer() {
+			Commit();
+			CloseSegment();
+			m_Stop = true;
+			if (m_Compactor.joinable()) m_Compactor.join();
+			if (m_LockFd >= 0) close(m_LockFd);
+		}
+		Writer(Writer const &) = delete;
+		Writer &operator=(Writer const &) = delete;
+
+		/** @brief Compress finished segments (call before Open()) */
+		void SetCompression(Compression::Settings const &How) {
+			m_Compression = How;
+		}
+
+		/** @brief Log samples of Names to Dir (created if missing), continuing its newest segment if possible
+		 * @returns false (with a message) if Dir can't be used, or another Writer is logging to it
+		 */
+		bool Open(std::string const &Dir, std::vector<std::string> const &Names) {
+			CloseSegment();
+			if (m_LockFd >= 0 && Dir != m_Dir) {
+				if (m_Compactor.joinable()) m_Compactor.join();   //It is still working on the old directory
+				close(m_LockFd);
+				m_LockFd = -1;
+			}
+			m_Dir = Dir;
+			m_Names = Names;
+			m_RecordSize = RecordSize(Names.size());
+			m_Limits.BatchRecords = std::max<std::size_t>(m_Limits.BatchRecords, 1);
+			m_Batch.assign(m_Limits.BatchRecords * m_RecordSize, 0);
+			m_Batched = 0;
+			if (mkdir(Dir.c_str(), 0755) != 0 && errno != EEXIST) {
+				std::cerr << "Cannot create " << Dir << ": " << strerror(errno) << "\n";
+				return false;
+			}
+			if (m_LockFd < 0) {
+				//Resume() would cut off another writer's block in progress and CompactOlder() unlink its segment
+				std::string LockPath = Dir + "/LOCK";
+				m_LockFd = open(LockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+				if (m_LockFd < 0 || flock(m_LockFd, LOCK_EX | LOCK_NB) != 0) {
+					if (m_LockFd >= 0 && errno == EWOULDBLOCK) std::cerr << "Another process is already logging to " << Dir << "\n";
+					else std::cerr << "Cannot lock " << LockPath << ": " << strerror(errno) << "\n";
+					if (m_LockFd >= 0) close(m_LockFd);
+					m_LockFd = -1;
+					return false;
+				}
+			}
+			std::vector<uint64_t> Existing = ListSegments(Dir);
+			m_Sequence = Existing.empty() ? 0 : Existing.back();
+			bool Opened = (!Existing.empty() && Resume(Existing.back())) || NewSegment();
+			if (Opened) CompactOlder();
+			return Opened;
+		}
+		bool IsOpen() const {
+			return m_Fd >= 0;
+		}
+		std::string const &Directory() const {
+			return m_Dir;
+		}
+
+		/** @brief Queue a sample of every sensor (Values indexed like the names given to Open()) */
+		void Append(double Time, float const *Values) {
+			if (m_Batch.empty()) return;
+			unsigned char *Record = m_Batch.data() + m_Batched * m_RecordSize;
+			std::memcpy(Record, &Time, 8);
+			std::memcpy(Record + 8, Values, 4 * m_Names.size());
+			if (m_Batched++ == 0) m_BatchStart = WallNow();
+			if (m_Batched == m_Limits.BatchRecords) Commit();
+		}
+		void Append(double Time, std::vector<float> const &Values) {
+			Append(Time, Values.data());
+		}
+
+		/** @brief Commit if the oldest queued sample has waited Limits::BatchAge (call periodically) */
+		void CommitIfDue() {
+			if (m_Batched != 0 && WallNow() - m_BatchStart >= m_Limits.BatchAge) Commit();
+		}
+
+		/** @brief Write the queued samples as one block and sync it
+		 * @returns false if they couldn't be written (they are dropped)
+		 */
+		bool Commit() {
+			if (m_Batched == 0) return true;
+			std::size_t Bytes = m_Batched * m_RecordSize;
+			if (m_Fd < 0 || m_Size + sizeof(BlockHeader) + Bytes > m_Limits.SegmentBytes || WallNow() - m_Created >= m_Limits.SegmentAge) {
+				if (!NewSegment()) {
+					m_Batched = 0;
+					return false;
+				}
+				CompactOlder();
+			}
+			BlockHeader B{BlockMagic, (uint32_t)m_Batched, ~(uint32_t)m_Batched, Crc32C::Compute(m_Batch.data(), Bytes)};
+			iovec Parts[2] = {{&B, sizeof(B)}, {m_Batch.data(), Bytes}};
+			ssize_t Written = writev(m_Fd, Parts, 2);
+			m_Batched = 0;
+			if (Written != (ssize_t)(sizeof(B) + Bytes) || (m_Limits.Sync && fdatasync(m_Fd) != 0)) {
+				std::cerr << "Cannot write to " << SegmentPath(m_Dir, m_Sequence) << ": " << strerror(errno) << "\n";
+				if (Written > 0 && ftruncate(m_Fd, m_Size) != 0) CloseSegment();
+				return false;
+			}
+			m_Size += Written;
+			m_Committed++;
+			return true;
+		}
+
+		/** @brief Number of blocks committed since Open() */
+		uint64_t Commits() const {
+			return m_Committed;
+		}
+	};
+}
+
+#endif //HISTORY_SAMPLELOG_HPP_
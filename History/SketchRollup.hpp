@@ -0,0 +1,100 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sketch Rollup
+	A quantile sketch per sensor for every BucketSeconds (an
+	    hour by default) of the last Buckets periods, plus one
+	    per sensor since the start.  Percentiles over a range
+	    are answered by merging the buckets it covers, without
+	    going back to the samples.
+
+	Buckets are kept in a ring indexed by period number, so
+	    samples may arrive out of order (e.g. history restored
+	    from the log); ones older than the ring are only
+	    counted in the totals.
+****************************************************************/
+#ifndef HISTORY_SKETCHROLLUP_HPP_
+#define HISTORY_SKETCHROLLUP_HPP_
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "QuantileSketch.hpp"
+
+class SketchRollup {
+private:
+	std::size_t m_Sensors = 0;
+	double m_BucketSeconds = 3600;
+	std::vector<int64_t> m_Periods;          ///<[Slot] period held by each slot (-1: none)
+	std::vector<QuantileSketch> m_Buckets;   ///<[Slot * Sensors + Sensor]
+	std::vector<QuantileSketch> m_Totals;    ///<[Sensor]
+public:
+	SketchRollup() = default;
+	SketchRollup(std::size_t Sensors, double BucketSeconds = 3600, std::size_t Buckets = 168) {
+		Reset(Sensors, BucketSeconds, Buckets);
+	}
+	void Reset(std::size_t Sensors, double BucketSeconds = 3600, std::size_t Buckets = 168) {
+		m_Sensors = Sensors;
+		m_BucketSeconds = BucketSeconds;
+		m_Periods.assign(std::max<std::size_t>(Buckets, 1), -1);
+		m_Buckets.assign(m_Periods.size() * Sensors, QuantileSketch());
+		m_Totals.assign(Sensors, QuantileSketch());
+	}
+
+	/** @brief Count a sample of every sensor (NaN values are skipped) */
+	void Add(double Time, float const *Values) {
+		for (std::size_t s = 0; s != m_Sensors; s++) m_Totals[s].Add(Values[s]);
+		int64_t Period = (int64_t)std::floor(Time / m_BucketSeconds);
+		std::size_t Slot = (std::size_t)(Period % (int64_t)m_Periods.size());
+		if (Period > m_Periods[Slot]) {
+			m_Periods[Slot] = Period;
+			for (std::size_t s = 0; s != m_Sensors; s++) m_Buckets[Slot * m_Sensors + s].Clear();
+		}
+		else if (Period < m_Periods[Slot]) return;
+		for (std::size_t s = 0; s != m_Sensors; s++) m_Buckets[Slot * m_Sensors + s].Add(Values[s]);
+	}
+	void Add(double Time, std::vector<float> const &Values) {
+		if (Values.size() >= m_Sensors) Add(Time, Values.data());
+	}
+
+	/** @brief Merge the buckets of Sensor overlapping [From, To] into Out
+	 * @returns The number of buckets merged
+	 */
+	std::size_t Merge(std::size_t Sensor, double From, double To, QuantileSketch &Out) const {
+		std::size_t N = 0;
+		int64_t First = (int64_t)std::floor(From / m_BucketSeconds), Last = (int64_t)std::floor(To / m_BucketSeconds);
+		for (std::size_t Slot = 0; Slot != m_Periods.size(); Slot++) {
+			if (m_Periods[Slot] < 0 || m_Periods[Slot] < First || m_Periods[Slot] > Last) continue;
+			Out.Merge(m_Buckets[Slot * m_Sensors + Sensor]);
+			N++;
+		}
+		return N;
+	}
+
+	/** @brief Everything counted for Sensor since the start */
+	QuantileSketch const &Total(std::size_t Sensor) const {
+		return m_Totals[Sensor];
+	}
+	std::size_t Sensors() const {
+		return m_Sensors;
+	}
+	double BucketSeconds() const {
+		return m_BucketSeconds;
+	}
+};
+
+#endif //HISTORY_SKETCHROLLUP_HPP_
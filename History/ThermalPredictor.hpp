@@ -0,0 +1,188 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Thermal Predictor
+	Fits a first-order thermal model to one sensor: the
+	    temperature approaches a steady value exponentially,
+
+	        dT/dt = (Asymptote - T) / TimeConstant
+
+	    which, averaged over steps of Step seconds, is the linear
+	    recurrence
+
+	        T[k] = A T[k-1] + C,  A = exp(-Step / TimeConstant),
+	                              Asymptote = C / (1 - A)
+
+	A and C are fitted by recursive least squares with
+	    exponential forgetting (Memory seconds), so each sample
+	    costs the same no matter how long it has been running, and
+	    the model follows changes of load.  Averaging over a step
+	    (at least 10 seconds) keeps sensor noise and quantization
+	    from swamping the change between steps.  A change of load
+	    is a new model, though, and the old one has a lot of
+	    samples behind it: when the predictions keep missing on
+	    the same side, the covariance is reset so that the fit
+	    starts over from the recent steps.
+
+	The model is only trusted (Valid) once the temperature has
+	    moved enough for A to be told from 1; until then, and when
+	    the sensor is not settling (e.g. it keeps heating faster),
+	    the time to a threshold is extrapolated from the change
+	    over the last step.
+****************************************************************/
+#ifndef HISTORY_THERMALPREDICTOR_HPP_
+#define HISTORY_THERMALPREDICTOR_HPP_
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+class ThermalPredictor {
+public:
+	static constexpr double DefaultMemory = 600;
+	static constexpr double MinStep = 10;
+private:
+	static constexpr double InitialCovariance = 1e4;
+	static constexpr double MaxCovariance = 1e8;   ///<Stop forgetting when nothing is being learnt (covariance windup)
+	static constexpr unsigned MinSteps = 6;
+	static constexpr unsigned MaxMisses = 3;       ///<Predictions off by over 3 sigma on the same side in a row: the load changed
+	double m_Memory;
+	double m_Step = 0;             ///<Seconds per step (0: not known until the second sample)
+	double m_First = NAN;          ///<Time of the first sample; steps are counted from it
+	double m_Last = NAN;           ///<Time of the newest sample
+	int64_t m_Index = -1;          ///<Step being accumulated
+	double m_Sum = 0;
+	unsigned m_Samples = 0;
+	double m_Previous = NAN;       ///<Mean of the step before m_Index (NaN: it had no samples)
+	double m_Slope = NAN;          ///<Degrees/second between the last two steps
+	double m_Reference = NAN;      ///<First mean; the fit is in T - m_Reference for conditioning
+	double m_Theta[2] = {0, 0};    ///<T[k] - m_Reference = Theta[0] + Theta[1] * (T[k-1] - m_Reference)
+	double m_P[3] = {InitialCovariance, 0, InitialCovariance};  ///<Symmetric covariance: P00, P01, P11
+	double m_Residual = 0;         ///<Exponentially weighted squared prediction error
+	unsigned m_Errors = 0;         ///<Errors averaged into m_Residual
+	int m_Misses = 0;              ///<Signed count of consecutive large errors
+	unsigned m_Since = 0;          ///<Steps fitted since the covariance was last reset
+	uint64_t m_Count = 0;
+
+	/** @brief Fit one step of the recurrence */
+	void Fit(double Previous, double Mean) {
+		if (std::isnan(m_Reference)) m_Reference = Previous;
+		double Lambda = std::exp(-m_Step / m_Memory);
+		double X = Previous - m_Reference;
+		double Error = (Mean - m_Reference) - (m_Theta[0] + m_Theta[1] * X);
+		if (m_Since >= MinSteps && Error * Error > 9 * m_Residual) {
+			m_Misses = (Error > 0) ? std::max(m_Misses, 0) + 1 : std::min(m_Misses, 0) - 1;
+			if ((unsigned)std::abs(m_Misses) >= MaxMisses) {
+				m_P[0] = m_P[2] = InitialCovariance;
+				m_P[1] = 0;
+				m_Misses = 0;
+				m_Since = 0;
+			}
+		}
+		else m_Misses = 0;
+		//Gain K = P phi / (lambda + phi' P phi) with phi = (1, X)
+		double P0 = m_P[0] + m_P[1] * X, P1 = m_P[1] + m_P[2] * X;
+		double Denominator = Lambda + P0 + P1 * X;
+		double K0 = P0 / Denominator, K1 = P1 / Denominator;
+		m_Theta[0] += K0 * Error;
+		m_Theta[1] += K1 * Error;
+		double Forget = (m_P[0] + m_P[2] < MaxCovariance) ? 1 / Lambda : 1;
+		m_P[0] = (m_P[0] - K0 * P0) * Forget;
+		m_P[1] = (m_P[1] - K0 * P1) * Forget;
+		m_P[2] = (m_P[2] - K1 * P1) * Forget;
+		//Only the errors of a fit to two steps or more count: before that they measure the initial guess, not
+		//the noise.  The first ones are averaged evenly, so no single one sets the level for the next Memory
+		//seconds; after that they are clipped, so that the jump of a change of load doesn't hide the misses
+		//that follow it
+		if (m_Since >= 2) {
+			double Weight = std::max(1 - Lambda, 1.0 / ++m_Errors);
+			double Squared = (m_Errors > MinSteps) ? std::min(Error * Error, 9 * m_Residual) : Error * Error;
+			m_Residual += Weight * (Squared - m_Residual);
+		}
+		m_Count++;
+		m_Since++;
+	}
+	double Asymptote(double A) const {
+		return m_Reference + m_Theta[0] / (1 - A);
+	}
+public:
+	/** @param Memory  Seconds over which old samples are forgotten */
+	ThermalPredictor(double Memory = DefaultMemory) : m_Memory(Memory > 0 ? Memory : DefaultMemory) {}
+
+	/** @brief Add a reading (NaN values are skipped); a time earlier than the last one starts over */
+	void Add(double Time, double Value) {
+		if (std::isnan(Value)) return;
+		if (!std::isnan(m_Last) && Time < m_Last) Clear();
+		if (std::isnan(m_First)) m_First = Time;
+		else if (m_Step == 0) {
+			//Steps span at least a sample interval and a half, so that consecutive steps have samples
+			if (Time == m_First) return;
+			m_Step = std::max(MinStep, 1.5 * (Time - m_First));
+		}
+		m_Last = Time;
+		int64_t Index = (m_Step > 0) ? (int64_t)((Time - m_First) / m_Step) : 0;
+		if (Index != m_Index) {
+			double Mean = (m_Samples > 0) ? m_Sum / m_Samples : NAN;
+			if (Index == m_Index + 1 && !std::isnan(m_Previous) && !std::isnan(Mean)) {
+				Fit(m_Previous, Mean);
+				m_Slope = (Mean - m_Previous) / m_Step;
+			}
+			else m_Slope = NAN;
+			m_Previous = (Index == m_Index + 1) ? Mean : NAN;   //After a gap there is no step to fit
+			m_Index = Index;
+			m_Sum = 0;
+			m_Samples = 0;
+		}
+		m_Sum += Value;
+		m_Samples++;
+	}
+	void Clear() {
+		*this = ThermalPredictor(m_Memory);
+	}
+
+	/** @brief Whether the fit describes a temperature settling towards Asymptote (with some confidence) */
+	bool Valid() const {
+		if (m_Since < MinSteps || !(m_Theta[1] > 0 && m_Theta[1] < 1)) return false;
+		return (1 - m_Theta[1]) * (1 - m_Theta[1]) > 4 * m_Residual * m_P[2];
+	}
+	/** @brief The temperature the sensor is settling towards (NaN unless Valid) */
+	double Asymptote() const {
+		return Valid() ? Asymptote(m_Theta[1]) : NAN;
+	}
+	/** @brief Seconds to cover 63% of the way to Asymptote (NaN unless Valid) */
+	double TimeConstant() const {
+		return Valid() ? -m_Step / std::log(m_Theta[1]) : NAN;
+	}
+
+	/** @brief Predicted seconds until the temperature reaches Threshold
+	 * @param Level  Current (e.g. smoothed) temperature
+	 * @returns 0 if it already has, INFINITY if it is not expected to (or nothing is known)
+	 */
+	double TimeTo(double Threshold, double Level) const {
+		if (std::isnan(Level) || std::isnan(Threshold)) return INFINITY;
+		if (Level >= Threshold) return 0;
+		if (Valid()) {
+			double Target = Asymptote(m_Theta[1]);
+			if (Target <= Threshold) return INFINITY;
+			return TimeConstant() * std::log((Target - Level) / (Target - Threshold));
+		}
+		return (m_Slope > 0) ? (Threshold - Level) / m_Slope : INFINITY;
+	}
+	uint64_t Count() const { return m_Count; }
+};
+
+#endif //HISTORY_THERMALPREDICTOR_HPP_
@@ -0,0 +1,68 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Warm Start
+	Restores the recent past from a sample log (--log) when a
+	    front end starts, so that graphs and history aren't
+	    empty until enough new samples arrive.
+
+	The log is read on a worker thread (only the newest
+	    segments are mapped) and the result is handed to
+	    OnLoaded on the event loop thread, so the first frame
+	    doesn't wait for the disk.
+****************************************************************/
+#ifndef HISTORY_WARMSTART_HPP_
+#define HISTORY_WARMSTART_HPP_
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "HistoryStore.hpp"
+#include "SampleLog.hpp"
+#include "../Core/EventLoop.hpp"
+
+class WarmStart {
+public:
+	using Callback = std::function<void(SampleLog::Tail &Loaded)>;
+private:
+	std::thread m_Worker;
+	std::shared_ptr<char> m_Alive = std::make_shared<char>(); ///<Posted results are dropped once we're gone
+public:
+	/** @brief Start reading the samples of Names from the last Seconds of the log in Dir */
+	WarmStart(EventLoop &Loop, std::string Dir, std::vector<std::string> Names, double Seconds, Callback OnLoaded) {
+		std::weak_ptr<char> Alive = m_Alive;
+		m_Worker = std::thread([&Loop, Dir, Names, Seconds, OnLoaded, Alive]{
+			auto Start = std::chrono::steady_clock::now();
+			auto Loaded = std::make_shared<SampleLog::Tail>(SampleLog::ReadTail(Dir, Names, HistoryStore::Now() - Seconds));
+			double Took = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+			if (Took > 1) std::cerr << "Restoring history from " << Dir << " took " << Took << " s\n";
+			Loop.Post([Loaded, OnLoaded, Alive]{
+				if (!Alive.expired() && !Loaded->Times.empty()) OnLoaded(*Loaded);
+			});
+		});
+	}
+	~WarmStart() {
+		m_Alive.reset();
+		if (m_Worker.joinable()) m_Worker.join();
+	}
+	WarmStart(WarmStart const &) = delete;
+	WarmStart &operator=(WarmStart const &) = delete;
+};
+
+#endif //HISTORY_WARMSTART_HPP_
@@ -0,0 +1,256 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Record Stream
+	Streams one record per sampling tick to stdout or a file,
+	    for log shippers and other pipelines:
+	     -jsonl: {"time":T,"temperatures":{"NAME":V,...},
+	          "alerts":{"NAME":"warning",...}}
+	          (unreadable sensors are null; only sensors not in
+	          the normal state are listed under alerts)
+	     -csv:   a header row (time,NAME,...) and then a row of
+	          temperatures per tick (unreadable sensors empty)
+	    Time is in seconds since the epoch.
+
+	Records are formatted with std::to_chars into a reused
+	    buffer and written in batches (when BatchBytes are
+	    pending, or by Flush() from a timer).  Writes never block:
+	    if the reader stops reading, records queue up to
+	    MaxPending bytes and any more are dropped (and counted)
+	    rather than stalling sampling.  An --output-file is opened
+	    O_NONBLOCK; stdout's flags are shared with the parent
+	    shell and anything else holding it, so they are left
+	    alone and it is written with send(MSG_DONTWAIT) if it is
+	    a socket, or in PIPE_BUF chunks once poll() reports room.
+****************************************************************/
+#ifndef OUTPUT_RECORDSTREAM_HPP_
+#define OUTPUT_RECORDSTREAM_HPP_
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "../Alerts/AlertState.hpp"
+
+class RecordStream {
+public:
+	enum class Format {
+		JSONLines,
+		CSV
+	};
+	struct Limits {
+		std::size_t BatchBytes = 64 * 1024;       ///<Write once this much is pending
+		std::size_t MaxPending = 4 * 1024 * 1024; ///<Drop records beyond this
+	};
+
+	/** @brief Parse a --output argument ("jsonl" or "csv") */
+	static bool ParseFormat(std::string const &Text, Format &Out) {
+		if (Text == "jsonl" || Text == "json") Out = Format::JSONLines;
+		else if (Text == "csv") Out = Format::CSV;
+		else return false;
+		return true;
+	}
+private:
+	Format m_Format;
+	Limits m_Limits;
+	int m_Fd = -1;
+	bool m_OwnFd = false;
+	bool m_Socket = false;                ///<Shared stdout is a socket
+	std::vector<std::string> m_Keys;      ///<"NAME": (JSON) or ,NAME (CSV), built once
+	std::string m_Pending;                ///<Formatted but not yet written
+	std::size_t m_Start = 0;              ///<Offset of the first unwritten byte of m_Pending
+	uint64_t m_Dropped = 0;
+	bool m_Stalled = false;
+	bool m_Broken = false;
+
+	void Put(double Value) {
+		char Buffer[32];
+		m_Pending.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Value).ptr);
+	}
+	void Put(float Value) {
+		char Buffer[32];
+		m_Pending.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Value).ptr);
+	}
+	void PutTime(double Time) {
+		char Buffer[32];
+		m_Pending.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Time, std::chars_format::fixed, 3).ptr);
+	}
+
+	/** @brief write() what m_Fd takes without blocking (-1 with EAGAIN if it takes nothing) */
+	ssize_t WriteSome(char const *Data, std::size_t Size) {
+		if (m_OwnFd) return write(m_Fd, Data, Size);
+		if (m_Socket) return send(m_Fd, Data, Size, MSG_DONTWAIT);
+		//A pipe, terminal or file: POLLOUT means at least PIPE_BUF bytes fit in a pipe
+		pollfd P = {m_Fd, POLLOUT, 0};
+		int Ready = poll(&P, 1, 0);
+		if (Ready < 0) return -1;
+		if (Ready == 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+		return write(m_Fd, Data, std::min<std::size_t>(Size, PIPE_BUF));
+	}
+
+	static std::string Quote(std::string const &Text, Format F) {
+		std::string Out = "\"";
+		for (char c : Text) {
+			if (F == Format::CSV) {
+				if (c == '"') Out += '"';
+				Out += c;
+			}
+			else if (c == '"' || c == '\\') { Out += '\\'; Out += c; }
+			else if ((unsigned char)c < 0x20) {
+				char Buffer[8];
+				snprintf(Buffer, sizeof(Buffer), "\\u%04x", (unsigned)c);
+				Out += Buffer;
+			}
+			else Out += c;
+		}
+		return Out + "\"";
+	}
+public:
+	explicit RecordStream(Format F) : m_Format(F) {}
+	RecordStream(Format F, Limits L) : m_Format(F), m_Limits(L) {}
+	~RecordStream() {
+		Finish();
+	}
+	RecordStream(RecordStream const &) = delete;
+	RecordStream &operator=(RecordStream const &) = delete;
+
+	/** @brief Write to Path ("" or "-" for stdout; files are appended to) */
+	bool Open(std::string const &Path, std::vector<std::string> const &Names) {
+		if (Path.empty() || Path == "-") {
+			m_Fd = STDOUT_FILENO;
+			struct stat Info;
+			m_Socket = fstat(m_Fd, &Info) == 0 && S_ISSOCK(Info.st_mode);
+		}
+		else {
+			m_Fd = open(Path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+			if (m_Fd < 0) {
+				std::cerr << "Cannot open " << Path << " for output: " << strerror(errno) << "\n";
+				return false;
+			}
+			m_OwnFd = true;
+		}
+		m_Keys.clear();
+		for (auto const &Name : Names)
+			m_Keys.push_back(m_Format == Format::CSV ? "," + Quote(Name, Format::CSV) : Quote(Name, Format::JSONLines) + ":");
+		m_Pending.reserve(m_Limits.BatchBytes * 2);
+		if (m_Format == Format::CSV) {
+			m_Pending += "time";
+			for (auto const &Key : m_Keys) m_Pending += Key;
+			m_Pending += '\n';
+		}
+		return true;
+	}
+
+	/** @brief Queue one record (arrays indexed like the sensor names) */
+	void Write(double Time, float const *Values, uint8_t const *Levels) {
+		if (m_Fd < 0 || m_Broken) return;
+		if (m_Pending.size() - m_Start >= m_Limits.MaxPending) {
+			if (m_Dropped++ == 0) std::cerr << "Output is not being read; dropping records\n";
+			return;
+		}
+		if (m_Format == Format::CSV) {
+			PutTime(Time);
+			for (std::size_t i = 0; i != m_Keys.size(); i++) {
+				m_Pending += ',';
+				if (!std::isnan(Values[i])) Put(Values[i]);
+			}
+			m_Pending += '\n';
+		}
+		else {
+			m_Pending += "{\"time\":";
+			PutTime(Time);
+			m_Pending += ",\"temperatures\":{";
+			for (std::size_t i = 0; i != m_Keys.size(); i++) {
+				if (i != 0) m_Pending += ',';
+				m_Pending += m_Keys[i];
+				if (std::isnan(Values[i])) m_Pending += "null";
+				else Put(Values[i]);
+			}
+			m_Pending += "},\"alerts\":{";
+			bool First = true;
+			for (std::size_t i = 0; i != m_Keys.size(); i++) {
+				if (Levels == nullptr || Levels[i] == (uint8_t)AlertLevel::Normal) continue;
+				if (!First) m_Pending += ',';
+				First = false;
+				m_Pending += m_Keys[i];
+				m_Pending += '"';
+				m_Pending += AlertLevelName((AlertLevel)Levels[i]);
+				m_Pending += '"';
+			}
+			m_Pending += "}}\n";
+		}
+		if (m_Pending.size() - m_Start >= m_Limits.BatchBytes) Flush();
+	}
+
+	/** @brief Write whatever is pending without blocking */
+	void Flush() {
+		while (m_Fd >= 0 && !m_Broken && m_Start != m_Pending.size()) {
+			ssize_t N = WriteSome(m_Pending.data() + m_Start, m_Pending.size() - m_Start);
+			if (N > 0) {
+				m_Start += N;
+				continue;
+			}
+			if (N < 0 && errno == EINTR) continue;
+			if (N < 0 && errno == EAGAIN) {
+				if (!m_Stalled) std::cerr << "Output is stalled; queueing records\n";
+				m_Stalled = true;
+				return;
+			}
+			std::cerr << "Cannot write output: " << strerror(errno) << "; output stopped\n";
+			m_Broken = true;
+		}
+		if (m_Stalled && m_Start == m_Pending.size()) {
+			if (m_Dropped > 0) std::cerr << "Output resumed (" << m_Dropped << " records dropped)\n";
+			m_Stalled = false;
+			m_Dropped = 0;
+		}
+		//Keep the buffer's capacity; only move the unwritten tail down
+		m_Pending.erase(0, m_Start);
+		m_Start = 0;
+	}
+
+	/** @brief Flush (waiting up to a second for a slow reader) and release the descriptor */
+	void Finish() {
+		if (m_Fd < 0) return;
+		for (int Tries = 0; Tries < 10 && !m_Broken && m_Start != m_Pending.size(); Tries++) {
+			Flush();
+			pollfd P = {m_Fd, POLLOUT, 0};
+			if (m_Start != m_Pending.size()) poll(&P, 1, 100);
+		}
+		if (m_OwnFd) close(m_Fd);
+		m_Fd = -1;
+	}
+
+	uint64_t Dropped() const {
+		return m_Dropped;
+	}
+};
+
+#endif //OUTPUT_RECORDSTREAM_HPP_
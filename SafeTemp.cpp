@@ -22,7 +22,6 @@ KNOWN BUGS:
 	-In the User Interface, backspace does not work when 
 		editing "commands"
 	-In the User Interface, the cursor position is not steady
-	-The Estimated Maximum Temperatures make no sense
 	-This program WILL RUN OUT OF MEMORY EVENTUALLY WHEN USING
 				THE GUI.  The graphical interfaces store the
 				temperatures from the start of the program.  
@@ -51,6 +50,7 @@ PLANNED UPDATES:
 #include <string>
 #include <vector>
 #include <cmath>
+#include <csignal>
 #include <ctime>
 #include <memory>
 #include <stdexcept>
@@ -63,10 +63,33 @@ PLANNED UPDATES:
 #include <nvml.h>
 #endif
 
+#if HAVE_LIBNCURSES == 1
 #include "UserInterface/Manager.hpp"
 #include "UserInterface/UI.hpp"
+#endif
 #include "UserInterface/GTKInterface.hpp"
 #include "Sensors/SensorClass.hpp"
+#include "Sensors/SocketSensor.hpp"
+#include "Sensors/ReplaySensor.hpp"
+#include "Sensors/SyntheticSensor.hpp"
+#include "Core/EventLoop.hpp"
+#include "Alerts/CommandExecutor.hpp"
+#include "Alerts/Actions.hpp"
+#include "Alerts/AlertState.hpp"
+#include "Alerts/RuleEngine.hpp"
+#include "Alerts/ThresholdTable.hpp"
+#include "Alerts/AlertConfig.hpp"
+#include "Config/ConfigFile.hpp"
+#include "Config/ConfigWatcher.hpp"
+#include "History/HistoryStore.hpp"
+#include "History/SampleLog.hpp"
+#include "History/WarmStart.hpp"
+#include "History/SketchRollup.hpp"
+#include "History/OnlineStats.hpp"
+#include "Server/SensorServer.hpp"
+#include "Server/SharedSnapshot.hpp"
+#include "Server/MetricsServer.hpp"
+#include "Output/RecordStream.hpp"
 using namespace std;
 
 /****************************************************************
@@ -74,17 +97,49 @@ Global Variables:
 	-TimeStep: amount of time (in microseconds) between 
 		temperature readings
 	-StartTime: the system time that the program started at
-	-MaxTemps: Critical Temperatures that trigger a warning
-	-MinTemp: the minimum of MaxTemps
+	-Thresholds: Critical Temperatures that trigger a warning
+		(by sensor name, glob or position)
 	-File: config file for lm_sensors
 	-Temp: file of critical temperatures (non-UI mode)
-	-Prog: file for running a program (i.e. a command)
+	-TempFile: its path, so that it can be reloaded
 	-run: whether the program runs in a loop
 	-PrtTmp: whether to print temperatures on-screen
-	-Stats: whether to calculate statistics (not reliable)
+	-Stats: whether to print each sensor's smoothed temperature,
+		spread and trend (History/OnlineStats.hpp)
 	-Command: the actual command text to be run when 
 		temperature threshold is exceeded
 	-UseUI: whether to use the EXPERIMENTAL user interface
+	-Alert: hysteresis/debounce/re-arm/prediction settings for
+		alerts
+	-RulesFile: file of windowed alert rules (Alerts/RuleEngine.hpp)
+	-SysfsRoot: directory used in place of /sys by built-in
+		'@' actions (Alerts/Actions.hpp)
+	-ListenPath: Unix socket to serve readings and history on
+		(daemon mode; Server/SensorServer.hpp)
+	-ConnectPath: Unix socket of a daemon to read from instead
+		of the hardware (Sensors/SocketSensor.hpp)
+	-ReplayPath: sample log to play back instead of the hardware
+		(Sensors/ReplaySensor.hpp)
+	-ReplaySpeed: multiple of real time to play it (or the
+		synthetic sensors) back at (0: a sample per tick, as
+		fast as possible)
+	-Synthetic: sensors to generate instead of reading the
+		hardware, if UseSynthetic (Sensors/SyntheticSensor.hpp)
+	-ShmName: shared-memory segment to publish the latest
+		readings in (Server/SharedSnapshot.hpp)
+	-MetricsAddress: [HOST:]PORT to serve Prometheus metrics on
+		(Server/MetricsServer.hpp)
+	-OutputFormat: stream a record per tick as "jsonl" or "csv"
+		(Output/RecordStream.hpp)
+	-OutputFile: where to stream them (stdout if empty)
+	-LogDir: directory of the persistent sample log
+		(History/SampleLog.hpp)
+	-WarmStartMinutes: how much of the log to restore on start
+		(-1: the default for the front end, 0: none)
+	-LogCompression: how finished log segments are compressed,
+		and each sensor's tolerance (History/Compression.hpp)
+	-HistoryBudget: bytes of memory the history may use (0: no
+		limit; History/HistoryStore.hpp)
 	-helptext: the text to print with the -h option
 ****************************************************************/
 /*int TimeStep = 5000000;
@@ -104,36 +159,94 @@ bool UseUI = 0;
 bool UseGUI = 0;*/
 
 struct InputArguments {
-	vector<int> MaxTemps;
+	ThresholdTable Thresholds;
 	string Command = "";
 	string HomeDir = "";
 	time_t StartTime = time(NULL);
 	int TimeStep = 5000000;
-	int MinTemp;
 	FILE* File = NULL;
 	FILE* Temp = NULL;
-	FILE* Prog = NULL;
+	string TempFile = "";
 	bool run = 1;
 	bool PrtTmp = 0;
 	bool Stats = 0;
 	bool UseUI = 0;
 	bool UseGUI = 0;
 	bool Success = 0;
+	AlertPolicy Alert;
+	string RulesFile = "";
+	string SysfsRoot = "/sys";
+	string ListenPath = "";
+	string ConnectPath = "";
+	string ReplayPath = "";
+	double ReplaySpeed = 1;
+	bool UseSynthetic = 0;
+	synthetic_sensor::Settings Synthetic;
+	string ShmName = "";
+	string MetricsAddress = "";
+	string OutputFormat = "";
+	string OutputFile = "";
+	string LogDir = "";
+	int WarmStartMinutes = -1;
+	Compression::Settings LogCompression;
+	std::size_t HistoryBudget = 0;
 };
 
-const char* helptext = "tempsafe -p FILE -w TIME -i -v -f FILE -C SCRIPT \nsensors-checking program\nKevin Brooks, 2015\nUsage: \n-p\t\tPath to lm-sensors config file\n-w\t\ttime interval to wait between checks (seconds); default is 5 seconds\n-f\t\tLoad temperatures from a file\n-i\t\tDon't run, just print temperatures and exit (implies -v)\n-v\t\tVerbose output (print temperatures at each TIME interval)\n-C\t\texecute a shell script;\n\t\tSCRIPT path should be given in double-quotes.\n-UI\t\tEXPERIMENTAL: Start with User Interface (overrides -v, -c, -f, and -s)\n\t\tUser Interface reads a config file from ~/.config/TempSafe.cfg \n--use-gtk\tEXPERIMENTAL: Use GTK graphical interface\n\t\tReads config file from ~/.config/TempSafe_GUI.cfg\n-h\t\tPrint this help file\n\n";
+const char* helptext = "tempsafe -p FILE -w TIME -i -v -f FILE -C SCRIPT \nsensors-checking program\nKevin Brooks, 2015\nUsage: \n-p\t\tPath to lm-sensors config file\n-w\t\ttime interval to wait between checks (seconds); default is 5 seconds\n-f\t\tLoad temperatures from a file (NAME=TEMP or positional TEMP entries)\n-i\t\tDon't run, just print temperatures and exit (implies -v)\n-v\t\tVerbose output (print temperatures at each TIME interval)\n-s\t\tPrint each sensor's moving average, standard deviation and trend at each TIME interval\n-C\t\texecute a shell script, or a built-in action:\n\t\t@cpufreq KHZ|N%, @pwm HWMON/PWM VALUE, @freeze CGROUP\n\t\t(VALUE may be FROM:TO@SPAN to ramp over SPAN degrees above critical);\n\t\tSCRIPT path should be given in double-quotes.\n-UI\t\tEXPERIMENTAL: Start with User Interface (overrides -v, -c, -f, and -s)\n\t\tUser Interface reads a config file from ~/.config/TempSafe.cfg \n--use-gtk\tEXPERIMENTAL: Use GTK graphical interface\n\t\tReads config file from ~/.config/TempSafe_GUI.cfg\n--warn-band DEG\tWarn DEG degrees below the critical temperature (default 5)\n--hysteresis DEG\tDegrees below a threshold before an alert clears (default 2)\n--dwell SEC\tSeconds a new alert level must persist before it is entered (default 0)\n--rearm SEC\tSeconds after an alert clears before the command can run again (default 30)\n--predict SEC\tWarn when a sensor is predicted to reach its critical temperature within SEC seconds\n--sysfs-root DIR\tUse DIR instead of /sys for the built-in actions (@cpufreq, @pwm, @freeze)\n--rules FILE\tLoad windowed alert rules, e.g. 'avg(Core*, 5m) > 85 for 30 do \"cmd\"'\n--listen PATH\tRun as a daemon serving readings and history on the Unix socket PATH\n--connect PATH\tRead from the daemon at PATH instead of the hardware\n--replay DIR\tPlay back the --log in DIR instead of reading the hardware\n--replay-speed N\tPlay it (or --synthetic) back N times as fast as real time, or 'max' (default 1)\n--synthetic SPEC\tGenerate COUNT[,KEY=VALUE...] sensors instead of reading the hardware\n--shm NAME\tPublish the latest readings in the shared-memory segment NAME (e.g. /safetemp)\n--metrics [HOST:]PORT\tServe Prometheus metrics over HTTP (host defaults to 127.0.0.1)\n--output FORMAT\tStream a record per sample as jsonl or csv\n--output-file PATH\tStream to PATH instead of stdout\n--log DIR\tKeep every sample in an append-only log in DIR\n--warm-start MIN\tRestore MIN minutes of the --log history on start (0: none)\n--log-compress METHOD\tCompress finished --log segments by deadband or swinging-door\n--log-tolerance LIST\tError allowed by --log-compress: DEG and NAME=DEG entries (default 0.5)\n--history-budget SIZE\tKeep at most SIZE bytes (K, M or G) of history in memory, compressing and then\n\t\tsummarising older samples to stay within it\n-h\t\tPrint this help file\n\n";
 
 InputArguments ProcessArgs(int, char**);
+bool ParseSize(char const *Text, std::size_t &Out);
 bool ParseTemp(InputArguments &InArgs);
-bool ProcessTemp(int,double, InputArguments &InArgs);
-//double deriv(double,double,int);
-double avg(double, double);
-//double EstMaxTemp(vector<double>, vector<double>, vector<double>, vector<time_t>, time_t StartTime);
-//double EstMaxTime(vector<double>, vector<double>, vector<double>, vector<time_t>, time_t StartTime);
-bool ReadConfig(UserInterface*, unsigned int, InputArguments &InArgs);
-bool WriteConfig(UserInterface*, InputArguments &InArgs);
+bool ProcessTemp(SensorSnapshot const &Snapshot, std::vector<float> const &Criticals, std::vector<float> const *Eta, std::vector<std::string> const &Names, InputArguments &InArgs, AlertTracker &Alerts, AlertActions &Actions);
+void ProcessRules(RuleEngine &Rules, SensorSnapshot const &Snapshot, std::vector<float> const &Criticals, std::vector<std::string> const &Names, InputArguments const &InArgs, AlertActions &Actions);
+void PrintStats(SensorSnapshot const &Snapshot, SensorStats const &Stats, std::vector<float> const &Criticals, std::vector<std::string> const &Names);
+void PrintHistoryUsage(HistoryStore const &History);
+void ApplyAlertConfig(AlertConfig const &Config, RuleEngine &Rules, std::vector<std::string> const &Names, std::vector<float> *Criticals, AlertActions &Actions);
+std::string ThresholdKey(std::string const &Sensor);
+std::string RuleKey(AlertRule const &Rule, std::string const &Sensor);
+#if HAVE_LIBNCURSES == 1
+struct SensorConfig;
+std::shared_ptr<const SensorConfig> LoadConfig(std::string const &Path, std::size_t NSensors, std::string &Error);
+void ApplyConfig(SensorConfig const &Config, std::vector<SensorPreferences> &Prefs);
+bool ReadConfig(std::vector<SensorPreferences> &Prefs, InputArguments &InArgs, uint64_t *Hash);
+bool WriteConfig(std::vector<SensorPreferences> const &Prefs, InputArguments &InArgs, uint64_t *Hash);
+#endif
 void SetHomeDirectory(InputArguments &InArgs);
 
+#if HAVE_LIBNCURSES == 1
+/****************************************************************
+SensorConfig:
+	The contents of ~/.config/TempSafe.cfg: one line per
+		sensor, "CRITICAL,COLOUR,COMMAND"
+****************************************************************/
+struct SensorConfig {
+	struct Line {
+		int CritTemp;
+		unsigned Colour;
+		std::string Command;
+	};
+	std::vector<Line> Lines;
+	uint64_t Hash = 0;
+};
+#endif
+
+#if HAVE_GTK == 1
+/****************************************************************
+GUIConfig:
+	The contents of TempSafe_GUI.cfg (see ReadGUIConfig)
+****************************************************************/
+struct GUIConfig {
+	std::vector<unsigned int> Colours;
+	std::vector<float> Criticals;
+	std::vector<char> Active;
+	std::vector<std::string> Commands;
+};
+bool ParseGUIConfig(std::string const &Data, std::size_t NSensors, GUIConfig &Out, std::string &Error);
+std::shared_ptr<const GUIConfig> LoadGUIConfig(std::size_t NSensors, std::string &Error);
+gboolean ApplyGUIConfig(gpointer Data);
+#endif
+
+#if HAVE_LIBNCURSES == 1
 /** @brief Set size of graph window */
 Rect<int> GetGraphSize(WinSize const &MainWindowSize)
 {
@@ -158,37 +271,32 @@ Rect<int> GetUiSize(WinSize const &MainWindowSize)
 
 /** @brief Draw everything for NCurses
  * @param Main            The main window
+ * @param Chart           The (cached) graph
  * @param SensorDetails   Information about the sensors (to be replaced with different structure)
+ * @param Sketches        Distribution of each sensor's readings (for the p50/p99 column)
+ * @param Trends          Smoothed statistics of each sensor (for the trend marks)
  * @param SensorHistory   Historical information about past sensor measurements
+ * @param MinTemp         Minimum temperature in SensorHistory
+ * @param MaxTemp         Maximum temperature in SensorHistory
  * @param Cursor          User's current UI selection
  * @param Scroll          User's current scroll value in the UI
  * @param Resize          Whether the window needs to be redrawn after a resize operation
  */
-void NCurses_Draw(MainWindow &Main, std::vector<SensorPreferences> const &SensorPrefs, std::vector<SensorDetailLine> const &SensorHistory, Selection Cursor, unsigned Scroll, bool Resize) {
+void NCurses_Draw(MainWindow &Main, NCursesChart &Chart, std::vector<SensorPreferences> const &SensorPrefs, std::vector<QuantileSketch> const &Sketches, SensorStats const &Trends, std::vector<SensorDetailLine> const &SensorHistory, float MinTemp, float MaxTemp, Selection Cursor, unsigned Scroll, bool Resize) {
 	WinSize MainWindowSize = Main.GetSize();
 	if (Resize) {
 		Main.GetSubWindow("Graph").Resize(GetGraphSize(MainWindowSize));
 		Main.GetSubWindow("UI").Resize(GetUiSize(MainWindowSize));
 		if (MainWindowSize.y >= 24) Main.RedrawAll();
+		Chart.Invalidate();
 	}
-	NCursesPrintGraphAxes(Main.GetSubWindow("Graph"), //TODO: move this to NCursesPrintGraphToWindow function call
-	                      GetMinTemp(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMaxTemp(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMinTime(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMaxTime(SensorHistory.begin(),SensorHistory.end()),
-	                      3);
-	NCursesPrintGraphToWindow(Main.GetSubWindow("Graph"), //TODO: move this to NCursesPrintGraphToWindow function call
-	                      SensorHistory,
-	                      GetMinTemp(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMaxTemp(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMinTime(SensorHistory.begin(),SensorHistory.end()),
-	                      GetMaxTime(SensorHistory.begin(),SensorHistory.end()),
-	                      3); //TODO should be variable
-	NCursesPrintUiToWindow(Main.GetSubWindow("UI"),Cursor,Scroll,SensorPrefs);
+	Chart.Draw(Main.GetSubWindow("Graph"), SensorHistory, MinTemp, MaxTemp, 3); //TODO should be variable
+	NCursesPrintUiToWindow(Main.GetSubWindow("UI"),Cursor,Scroll,SensorPrefs,Sketches,Trends);
 	Main.Draw();
 	if (MainWindowSize.y < 24 || MainWindowSize.x < 50) {
 		Main.PrintString(MainWindowSize.y/2,MainWindowSize.x/2-10,"Window size too small");
 		Main.Refresh();
+		Chart.Invalidate();
 	} else {
 		mvwprintw(Main.GetSubWindow("Graph").GetHandle().get(),0,0,"  Plot of Temperature VS Time  ");
 		Main.RefreshAll();
@@ -203,8 +311,14 @@ static unsigned GetTotalNumberOfSensors(std::vector<std::shared_ptr<temperature_
 	return ret;
 }
 
+/** @brief Approximate bytes held by one line of the ncurses history (including its strings) */
+std::size_t DetailBytes(SensorDetailLine const &Line) {
+	auto Heap = [](std::string const &S) { return (S.capacity() > std::string().capacity()) ? S.capacity() + 1 : 0; };
+	return sizeof(Line) + Heap(Line.FriendlyName) + Heap(Line.Command) + Heap(Line.TempData.Name);
+}
+
 /** Main function for NCurses */
-void RunNCurses(InputArguments &InArgs, std::vector<std::shared_ptr<temperature_sensor_set>> &Sensors, std::unordered_map<std::string,SensorDetailLine> const &NameMap) {
+void RunNCurses(InputArguments &InArgs, std::vector<std::shared_ptr<temperature_sensor_set>> &Sensors, std::unordered_map<std::string,SensorDetailLine> const &NameMap, EventLoop &Loop, AlertActions &Actions, AlertTracker &Alerts, RuleEngine &Rules) {
 	MainWindow Main;
 	unsigned TotalNSensors = GetTotalNumberOfSensors(Sensors);
 	//Create UI and graph windows;
@@ -217,21 +331,141 @@ void RunNCurses(InputArguments &InArgs, std::vector<std::shared_ptr<temperature_
 	time(&LastTime);
 	std::vector<SensorDetailLine> StepDetails = GetAllSensorDetails(Sensors,NameMap);
 	std::vector<SensorPreferences> SensorPref = BuildPreferences(Sensors,NameMap);
-	while (i != 'q') { //step
+	//With --history-budget the graph's history is trimmed (oldest first) to fit; it only shows the last few minutes
+	std::size_t MaxDetails = 0;
+	if (InArgs.HistoryBudget > 0 && !StepDetails.empty()) {
+		std::size_t Bytes = 0;
+		for (auto const &j : StepDetails) Bytes += DetailBytes(j);
+		MaxDetails = std::max(InArgs.HistoryBudget / (Bytes / StepDetails.size()),StepDetails.size());
+	}
+	auto TrimDetails = [&StepDetails,MaxDetails]() {
+		if (MaxDetails == 0 || StepDetails.size() <= MaxDetails + MaxDetails / 8) return;
+		StepDetails.erase(StepDetails.begin(),StepDetails.begin() + (StepDetails.size() - MaxDetails));
+	};
+	NCursesChart Chart;
+	float MinTemp = GetMinTemp(StepDetails.begin(),StepDetails.end());
+	float MaxTemp = GetMaxTemp(StepDetails.begin(),StepDetails.end());
+	SensorSnapshot Snapshot;
+	std::vector<float> Criticals;
+	std::vector<std::string> Names;
+	for (auto const &j : SensorPref) Names.push_back(j.GetTempData().Name);
+	Rules.Bind(Names);
+	//Critical temperatures from -f are the defaults; ~/.config/TempSafe.cfg overrides them
+	InArgs.Thresholds.Resolve(Names);
+	for (unsigned j = 0; j != SensorPref.size(); j++) {
+		if (!std::isnan(InArgs.Thresholds[j])) SensorPref[j].SetCriticalTemp(InArgs.Thresholds[j]);
+	}
+	SetHomeDirectory(InArgs);
+	uint64_t ConfigHash = 0;
+	bool ConfigLoaded = ReadConfig(SensorPref,InArgs,&ConfigHash);
+	//Edits to the config and rules files are picked up while running
+	std::string ConfFile = InArgs.HomeDir + "/.config/TempSafe.cfg";
+	std::size_t NSensors = SensorPref.size();
+	ConfigWatcher<SensorConfig> PrefWatcher(Loop,ConfFile,[ConfFile,NSensors](std::string &Error) {
+		return LoadConfig(ConfFile,NSensors,Error);
+	});
+	PrefWatcher.WatchFile(ConfFile);
+	std::shared_ptr<const SensorConfig> AppliedPrefs;
+	std::string RulesFile = InArgs.RulesFile;
+	ConfigWatcher<AlertConfig> RuleWatcher(Loop,"alert rules",[RulesFile,Names](std::string &Error) {
+		return LoadAlertConfig("",RulesFile,Names,Error);
+	});
+	RuleWatcher.WatchFile(RulesFile);
+	std::shared_ptr<const AlertConfig> AppliedRules;
+	SampleLog::Writer Log;
+	unsigned LogTimer = 0;
+	Log.SetCompression(InArgs.LogCompression);
+	if (InArgs.LogDir.length() > 0 && Log.Open(InArgs.LogDir,Names))
+		LogTimer = Loop.AddTimer(std::chrono::seconds(1),[&Log]() { Log.CommitIfDue(); });
+	//Fill the graph with the last half hour (by default) of the log once it has been read
+	std::vector<SensorDetailLine> const Templates = StepDetails;
+	std::vector<QuantileSketch> Sketches(Names.size());
+	SensorStats Trends(Names.size());
+	std::vector<float> Eta;
+	std::unique_ptr<WarmStart> Restore;
+	if (InArgs.LogDir.length() > 0 && InArgs.WarmStartMinutes != 0) {
+		double Seconds = 60.0 * ((InArgs.WarmStartMinutes < 0) ? 30 : InArgs.WarmStartMinutes);
+		Restore = std::make_unique<WarmStart>(Loop,InArgs.LogDir,Names,Seconds,[&](SampleLog::Tail &Loaded) {
+			std::time_t Before = StepDetails.empty() ? time(nullptr) : StepDetails.front().Time;
+			std::size_t const N = Names.size();
+			std::vector<SensorDetailLine> Restored;
+			for (std::size_t k = 0; k != Loaded.Times.size() && (std::time_t)Loaded.Times[k] < Before; k++) {
+				for (std::size_t j = 0; j != N && j != Templates.size(); j++) {
+					float Value = Loaded.Values[k * N + j];
+					if (std::isnan(Value)) continue;
+					Sketches[j].Add(Value);
+					Restored.push_back(Templates[j]);
+					Restored.back().Time = (std::time_t)Loaded.Times[k];
+					Restored.back().TempData.Temp = Value;
+					MinTemp = std::min(MinTemp,Value);
+					MaxTemp = std::max(MaxTemp,Value);
+				}
+			}
+			StepDetails.insert(StepDetails.begin(),Restored.begin(),Restored.end());
+			TrimDetails();
+			Chart.Invalidate();
+		});
+	}
+	while (i != 'q' && !Loop.Stopped()) { //step
 		i = InputHandler.GetKey();
 		std::vector<SensorDetailLine> LocalStepDetails = GetAllSensorDetails(Sensors,NameMap);
 		std::time_t CurrentTime;
 		time(&CurrentTime);
-		if (!UpdateSensorPreferences(LocalStepDetails,SensorPref))
+		if (!UpdateSensorPreferences(LocalStepDetails,SensorPref)) {
+			if (LogTimer != 0) Loop.RemoveTimer(LogTimer);
 			return;
-		NCurses_Draw(Main,SensorPref,StepDetails,InputHandler.GetCursor(), InputHandler.GetScroll(), i == KEY_RESIZE);
+		}
+		if (auto Config = PrefWatcher.Current(); Config && Config != AppliedPrefs) {
+			ApplyConfig(*Config,SensorPref);
+			ConfigHash = Config->Hash;
+			ConfigLoaded = true;
+			AppliedPrefs = Config;
+		}
+		if (auto Config = RuleWatcher.Current(); Config && Config != AppliedRules) {
+			ApplyAlertConfig(*Config,Rules,Names,nullptr,Actions);
+			AppliedRules = Config;
+		}
+		NCurses_Draw(Main,Chart,SensorPref,Sketches,Trends,StepDetails,MinTemp,MaxTemp,InputHandler.GetCursor(), InputHandler.GetScroll(), i == KEY_RESIZE);
 		if (CurrentTime - LastTime >= 3) {
 			LastTime = CurrentTime;
 			StepDetails.insert(StepDetails.end(),LocalStepDetails.begin(),LocalStepDetails.end());
+			TrimDetails();
+			for (auto const &j : LocalStepDetails) {
+				MinTemp = std::min(MinTemp,j.TempData.Temp);
+				MaxTemp = std::max(MaxTemp,j.TempData.Temp);
+			}
+			//Sensors without a critical temperature (absolute zero) never alert
+			Snapshot.Time = AlertTracker::Now();
+			Snapshot.Values.resize(SensorPref.size());
+			Criticals.resize(SensorPref.size());
+			for (unsigned j = 0; j != SensorPref.size(); j++) {
+				Snapshot.Values[j] = SensorPref[j].GetTempData().Temp;
+				Sketches[j].Add(Snapshot.Values[j]);
+				Criticals[j] = (SensorPref[j].GetCriticalTemp() > -273.0f) ? SensorPref[j].GetCriticalTemp() : NAN;
+			}
+			double Now = HistoryStore::Now();
+			Trends.Add(Now,Snapshot.Values);
+			if (Log.IsOpen()) Log.Append(Now,Snapshot.Values);
+			Trends.TimeToCritical(Criticals,Eta);
+			for (auto const &T : Alerts.Update(Snapshot,Criticals,&Eta)) {
+				if (T.To == AlertLevel::Critical)
+					Actions.Fire(Names[T.Sensor],SensorPref[T.Sensor].GetCommand(),T.Value,Criticals[T.Sensor]);
+				else if (T.From == AlertLevel::Critical)
+					Actions.Clear(Names[T.Sensor]);
+			}
+			for (unsigned j = 0; j != SensorPref.size(); j++) {
+				if (Alerts.Level(j) == AlertLevel::Critical) Actions.Update(Names[j],Snapshot.Values[j],Criticals[j]);
+			}
+			ProcessRules(Rules,Snapshot,Criticals,Names,InArgs,Actions);
 		}
+		Loop.RunOnce(0);
 		InputHandler.ProcessKey(i);
 	}
+	if (LogTimer != 0) Loop.RemoveTimer(LogTimer);
+	//Only rewrites the file if a preference actually changed
+	if (ConfigLoaded) WriteConfig(SensorPref,InArgs,&ConfigHash);
 }
+#endif
 
 int main(int argc,char** argv)
 {
@@ -255,26 +489,145 @@ int main(int argc,char** argv)
 		std::cerr << "ERROR: -UI and --use-gtk cannot be used simultaneously\n";
 		return -4;
 	}
+	if ((InArgs.ListenPath.length() > 0 || InArgs.ShmName.length() > 0 || InArgs.MetricsAddress.length() > 0) && (InArgs.UseUI || InArgs.UseGUI))
+	{
+		std::cerr << "ERROR: --listen, --shm and --metrics run headless; connect the interfaces to it with --connect\n";
+		return -4;
+	}
+	RecordStream::Format OutputFormat = RecordStream::Format::JSONLines;
+	if (InArgs.OutputFormat.length() > 0 || InArgs.OutputFile.length() > 0)
+	{
+		if (!RecordStream::ParseFormat(InArgs.OutputFormat.length() > 0 ? InArgs.OutputFormat : "jsonl",OutputFormat))
+		{
+			std::cerr << "ERROR: --output must be jsonl or csv\n";
+			return -4;
+		}
+		if (InArgs.UseUI || InArgs.UseGUI)
+		{
+			std::cerr << "ERROR: --output cannot be used with the interfaces\n";
+			return -4;
+		}
+		if ((InArgs.PrtTmp || InArgs.Stats) && (InArgs.OutputFile.length() == 0 || InArgs.OutputFile == "-"))
+		{
+			std::cerr << "ERROR: -v, -i and -s also print to stdout; use --output-file with them\n";
+			return -4;
+		}
+	}
+	if (InArgs.ListenPath.length() > 0 && InArgs.ConnectPath.length() > 0)
+	{
+		std::cerr << "ERROR: --listen and --connect cannot be used simultaneously\n";
+		return -4;
+	}
+	if (InArgs.ReplayPath.length() > 0 && (InArgs.ConnectPath.length() > 0 || InArgs.UseSynthetic || InArgs.ReplayPath == InArgs.LogDir))
+	{
+		std::cerr << "ERROR: --replay cannot be used with --connect or --synthetic, or with --log on the same directory\n";
+		return -4;
+	}
+	if (InArgs.UseSynthetic && InArgs.ConnectPath.length() > 0)
+	{
+		std::cerr << "ERROR: --synthetic and --connect cannot be used simultaneously\n";
+		return -4;
+	}
+#if HAVE_LIBNCURSES != 1
+	if (InArgs.UseUI)
+	{
+		std::cerr << "ERROR: this build has no ncurses interface (-UI); use safetemp-curses\n";
+		return -4;
+	}
+#endif
+#if HAVE_GTK != 1
+	if (InArgs.UseGUI)
+	{
+		std::cerr << "ERROR: this build has no GTK interface (--use-gtk); use safetemp-gtk\n";
+		return -4;
+	}
+#endif
 
 	std::vector<std::shared_ptr<temperature_sensor_set>> AllSensors;
+	std::shared_ptr<playback_sensor> Playback;
+	if (InArgs.ReplayPath.length() > 0)
+	{
+		try
+		{
+			Playback = std::make_shared<replay_sensor>(InArgs.ReplayPath,InArgs.ReplaySpeed);
+			AllSensors.push_back(Playback);
+		}
+		catch (std::runtime_error const &E)
+		{
+			std::cerr << "ERROR: " << E.what() << "\n";
+			return -7;
+		}
+	}
+	else if (InArgs.UseSynthetic)
+	{
+		Playback = std::make_shared<synthetic_sensor>(InArgs.Synthetic,InArgs.ReplaySpeed);
+		AllSensors.push_back(Playback);
+	}
+	else if (InArgs.ConnectPath.length() > 0)
+	{
+		try
+		{
+			AllSensors.emplace_back(std::make_shared<socket_sensor>(InArgs.ConnectPath));
+		}
+		catch (std::runtime_error const &E)
+		{
+			std::cerr << "ERROR: " << E.what() << "\n";
+			return -7;
+		}
+	}
+	else
+	{
 #if UI_TEST
-	AllSensors.emplace_back(std::make_shared<test_sensor>(10));
+		AllSensors.emplace_back(std::make_shared<test_sensor>(10));
 #else
-	AllSensors.emplace_back(std::make_shared<lm_sensor>(nullptr));
+		AllSensors.emplace_back(std::make_shared<lm_sensor>(nullptr));
 #endif
+	}
 	std::unordered_map<std::string,SensorDetailLine> BasicSensorMap;
+
+	/* Alert commands are run (and reaped) from this loop */
+	EventLoop Loop;
+	/* Ctrl-C and SIGTERM (e.g. systemctl stop) leave the main loop instead of killing the process, so that
+	   the actions still applied are put back and the log, socket and shared memory are cleaned up on the way out */
+	Loop.WatchSignals({SIGINT,SIGTERM},[&InArgs,&Loop](int) {
+		InArgs.run = 0;
+		Loop.Stop();
+	});
+	CommandExecutor Executor(Loop);
+	AlertActions Actions(Executor);
+	Actions.SetSysfsRoot(InArgs.SysfsRoot);
+	AlertTracker Alerts(InArgs.Alert);
+	RuleEngine Rules;
+	if (InArgs.RulesFile.length() > 0 && !Rules.LoadFile(InArgs.RulesFile))
+	{
+		std::cerr << "Failed to load alert rules.\n";
+		return -6;
+	}
+	{
+		std::string Error;
+		if (!AlertActions::Validate(InArgs.Command,Error))
+		{
+			std::cerr << "Invalid action '" << InArgs.Command << "': " << Error << "\n";
+			return -6;
+		}
+		for (unsigned i = 0; i != Rules.Size(); i++)
+		{
+			if (!AlertActions::Validate(Rules.Rule(i).Command,Error))
+			{
+				std::cerr << "Invalid action in rule '" << Rules.Rule(i).Text << "': " << Error << "\n";
+				return -6;
+			}
+		}
+	}
+
+#if HAVE_LIBNCURSES == 1
 	if (InArgs.UseUI) {
-		RunNCurses(InArgs,AllSensors,BasicSensorMap);
+		RunNCurses(InArgs,AllSensors,BasicSensorMap,Loop,Actions,Alerts,Rules);
 		return 0;
 	}
+#endif
 
 	//return -5; //Temporary; don't go beyond this.
-	/* Statistics variables */
-	vector<vector<time_t>> X_pts;
-	vector<vector<double>> Y_pts;
-	vector<vector<double>> Yp_pts;
-	vector<vector<double>> Ypp_pts;
-
 	/* Initialize NVidia devices if installed */
 #if HAVE_LIBNVIDIA_ML
 	static_assert(false,"Nvidia ML has been temporarily disabled");
@@ -308,15 +661,100 @@ int main(int argc,char** argv)
 	}*/
 #endif
 
-	lm_sensor Sensors(nullptr);
+	temperature_sensor_set &Sensors = *AllSensors.back();
+	//Before anything below creates the socket, shared memory or log (an exception skips their clean-up)
+	if (Sensors.GetNumberOfSensors() == 0)
+		throw std::runtime_error("No sensors were found.");
 	std::vector<std::string> SensorNames;
 	for (unsigned i = 0; i != Sensors.GetNumberOfSensors(); i++) {
 		SensorNames.push_back(Sensors.GetSensorName(i));
 	}
 	std::vector<std::string> ChipNames = SensorNames;
-
-	if (Sensors.GetNumberOfSensors() == 0)
-		throw std::runtime_error("No sensors were found.");
+	InArgs.Thresholds.Resolve(ChipNames);
+	Rules.Bind(ChipNames);
+	SensorSnapshot Snapshot;
+	std::vector<float> Criticals = InArgs.Thresholds.Values();
+	//Edits to -f and --rules are picked up while running
+	std::string TempFile = InArgs.TempFile, RulesFile = InArgs.RulesFile;
+	ConfigWatcher<AlertConfig> AlertWatcher(Loop,"alert configuration",[TempFile,RulesFile,ChipNames](std::string &Error) {
+		return LoadAlertConfig(TempFile,RulesFile,ChipNames,Error);
+	});
+	AlertWatcher.WatchFile(TempFile);
+	AlertWatcher.WatchFile(RulesFile);
+	std::shared_ptr<const AlertConfig> AppliedAlerts;
+
+	/* Keep a day of history (or as much as --history-budget holds) and serve it (and every new snapshot) to clients of --listen */
+	double Interval = std::max(InArgs.TimeStep / 1e6, 0.1);
+	std::size_t Day = (std::size_t)std::min(86400.0 / Interval,(double)HistoryStore::MaxCapacity);
+	//Too many sensors for a day of raw samples: keep what a default budget holds instead
+	if (InArgs.HistoryBudget == 0 && !InArgs.UseGUI && HistoryStore::RingBytes(Day,ChipNames.size()) > HistoryStore::DefaultBudget)
+	{
+		InArgs.HistoryBudget = std::max(HistoryStore::DefaultBudget,HistoryStore::MinBudget(ChipNames.size()));
+		std::cerr << "A day of history of " << ChipNames.size() << " sensors would take " << (HistoryStore::RingBytes(Day,ChipNames.size()) >> 20)
+			<< " MB: keeping " << (InArgs.HistoryBudget >> 20) << " MB of it instead (set --history-budget to change this)\n";
+	}
+	HistoryStore History(ChipNames,(InArgs.UseGUI || InArgs.HistoryBudget > 0) ? 1 : Day);
+	if (InArgs.HistoryBudget > 0 && !InArgs.UseGUI && !History.SetBudget(InArgs.HistoryBudget,InArgs.LogCompression))
+	{
+		std::cerr << "--history-budget is too small for " << 2 * HistoryStore::ChunkSamples << " samples of " << ChipNames.size() << " sensors\n";
+		return -4;
+	}
+	SketchRollup Rollup(ChipNames.size());
+	SensorStats Stats(ChipNames.size());
+	std::vector<float> Eta;
+	std::unique_ptr<SensorServer> Server;
+	if (InArgs.ListenPath.length() > 0)
+	{
+		Server = std::make_unique<SensorServer>(Loop,History);
+		if (!Server->Listen(InArgs.ListenPath)) return -7;
+	}
+	/* ...and the latest one to local pollers through shared memory */
+	SharedSnapshot::Writer Shared;
+	std::vector<uint8_t> Levels(ChipNames.size());
+	if (InArgs.ShmName.length() > 0 && !Shared.Create(InArgs.ShmName,ChipNames))
+	{
+		if (errno == EBUSY) std::cerr << "Another daemon is already publishing " << InArgs.ShmName << "\n";
+		else std::cerr << "Cannot create shared memory " << InArgs.ShmName << ": " << strerror(errno) << "\n";
+		return -7;
+	}
+	/* ...and to Prometheus, which scrapes the last tick rather than the sensors */
+	std::unique_ptr<MetricsServer> Metrics;
+	if (InArgs.MetricsAddress.length() > 0)
+	{
+		Metrics = std::make_unique<MetricsServer>(Loop);
+		Metrics->SetSensors(ChipNames);
+		Metrics->SetRollup(&Rollup);
+		Metrics->SetHistory(&History);
+		if (!Metrics->Listen(InArgs.MetricsAddress)) return -7;
+	}
+	/* ...and as a stream of records for pipelines, which must never hold up sampling */
+	std::unique_ptr<RecordStream> Output;
+	if (InArgs.OutputFormat.length() > 0 || InArgs.OutputFile.length() > 0)
+	{
+		signal(SIGPIPE,SIG_IGN); //A reader going away shows up as EPIPE instead
+		Output = std::make_unique<RecordStream>(OutputFormat);
+		if (!Output->Open(InArgs.OutputFile,ChipNames)) return -7;
+		Loop.AddTimer(std::chrono::seconds(1),[&Output]() { Output->Flush(); });
+	}
+	/* ...and to disk, in batches */
+	SampleLog::Writer Log;
+	Log.SetCompression(InArgs.LogCompression);
+	if (InArgs.LogDir.length() > 0)
+	{
+		if (!Log.Open(InArgs.LogDir,ChipNames)) return -7;
+		Loop.AddTimer(std::chrono::seconds(1),[&Log]() { Log.CommitIfDue(); });
+	}
+	/* Restore what the log holds of the history window (a day by default) in the background */
+	std::unique_ptr<WarmStart> Restore;
+	if (InArgs.LogDir.length() > 0 && InArgs.WarmStartMinutes != 0 && !InArgs.UseGUI)
+	{
+		double Seconds = (InArgs.WarmStartMinutes < 0) ? History.Capacity() * Interval : 60.0 * InArgs.WarmStartMinutes;
+		Restore = std::make_unique<WarmStart>(Loop,InArgs.LogDir,ChipNames,Seconds,[&History,&Rollup](SampleLog::Tail &Loaded) {
+			History.Backfill(Loaded.Times.data(),Loaded.Values.data(),Loaded.Times.size());
+			for (std::size_t k = 0; k != Loaded.Times.size(); k++)
+				Rollup.Add(Loaded.Times[k],Loaded.Values.data() + k * History.Names().size());
+		});
+	}
 
 	/* Initialize User Interface */
 	SetHomeDirectory(InArgs);
@@ -335,12 +773,46 @@ int main(int argc,char** argv)
 	}*/
 #endif
 	int CharBuffer = 0;
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
+#if HAVE_GTK == 1
 	std::thread GTKMain;
+	std::unique_ptr<ConfigWatcher<GUIConfig>> GUIWatcher;
+	std::shared_ptr<const GUIConfig> AppliedGUI;
 	if (InArgs.UseGUI)
 	{
+		GUI::Handle.CallInterval = InArgs.TimeStep/1000000;
+		GUI::Actions = &Actions;
+		GUI::Alerts.SetPolicy(InArgs.Alert);
 		GUI::BuildInterface(argc,argv,SensorNames,&InArgs.run);
+		if (InArgs.HistoryBudget > 0)
+			GUI::Handle.MaxSamples = std::max<std::size_t>(InArgs.HistoryBudget / (std::max<std::size_t>(ChipNames.size(),1) * (sizeof(float) + sizeof(int))),GUI::Handle.NumDataPts);
+		std::size_t NSensors = SensorNames.size();
+		GUIWatcher = std::make_unique<ConfigWatcher<GUIConfig>>(Loop,"GUI configuration",[NSensors](std::string &Error) {
+			return LoadGUIConfig(NSensors,Error);
+		});
+		GUIWatcher->WatchFile("TempSafe_GUI.cfg");
 		GTKMain = std::thread(gtk_main);
+		//The window is up; the last half hour (by default) of the log is added to the graphs once read
+		if (InArgs.LogDir.length() > 0 && InArgs.WarmStartMinutes != 0)
+		{
+			double Seconds = 60.0 * ((InArgs.WarmStartMinutes < 0) ? 30 : InArgs.WarmStartMinutes);
+			std::size_t const N = ChipNames.size();
+			Restore = std::make_unique<WarmStart>(Loop,InArgs.LogDir,ChipNames,Seconds,[N](SampleLog::Tail &Loaded) {
+				for (std::size_t j = 0; j != N; j++)
+				{
+					std::vector<double> Times;
+					std::vector<float> Values;
+					for (std::size_t k = 0; k != Loaded.Times.size(); k++)
+					{
+						float Value = Loaded.Values[k * N + j];
+						if (std::isnan(Value)) continue;
+						Times.push_back(Loaded.Times[k]);
+						Values.push_back(Value);
+					}
+					GUI::Handle.Backfill(j,Times,Values);
+				}
+				g_idle_add((GSourceFunc)GUI::replot,GUI::Objects);
+			});
+		}
 	}
 #endif
 	
@@ -352,53 +824,46 @@ int main(int argc,char** argv)
 	static_assert(false,"Nvidia ML has been temporarily disabled");
 #else
 #endif
-		if (InArgs.Stats)
-		{
-			X_pts.resize(Sensors.GetNumberOfSensors());
-			Y_pts.resize(Sensors.GetNumberOfSensors());
-			Yp_pts.resize(Sensors.GetNumberOfSensors());
-			Ypp_pts.resize(Sensors.GetNumberOfSensors());
-		}
 
 		while (true)
 		{
-			/* Loop through all available sensors and perform relevant actions */
-			if (InArgs.UseUI)//UseUI OR UseGUI
+			if (auto Config = AlertWatcher.Current(); Config && Config != AppliedAlerts)
 			{
-				if (true)
+				ApplyAlertConfig(*Config,Rules,ChipNames,&Criticals,Actions);
+				AppliedAlerts = Config;
+			}
+#if HAVE_GTK == 1
+			//GUI settings belong to the GTK thread; hand them over
+			if (GUIWatcher)
+			{
+				if (auto Config = GUIWatcher->Current(); Config && Config != AppliedGUI)
 				{
-					for (unsigned i = 0; i < ChipNames.size(); i++)
-					{
-						GUI::Handle.AddData(Sensors.GetTemperature(ChipNames[i]),i);
-						//UI.AppendSensorData(i,val,InArgs.TimeStep/1000000);
-					}
-#if HAVE_LIBNVIDIA_ML
-	static_assert(false,"Nvidia ML has been temporarily disabled");
-					/*if (nv) //NVIDIA GPU data
-					{
-						//Loop through all nvidia chips and perform relevant actions
-						for (int i = 0; i < nvDev.size(); i++)
-						{
-							if (nvmlDeviceGetTemperature(nvDev[i],NVML_TEMPERATURE_GPU,&nvTempTmp) != NVML_SUCCESS) fprintf(stderr,"Failed to read temperature from NVIDIA chip (%d)\n",ChipNames.size() + i);
-							val = (double)nvTempTmp;
-							//NV_CTRL_THERMAL_SENSOR_READING;
-							UI.AppendSensorData(ChipNames.size()+i,val,InArgs.TimeStep/1000000);
-						}
-					}*/
-#endif
-
+					g_idle_add(ApplyGUIConfig,new std::shared_ptr<const GUIConfig>(Config));
+					AppliedGUI = Config;
 				}
 			}
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
+#endif
+			/* Loop through all available sensors and perform relevant actions */
+#if HAVE_GTK == 1
 			if (InArgs.UseGUI)
 			{
 				if (GUI::Handle.GetTimeTrigger(InArgs.TimeStep/1000000))
 				{
+					Snapshot.Time = AlertTracker::Now();
+					Snapshot.Values.resize(ChipNames.size());
 					for (unsigned i = 0; i < ChipNames.size(); i++)
 					{
 						//sensors_get_value(ChipNames[i],SubFeats[i]->number,&val);
-						GUI::Handle.AddData(Sensors.GetTemperature(ChipNames[i]),i);
+						Snapshot.Values[i] = Sensors.GetTemperature(i);
+						GUI::Handle.AddData(Snapshot.Values[i],i);
+					}
+					if (Log.IsOpen()) Log.Append(HistoryStore::Now(),Snapshot.Values);
+					{
+						std::lock_guard<std::mutex> Guard(GUI::Handle.DataLock);
+						for (unsigned i = 0; i < ChipNames.size() && i < GUI::Handle.SensorCriticals.size(); i++)
+							Criticals[i] = GUI::Handle.SensorCriticals[i];
 					}
+					ProcessRules(Rules,Snapshot,Criticals,ChipNames,InArgs,Actions);
 	#if HAVE_LIBNVIDIA_ML
 	static_assert(false,"Nvidia ML has been temporarily disabled");
 					/*if (nv) //NVIDIA GPU data
@@ -419,15 +884,62 @@ int main(int argc,char** argv)
 			}
 #endif
 
+			if (!InArgs.UseUI && !InArgs.UseGUI)
+			{
+				EventLoop::Clock::time_point TickStart = EventLoop::Clock::now();
+				Snapshot.Time = AlertTracker::Now();
+				Snapshot.Values.resize(ChipNames.size());
+				for (unsigned i = 0; i < ChipNames.size(); i++)
+				{
+					Snapshot.Values[i] = Sensors.GetTemperature(i);
+				}
+				std::chrono::duration<double> ReadTime = EventLoop::Clock::now() - TickStart;
+				double Now = HistoryStore::Now();
+				//Played-back sensors run on their own clock, so that windows, dwell times and trends see the trace as it was
+				if (Playback) Snapshot.Time = Now = Playback->GetTime();
+				History.Append(Now,Snapshot.Values);
+				Rollup.Add(Now,Snapshot.Values);
+				Stats.Add(Now,Snapshot.Values);
+				if (Log.IsOpen()) Log.Append(Now,Snapshot.Values);
+				if (Server) Server->Publish(Now,Snapshot.Values);
+				if (InArgs.Alert.Horizon > 0) Stats.TimeToCritical(Criticals,Eta);
+				ProcessTemp(Snapshot,Criticals,(InArgs.Alert.Horizon > 0) ? &Eta : NULL,ChipNames,InArgs,Alerts,Actions);
+				ProcessRules(Rules,Snapshot,Criticals,ChipNames,InArgs,Actions);
+				float const *KnownCriticals = (Criticals.size() == ChipNames.size()) ? Criticals.data() : NULL;
+				for (unsigned i = 0; i < ChipNames.size(); i++) Levels[i] = (uint8_t)Alerts.Level(i);
+				if (Shared.Open()) Shared.Publish(Now,Snapshot.Values.data(),KnownCriticals,Levels.data());
+				if (Metrics)
+				{
+					Metrics->Update(Snapshot.Values.data(),KnownCriticals,Levels.data());
+					Metrics->ObserveRead(ReadTime.count());
+					Metrics->ObserveTick(std::chrono::duration<double>(EventLoop::Clock::now() - TickStart).count());
+				}
+				if (Output) Output->Write(Now,Snapshot.Values.data(),Levels.data());
+				if (InArgs.Stats) PrintStats(Snapshot,Stats,Criticals,ChipNames);
+				if (InArgs.Stats && History.Budget() != 0) PrintHistoryUsage(History);
+				if (Playback && Playback->Finished())
+				{
+					std::cerr << "Played back " << Playback->Played() << " samples\n";
+					InArgs.run = 0;
+				}
+			}
+
 			if (InArgs.PrtTmp && !InArgs.UseUI) std::cout << "Finished Line\n";
 			if (!InArgs.run) break;
 
-			if (!InArgs.UseUI && !InArgs.UseGUI) usleep((int)(InArgs.TimeStep));
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
+			if (!InArgs.UseUI && !InArgs.UseGUI)
+			{
+				//-w is in playback time
+				double Wait = InArgs.TimeStep / 1000.0;
+				if (Playback) Wait = (InArgs.ReplaySpeed > 0) ? Wait / InArgs.ReplaySpeed : 0;
+				Loop.RunFor(std::chrono::milliseconds((long)Wait));
+				if (Loop.Stopped()) break;
+			}
+#if HAVE_GTK == 1
 			if (InArgs.UseGUI) 
 			{
-				usleep(10000);//((int)TimeStep/4);
-				g_idle_add((GSourceFunc)GUI::CheckResize,GUI::Objects);
+				//Resizes are picked up by GUI::GraphResized; we only wait for the next sample here
+				Loop.RunFor(std::chrono::milliseconds(100));
 			}
 #endif
 		}
@@ -437,15 +949,18 @@ int main(int argc,char** argv)
 		std::cerr << "Vector sizes uneven\n";
 		return -1;
 	}
-	/* Clean up on exit */
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
-	if (InArgs.UseGUI) GTKMain.join();
-#endif
-	if (InArgs.Prog != NULL)
+	/* Clean up on exit (also after SIGINT/SIGTERM): the samples still queued for the log go out first,
+	   then the destructors restore the actions, flush --output and remove the socket and shared memory */
+	if (Log.IsOpen()) Log.Commit();
+#if HAVE_GTK == 1
+	if (InArgs.UseGUI)
 	{
-		pclose(InArgs.Prog);
-		InArgs.Prog = NULL;
+		//Stopped by a signal rather than by closing the window (which has already quit the GTK loop)
+		g_idle_add([](gpointer) -> gboolean { gtk_main_quit(); return FALSE; },nullptr);
+		GTKMain.join();
 	}
+	GUI::Actions = nullptr;
+#endif
 #if HAVE_LIBNVIDIA_ML
 	static_assert(false,"Nvidia ML has been temporarily disabled");
 	//nvmlShutdown();
@@ -481,6 +996,7 @@ InputArguments ProcessArgs(int argc, char** argv)
 		else if (strcmp(argv[i],"-f") == 0) 
 		{
 			InArgs.Temp = fopen(argv[i+1],"r"); 
+			InArgs.TempFile = argv[i+1];
 			i++;
 			if (InArgs.Temp == NULL || !ParseTemp(InArgs)) 
 			{
@@ -493,6 +1009,70 @@ InputArguments ProcessArgs(int argc, char** argv)
 		else if (strcmp(argv[i],"-s") == 0) InArgs.Stats = 1;
 		else if (strcmp(argv[i],"-UI") == 0) InArgs.UseUI = 1;
 		else if (strcmp(argv[i],"--use-gtk") == 0) InArgs.UseGUI = 1;
+		else if (strcmp(argv[i],"--warn-band") == 0 && i+1 < argc) {InArgs.Alert.WarningBand = stof(argv[i+1]); i++;}
+		else if (strcmp(argv[i],"--hysteresis") == 0 && i+1 < argc) {InArgs.Alert.Hysteresis = stof(argv[i+1]); i++;}
+		else if (strcmp(argv[i],"--dwell") == 0 && i+1 < argc) {InArgs.Alert.MinDwell = stod(argv[i+1]); i++;}
+		else if (strcmp(argv[i],"--rearm") == 0 && i+1 < argc) {InArgs.Alert.RearmDelay = stod(argv[i+1]); i++;}
+		else if (strcmp(argv[i],"--predict") == 0 && i+1 < argc) {InArgs.Alert.Horizon = stod(argv[i+1]); i++;}
+		else if (strcmp(argv[i],"--rules") == 0 && i+1 < argc) {InArgs.RulesFile = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--sysfs-root") == 0 && i+1 < argc) {InArgs.SysfsRoot = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--listen") == 0 && i+1 < argc) {InArgs.ListenPath = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--connect") == 0 && i+1 < argc) {InArgs.ConnectPath = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--replay") == 0 && i+1 < argc) {InArgs.ReplayPath = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--synthetic") == 0 && i+1 < argc)
+		{
+			std::string Error;
+			InArgs.UseSynthetic = 1;
+			if (!InArgs.Synthetic.Parse(argv[i+1],Error))
+			{
+				std::cerr << "--synthetic: " << Error << "\n";
+				InArgs.Success = false;
+			}
+			i++;
+		}
+		else if (strcmp(argv[i],"--replay-speed") == 0 && i+1 < argc)
+		{
+			if (!PlaybackClock::ParseSpeed(argv[i+1],InArgs.ReplaySpeed))
+			{
+				std::cerr << "--replay-speed must be a positive number or 'max'\n";
+				InArgs.Success = false;
+			}
+			i++;
+		}
+		else if (strcmp(argv[i],"--shm") == 0 && i+1 < argc) {InArgs.ShmName = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--metrics") == 0 && i+1 < argc) {InArgs.MetricsAddress = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--output") == 0 && i+1 < argc) {InArgs.OutputFormat = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--output-file") == 0 && i+1 < argc) {InArgs.OutputFile = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--log") == 0 && i+1 < argc) {InArgs.LogDir = argv[i+1]; i++;}
+		else if (strcmp(argv[i],"--warm-start") == 0 && i+1 < argc) {InArgs.WarmStartMinutes = std::max(0,atoi(argv[i+1])); i++;}
+		else if (strcmp(argv[i],"--log-compress") == 0 && i+1 < argc)
+		{
+			if (!InArgs.LogCompression.SetMethod(argv[i+1]))
+			{
+				std::cerr << "Unknown compression method " << argv[i+1] << " (deadband or swinging-door)\n";
+				InArgs.Success = false;
+			}
+			i++;
+		}
+		else if (strcmp(argv[i],"--history-budget") == 0 && i+1 < argc)
+		{
+			if (!ParseSize(argv[i+1],InArgs.HistoryBudget))
+			{
+				std::cerr << "--history-budget: bad size " << argv[i+1] << "\n";
+				InArgs.Success = false;
+			}
+			i++;
+		}
+		else if (strcmp(argv[i],"--log-tolerance") == 0 && i+1 < argc)
+		{
+			string Error;
+			if (!InArgs.LogCompression.SetTolerances(argv[i+1],Error))
+			{
+				std::cerr << "--log-tolerance: " << Error << "\n";
+				InArgs.Success = false;
+			}
+			i++;
+		}
 		else if (argv[i][0] == '-')
 		{
 			for (unsigned j = 1; j != string(argv[i]).length(); j++) 
@@ -504,6 +1084,7 @@ InputArguments ProcessArgs(int argc, char** argv)
 				else if (strcmp(argv[i],"f") == 0) 
 				{
 					InArgs.Temp = fopen(argv[i+1],"r"); 
+					InArgs.TempFile = argv[i+1];
 					i++;
 					if (InArgs.Temp == NULL || !ParseTemp(InArgs)) 
 					{
@@ -522,36 +1103,52 @@ InputArguments ProcessArgs(int argc, char** argv)
 	return InArgs;
 };
 
+/****************************************************************
+ParseSize:
+	Takes:
+		Text: a number of bytes, optionally followed by K, M or
+			G (binary multiples), e.g. "16M"
+		Out: set to the number of bytes
+	Returns:
+		1 if Text was a valid size
+****************************************************************/
+bool ParseSize(char const *Text, std::size_t &Out)
+{
+	char *End;
+	double Value = strtod(Text,&End);
+	double Unit = 1;
+	if (*End == 'K' || *End == 'k') Unit = 1024;
+	else if (*End == 'M' || *End == 'm') Unit = 1024.0 * 1024;
+	else if (*End == 'G' || *End == 'g') Unit = 1024.0 * 1024 * 1024;
+	if (End == Text || !(Value > 0) || (Unit > 1 && End[1] != 0) || (Unit == 1 && *End != 0)) return 0;
+	Out = (std::size_t)(Value * Unit);
+	return 1;
+};
+
 /****************************************************************
 ParseTemp:
 	Returns:
 		1 upon successful reading of Critical Temperatures file
 
 	This function reads Critical Temperatures from a user-
-		specified file and loads them into the MaxTemps
-		global variable.
+		specified file into InArgs.Thresholds.  Entries are
+		"NAME=TEMP" (NAME may be a glob) or plain positional
+		temperatures; see Alerts/ThresholdTable.hpp.  They are
+		matched to sensors once the sensors are known.
 ****************************************************************/
 bool ParseTemp(InputArguments &InArgs)
 {
 	rewind(InArgs.Temp);
-	int IntBuffer;
-	string StrBuffer;
-	while (!feof(InArgs.Temp))
-	{
-		InArgs.MaxTemps.resize(InArgs.MaxTemps.size()+1);
-		StrBuffer = "";
-		IntBuffer = fgetc(InArgs.Temp);
-		while (IntBuffer != ',' && IntBuffer != EOF)
-		{
-			StrBuffer += (char)IntBuffer;
-			IntBuffer = fgetc(InArgs.Temp);
-		}
-		InArgs.MaxTemps.at(InArgs.MaxTemps.size()-1) = stof(StrBuffer.c_str());
-	}
-	InArgs.MinTemp = InArgs.MaxTemps[0];
-	for (unsigned i = 1; i != InArgs.MaxTemps.size(); i++)
+	string Text;
+	char Buffer[4096];
+	size_t Read;
+	while ((Read = fread(Buffer,1,sizeof(Buffer),InArgs.Temp)) > 0) Text.append(Buffer,Read);
+	string Error;
+	if (!InArgs.Thresholds.Parse(Text,Error))
 	{
-		if (InArgs.MaxTemps[i] < InArgs.MinTemp) InArgs.MinTemp = InArgs.MaxTemps[i];
+		std::cerr << "Invalid critical temperature file: " << Error << "\n";
+		errno = EINVAL;
+		return 0;
 	}
 	return 1;
 };
@@ -559,59 +1156,177 @@ bool ParseTemp(InputArguments &InArgs)
 /****************************************************************
 ProcessTemp:
 	Takes:
-		index: the sensor number corresponding to 'value'
-		value: the temperature reading from the sensor
+		Snapshot: the newest reading of every sensor
+		Criticals: critical temperature of every sensor
+			(InArgs.Thresholds resolved to the sensor list)
+		Eta: predicted seconds until each sensor reaches it
+			(for --predict; may be NULL)
+		Names: sensor names, indexed like Snapshot
 	Returns:
-		0 if the sensor temperature threshold is exceeded
+		0 if any sensor is in the critical state
 		1 otherwise
 
-	This program takes the sensor temperature reading and
-		runs the user-specified program if the critical 
-		temperature is exceeded.  If insufficient temperature
-		data is supplied at program start, this will compare 
-		the temperature 'value' to the minimum of MaxTemps.
+	This program feeds the sensor temperature readings to the
+		alert state machine (which checks them all in one
+		vectorized pass) and runs the user-specified action
+		for each sensor that becomes critical (once per
+		excursion; see Alerts/AlertState.hpp).  Built-in '@'
+		actions follow the temperature while the sensor stays
+		critical and are undone when it cools down; shell
+		commands go to the executor, which will not start one
+		again while the previous one for this sensor runs.
 ****************************************************************/
-bool ProcessTemp(int index,double value, InputArguments &InArgs)
+bool ProcessTemp(SensorSnapshot const &Snapshot, std::vector<float> const &Criticals, std::vector<float> const *Eta, std::vector<std::string> const &Names, InputArguments &InArgs, AlertTracker &Alerts, AlertActions &Actions)
 {
-	if (InArgs.Prog != NULL)
-	{
-		pclose(InArgs.Prog);
-		InArgs.Prog = NULL;
-	}
-	if (InArgs.MaxTemps.size() == 0) return 1;
-	if ((unsigned)index < InArgs.MaxTemps.size())
+	bool Safe = 1;
+	for (auto const &Change : Alerts.Update(Snapshot,Criticals,Eta))
 	{
-		if (value >= InArgs.MaxTemps[index])
+		std::string Key = ThresholdKey(Names[Change.Sensor]);
+		if (InArgs.PrtTmp)
 		{
-			if (InArgs.PrtTmp) std::cout << "Maximum temperature exceeded by sensor " << index << "\n";
-			if (InArgs.Command.length() > 0) InArgs.Prog = popen(InArgs.Command.c_str(),"r");
-			return 0;
+			std::cout << "Sensor " << Change.Sensor << ": " << AlertLevelName(Change.From) << " -> " << AlertLevelName(Change.To) << " (" << Change.Value;
+			if (Change.To == AlertLevel::Warning && Eta != NULL && (*Eta)[Change.Sensor] <= InArgs.Alert.Horizon)
+				std::cout << ", critical in " << (int)(*Eta)[Change.Sensor] << " s";
+			std::cout << ")\n";
 		}
-		else return 1;
+		if (Change.To == AlertLevel::Critical) Actions.Fire(Key,InArgs.Command,Change.Value,Criticals[Change.Sensor]);
+		else if (Change.From == AlertLevel::Critical) Actions.Clear(Key);
 	}
-	else
+	for (std::size_t i = 0; i != Snapshot.Values.size(); i++)
+	{
+		if (Alerts.Level(i) != AlertLevel::Critical) continue;
+		Safe = 0;
+		Actions.Update(ThresholdKey(Names[i]),Snapshot.Values[i],Criticals[i]);
+	}
+	return Safe;
+};
+
+/****************************************************************
+ProcessRules:
+	Takes:
+		Rules: the loaded alert rules (bound to 'Names')
+		Snapshot: the newest reading of every sensor
+		Criticals: critical temperature of every sensor
+		Names: sensor names, indexed like Snapshot
+
+	Feeds the snapshot to the rule engine and runs the action
+		of every rule that fires (or the -C action if the
+		rule has none), undoing built-in actions when the
+		rule clears.
+****************************************************************/
+void ProcessRules(RuleEngine &Rules, SensorSnapshot const &Snapshot, std::vector<float> const &Criticals, std::vector<std::string> const &Names, InputArguments const &InArgs, AlertActions &Actions)
+{
+	if (Rules.Size() == 0) return;
+	for (auto const &Fired : Rules.Evaluate(Snapshot,Criticals))
 	{
-		if (value >= InArgs.MinTemp)
+		AlertRule const &Rule = Rules.Rule(Fired.Rule);
+		std::string Key = RuleKey(Rule,Names[Fired.Sensor]);
+		if (Fired.Cleared)
 		{
-			if (InArgs.PrtTmp) std::cout << "Maximum temperature exceeded by sensor " << index << "\n";
-			if (InArgs.Command.length() > 0) InArgs.Prog = popen(InArgs.Command.c_str(),"r");
-			return 0;
+			Actions.Clear(Key);
+			continue;
 		}
-		else return 1;
+		if (InArgs.PrtTmp) std::cout << "Rule '" << Rule.Text << "' fired for " << Names[Fired.Sensor] << " (" << Fired.Value << ")\n";
+		std::string const &Command = (Rule.Command.length() > 0) ? Rule.Command : InArgs.Command;
+		float Critical = (Fired.Sensor < Criticals.size()) ? Criticals[Fired.Sensor] : NAN;
+		Actions.Fire(Key,Command,Snapshot.Values[Fired.Sensor],Critical);
 	}
 };
 
 /****************************************************************
-avg:
+ThresholdKey:
+	Takes:
+		Sensor: the name of a sensor
+	Returns:
+		The key the actions of its critical threshold run
+		under, by name like RuleKey's.
+****************************************************************/
+std::string ThresholdKey(std::string const &Sensor)
+{
+	return "threshold:" + Sensor;
+};
+
+/****************************************************************
+RuleKey:
 	Takes:
-		x1: some value
-		x2: some other value
+		Rule: an alert rule
+		Sensor: the name of a sensor it is bound to
 	Returns:
-		The mean value of x1 and x2
+		The key its actions run under.  Rules are keyed by
+		their text rather than their position so that
+		reloading the rules file doesn't mix them up.
+****************************************************************/
+std::string RuleKey(AlertRule const &Rule, std::string const &Sensor)
+{
+	return "rule:" + Rule.Text + ":" + Sensor;
+};
+
+/****************************************************************
+ApplyAlertConfig:
+	Takes:
+		Config: a newly loaded alert configuration
+		Rules: the rule engine (bound to 'Names')
+		Criticals: critical temperatures to replace (if the
+			configuration has a thresholds file; may be NULL)
+
+	Swaps a reloaded configuration in between two samples.
+		Window history is kept for the rules that still use
+		it; built-in actions of rules that were removed while
+		firing are undone.
+****************************************************************/
+void ApplyAlertConfig(AlertConfig const &Config, RuleEngine &Rules, std::vector<std::string> const &Names, std::vector<float> *Criticals, AlertActions &Actions)
+{
+	if (Criticals != NULL && Config.Criticals.size() > 0) *Criticals = Config.Criticals;
+	for (auto const &Dropped : Rules.Replace(Config.Rules,Names))
+		Actions.Clear(RuleKey(Dropped.first,Names[Dropped.second]));
+};
+
+/****************************************************************
+PrintStats:
+	Takes:
+		Snapshot: the newest reading of every sensor
+		Stats: the running statistics it was added to
+		Criticals: critical temperature of every sensor
+		Names: sensor names
+
+	Prints a line per sensor (-s): the reading, its moving
+		average and standard deviation, the trend from the
+		smoothed first and second derivatives and, once the
+		thermal model has been fitted, the temperature it is
+		settling towards and how soon it reaches critical.
+****************************************************************/
+void PrintStats(SensorSnapshot const &Snapshot, SensorStats const &Stats, std::vector<float> const &Criticals, std::vector<std::string> const &Names)
+{
+	for (std::size_t i = 0; i != Stats.Size() && i != Snapshot.Values.size(); i++)
+	{
+		OnlineStats const &S = Stats[i];
+		std::printf("%-24s %7.2f  avg %7.2f +/- %5.2f  trend %+6.2f C/min %+7.3f C/min^2",Names[i].c_str(),Snapshot.Values[i],
+			S.Ewma(),S.StdDev(),S.Slope() * 60,S.Acceleration() * 3600);
+		ThermalPredictor const &Model = Stats.Model(i);
+		if (Model.Valid()) std::printf("  -> %6.2f (tau %.0f s)",Model.Asymptote(),Model.TimeConstant());
+		float Critical = (i < Criticals.size()) ? Criticals[i] : NAN;
+		double Eta = Model.TimeTo(Critical,S.Smoothed());
+		if (std::isfinite(Eta)) std::printf("  critical in %.0f s",Eta);
+		std::printf("\n");
+	}
+	std::fflush(stdout);
+};
+
+/****************************************************************
+PrintHistoryUsage:
+	Takes:
+		History: the history kept within --history-budget
+
+	Prints a line (with -s) of the memory held by each tier of
+		the history and how far back it reaches.
 ****************************************************************/
-double avg(double x1, double x2)
+void PrintHistoryUsage(HistoryStore const &History)
 {
-	return (x1+x2)/2;
+	HistoryStore::Usage U = History.GetUsage();
+	std::printf("history: %zu of %zu KiB: raw %zu KiB (%zu samples), compressed %zu KiB (%zu chunks), rollup %zu KiB (%zu rows, %llu evicted); %.1f hours\n",
+		U.Total() / 1024,History.Budget() / 1024,U.Raw / 1024,U.RawSamples,U.Compressed / 1024,U.Chunks,U.Rollup / 1024,U.RollupRows,
+		(unsigned long long)U.Evicted,(History.LastTime() - History.OldestTime()) / 3600);
+	std::fflush(stdout);
 };
 
 #include <sys/types.h>
@@ -626,7 +1341,8 @@ SetHomeDirectory:
 void SetHomeDirectory(InputArguments &InArgs)
 {
 	//attempt to figure out home directory from environment variable
-	InArgs.HomeDir = string(getenv("HOME"));
+	char const *Home = getenv("HOME");
+	InArgs.HomeDir = (Home != NULL) ? string(Home) : "";
 	//otherwise, get current directory
 	if (InArgs.HomeDir == "") 
 	{
@@ -634,154 +1350,165 @@ void SetHomeDirectory(InputArguments &InArgs)
 	}
 };
 
+#if HAVE_LIBNCURSES == 1
 /****************************************************************
-ReadConfig:
+ParseConfig:
 	Takes:
-		*UI: Pointer to a User Interface object
-		NumSensors: Number of Sensors
+		Data: the contents of ~/.config/TempSafe.cfg
+		NSensors: the number of sensors (one line each)
+		Out: receives the parsed lines
 	Returns:
-		0 if the config file at ~/.config/TempSafe.cfg could
-		not be read
-		1 if the config file is successfully read and
-		loaded into the appropriate variables
+		0 (with Error set) if the file is malformed
+		1 otherwise
 
-	Since this is run only after curses mode is initialized,
-		the errors printed to stderr are not likely to
-		be visible to the user.
+	Each line is "CRITICAL,COLOUR,COMMAND" for the sensor at
+		that position.
 ****************************************************************/
-bool ReadConfig(UserInterface* UI, unsigned int NumSensors, InputArguments &InArgs)
+bool ParseConfig(std::string const &Data, std::size_t NSensors, SensorConfig &Out, std::string &Error)
 {
-	FILE *f;
-	string ConfFile = InArgs.HomeDir + "/.config/TempSafe.cfg";
-	f = fopen(ConfFile.c_str(),"r");
-	if (f == NULL) return 0;
-	vector<int> CritTemps;
-	vector<unsigned int> Colours;
-	vector<string> Commands;
-
-	int BUFFER;
-	string StrBuffer;
-	BUFFER = fgetc(f);
-
-	while (BUFFER != EOF)
+	Out.Lines.clear();
+	Out.Lines.reserve(NSensors);
+	ConfigLines Tokens(Data);
+	std::string_view Fields[3];
+	unsigned NFields;
+	while ((NFields = Tokens.Next(Fields,3)) != 0)
 	{
-		for (int i = 0; i < 3; i++)
+		SensorConfig::Line L;
+		if (NFields != 3)
 		{
-			StrBuffer = "";
-			while (BUFFER != ',' && BUFFER != '\n' && BUFFER != EOF)
-			{
-				StrBuffer += (char) BUFFER;
-				BUFFER = fgetc(f);
-				if (BUFFER == '.' && i < 2) 
-				{
-					std::cerr << "ERROR: inputs in TempSafe.cfg cannot be decimal numbers.\n";
-					fclose(f);
-					return 0;
-				}
-			}
-			switch (i)
-			{
-				case (0): CritTemps.push_back(stoi(StrBuffer)); break;
-				case (1): Colours.push_back(stoi(StrBuffer)); break;
-				case (2): Commands.push_back(StrBuffer); break;
-				default: break;
-			}
-			if (BUFFER != EOF) BUFFER = fgetc(f);
+			Error = "TempSafe.cfg has incomplete lines.";
+			return 0;
 		}
+		if (!ParseField(Fields[0],L.CritTemp) || !ParseField(Fields[1],L.Colour))
+		{
+			Error = "inputs in TempSafe.cfg must be whole numbers (line " + std::to_string(Tokens.LineNo()) + ").";
+			return 0;
+		}
+		L.Command = string(Fields[2]);
+		Out.Lines.push_back(std::move(L));
 	}
 
-	if (CritTemps.size() != Colours.size() || Colours.size() != Commands.size() || Commands.size() != CritTemps.size())
+	if (Out.Lines.size() > NSensors)
 	{
-		std::cerr << "ERROR: TempSafe.cfg has incomplete lines.\n";
-		fclose(f);
+		Error = "TempSafe.cfg has too many config lines.";
 		return 0;
 	}
-	if (CritTemps.size() > NumSensors)
+	else if (Out.Lines.size() < NSensors)
 	{
-		std::cerr << "ERROR: TempSafe.cfg has too many config lines.\n";
-		fclose(f);
+		Error = "TempSafe.cfg has too few config lines.";
 		return 0;
 	}
-	else if (CritTemps.size() < NumSensors)
+	Out.Hash = ContentHash(Data);
+	return 1;
+};
+
+/****************************************************************
+LoadConfig:
+	Reads and parses a TempSafe.cfg into a new snapshot (for
+		reloading; see Config/ConfigWatcher.hpp).  Returns
+		NULL (with Error set) if it can't.
+****************************************************************/
+std::shared_ptr<const SensorConfig> LoadConfig(std::string const &Path, std::size_t NSensors, std::string &Error)
+{
+	string Data;
+	if (!ReadWholeFile(Path,Data))
 	{
-		std::cerr << "ERROR: TempSafe.cfg has too few config lines.\n";
-		fclose(f);
-		return 0;
+		Error = Path + ": " + strerror(errno);
+		return NULL;
 	}
-	
-	if (!UI->SetupValues(CritTemps,Colours,Commands))
+	auto Config = std::make_shared<SensorConfig>();
+	if (!ParseConfig(Data,NSensors,*Config,Error)) return NULL;
+	return Config;
+};
+
+/****************************************************************
+ApplyConfig:
+	Copies the critical temperatures, colours and commands of
+		a parsed TempSafe.cfg into the sensors' preferences.
+****************************************************************/
+void ApplyConfig(SensorConfig const &Config, std::vector<SensorPreferences> &Prefs)
+{
+	for (unsigned i = 0; i != Config.Lines.size() && i != Prefs.size(); i++)
 	{
-		std::cerr << "ERROR: Failed to load TempSafe.cfg into vectors.\n";
-		fclose(f);
+		Prefs[i].SetCriticalTemp(Config.Lines[i].CritTemp);
+		Prefs[i].SetColour(Config.Lines[i].Colour);
+		Prefs[i].SetCommand(Config.Lines[i].Command);
+	}
+};
+
+/****************************************************************
+ReadConfig:
+	Takes:
+		Prefs: the sensors' preferences (one per sensor)
+		Hash: receives the hash of the file's contents, so that
+			WriteConfig can tell whether anything changed
+	Returns:
+		0 if the config file at ~/.config/TempSafe.cfg could
+		not be read
+		1 if the config file is successfully read and
+		loaded into Prefs
+
+	Since this is run only after curses mode is initialized,
+		the errors printed to stderr are not likely to
+		be visible to the user.
+****************************************************************/
+bool ReadConfig(std::vector<SensorPreferences> &Prefs, InputArguments &InArgs, uint64_t *Hash)
+{
+	string ConfFile = InArgs.HomeDir + "/.config/TempSafe.cfg";
+	string Data;
+	if (!ReadWholeFile(ConfFile,Data)) return 0;
+	SensorConfig Config;
+	string Error;
+	if (!ParseConfig(Data,Prefs.size(),Config,Error))
+	{
+		std::cerr << "ERROR: " << Error << "\n";
 		return 0;
 	}
-	fclose(f);
+	ApplyConfig(Config,Prefs);
+	if (Hash != NULL) *Hash = Config.Hash;
 	return 1;
 };
 
 /****************************************************************
 WriteConfig
 	Takes:
-		UI: Pointer to User Interface
+		Prefs: the sensors' preferences (one per sensor)
+		Hash: hash of the file as last read or written
 	Returns:
 		1 upon successful updating of config files
 
-	This function checks the text in the TempSafe.cfg file
-		and if the data has changed, writes the updated
-		information.
+	This function formats the preferences in the TempSafe.cfg
+		format and, if the data has changed, writes it to a
+		temporary file which then replaces the old one.
 ****************************************************************/
-bool WriteConfig(UserInterface* UI, InputArguments &InArgs)
+bool WriteConfig(std::vector<SensorPreferences> const &Prefs, InputArguments &InArgs, uint64_t *Hash)
 {
-	FILE *conf = NULL;
 	string ConfLoc = InArgs.HomeDir + "/.config/TempSafe.cfg";
-	int BUFFER;
-	string ConfData = "";
-
-	string TextToPrint = "";
-
-	vector<int> CritTemps = UI->GetCritTemps();
-	vector<string> Commands = UI->GetCommands();
-	vector<unsigned int> SensColours = UI->GetSensorColours();
-
-	for (unsigned i = 0; i != CritTemps.size(); i++)
-	{
-		char BufferString[512]; //anything this long should be a shell script instead
-		sprintf(BufferString,"%d,%d,%s\n",CritTemps[i],SensColours[i],Commands[i].c_str());
-		TextToPrint += string(BufferString);
-	}
-
-	conf = fopen(ConfLoc.c_str(),"r");
-	if (conf != NULL)
+	string TextToPrint;
+	TextToPrint.reserve(Prefs.size() * 32);
+	for (auto const &i : Prefs)
 	{
-		BUFFER = fgetc(conf);
-		while (BUFFER != EOF)
-		{
-			ConfData += (char)BUFFER;
-			BUFFER = fgetc(conf);
-		}
-		fclose(conf);
-		if (strcmp(ConfData.c_str(),TextToPrint.c_str()) == 0) 
-		{
-			return 1;
-		}
+		char Number[16];
+		auto End = std::to_chars(Number,Number + sizeof(Number),(int)std::lround(i.GetCriticalTemp())).ptr;
+		TextToPrint.append(Number,End);
+		TextToPrint += ',';
+		End = std::to_chars(Number,Number + sizeof(Number),(unsigned)i.GetColour()).ptr;
+		TextToPrint.append(Number,End);
+		TextToPrint += ',';
+		TextToPrint += i.GetCommand();
+		TextToPrint += '\n';
 	}
 
-	std::cerr << "Configuration changed.  Writing changes...\n";
-	remove(ConfLoc.c_str());
-	conf = fopen(ConfLoc.c_str(),"w+");
-	if (conf == NULL)
-	{
-		std::cerr << "ERROR: Could not open " << ConfLoc.c_str() << "for writing.\n";
-	}
-	else
+	if (!WriteFileIfChanged(ConfLoc,TextToPrint,Hash))
 	{
-		fprintf(conf,"%s",TextToPrint.c_str());
-		fclose(conf);
-		return 1;
+		std::cerr << "ERROR: Could not write " << ConfLoc << ": " << strerror(errno) << "\n";
+		return 0;
 	}
-	return 0;
+	return 1;
 }
+#endif
 
+#if HAVE_GTK == 1
 /*
 GUI Config binary file format:
 	GUI Config file starts with a 13-character signature
@@ -809,47 +1536,125 @@ SaveGUIConfig
 ****************************************************************/
 bool SaveGUIConfig(GUI::GUIDataHandler *Handle)
 {
-	FILE *f;
 	string ConfFile = "TempSafe_GUI.cfg";
-	f = fopen(ConfFile.c_str(),"r");
-	if (f != NULL)
-	{
-		fclose(f);
-		remove(ConfFile.c_str());
-	}
-
-	std::ofstream f_out(ConfFile.c_str(),std::ifstream::binary);
+	string Out;
+	auto Put = [&Out](void const *Data, size_t Size) {
+		Out.append((char const*)Data,Size);
+	};
 
-	/*Read signature: {SafeTemp_0.3}*/
+	/*Write signature: {SafeTemp_0.3}*/
 	char Signature[13] = "SafeTemp_0.3";
-	f_out.write(Signature,sizeof(Signature));
+	Put(Signature,sizeof(Signature));
 
 	int NumSensors = Handle->SensorNames.size();
-	f_out.write((char*)&NumSensors,sizeof(int));
+	Put(&NumSensors,sizeof(int));
 	for (unsigned i = 0; i != Handle->SensorNames.size(); i++)
 	{
-		for (unsigned j = 0; j != Handle->SensorNames[i].length(); j++)
-		{
-			f_out.write((char*)&Handle->SensorNames[i][j],sizeof(char));
-		}
-		char NullChar = '\0';
-		f_out.write(&NullChar,sizeof(char));
+		Put(Handle->SensorNames[i].c_str(),Handle->SensorNames[i].length() + 1);
 		unsigned int TMP_Colour = Handle->SensorColours[i];
 		float TMP_Critical = Handle->SensorCriticals[i];
 		char TMP_Active = (char)Handle->SensorActive[i];
-		f_out.write((char*)&TMP_Colour,sizeof(unsigned int));
-		f_out.write((char*)&TMP_Critical,sizeof(float));
-		f_out.write((char*)&TMP_Active,sizeof(char));
-		for (unsigned k = 0; k < Handle->SensorCommands[i].length(); k++)
+		Put(&TMP_Colour,sizeof(unsigned int));
+		Put(&TMP_Critical,sizeof(float));
+		Put(&TMP_Active,sizeof(char));
+		Put(Handle->SensorCommands[i].c_str(),Handle->SensorCommands[i].length() + 1);
+	}
+	if (!WriteFileIfChanged(ConfFile,Out))
+	{
+		std::cerr << "[Save config]: " << ConfFile << ": " << strerror(errno) << "\n";
+		return 0;
+	}
+	return 1;
+};
+
+/****************************************************************
+ParseGUIConfig
+	Takes:
+		Data: the contents of TempSafe_GUI.cfg
+		NSensors: the number of sensors
+		Out: receives the settings of every sensor
+	Returns:
+		1 upon successful parsing (0 with Error set otherwise)
+
+	Checks the signature and bounds-checks every field of the
+		binary format.
+****************************************************************/
+bool ParseGUIConfig(std::string const &Data, std::size_t NSensors, GUIConfig &Out, std::string &Error)
+{
+	size_t Pos = 0;
+	auto Get = [&Data,&Pos](void *Out, size_t Size) {
+		if (Data.size() - Pos < Size) return false;
+		memcpy(Out,Data.data() + Pos,Size);
+		Pos += Size;
+		return true;
+	};
+	auto GetString = [&Data,&Pos](std::string_view &Out) {
+		size_t End = Data.find('\0',Pos);
+		if (End == string::npos) return false;
+		Out = std::string_view(Data).substr(Pos,End - Pos);
+		Pos = End + 1;
+		return true;
+	};
+
+	/*Read signature: {SafeTemp_0.3}*/
+	char Signature[13] = "";
+	Get(Signature,sizeof(Signature));
+	Signature[sizeof(Signature)-1] = '\0';
+	if (strcmp(Signature,"SafeTemp_0.3") != 0)
+	{
+		Error = string("unrecognized file format ") + Signature;
+		return 0;
+	}
+
+	int NumSensors = 0;
+	if (!Get(&NumSensors,sizeof(int)) || NumSensors < 0 || (size_t)NumSensors != NSensors)
+	{
+		Error = "file is for a different set of sensors";
+		return 0;
+	}
+	Out.Colours.resize(NSensors);
+	Out.Criticals.resize(NSensors);
+	Out.Active.resize(NSensors);
+	Out.Commands.resize(NSensors);
+	for (size_t i = 0; i < NSensors; i++)
+	{
+		/*The sensor name is just a placeholder in the file*/
+		std::string_view Name, Command;
+		if (!GetString(Name) || !Get(&Out.Colours[i],sizeof(unsigned int)) || !Get(&Out.Criticals[i],sizeof(float)) ||
+			!Get(&Out.Active[i],sizeof(char)) || !GetString(Command))
 		{
-			f_out.write((char*)&Handle->SensorCommands[i][k],sizeof(char));
+			Error = "file is truncated";
+			return 0;
 		}
-		f_out.write(&NullChar,sizeof(char));
+		Out.Commands[i] = string(Command);
 	}
-	f_out.close();
 	return 1;
 };
 
+/****************************************************************
+LoadGUIConfig
+	Reads and parses TempSafe_GUI.cfg into a new snapshot (for
+		reloading; see Config/ConfigWatcher.hpp).  Returns
+		NULL (with Error set) if it can't.
+****************************************************************/
+std::shared_ptr<const GUIConfig> LoadGUIConfig(std::size_t NSensors, std::string &Error)
+{
+	string ConfFile = "TempSafe_GUI.cfg";
+	string Data;
+	if (!ReadWholeFile(ConfFile,Data))
+	{
+		Error = ConfFile + ": " + strerror(errno);
+		return NULL;
+	}
+	auto Config = std::make_shared<GUIConfig>();
+	if (!ParseGUIConfig(Data,NSensors,*Config,Error))
+	{
+		Error = ConfFile + ": " + Error;
+		return NULL;
+	}
+	return Config;
+};
+
 /****************************************************************
 ReadGUIConfig
 	Takes:
@@ -863,58 +1668,54 @@ ReadGUIConfig
 ****************************************************************/
 bool ReadGUIConfig(GUI::GUIDataHandler *Handle)
 {
-	FILE *f;
 	string ConfFile = "TempSafe_GUI.cfg";
-	f = fopen(ConfFile.c_str(),"r");
-	if (f == NULL) return 0;
-	else fclose(f);
-
-	std::ifstream f_in(ConfFile.c_str(),std::ifstream::binary);
-
-	/*Read signature: {SafeTemp_0.3}*/
-	char Signature[13];
-	f_in.read(Signature,sizeof(Signature));
-
-	int NumSensors = 0;
+	string Data;
+	if (!ReadWholeFile(ConfFile,Data)) return 0;
 	Handle->Harmonize();
-
-	if (strcmp(Signature,"SafeTemp_0.3") == 0)
+	GUIConfig Config;
+	string Error;
+	if (!ParseGUIConfig(Data,Handle->SensorNames.size(),Config,Error))
 	{
-		f_in.read((char*)&NumSensors,sizeof(int));
-		if (Handle->SensorNames.size() != NumSensors)
-			return 0;
-		for (int i = 0; i < NumSensors; i++)
-		{
-			char BUFFER;
-			f_in.read(&BUFFER,sizeof(char));
-			while (BUFFER != '\0' && !f_in.eof())
-			{
-				/*Basically dump this buffer (the sensor name is just a placeholder in the file*/
-				f_in.read(&BUFFER,sizeof(char));
-			}
-			unsigned int TMP_Colour;
-			float TMP_Critical;
-			char TMP_Active;
-			f_in.read((char*)&TMP_Colour,sizeof(unsigned int));
-			f_in.read((char*)&TMP_Critical,sizeof(float));
-			f_in.read((char*)&TMP_Active,sizeof(char));
-			Handle->SensorColours[i] = TMP_Colour;
-			Handle->SensorCriticals[i] = TMP_Critical;
-			Handle->SensorActive[i] = (bool)TMP_Active;
-
-			f_in.read(&BUFFER,sizeof(char));
-			while (BUFFER != '\0' && !f_in.eof())
-			{
-				Handle->SensorCommands[i] += BUFFER;
-				f_in.read(&BUFFER,sizeof(char));
-			}
-		}
+		std::cerr << "[Load config]: " << ConfFile << ": " << Error << "\n";
+		return 0;
 	}
-	else
+	for (size_t i = 0; i != Handle->SensorNames.size(); i++)
 	{
-		std::cerr << "[Load config]: " << ConfFile.c_str() << ": unrecognized file format " << Signature << "\n";
-		return 0;
+		Handle->SensorColours[i] = Config.Colours[i];
+		Handle->SensorCriticals[i] = Config.Criticals[i];
+		Handle->SensorActive[i] = (bool)Config.Active[i];
+		Handle->SensorCommands[i] = Config.Commands[i];
 	}
-	f_in.close();
 	return 1;
 };
+
+/****************************************************************
+ApplyGUIConfig
+	Takes:
+		A heap-allocated std::shared_ptr<const GUIConfig>,
+			which is freed
+	Returns:
+		G_SOURCE_REMOVE
+
+	Idle callback which applies a reloaded TempSafe_GUI.cfg on
+		the GTK thread (which owns the settings and widgets),
+		under the lock shared with the chart renderer.
+****************************************************************/
+gboolean ApplyGUIConfig(gpointer Data)
+{
+	std::unique_ptr<std::shared_ptr<const GUIConfig>> Config((std::shared_ptr<const GUIConfig>*)Data);
+	GUI::GUIDataHandler &Handle = GUI::Handle;
+	{
+		std::lock_guard<std::mutex> Guard(Handle.DataLock);
+		for (size_t i = 0; i != Handle.SensorNames.size() && i != (*Config)->Colours.size(); i++)
+		{
+			Handle.SensorColours[i] = (*Config)->Colours[i];
+			Handle.SensorCriticals[i] = (*Config)->Criticals[i];
+			Handle.SensorActive[i] = (bool)(*Config)->Active[i];
+			Handle.SensorCommands[i] = (*Config)->Commands[i];
+		}
+	}
+	GUI::SetDataFields(GUI::Objects);
+	return G_SOURCE_REMOVE;
+};
+#endif
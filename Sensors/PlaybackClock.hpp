@@ -0,0 +1,106 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Playback Clock
+	Paces a sensor backend that plays samples back rather than
+	    reading hardware (replay_sensor, and the other simulated
+	    backends), so that runs can be reproduced at any speed.
+
+	At a speed S > 0, playback time runs S times as fast as the
+	    wall clock from the first reading.  At speed 0 (as fast
+	    as possible) it only moves on when the caller starts a
+	    new sweep over the sensors: reading a sensor at or
+	    before the last one read (or all of them at once) means
+	    the previous sweep is finished.  Every sweep then sees
+	    the next sample, however quickly the caller loops.
+
+	playback_sensor is the interface such backends share, so
+	    that the main loop can run on their clock (the time of
+	    the sample being played) and stop when they run out.
+****************************************************************/
+#ifndef SENSORS_PLAYBACKCLOCK_HPP_
+#define SENSORS_PLAYBACKCLOCK_HPP_
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include "SensorClass.hpp"
+
+class PlaybackClock {
+private:
+	double m_Speed;
+	bool m_Started = false;
+	std::chrono::steady_clock::time_point m_Start;
+	long m_LastRead = -1;      ///<Index of the last sensor read
+public:
+	/** @param Speed  Multiple of real time (0: one sample per sweep) */
+	explicit PlaybackClock(double Speed = 1) : m_Speed(Speed) {}
+
+	double Speed() const {
+		return m_Speed;
+	}
+	/** @brief Whether samples are stepped through one per sweep instead of by time */
+	bool Stepped() const {
+		return m_Speed <= 0;
+	}
+
+	/** @brief Seconds of playback time since the first call */
+	double Elapsed() {
+		auto Now = std::chrono::steady_clock::now();
+		if (!m_Started) {
+			m_Start = Now;
+			m_Started = true;
+		}
+		return std::chrono::duration<double>(Now - m_Start).count() * m_Speed;
+	}
+
+	/** @brief Note a read of sensors First to Last
+	 * @returns true if it starts a new sweep (never for the first read)
+	 */
+	bool NewSweep(unsigned First, unsigned Last) {
+		bool New = m_LastRead >= 0 && (long)First <= m_LastRead;
+		m_LastRead = Last;
+		return New;
+	}
+
+	/** @brief Parse a speed: a positive multiple of real time (e.g. 1, 60, 0.5) or "max"
+	 * @returns false if Text is neither
+	 */
+	static bool ParseSpeed(char const *Text, double &Speed) {
+		if (std::string(Text) == "max") {
+			Speed = 0;
+			return true;
+		}
+		char *End;
+		double Value = std::strtod(Text, &End);
+		if (End == Text || *End != 0 || !(Value > 0)) return false;
+		Speed = Value;
+		return true;
+	}
+};
+
+/** @brief A set of sensors played back (on a PlaybackClock) rather than read */
+class playback_sensor : public temperature_sensor_set {
+public:
+	/** @brief Wall-clock time (recorded or simulated) of the current sample */
+	virtual double GetTime() const = 0;
+	/** @brief Samples played so far (including the current one) */
+	virtual std::size_t Played() const = 0;
+	/** @brief Whether the last sample has been played */
+	virtual bool Finished() const = 0;
+};
+
+#endif //SENSORS_PLAYBACKCLOCK_HPP_
@@ -0,0 +1,199 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Replay Sensor
+	A temperature_sensor_set that plays back a sample log (the
+	    --log DIR of an earlier run, see History/SampleLog.hpp)
+	    instead of reading the hardware, so that the interfaces,
+	    the history and the alerts can be run against a real
+	    trace, reproducibly.
+
+	The segments are mapped read-only and read a block (or
+	    compressed chunk) at a time, as playback reaches them;
+	    the sensors are every name found in the log, in the
+	    order they first appear, and read NaN in segments that
+	    lack them.  Playback is paced by a PlaybackClock: at
+	    real time, N times as fast, or one sample per sweep
+	    over the sensors.  Finished() is set once the last
+	    sample has been played; the readings then stay at it.
+****************************************************************/
+#ifndef SENSORS_REPLAYSENSOR_HPP_
+#define SENSORS_REPLAYSENSOR_HPP_
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "PlaybackClock.hpp"
+#include "../History/SampleLog.hpp"
+
+class replay_sensor : public playback_sensor {
+private:
+	SampleLog::Reader m_Log;
+	PlaybackClock m_Clock;
+	std::vector<std::string> m_Names;
+	std::vector<std::vector<int>> m_Columns;   ///<[Segment][Column]: index into m_Names
+	std::vector<float> m_Values;
+	double m_Time = NAN;                        ///<Recorded time of the current sample
+	double m_Start = NAN;                       ///<...of the first one
+	std::size_t m_Played = 0;
+	//Position: the current block, decoded into m_Times and m_Block
+	std::size_t m_Segment = 0, m_BlockIndex = 0, m_Record = 0;
+	std::vector<double> m_Times;
+	std::vector<float> m_Block;                 ///<[Record * Names + Sensor]
+	bool m_Loaded = false, m_Finished = false;
+
+	SampleLog::Segment const &Current() const {
+		return *m_Log.Segments()[m_Segment];
+	}
+
+	/** @brief Decode the block at the position (skipping empty segments)
+	 * @returns false at the end of the log
+	 */
+	bool Load() {
+		while (m_Segment < m_Log.Segments().size() && m_BlockIndex >= Current().Blocks().size()) {
+			m_Segment++;
+			m_BlockIndex = 0;
+		}
+		if (m_Segment >= m_Log.Segments().size()) return false;
+		std::vector<int> const &Column = m_Columns[m_Segment];
+		std::size_t const N = m_Names.size();
+		m_Times.clear();
+		m_Block.clear();
+		Current().ForEach(Current().Blocks()[m_BlockIndex], -INFINITY, INFINITY, [&](double Time, float const *Values) {
+			m_Times.push_back(Time);
+			m_Block.resize(m_Block.size() + N, NAN);
+			float *Row = m_Block.data() + m_Block.size() - N;
+			for (std::size_t j = 0; j != Column.size(); j++) Row[Column[j]] = Values[j];
+		});
+		m_Record = 0;
+		m_Loaded = true;
+		return true;
+	}
+
+	/** @brief Time of the next sample (NaN at the end of the log) */
+	double Next() {
+		while (true) {
+			if (!m_Loaded && !Load()) return NAN;
+			//Segments may overlap by a sample or two (a restart); keep times increasing
+			while (m_Record < m_Times.size() && !(std::isnan(m_Time) || m_Times[m_Record] > m_Time)) m_Record++;
+			if (m_Record < m_Times.size()) return m_Times[m_Record];
+			m_Loaded = false;
+			m_BlockIndex++;
+		}
+	}
+
+	/** @brief Make the next sample current */
+	void Take() {
+		m_Time = m_Times[m_Record];
+		std::copy_n(m_Block.data() + m_Record * m_Names.size(), m_Names.size(), m_Values.data());
+		m_Record++;
+		m_Played++;
+		m_Finished = std::isnan(Next());
+	}
+
+	/** @brief Skip (without decoding) the blocks that end before Target */
+	void SkipTo(double Target) {
+		std::size_t Segment = m_Segment, Index = m_BlockIndex + 1;
+		while (Segment < m_Log.Segments().size()) {
+			auto const &Blocks = m_Log.Segments()[Segment]->Blocks();
+			if (Index >= Blocks.size()) {
+				Segment++;
+				Index = 0;
+				continue;
+			}
+			if (Blocks[Index].First > Target) break;
+			m_Segment = Segment;
+			m_BlockIndex = Index++;
+			m_Loaded = false;
+		}
+	}
+
+	/** @brief Move playback on: a sample per sweep, or up to the clock's time */
+	void Update(unsigned First, unsigned Last) {
+		bool Sweep = m_Clock.NewSweep(First, Last);
+		if (m_Finished) return;
+		if (m_Clock.Stepped()) {
+			if (Sweep) Take();
+			return;
+		}
+		double Target = m_Start + m_Clock.Elapsed();
+		SkipTo(Target);
+		while (!m_Finished && Next() <= Target) Take();
+	}
+public:
+	/** @brief Map the log in Dir for playback at Speed times real time (0: a sample per sweep)
+	 * @throws std::runtime_error if Dir holds no samples
+	 */
+	replay_sensor(std::string const &Dir, double Speed = 1) : m_Clock(Speed) {
+		if (!m_Log.Open(Dir)) throw std::runtime_error("Unable to read a sample log in " + Dir);
+		for (auto const &S : m_Log.Segments()) {
+			std::vector<int> Column;
+			for (auto const &Name : S->Names()) {
+				auto IT = std::find(m_Names.begin(), m_Names.end(), Name);
+				if (IT == m_Names.end()) IT = m_Names.insert(m_Names.end(), Name);
+				Column.push_back(IT - m_Names.begin());
+			}
+			m_Columns.push_back(std::move(Column));
+		}
+		m_Values.assign(m_Names.size(), NAN);
+		m_Start = Next();
+		if (std::isnan(m_Start)) throw std::runtime_error("No samples to replay in " + Dir);
+		Take();
+	}
+	replay_sensor(replay_sensor const &) = delete;
+	replay_sensor &operator=(replay_sensor const &) = delete;
+
+	virtual std::vector<TempPair> GetAllTemperatures() override {
+		Update(0, m_Names.size() - 1);
+		std::vector<TempPair> ret;
+		for (unsigned i = 0; i != m_Names.size(); i++) {
+			TempPair TP;
+			TP.Name = m_Names[i];
+			TP.Temp = m_Values[i];
+			ret.push_back(TP);
+		}
+		return ret;
+	}
+	virtual float GetTemperature(std::string const &SensorName) override {
+		auto IT = std::find(m_Names.begin(), m_Names.end(), SensorName);
+		if (IT == m_Names.end()) throw std::runtime_error("Failed to find sensor by name.");
+		return GetTemperature((unsigned)(IT - m_Names.begin()));
+	}
+	virtual float GetTemperature(unsigned index) override {
+		Update(index, index);
+		return m_Values.at(index);
+	}
+	virtual unsigned GetNumberOfSensors() const override {
+		return m_Names.size();
+	}
+	virtual std::string GetSensorName(unsigned index) const override {
+		return m_Names.at(index);
+	}
+
+	virtual double GetTime() const override {
+		return m_Time;
+	}
+	virtual std::size_t Played() const override {
+		return m_Played;
+	}
+	virtual bool Finished() const override {
+		return m_Finished;
+	}
+};
+
+#endif //SENSORS_REPLAYSENSOR_HPP_
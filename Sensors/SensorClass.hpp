@@ -22,6 +22,8 @@ public:
 	virtual float GetTemperature(unsigned index) = 0;
 	/** @brief Get the number of sensors stored in this object */
 	virtual unsigned GetNumberOfSensors() const = 0;
+	/** @brief Get the (raw) name of the sensor at the given index */
+	virtual std::string GetSensorName(unsigned index) const = 0;
 	virtual ~temperature_sensor_set() = default;
 };
 
@@ -71,6 +73,9 @@ public:
 	virtual unsigned GetNumberOfSensors() const override {
 		return SensorNames.size();
 	}
+	virtual std::string GetSensorName(unsigned index) const override {
+		return SensorNames.at(index);
+	}
 };
 
 //TODO: put nvidia sensors here;
@@ -129,7 +134,7 @@ public:
 	}
 
 	/** @brief Get the name of a sensor at index */
-	std::string GetSensorName(unsigned index) const {
+	virtual std::string GetSensorName(unsigned index) const override {
 		return Chips.at(index).Name;
 	}
 
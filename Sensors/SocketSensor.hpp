@@ -0,0 +1,273 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Socket Sensor
+	A temperature_sensor_set that reads from a running daemon
+	    (safetemp-daemon --listen PATH) instead of the hardware,
+	    so that any number of viewers share one sampler.
+
+	It subscribes to the daemon's snapshots and picks up the
+	    ones that have arrived (without blocking) whenever a
+	    temperature is asked for.  If the daemon goes away the
+	    readings become NaN and it reconnects every few seconds.
+	The sensor list is the daemon's when first connected: the
+	    front ends are sized to it, so if a restarted daemon has
+	    different sensors, its readings are matched by name,
+	    sensors it no longer has read NaN and new ones are left
+	    out.
+****************************************************************/
+#ifndef SENSORS_SOCKETSENSOR_HPP_
+#define SENSORS_SOCKETSENSOR_HPP_
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "SensorClass.hpp"
+#include "../Server/Protocol.hpp"
+
+class socket_sensor : public temperature_sensor_set {
+private:
+	std::string m_Path;
+	int m_Fd = -1;
+	Protocol::MessageBuffer m_In;
+	std::string m_Out;
+	std::vector<std::string> m_Names;                   ///<Fixed at the first connection
+	std::vector<float> m_Values;                        ///<Indexed like m_Names
+	std::vector<std::string> m_RemoteNames;             ///<The connected daemon's sensors...
+	std::vector<int> m_Local;                           ///<...and the index of each in m_Names (-1: not there)
+	std::vector<float> m_Received;                      ///<A snapshot as sent (indexed like m_RemoteNames)
+	double m_Time = 0;                                  ///<Time of the newest snapshot
+	std::chrono::steady_clock::time_point m_Retry{};    ///<Earliest time to reconnect
+	std::function<void(double,float const*)> m_OnHistory;
+	bool m_HistoryDone = false;
+
+	void Disconnect() {
+		if (m_Fd < 0) return;
+		close(m_Fd);
+		m_Fd = -1;
+		m_Values.assign(m_Names.size(), NAN);
+		m_Retry = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+		std::cerr << "Lost connection to " << m_Path << "\n";
+	}
+
+	bool Send() {
+		std::size_t Pos = 0;
+		while (Pos < m_Out.size()) {
+			ssize_t N = send(m_Fd, m_Out.data() + Pos, m_Out.size() - Pos, MSG_NOSIGNAL);
+			if (N < 0 && errno == EINTR) continue;
+			if (N <= 0) {
+				m_Out.clear();
+				Disconnect();
+				return false;
+			}
+			Pos += N;
+		}
+		m_Out.clear();
+		return true;
+	}
+
+	void Handle(Protocol::MessageType Type, uint16_t Flags, std::string_view Payload) {
+		using Protocol::MessageType;
+		Protocol::Reader In(Payload);
+		switch (Type) {
+		case MessageType::Sensors: {
+			In.Get<uint32_t>();
+			uint32_t N = In.Get<uint32_t>();
+			std::vector<std::string> Names;
+			for (uint32_t i = 0; i != N && In.Ok(); i++) Names.emplace_back(In.GetString());
+			if (!In.Ok()) break;
+			if (m_Names.empty()) {
+				m_Names = Names;
+				m_Values.assign(m_Names.size(), NAN);
+			}
+			std::unordered_map<std::string,int> Index;
+			for (std::size_t i = 0; i != m_Names.size(); i++) Index.emplace(m_Names[i], (int)i);
+			m_Local.assign(Names.size(), -1);
+			unsigned Matched = 0;
+			for (std::size_t i = 0; i != Names.size(); i++) {
+				auto IT = Index.find(Names[i]);
+				if (IT != Index.end()) { m_Local[i] = IT->second; Matched++; }
+			}
+			if (Matched != m_Names.size() || Matched != Names.size())
+				std::cerr << m_Path << ": the daemon's sensors have changed; showing the " << Matched << " of the original " << m_Names.size() << " it still has\n";
+			m_RemoteNames = std::move(Names);
+			m_Received.assign(m_RemoteNames.size(), NAN);
+			break;
+		}
+		case MessageType::Snapshot: {
+			double Time = In.Get<double>();
+			uint32_t N = In.Get<uint32_t>();
+			if (!In.Ok() || N != m_RemoteNames.size() || In.Left() < N * sizeof(float)) break;
+			In.Get(m_Received.data(), N * sizeof(float));
+			std::vector<float> History;
+			std::vector<float> &Out = (Flags & Protocol::FlagHistory) ? History : m_Values;
+			Out.assign(m_Names.size(), NAN);
+			for (uint32_t i = 0; i != N; i++)
+				if (m_Local[i] >= 0) Out[m_Local[i]] = m_Received[i];
+			if (Flags & Protocol::FlagHistory) {
+				if (m_OnHistory) m_OnHistory(Time, History.data());
+				break;
+			}
+			m_Time = Time;
+			break;
+		}
+		case MessageType::HistoryEnd:
+			m_HistoryDone = true;
+			break;
+		case MessageType::Error:
+			std::cerr << m_Path << ": " << In.GetString() << "\n";
+			break;
+		default:
+			break;
+		}
+	}
+
+	/** @brief Read whatever has arrived, waiting up to TimeoutMs for more */
+	bool Receive(int TimeoutMs) {
+		if (m_Fd < 0) return false;
+		pollfd P{m_Fd, POLLIN, 0};
+		if (TimeoutMs > 0 && poll(&P, 1, TimeoutMs) <= 0) return false;
+		while (true) {
+			char *Buffer = m_In.Reserve(65536);
+			ssize_t N = recv(m_Fd, Buffer, 65536, MSG_DONTWAIT);
+			m_In.Commit(N > 0 ? N : 0);
+			if (N > 0) continue;
+			if (N < 0 && errno == EINTR) continue;
+			if (N < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+			Disconnect();
+			return false;
+		}
+		Protocol::MessageType Type;
+		uint16_t Flags;
+		std::string_view Payload;
+		bool Error;
+		while (m_In.Next(Type, Flags, Payload, Error)) Handle(Type, Flags, Payload);
+		if (Error) {
+			Disconnect();
+			return false;
+		}
+		return true;
+	}
+
+	bool Connect() {
+		sockaddr_un Address;
+		std::memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+		if (m_Path.size() >= sizeof(Address.sun_path)) return false;
+		std::memcpy(Address.sun_path, m_Path.c_str(), m_Path.size() + 1);
+		m_Fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (m_Fd < 0) return false;
+		if (connect(m_Fd, (sockaddr*)&Address, sizeof(Address)) != 0) {
+			close(m_Fd);
+			m_Fd = -1;
+			m_Retry = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+			return false;
+		}
+		m_In = Protocol::MessageBuffer();
+		Protocol::Writer(m_Out, Protocol::MessageType::Hello).Put(Protocol::Version);
+		Protocol::Writer(m_Out, Protocol::MessageType::Subscribe);
+		if (!Send()) return false;
+		//The reply to Hello is the sensor list (and the latest snapshot)
+		m_RemoteNames.clear();
+		auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+		while (m_RemoteNames.empty() && m_Fd >= 0 && std::chrono::steady_clock::now() < Deadline)
+			Receive(100);
+		return m_Fd >= 0 && !m_RemoteNames.empty();
+	}
+
+	/** @brief Pick up new snapshots (reconnecting if the daemon went away) */
+	void Update() {
+		if (m_Fd < 0) {
+			if (std::chrono::steady_clock::now() < m_Retry || !Connect()) return;
+			std::cerr << "Reconnected to " << m_Path << "\n";
+		}
+		Receive(0);
+	}
+public:
+	/** @brief Connect to the daemon listening at Path
+	 * @throws std::runtime_error if there is no daemon there
+	 */
+	socket_sensor(std::string const &Path) : m_Path(Path) {
+		if (!Connect()) throw std::runtime_error("Unable to connect to a SafeTemp daemon at " + Path);
+	}
+	~socket_sensor() {
+		if (m_Fd >= 0) close(m_Fd);
+	}
+	socket_sensor(socket_sensor const &) = delete;
+	socket_sensor &operator=(socket_sensor const &) = delete;
+
+	virtual std::vector<TempPair> GetAllTemperatures() override {
+		Update();
+		std::vector<TempPair> ret;
+		for (unsigned i = 0; i != m_Names.size(); i++) {
+			TempPair TP;
+			TP.Name = m_Names[i];
+			TP.Temp = m_Values[i];
+			ret.push_back(TP);
+		}
+		return ret;
+	}
+	virtual float GetTemperature(std::string const &SensorName) override {
+		Update();
+		for (unsigned i = 0; i != m_Names.size(); i++)
+			if (m_Names[i] == SensorName) return m_Values[i];
+		throw std::runtime_error("Failed to find sensor by name.");
+	}
+	virtual float GetTemperature(unsigned index) override {
+		Update();
+		return m_Values.at(index);
+	}
+	virtual unsigned GetNumberOfSensors() const override {
+		return m_Names.size();
+	}
+	virtual std::string GetSensorName(unsigned index) const override {
+		return m_Names.at(index);
+	}
+
+	/** @brief Wall-clock time of the newest snapshot */
+	double GetTime() const {
+		return m_Time;
+	}
+
+	/** @brief Fetch the daemon's history between two wall-clock times (blocking)
+	 * @param Visit  Called with (Time, Values) for each sample, oldest first (Values indexed like the sensors)
+	 * @returns false if the daemon didn't answer
+	 */
+	bool FetchHistory(double From, double To, std::function<void(double,float const*)> Visit) {
+		if (m_Fd < 0) return false;
+		Protocol::Writer(m_Out, Protocol::MessageType::GetHistory).Put(From).Put(To);
+		if (!Send()) return false;
+		m_OnHistory = std::move(Visit);
+		m_HistoryDone = false;
+		auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (!m_HistoryDone && m_Fd >= 0 && std::chrono::steady_clock::now() < Deadline)
+			Receive(100);
+		m_OnHistory = nullptr;
+		return m_HistoryDone;
+	}
+};
+
+#endif //SENSORS_SOCKETSENSOR_HPP_
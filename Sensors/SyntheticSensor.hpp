@@ -0,0 +1,277 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Synthetic Sensor
+	A temperature_sensor_set that makes up its readings, for
+	    load testing: from 1 to MaxSensors sensors ("Synthetic
+	    00000", ...) whose temperatures drift, jump between
+	    levels, spike and drop out, all decided by a seed.
+
+	Each reading is a function of the sensor, the sample number
+	    and the seed alone (a counter-based hash rather than a
+	    random number generator that has to be stepped), so a
+	    sample is the same whether it is reached one at a time
+	    or skipped to, and a run can be repeated exactly.  A
+	    sample of every sensor is generated in one loop over
+	    arrays of per-sensor parameters, with no branches or
+	    library calls in it, which compilers vectorize.
+
+	A reading is made of:
+	    a base temperature, between 35 and 55 degrees;
+	    drift: a slow wave (a period of 10 minutes to 2 hours)
+	        of up to Settings::Drift degrees either way;
+	    steps: a level of up to Settings::Steps degrees either
+	        way, held for 15 minutes and then drawn again (each
+	        sensor at its own times);
+	    noise: up to Settings::Noise degrees either way (the
+	        sum of two uniform draws, so small values are the
+	        most likely);
+	    spikes: a Settings::Spikes fraction of samples are 10 to
+	        20 degrees higher;
+	    dropouts: a Settings::Dropouts fraction of the time, in
+	        runs of 5 samples, the sensor can't be read (NaN).
+
+	Samples are Settings::Interval seconds apart, from the time
+	    the set was made (or Settings::Start, for runs that must
+	    match to the timestamp), and paced by a PlaybackClock.
+****************************************************************/
+#ifndef SENSORS_SYNTHETICSENSOR_HPP_
+#define SENSORS_SYNTHETICSENSOR_HPP_
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "PlaybackClock.hpp"
+
+class synthetic_sensor : public playback_sensor {
+public:
+	static constexpr unsigned MaxSensors = 100000;
+
+	/** @brief What to generate, parsed from "COUNT[,KEY=VALUE...]" */
+	struct Settings {
+		unsigned Count = 100;
+		uint32_t Seed = 1;
+		double Interval = 1;         ///<Seconds between samples
+		float Drift = 5;             ///<Degrees
+		float Steps = 6;             ///<Degrees
+		float Noise = 0.25;          ///<Degrees
+		float Spikes = 0.0005;       ///<Fraction of samples
+		float Dropouts = 0.0005;     ///<Fraction of samples
+		std::size_t Samples = 0;     ///<Stop after this many (0: never)
+		double Start = 0;            ///<Time of the first sample (0: when the set is made)
+
+		/** @brief Parse Text, e.g. "10000,seed=7,noise=0.5,dropouts=0"
+		 * @returns false (with Error set) if it is malformed or out of range
+		 */
+		bool Parse(std::string const &Text, std::string &Error) {
+			std::size_t Pos = 0;
+			for (bool First = true; Pos <= Text.size(); First = false) {
+				std::size_t End = Text.find(',', Pos);
+				if (End == std::string::npos) End = Text.size();
+				std::string Item = Text.substr(Pos, End - Pos);
+				Pos = End + 1;
+				std::size_t Eq = Item.find('=');
+				std::string Key = First ? "count" : Item.substr(0, Eq);
+				std::string Value = First ? Item : (Eq == std::string::npos ? "" : Item.substr(Eq + 1));
+				char *Stop;
+				double Number = std::strtod(Value.c_str(), &Stop);
+				if (Value.empty() || *Stop != 0 || !(Number >= 0)) {
+					Error = "bad value in '" + Item + "'";
+					return false;
+				}
+				if (Key == "count") Count = (unsigned)std::min(Number, 1e9);
+				else if (Key == "seed") Seed = (uint32_t)std::fmod(Number, 4294967296.0);
+				else if (Key == "interval") Interval = Number;
+				else if (Key == "drift") Drift = Number;
+				else if (Key == "steps") Steps = Number;
+				else if (Key == "noise") Noise = Number;
+				else if (Key == "spikes") Spikes = Number;
+				else if (Key == "dropouts") Dropouts = Number;
+				else if (Key == "samples") Samples = (std::size_t)Number;
+				else if (Key == "start") Start = Number;
+				else {
+					Error = "unknown setting '" + Key + "'";
+					return false;
+				}
+			}
+			if (Count < 1 || Count > MaxSensors) Error = "the number of sensors must be 1 to " + std::to_string(MaxSensors);
+			else if (!(Interval > 0)) Error = "interval must be more than 0";
+			else if (Spikes > 1 || Dropouts > 1) Error = "spikes and dropouts are fractions (0 to 1)";
+			else return true;
+			return false;
+		}
+	};
+private:
+	static constexpr double HoldSeconds = 900;    ///<Between steps
+	static constexpr uint32_t DropoutRun = 5;     ///<Samples
+
+	Settings m_Settings;
+	PlaybackClock m_Clock;
+	std::vector<std::string> m_Names;
+	//Per sensor, fixed by the seed
+	std::vector<uint32_t> m_Key;
+	std::vector<float> m_Base, m_Amplitude;
+	std::vector<double> m_Cycles, m_Phase;       ///<Drift periods per sample, and where they start
+	std::vector<double> m_Holds, m_HoldPhase;    ///<Step levels per sample, and where they start
+	std::vector<float> m_Values;
+	double m_Origin;
+	std::size_t m_Sample = 0;
+	std::size_t m_Played = 1;
+
+	/** @brief A well-mixed 32-bit hash (lowbias32) */
+	static uint32_t Hash(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return x;
+	}
+	/** @brief The top 24 bits of H as a float in [0, 1) */
+	static float Uniform(uint32_t H) {
+		return (float)(H >> 8) * (1.0f / 16777216);
+	}
+
+	/** @brief Compute sample K of every sensor into m_Values */
+	void Generate(std::size_t K) {
+		std::size_t const N = m_Values.size();
+		uint32_t const Sample = (uint32_t)K;
+		uint32_t const Run = Hash((uint32_t)(K / DropoutRun) ^ 0x5bd1e995U);
+		uint32_t const Tick = Hash(Sample ^ 0x27d4eb2fU);
+		float const Drift = m_Settings.Drift, Steps = m_Settings.Steps, Noise = m_Settings.Noise;
+		//Compared with the top 24 bits of a hash, which is how likely each is
+		uint32_t const Spikes = (uint32_t)(m_Settings.Spikes * 16777216), Dropouts = (uint32_t)(m_Settings.Dropouts * 16777216);
+		uint32_t const *Key = m_Key.data();
+		float const *Base = m_Base.data(), *Amplitude = m_Amplitude.data();
+		double const *Cycles = m_Cycles.data(), *Phase = m_Phase.data(), *Holds = m_Holds.data(), *HoldPhase = m_HoldPhase.data();
+		float *Out = m_Values.data();
+		for (std::size_t i = 0; i < N; i++) {
+			//Drift: a sine wave, approximated by a parabola (refined) over the fraction of its period
+			double Cycle = K * Cycles[i] + Phase[i];
+			float u = 2 * (float)(Cycle - (int32_t)Cycle) - 1;
+			float Wave = 4 * u * (1 - std::fabs(u));
+			Wave = 0.775f * Wave + 0.225f * Wave * std::fabs(Wave);
+			//Steps: a level drawn for each hold
+			double Hold = K * Holds[i] + HoldPhase[i];
+			float Level = 2 * Uniform(Hash(Key[i] ^ (uint32_t)(int32_t)Hold * 0x9e3779b9U)) - 1;
+			uint32_t H = Hash(Key[i] ^ Tick);
+			float Jitter = (float)(H & 0xffff) * (1.0f / 65536) + (float)(H >> 16) * (1.0f / 65536) - 1;
+			//Spikes and dropouts are applied with integer masks: a float select (?:) is
+			//turned into a branch, since float arithmetic may trap, and the loop isn't vectorized
+			uint32_t S = Hash(H);
+			uint32_t Spiking = 0 - (uint32_t)((S >> 8) < Spikes);
+			uint32_t Dropped = 0 - (uint32_t)((Hash(Key[i] ^ Run) >> 8) < Dropouts);
+			float Spike = (float)(int32_t)(Spiking & ((Hash(S) >> 8) + 16777216)) * (10.0f / 16777216);   //10 to 20
+			float Value = Base[i] - Amplitude[i] * Drift * Wave + Steps * Level + Noise * Jitter + Spike;
+			uint32_t Bits;
+			std::memcpy(&Bits, &Value, sizeof(Bits));
+			Bits |= Dropped & 0x7fc00000U;   //NaN
+			std::memcpy(Out + i, &Bits, sizeof(Bits));
+		}
+	}
+
+	/** @brief Move on: a sample per sweep, or to the clock's time */
+	void Update(unsigned First, unsigned Last) {
+		bool Sweep = m_Clock.NewSweep(First, Last);
+		if (Finished()) return;
+		std::size_t K = m_Sample;
+		if (m_Clock.Stepped()) K += Sweep;
+		else K = (std::size_t)(m_Clock.Elapsed() / m_Settings.Interval);
+		if (m_Settings.Samples != 0) K = std::min(K, m_Settings.Samples - 1);
+		if (K == m_Sample) return;
+		m_Sample = K;
+		m_Played++;
+		Generate(K);
+	}
+public:
+	/** @param Speed  Multiple of real time (0: a sample per sweep) */
+	synthetic_sensor(Settings const &S, double Speed = 1) : m_Settings(S), m_Clock(Speed) {
+		if (S.Count < 1 || S.Count > MaxSensors) throw std::runtime_error("Unsupported number of synthetic sensors");
+		unsigned const N = S.Count;
+		m_Origin = (S.Start > 0) ? S.Start : std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+		m_Names.reserve(N);
+		m_Key.resize(N);
+		m_Base.resize(N);
+		m_Amplitude.resize(N);
+		m_Cycles.resize(N);
+		m_Phase.resize(N);
+		m_Holds.resize(N);
+		m_HoldPhase.resize(N);
+		m_Values.resize(N);
+		char Name[32];
+		for (unsigned i = 0; i != N; i++) {
+			std::snprintf(Name, sizeof(Name), "Synthetic %05u", i);
+			m_Names.push_back(Name);
+			uint32_t Key = Hash(S.Seed * 0x9e3779b9U + Hash(i));
+			m_Key[i] = Key;
+			m_Base[i] = 35 + 20 * Uniform(Hash(Key + 1));
+			m_Amplitude[i] = Uniform(Hash(Key + 2));
+			double Period = 600 + 6600 * Uniform(Hash(Key + 3));
+			m_Cycles[i] = S.Interval / Period;
+			m_Phase[i] = Uniform(Hash(Key + 4));
+			m_Holds[i] = S.Interval / HoldSeconds;
+			m_HoldPhase[i] = Uniform(Hash(Key + 5));
+		}
+		Generate(0);
+	}
+
+	virtual std::vector<TempPair> GetAllTemperatures() override {
+		Update(0, m_Names.size() - 1);
+		std::vector<TempPair> ret;
+		ret.reserve(m_Names.size());
+		for (unsigned i = 0; i != m_Names.size(); i++) {
+			TempPair TP;
+			TP.Name = m_Names[i];
+			TP.Temp = m_Values[i];
+			ret.push_back(TP);
+		}
+		return ret;
+	}
+	virtual float GetTemperature(std::string const &SensorName) override {
+		unsigned Index;
+		if (std::sscanf(SensorName.c_str(), "Synthetic %u", &Index) != 1 || Index >= m_Names.size() || m_Names[Index] != SensorName)
+			throw std::runtime_error("Failed to find sensor by name.");
+		return GetTemperature(Index);
+	}
+	virtual float GetTemperature(unsigned index) override {
+		Update(index, index);
+		return m_Values.at(index);
+	}
+	virtual unsigned GetNumberOfSensors() const override {
+		return m_Names.size();
+	}
+	virtual std::string GetSensorName(unsigned index) const override {
+		return m_Names.at(index);
+	}
+
+	virtual double GetTime() const override {
+		return m_Origin + m_Sample * m_Settings.Interval;
+	}
+	virtual std::size_t Played() const override {
+		return m_Played;
+	}
+	virtual bool Finished() const override {
+		return m_Settings.Samples != 0 && m_Sample + 1 >= m_Settings.Samples;
+	}
+};
+
+#endif //SENSORS_SYNTHETICSENSOR_HPP_
@@ -0,0 +1,399 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Metrics Server
+	A minimal HTTP endpoint (GET /metrics) serving the latest
+	    snapshot in the Prometheus text format:
+	     -safetemp_temperature_celsius{sensor}   gauge
+	     -safetemp_critical_celsius{sensor}      gauge (NaN: none)
+	     -safetemp_alert_state{sensor}           gauge (0 normal,
+	          1 warning, 2 critical, 3 cooldown)
+	     -safetemp_sensor_read_seconds          histogram
+	     -safetemp_tick_seconds                 histogram
+	     -safetemp_samples_total                counter
+	     -safetemp_temperature_summary_celsius{sensor}  summary
+	          (quantiles 0.5/0.9/0.99 of the last 24 hours, from
+	          the SketchRollup given to SetRollup())
+	     -safetemp_history_bytes{tier}          gauge (raw,
+	          compressed and rollup tiers of the HistoryStore
+	          given to SetHistory(), with --history-budget)
+	     -safetemp_history_evicted_total        counter
+
+	The sampler calls Update() each tick; a scrape only renders
+	    what Update() stored, so it never touches the hardware.
+	    The body is rendered into a reused buffer with
+	    std::to_chars and the per-sensor label text is built
+	    once, so a scrape doesn't allocate per sensor.
+****************************************************************/
+#ifndef SERVER_METRICSSERVER_HPP_
+#define SERVER_METRICSSERVER_HPP_
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <charconv>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "../Core/EventLoop.hpp"
+#include "../History/HistoryStore.hpp"
+#include "../History/SketchRollup.hpp"
+
+/** @brief A fixed-bucket histogram of durations in seconds */
+class LatencyHistogram {
+public:
+	static constexpr std::array<double,10> Bounds{0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.1, 1};
+private:
+	std::array<uint64_t,Bounds.size() + 1> m_Counts{};   ///<Last bucket: +Inf
+	double m_Sum = 0;
+	uint64_t m_Count = 0;
+public:
+	void Observe(double Seconds) {
+		std::size_t i = 0;
+		while (i != Bounds.size() && Seconds > Bounds[i]) i++;
+		m_Counts[i]++;
+		m_Sum += Seconds;
+		m_Count++;
+	}
+	uint64_t Bucket(std::size_t i) const {
+		return m_Counts[i];
+	}
+	double Sum() const {
+		return m_Sum;
+	}
+	uint64_t Count() const {
+		return m_Count;
+	}
+};
+
+class MetricsServer {
+private:
+	struct Connection {
+		int Fd;
+		std::string In;
+		std::string Out;
+		std::size_t OutPos = 0;
+	};
+	EventLoop &m_Loop;
+	int m_Listen = -1;
+	std::vector<std::unique_ptr<Connection>> m_Connections;
+
+	std::vector<std::string> m_Labels;      ///<{sensor="NAME"} of each sensor, escaped
+	std::vector<std::string> m_QuantileLabels; ///<{sensor="NAME",quantile="
+	SketchRollup const *m_Rollup = nullptr;
+	HistoryStore const *m_History = nullptr;
+	QuantileSketch m_Window;                ///<Reused to merge a sensor's buckets
+	std::vector<float> m_Values;
+	std::vector<float> m_Criticals;
+	std::vector<uint8_t> m_Levels;
+	uint64_t m_Samples = 0;
+	LatencyHistogram m_ReadLatency;
+	LatencyHistogram m_TickLatency;
+	std::string m_Body;                     ///<Reused for every scrape
+
+	void Put(double Value) {
+		if (std::isnan(Value)) { m_Body += "NaN"; return; }
+		if (std::isinf(Value)) { m_Body += (Value > 0) ? "+Inf" : "-Inf"; return; }
+		char Buffer[32];
+		m_Body.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Value).ptr);
+	}
+	void Put(float Value) {   //Shortest text that reads back as the same float: 45.1, not 45.099998474121094
+		if (std::isnan(Value)) { m_Body += "NaN"; return; }
+		if (std::isinf(Value)) { m_Body += (Value > 0) ? "+Inf" : "-Inf"; return; }
+		char Buffer[32];
+		m_Body.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Value).ptr);
+	}
+	void Put(uint64_t Value) {
+		char Buffer[24];
+		m_Body.append(Buffer, std::to_chars(Buffer, Buffer + sizeof(Buffer), Value).ptr);
+	}
+	void PutHeader(char const *Name, char const *Type, char const *Help) {
+		m_Body += "# HELP ";
+		m_Body += Name;
+		m_Body += ' ';
+		m_Body += Help;
+		m_Body += "\n# TYPE ";
+		m_Body += Name;
+		m_Body += ' ';
+		m_Body += Type;
+		m_Body += '\n';
+	}
+	template <typename T>
+	void PutGauge(char const *Name, char const *Help, std::vector<T> const &Values) {
+		PutHeader(Name, "gauge", Help);
+		for (std::size_t i = 0; i != Values.size(); i++) {
+			m_Body += Name;
+			m_Body += m_Labels[i];
+			m_Body += ' ';
+			Put((std::conditional_t<std::is_integral<T>::value, uint64_t, T>)Values[i]);
+			m_Body += '\n';
+		}
+	}
+	void PutHistogram(char const *Name, char const *Help, LatencyHistogram const &H) {
+		PutHeader(Name, "histogram", Help);
+		uint64_t Cumulative = 0;
+		for (std::size_t i = 0; i <= LatencyHistogram::Bounds.size(); i++) {
+			Cumulative += H.Bucket(i);
+			m_Body += Name;
+			m_Body += "_bucket{le=\"";
+			Put(i < LatencyHistogram::Bounds.size() ? LatencyHistogram::Bounds[i] : INFINITY);
+			m_Body += "\"} ";
+			Put(Cumulative);
+			m_Body += '\n';
+		}
+		m_Body += Name;
+		m_Body += "_sum ";
+		Put(H.Sum());
+		m_Body += '\n';
+		m_Body += Name;
+		m_Body += "_count ";
+		Put(H.Count());
+		m_Body += '\n';
+	}
+
+	void PutSummary(char const *Name, char const *Help) {
+		static constexpr double Quantiles[] = {0.5, 0.9, 0.99};
+		static constexpr char const *QuantileText[] = {"0.5", "0.9", "0.99"};
+		PutHeader(Name, "summary", Help);
+		double Now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+		for (std::size_t i = 0; i != m_Labels.size(); i++) {
+			m_Window.Clear();
+			m_Rollup->Merge(i, Now - 86400, Now, m_Window);
+			for (std::size_t q = 0; q != 3; q++) {
+				m_Body += Name;
+				m_Body += m_QuantileLabels[i];
+				m_Body += QuantileText[q];
+				m_Body += "\"} ";
+				Put(m_Window.Quantile(Quantiles[q]));
+				m_Body += '\n';
+			}
+			m_Body += Name;
+			m_Body += "_sum";
+			m_Body += m_Labels[i];
+			m_Body += ' ';
+			Put(m_Window.Sum());
+			m_Body += '\n';
+			m_Body += Name;
+			m_Body += "_count";
+			m_Body += m_Labels[i];
+			m_Body += ' ';
+			Put(m_Window.Count());
+			m_Body += '\n';
+		}
+	}
+
+	void Render() {
+		m_Body.clear();
+		PutGauge("safetemp_temperature_celsius", "Latest temperature of each sensor.", m_Values);
+		PutGauge("safetemp_critical_celsius", "Critical temperature of each sensor (NaN: none).", m_Criticals);
+		PutGauge("safetemp_alert_state", "Alert state (0 normal, 1 warning, 2 critical, 3 cooldown).", m_Levels);
+		if (m_Rollup != nullptr && m_Rollup->Sensors() == m_Labels.size())
+			PutSummary("safetemp_temperature_summary_celsius", "Temperature quantiles over the last 24 hours (within 1%).");
+		PutHistogram("safetemp_sensor_read_seconds", "Time taken to read every sensor once.", m_ReadLatency);
+		PutHistogram("safetemp_tick_seconds", "Time taken by one sampling tick (reading, alerts and outputs).", m_TickLatency);
+		PutHeader("safetemp_samples_total", "counter", "Sampling ticks since start.");
+		m_Body += "safetemp_samples_total ";
+		Put(m_Samples);
+		m_Body += '\n';
+		if (m_History != nullptr && m_History->Budget() != 0) {
+			HistoryStore::Usage U = m_History->GetUsage();
+			PutHeader("safetemp_history_bytes", "gauge", "Memory held by each tier of the history.");
+			m_Body += "safetemp_history_bytes{tier=\"raw\"} ";
+			Put((uint64_t)U.Raw);
+			m_Body += "\nsafetemp_history_bytes{tier=\"compressed\"} ";
+			Put((uint64_t)U.Compressed);
+			m_Body += "\nsafetemp_history_bytes{tier=\"rollup\"} ";
+			Put((uint64_t)U.Rollup);
+			m_Body += '\n';
+			PutHeader("safetemp_history_evicted_total", "counter", "Rollup rows evicted to stay within the history budget.");
+			m_Body += "safetemp_history_evicted_total ";
+			Put(U.Evicted);
+			m_Body += '\n';
+		}
+	}
+
+	void Accept() {
+		int Fd;
+		while ((Fd = accept4(m_Listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+			if (m_Connections.size() >= 16) {
+				close(Fd);
+				continue;
+			}
+			m_Connections.push_back(std::make_unique<Connection>());
+			Connection *C = m_Connections.back().get();
+			C->Fd = Fd;
+			m_Loop.AddFd(Fd, POLLIN, [this, C](short Revents){ OnConnection(C, Revents); });
+		}
+	}
+
+	void Close(Connection *C) {
+		m_Loop.RemoveFd(C->Fd);
+		close(C->Fd);
+		for (auto IT = m_Connections.begin(); IT != m_Connections.end(); ++IT) {
+			if (IT->get() == C) {
+				m_Connections.erase(IT);
+				break;
+			}
+		}
+	}
+
+	void Respond(Connection *C, char const *Status, std::string_view Body) {
+		C->Out = "HTTP/1.1 ";
+		C->Out += Status;
+		C->Out += "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nConnection: close\r\nContent-Length: ";
+		C->Out += std::to_string(Body.size());
+		C->Out += "\r\n\r\n";
+		C->Out += Body;
+		m_Loop.ModifyFd(C->Fd, POLLOUT);
+	}
+
+	void OnConnection(Connection *C, short Revents) {
+		if (Revents & POLLIN) {
+			char Buffer[2048];
+			ssize_t N = read(C->Fd, Buffer, sizeof(Buffer));
+			if (N <= 0 && !(N < 0 && (errno == EAGAIN || errno == EINTR))) {
+				Close(C);
+				return;
+			}
+			if (N > 0) C->In.append(Buffer, N);
+			if (C->In.find("\r\n\r\n") == std::string::npos) {
+				if (C->In.size() > 8192) Close(C);
+				return;
+			}
+			if (C->In.compare(0, 12, "GET /metrics") == 0 && (C->In[12] == ' ' || C->In[12] == '?')) {
+				Render();
+				Respond(C, "200 OK", m_Body);
+			}
+			else if (C->In.compare(0, 4, "GET ") == 0) Respond(C, "404 Not Found", "Try /metrics\n");
+			else Respond(C, "405 Method Not Allowed", "");
+			return;
+		}
+		if (Revents & POLLOUT) {
+			ssize_t N = send(C->Fd, C->Out.data() + C->OutPos, C->Out.size() - C->OutPos, MSG_NOSIGNAL);
+			if (N > 0) C->OutPos += N;
+			if (C->OutPos == C->Out.size() || (N < 0 && errno != EAGAIN && errno != EINTR)) Close(C);
+			return;
+		}
+		if (Revents & (POLLERR | POLLHUP | POLLNVAL)) Close(C);
+	}
+
+	static std::string Escape(std::string const &Text) {
+		std::string Out;
+		for (char c : Text) {
+			if (c == '\\' || c == '"') Out += '\\';
+			if (c == '\n') { Out += "\\n"; continue; }
+			Out += c;
+		}
+		return Out;
+	}
+public:
+	explicit MetricsServer(EventLoop &Loop) : m_Loop(Loop) {}
+	~MetricsServer() {
+		for (auto &C : m_Connections) {
+			m_Loop.RemoveFd(C->Fd);
+			close(C->Fd);
+		}
+		if (m_Listen >= 0) {
+			m_Loop.RemoveFd(m_Listen);
+			close(m_Listen);
+		}
+	}
+	MetricsServer(MetricsServer const &) = delete;
+	MetricsServer &operator=(MetricsServer const &) = delete;
+
+	/** @brief Listen for scrapes on Address ("PORT" or "HOST:PORT"; the host defaults to 127.0.0.1) */
+	bool Listen(std::string const &Address) {
+		std::string Host = "127.0.0.1", Port = Address;
+		std::size_t Colon = Address.rfind(':');
+		if (Colon != std::string::npos) {
+			Host = Address.substr(0, Colon);
+			Port = Address.substr(Colon + 1);
+		}
+		sockaddr_in Bind;
+		std::memset(&Bind, 0, sizeof(Bind));
+		Bind.sin_family = AF_INET;
+		unsigned PortNumber = 0;
+		auto Parsed = std::from_chars(Port.data(), Port.data() + Port.size(), PortNumber);
+		if (Parsed.ec != std::errc() || Parsed.ptr != Port.data() + Port.size() || PortNumber == 0 || PortNumber > 65535 ||
+		    inet_pton(AF_INET, Host.c_str(), &Bind.sin_addr) != 1) {
+			std::cerr << "Invalid metrics address '" << Address << "' (expected [HOST:]PORT)\n";
+			return false;
+		}
+		Bind.sin_port = htons(PortNumber);
+		m_Listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		int One = 1;
+		if (m_Listen < 0 || setsockopt(m_Listen, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One)) != 0 ||
+		    bind(m_Listen, (sockaddr*)&Bind, sizeof(Bind)) != 0 || listen(m_Listen, 16) != 0) {
+			std::cerr << "Cannot serve metrics on " << Address << ": " << strerror(errno) << "\n";
+			if (m_Listen >= 0) close(m_Listen);
+			m_Listen = -1;
+			return false;
+		}
+		m_Loop.AddFd(m_Listen, POLLIN, [this](short){ Accept(); });
+		return true;
+	}
+
+	/** @brief Set the sensor list (the only place per-sensor text is built) */
+	void SetSensors(std::vector<std::string> const &Names) {
+		m_Labels.clear();
+		m_QuantileLabels.clear();
+		for (auto const &Name : Names) {
+			m_Labels.push_back("{sensor=\"" + Escape(Name) + "\"}");
+			m_QuantileLabels.push_back("{sensor=\"" + Escape(Name) + "\",quantile=\"");
+		}
+		m_Values.assign(Names.size(), NAN);
+		m_Criticals.assign(Names.size(), NAN);
+		m_Levels.assign(Names.size(), 0);
+	}
+
+	/** @brief Also export quantiles from Rollup (which must outlive the server) */
+	void SetRollup(SketchRollup const *Rollup) {
+		m_Rollup = Rollup;
+	}
+
+	/** @brief Also export the memory used by the tiers of History (which must outlive the server) */
+	void SetHistory(HistoryStore const *History) {
+		m_History = History;
+	}
+
+	/** @brief Record one tick (arrays indexed like the sensor list; Criticals may be null) */
+	void Update(float const *Values, float const *Criticals, uint8_t const *Levels) {
+		std::copy(Values, Values + m_Values.size(), m_Values.begin());
+		if (Criticals != nullptr) std::copy(Criticals, Criticals + m_Criticals.size(), m_Criticals.begin());
+		else std::fill(m_Criticals.begin(), m_Criticals.end(), NAN);
+		std::copy(Levels, Levels + m_Levels.size(), m_Levels.begin());
+		m_Samples++;
+	}
+	void ObserveRead(double Seconds) {
+		m_ReadLatency.Observe(Seconds);
+	}
+	void ObserveTick(double Seconds) {
+		m_TickLatency.Observe(Seconds);
+	}
+};
+
+#endif //SERVER_METRICSSERVER_HPP_
@@ -0,0 +1,211 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sensor Protocol
+	The messages exchanged over the daemon's Unix socket.  Both
+	    ends are on the same host, so fields are in native byte
+	    order and alignment is not assumed.
+
+	Every message is an 8-byte header followed by its payload:
+	    uint32 Length   payload bytes
+	    uint16 Type     MessageType
+	    uint16 Flags    FlagHistory on Snapshots that answer a
+	                    GetHistory (rather than live updates)
+
+	Client -> daemon:
+	    Hello       uint32 Version
+	    GetHistory  double From, double To (wall-clock seconds)
+	    Subscribe   (empty)  stream every new snapshot
+	    Unsubscribe (empty)
+	Daemon -> client:
+	    Sensors     uint32 Version, uint32 N, N NUL-terminated
+	                names (reply to Hello; sent again if the
+	                sensor list changes)
+	    Snapshot    double Time, uint32 N, float Values[N]
+	                (a subscription update or a history record)
+	    HistoryEnd  uint32 Count (ends a GetHistory reply)
+	    Error       NUL-terminated text
+****************************************************************/
+#ifndef SERVER_PROTOCOL_HPP_
+#define SERVER_PROTOCOL_HPP_
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Protocol {
+
+constexpr uint32_t Version = 1;
+constexpr uint32_t MaxPayload = 16 << 20;   ///<Larger messages are a protocol error
+constexpr uint16_t FlagHistory = 1;
+
+enum class MessageType : uint16_t {
+	Hello = 1,
+	GetHistory = 2,
+	Subscribe = 3,
+	Unsubscribe = 4,
+	Sensors = 64,
+	Snapshot = 65,
+	HistoryEnd = 66,
+	Error = 67
+};
+
+struct Header {
+	uint32_t Length;
+	uint16_t Type;
+	uint16_t Flags;
+};
+static_assert(sizeof(Header) == 8, "Header must be packed");
+
+/** @brief Builds messages by appending to a (reused) buffer */
+class Writer {
+private:
+	std::string &m_Out;
+	std::size_t m_Start;
+public:
+	Writer(std::string &Out, MessageType Type, uint16_t Flags = 0) : m_Out(Out), m_Start(Out.size()) {
+		Header H{0, (uint16_t)Type, Flags};
+		m_Out.append((char const*)&H, sizeof(H));
+	}
+	/** @brief Patches the payload length into the header */
+	~Writer() {
+		uint32_t Length = (uint32_t)(m_Out.size() - m_Start - sizeof(Header));
+		std::memcpy(&m_Out[m_Start], &Length, sizeof(Length));
+	}
+	template <typename T>
+	Writer &Put(T const &Value) {
+		m_Out.append((char const*)&Value, sizeof(T));
+		return *this;
+	}
+	Writer &Put(void const *Data, std::size_t Size) {
+		m_Out.append((char const*)Data, Size);
+		return *this;
+	}
+	Writer &PutString(std::string_view Text) {
+		m_Out.append(Text.data(), Text.size());
+		m_Out += '\0';
+		return *this;
+	}
+};
+
+/** @brief Reads the fields of one payload, failing (not crashing) on short input */
+class Reader {
+private:
+	std::string_view m_Data;
+	std::size_t m_Pos = 0;
+	bool m_Ok = true;
+public:
+	explicit Reader(std::string_view Payload) : m_Data(Payload) {}
+	template <typename T>
+	T Get() {
+		T Value{};
+		if (m_Data.size() - m_Pos < sizeof(T)) m_Ok = false;
+		else {
+			std::memcpy(&Value, m_Data.data() + m_Pos, sizeof(T));
+			m_Pos += sizeof(T);
+		}
+		return Value;
+	}
+	bool Get(void *Out, std::size_t Size) {
+		if (m_Data.size() - m_Pos < Size) return m_Ok = false;
+		std::memcpy(Out, m_Data.data() + m_Pos, Size);
+		m_Pos += Size;
+		return true;
+	}
+	std::string_view GetString() {
+		std::size_t End = m_Data.find('\0', m_Pos);
+		if (End == std::string_view::npos) {
+			m_Ok = false;
+			return {};
+		}
+		std::string_view Text = m_Data.substr(m_Pos, End - m_Pos);
+		m_Pos = End + 1;
+		return Text;
+	}
+	std::size_t Left() const {
+		return m_Data.size() - m_Pos;
+	}
+	bool Ok() const {
+		return m_Ok;
+	}
+};
+
+/** @brief Reassembles messages from a byte stream */
+class MessageBuffer {
+private:
+	std::string m_Data;
+	std::size_t m_Pos = 0;      ///<Start of the first unconsumed message
+	std::size_t m_Used = 0;     ///<Bytes of m_Data holding data (during Reserve/Commit)
+public:
+	/** @brief Space to read up to Size more bytes into; call Commit with the number read */
+	char *Reserve(std::size_t Size) {
+		if (m_Pos > 0 && m_Pos == m_Data.size()) {
+			m_Data.clear();
+			m_Pos = 0;
+		}
+		else if (m_Pos > 65536) {
+			m_Data.erase(0, m_Pos);
+			m_Pos = 0;
+		}
+		m_Used = m_Data.size();
+		m_Data.resize(m_Used + Size);
+		return &m_Data[m_Used];
+	}
+	void Commit(std::size_t Size) {
+		m_Data.resize(m_Used + Size);
+	}
+	/** @brief Take the next complete message (Payload is valid until the next Reserve)
+	 * @returns false if none is complete yet; Error is set if the stream is corrupt
+	 */
+	bool Next(MessageType &Type, std::string_view &Payload, bool &Error) {
+		uint16_t Flags;
+		return Next(Type, Flags, Payload, Error);
+	}
+	bool Next(MessageType &Type, uint16_t &Flags, std::string_view &Payload, bool &Error) {
+		Error = false;
+		if (m_Data.size() - m_Pos < sizeof(Header)) return false;
+		Header H;
+		std::memcpy(&H, m_Data.data() + m_Pos, sizeof(H));
+		if (H.Length > MaxPayload) {
+			Error = true;
+			return false;
+		}
+		if (m_Data.size() - m_Pos - sizeof(Header) < H.Length) return false;
+		Type = (MessageType)H.Type;
+		Flags = H.Flags;
+		Payload = std::string_view(m_Data).substr(m_Pos + sizeof(Header), H.Length);
+		m_Pos += sizeof(Header) + H.Length;
+		return true;
+	}
+};
+
+/** @brief Append a Snapshot message */
+inline void PutSnapshot(std::string &Out, double Time, float const *Values, uint32_t N, uint16_t Flags = 0) {
+	Writer(Out, MessageType::Snapshot, Flags).Put(Time).Put(N).Put(Values, N * sizeof(float));
+}
+
+/** @brief Append a Sensors message */
+inline void PutSensors(std::string &Out, std::vector<std::string> const &Names) {
+	Writer W(Out, MessageType::Sensors);
+	W.Put(Version).Put((uint32_t)Names.size());
+	for (auto const &Name : Names) W.PutString(Name);
+}
+
+} //namespace Protocol
+
+#endif //SERVER_PROTOCOL_HPP_
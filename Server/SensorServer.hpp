@@ -0,0 +1,302 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sensor Server
+	Serves the daemon's readings over a Unix domain socket (see
+	    Server/Protocol.hpp) so that any number of viewers and
+	    scripts share one sampler:
+	     -clients fetch ranges of the history store
+	     -subscribers get every new snapshot as it is taken;
+	      each snapshot is encoded once for all of them
+	     -all sockets are non-blocking and run from the event
+	      loop; a subscriber that stops reading is dropped
+	      once its backlog exceeds Limits::MaxQueued, so it
+	      can never stall sampling
+****************************************************************/
+#ifndef SERVER_SENSORSERVER_HPP_
+#define SERVER_SENSORSERVER_HPP_
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../Core/EventLoop.hpp"
+#include "../History/HistoryStore.hpp"
+#include "Protocol.hpp"
+
+class SensorServer {
+public:
+	struct Limits {
+		std::size_t MaxClients = 64;
+		std::size_t MaxQueued = 32 << 20;   ///<Bytes a client may have waiting before it is dropped
+	};
+private:
+	struct Client {
+		int Fd;
+		Protocol::MessageBuffer In;
+		std::string Out;
+		std::size_t OutPos = 0;     ///<Bytes of Out already sent
+		bool Subscribed = false;
+		bool Closing = false;       ///<Shut down its end: answer what it sent, then drop it (subscribers: once gone)
+	};
+	EventLoop &m_Loop;
+	HistoryStore const &m_History;
+	Limits m_Limits;
+	std::string m_Path;
+	int m_Listen = -1;
+	std::vector<std::unique_ptr<Client>> m_Clients;
+	std::string m_Frame;        ///<Reused encoding buffer for Publish
+
+	static bool FillAddress(std::string const &Path, sockaddr_un &Address) {
+		std::memset(&Address, 0, sizeof(Address));
+		Address.sun_family = AF_UNIX;
+		if (Path.size() >= sizeof(Address.sun_path)) return false;
+		std::memcpy(Address.sun_path, Path.c_str(), Path.size() + 1);
+		return true;
+	}
+
+	void Accept() {
+		int Fd;
+		while ((Fd = accept4(m_Listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+			if (m_Clients.size() >= m_Limits.MaxClients) {
+				close(Fd);
+				continue;
+			}
+			m_Clients.push_back(std::make_unique<Client>());
+			Client *C = m_Clients.back().get();
+			C->Fd = Fd;
+			m_Loop.AddFd(Fd, POLLIN, [this, C](short Revents){ OnClient(C, Revents); });
+		}
+	}
+
+	void Drop(Client *C) {
+		m_Loop.RemoveFd(C->Fd);
+		close(C->Fd);
+		for (auto IT = m_Clients.begin(); IT != m_Clients.end(); ++IT) {
+			if (IT->get() == C) {
+				m_Clients.erase(IT);
+				break;
+			}
+		}
+	}
+
+	/** @returns false if the client was dropped */
+	bool Flush(Client *C) {
+		while (C->OutPos < C->Out.size()) {
+			ssize_t N = send(C->Fd, C->Out.data() + C->OutPos, C->Out.size() - C->OutPos, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (N > 0) {
+				C->OutPos += N;
+				continue;
+			}
+			if (N < 0 && errno == EINTR) continue;
+			if (N < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+			Drop(C);
+			return false;
+		}
+		//A closing client's end reads as EOF forever, so it is no longer polled for input
+		short Input = C->Closing ? 0 : POLLIN;
+		if (C->OutPos == C->Out.size()) {
+			C->Out.clear();
+			C->OutPos = 0;
+			if (C->Closing && !C->Subscribed) {
+				Drop(C);
+				return false;
+			}
+			m_Loop.ModifyFd(C->Fd, Input);
+		}
+		else {
+			if (C->OutPos > (1 << 20)) {
+				C->Out.erase(0, C->OutPos);
+				C->OutPos = 0;
+			}
+			m_Loop.ModifyFd(C->Fd, Input | POLLOUT);
+		}
+		return true;
+	}
+
+	void Handle(Client *C, Protocol::MessageType Type, std::string_view Payload) {
+		using Protocol::MessageType;
+		Protocol::Reader In(Payload);
+		switch (Type) {
+		case MessageType::Hello: {
+			uint32_t Version = In.Get<uint32_t>();
+			if (!In.Ok() || Version != Protocol::Version) {
+				Protocol::Writer(C->Out, MessageType::Error).PutString("unsupported protocol version");
+				break;
+			}
+			Protocol::PutSensors(C->Out, m_History.Names());
+			if (!m_History.Empty()) {
+				std::vector<float> Latest(m_History.Names().size());
+				for (std::size_t i = 0; i != Latest.size(); i++) Latest[i] = m_History.Latest(i);
+				Protocol::PutSnapshot(C->Out, m_History.LastTime(), Latest.data(), Latest.size());
+			}
+			break;
+		}
+		case MessageType::GetHistory: {
+			double From = In.Get<double>();
+			double To = In.Get<double>();
+			if (!In.Ok()) {
+				Protocol::Writer(C->Out, MessageType::Error).PutString("malformed GetHistory");
+				break;
+			}
+			uint32_t N = m_History.Names().size();
+			uint32_t Count = m_History.ForEach(From, To, [C, N](double Time, float const *Values) {
+				Protocol::PutSnapshot(C->Out, Time, Values, N, Protocol::FlagHistory);
+			});
+			Protocol::Writer(C->Out, MessageType::HistoryEnd).Put(Count);
+			break;
+		}
+		case MessageType::Subscribe:
+			C->Subscribed = true;
+			break;
+		case MessageType::Unsubscribe:
+			C->Subscribed = false;
+			break;
+		default:
+			Protocol::Writer(C->Out, MessageType::Error).PutString("unknown request");
+			break;
+		}
+	}
+
+	void OnClient(Client *C, short Revents) {
+		if (Revents & POLLIN) {
+			while (true) {
+				char *Buffer = C->In.Reserve(65536);
+				ssize_t N = read(C->Fd, Buffer, 65536);
+				if (N > 0) {
+					C->In.Commit(N);
+					continue;
+				}
+				C->In.Commit(0);
+				if (N < 0 && errno == EINTR) continue;
+				if (N < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+				if (N < 0) {
+					Drop(C);
+					return;
+				}
+				C->Closing = true;   //EOF: the requests already received are still answered
+				break;
+			}
+			Protocol::MessageType Type;
+			std::string_view Payload;
+			bool Error;
+			while (C->In.Next(Type, Payload, Error)) Handle(C, Type, Payload);
+			if (Error) {
+				Drop(C);
+				return;
+			}
+		}
+		else if (Revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			Drop(C);
+			return;
+		}
+		Flush(C);
+	}
+public:
+	SensorServer(EventLoop &Loop, HistoryStore const &History) : SensorServer(Loop, History, Limits()) {}
+	SensorServer(EventLoop &Loop, HistoryStore const &History, Limits L) : m_Loop(Loop), m_History(History), m_Limits(L) {}
+	~SensorServer() {
+		for (auto &C : m_Clients) {
+			m_Loop.RemoveFd(C->Fd);
+			close(C->Fd);
+		}
+		if (m_Listen >= 0) {
+			m_Loop.RemoveFd(m_Listen);
+			close(m_Listen);
+			unlink(m_Path.c_str());
+		}
+	}
+	SensorServer(SensorServer const &) = delete;
+	SensorServer &operator=(SensorServer const &) = delete;
+
+	/** @brief Listen on a Unix socket at Path (replacing a stale socket, but not a live daemon's) */
+	bool Listen(std::string const &Path) {
+		sockaddr_un Address;
+		if (!FillAddress(Path, Address)) {
+			std::cerr << "Socket path is too long: " << Path << "\n";
+			return false;
+		}
+		m_Listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (m_Listen < 0) {
+			std::cerr << "Cannot create socket: " << strerror(errno) << "\n";
+			return false;
+		}
+		int Bound = bind(m_Listen, (sockaddr*)&Address, sizeof(Address));
+		if (Bound != 0 && errno == EADDRINUSE) {
+			int Probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			bool Live = Probe >= 0 && connect(Probe, (sockaddr*)&Address, sizeof(Address)) == 0;
+			if (Probe >= 0) close(Probe);
+			if (Live) {
+				std::cerr << "Another daemon is already listening on " << Path << "\n";
+				close(m_Listen);
+				m_Listen = -1;
+				return false;
+			}
+			unlink(Path.c_str());
+			Bound = bind(m_Listen, (sockaddr*)&Address, sizeof(Address));
+		}
+		if (Bound != 0 || listen(m_Listen, 16) != 0) {
+			std::cerr << "Cannot listen on " << Path << ": " << strerror(errno) << "\n";
+			close(m_Listen);
+			m_Listen = -1;
+			return false;
+		}
+		m_Path = Path;
+		m_Loop.AddFd(m_Listen, POLLIN, [this](short){ Accept(); });
+		return true;
+	}
+
+	/** @brief Send a new snapshot (Values indexed like the history's sensors) to every subscriber */
+	void Publish(double Time, std::vector<float> const &Values) {
+		bool Any = false;
+		for (auto const &C : m_Clients) Any |= C->Subscribed;
+		if (!Any) return;
+		m_Frame.clear();
+		Protocol::PutSnapshot(m_Frame, Time, Values.data(), Values.size());
+		for (std::size_t i = 0; i < m_Clients.size(); ) {
+			Client *C = m_Clients[i].get();
+			if (!C->Subscribed) { i++; continue; }
+			if (C->Out.size() - C->OutPos > m_Limits.MaxQueued) {
+				std::cerr << "Dropping a client that stopped reading\n";
+				Drop(C);
+				continue;
+			}
+			C->Out += m_Frame;
+			if (Flush(C)) i++;
+		}
+	}
+
+	/** @brief Tell every client that the sensor list changed */
+	void AnnounceSensors() {
+		for (std::size_t i = 0; i < m_Clients.size(); ) {
+			Client *C = m_Clients[i].get();
+			Protocol::PutSensors(C->Out, m_History.Names());
+			if (Flush(C)) i++;
+		}
+	}
+
+	std::size_t Clients() const {
+		return m_Clients.size();
+	}
+};
+
+#endif //SERVER_SENSORSERVER_HPP_
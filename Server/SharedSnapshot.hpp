@@ -0,0 +1,295 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Shared Snapshot
+	The latest reading of every sensor, published by the
+	    daemon (--shm NAME) in a POSIX shared-memory segment
+	    for local readers that poll too often for the socket.
+
+	The segment is guarded by a seqlock: the writer makes the
+	    sequence number odd, updates the data and makes it even
+	    again; a reader copies the data and retries if the
+	    sequence was odd or changed meanwhile.  The writer never
+	    waits for readers, and a read is a plain memory copy
+	    with no system calls.  A name has one writer at a time: a
+	    segment is only replaced once its WriterPid has exited.
+
+	Layout (native byte order, version 1; all offsets fixed):
+	    0   uint32  Magic        0x504D5453 ("STMP")
+	    4   uint16  Version      1
+	    6   uint16  HeaderSize   64
+	    8   uint32  Capacity     sensor slots in the segment
+	    12  uint32  EntrySize    bytes per sensor slot (64)
+	    16  uint32  Sequence     seqlock counter (odd: writing)
+	    20  uint32  Count        sensors in use
+	    24  double  Time         wall-clock seconds of the reading
+	    32  uint64  Updates      number of readings published
+	    40  uint32  WriterPid
+	    44  (reserved to 64)
+	    64  Capacity sensor slots of EntrySize bytes:
+	        0   char    Name[48]   NUL-terminated sensor name
+	        48  float   Value      temperature (NaN: unreadable)
+	        52  float   Critical   critical temperature (NaN: none)
+	        56  uint8   Level      AlertLevel (0 normal, 1 warning,
+	                               2 critical, 3 cooldown)
+	        57  (reserved to 64)
+	    The sensor id is the slot index.
+
+	This header needs only the standard library and POSIX, so
+	    other programs can include it to read the segment.
+****************************************************************/
+#ifndef SERVER_SHAREDSNAPSHOT_HPP_
+#define SERVER_SHAREDSNAPSHOT_HPP_
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace SharedSnapshot {
+
+constexpr uint32_t Magic = 0x504D5453;
+constexpr uint16_t Version = 1;
+
+struct Header {
+	uint32_t Magic;
+	uint16_t Version;
+	uint16_t HeaderSize;
+	uint32_t Capacity;
+	uint32_t EntrySize;
+	std::atomic<uint32_t> Sequence;
+	uint32_t Count;
+	double Time;
+	uint64_t Updates;
+	uint32_t WriterPid;
+	uint8_t Reserved[20];
+};
+static_assert(sizeof(Header) == 64, "Shared snapshot header layout changed");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The seqlock needs a lock-free counter");
+
+struct Entry {
+	char Name[48];
+	float Value;
+	float Critical;
+	uint8_t Level;
+	uint8_t Reserved[7];
+};
+static_assert(sizeof(Entry) == 64, "Shared snapshot entry layout changed");
+
+/** @brief One consistent copy of the segment (reuse it between reads to avoid allocation) */
+struct Reading {
+	double Time = 0;
+	uint64_t Updates = 0;
+	std::vector<Entry> Sensors;
+};
+
+/** @brief Creates and updates the segment (one writer per segment) */
+class Writer {
+private:
+	std::string m_Name;
+	Header *m_Header = nullptr;
+	Entry *m_Entries = nullptr;
+	std::size_t m_Size = 0;
+
+	void BeginWrite() {
+		m_Header->Sequence.store(m_Header->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	void EndWrite() {
+		m_Header->Sequence.store(m_Header->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+public:
+	Writer() = default;
+	~Writer() {
+		if (m_Header != nullptr) {
+			munmap(m_Header, m_Size);
+			shm_unlink(m_Name.c_str());
+		}
+	}
+	Writer(Writer const &) = delete;
+	Writer &operator=(Writer const &) = delete;
+
+	/** @brief Whether the segment Name was left by a writer that is still running */
+	static bool LiveWriter(std::string const &Name) {
+		int Fd = shm_open(Name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		if (Fd < 0) return false;
+		Header Existing;
+		bool Ok = pread(Fd, &Existing, sizeof(Existing), 0) == (ssize_t)sizeof(Existing);
+		close(Fd);
+		if (!Ok || Existing.Magic != Magic || Existing.WriterPid == 0) return false;
+		return kill((pid_t)Existing.WriterPid, 0) == 0 || errno == EPERM;
+	}
+
+	/** @brief Create the segment Name (e.g. "/safetemp") for the given sensors, replacing
+	 *         a stale one but not a running writer's
+	 * @returns false with errno set on failure (EBUSY: another writer is publishing Name)
+	 */
+	bool Create(std::string const &Name, std::vector<std::string> const &SensorNames) {
+		int Fd = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+		if (Fd < 0 && errno == EEXIST) {
+			if (LiveWriter(Name)) {
+				errno = EBUSY;
+				return false;
+			}
+			shm_unlink(Name.c_str());
+			Fd = shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+			if (Fd < 0 && errno == EEXIST) errno = EBUSY;   //Lost a race with another writer
+		}
+		if (Fd < 0) return false;
+		uint32_t Capacity = SensorNames.size();
+		m_Size = sizeof(Header) + Capacity * sizeof(Entry);
+		if (ftruncate(Fd, m_Size) != 0) {
+			int Error = errno;
+			close(Fd);
+			errno = Error;
+			return false;
+		}
+		void *Map = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+		close(Fd);
+		if (Map == MAP_FAILED) return false;
+		m_Name = Name;
+		m_Header = (Header*)Map;
+		m_Entries = (Entry*)((char*)Map + sizeof(Header));
+		m_Header->Sequence.store(1, std::memory_order_relaxed);   //Odd until initialized
+		m_Header->Magic = Magic;
+		m_Header->Version = Version;
+		m_Header->HeaderSize = sizeof(Header);
+		m_Header->Capacity = Capacity;
+		m_Header->EntrySize = sizeof(Entry);
+		m_Header->Count = Capacity;
+		m_Header->Time = 0;
+		m_Header->Updates = 0;
+		m_Header->WriterPid = getpid();
+		for (uint32_t i = 0; i != Capacity; i++) {
+			std::memset(&m_Entries[i], 0, sizeof(Entry));
+			std::strncpy(m_Entries[i].Name, SensorNames[i].c_str(), sizeof(Entry::Name) - 1);
+			m_Entries[i].Value = NAN;
+			m_Entries[i].Critical = NAN;
+		}
+		m_Header->Sequence.store(2, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief Publish a reading (arrays indexed by sensor id; Criticals/Levels may be null) */
+	void Publish(double Time, float const *Values, float const *Criticals, uint8_t const *Levels) {
+		if (m_Header == nullptr) return;
+		BeginWrite();
+		m_Header->Time = Time;
+		m_Header->Updates++;
+		for (uint32_t i = 0; i != m_Header->Count; i++) {
+			m_Entries[i].Value = Values[i];
+			if (Criticals != nullptr) m_Entries[i].Critical = Criticals[i];
+			if (Levels != nullptr) m_Entries[i].Level = Levels[i];
+		}
+		EndWrite();
+	}
+
+	bool Open() const {
+		return m_Header != nullptr;
+	}
+};
+
+/** @brief Reads the segment; never blocks the writer and makes no system calls after Open */
+class Reader {
+private:
+	Header const *m_Header = nullptr;
+	Entry const *m_Entries = nullptr;
+	std::size_t m_Size = 0;
+public:
+	Reader() = default;
+	~Reader() {
+		if (m_Header != nullptr) munmap((void*)m_Header, m_Size);
+	}
+	Reader(Reader const &) = delete;
+	Reader &operator=(Reader const &) = delete;
+
+	/** @brief Map the segment Name read-only
+	 * @returns false with errno set on failure (EPROTO: not a SafeTemp segment of this version)
+	 */
+	bool Open(std::string const &Name) {
+		int Fd = shm_open(Name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+		if (Fd < 0) return false;
+		struct stat Info;
+		if (fstat(Fd, &Info) != 0 || (std::size_t)Info.st_size < sizeof(Header)) {
+			close(Fd);
+			errno = EPROTO;
+			return false;
+		}
+		void *Map = mmap(nullptr, Info.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+		close(Fd);
+		if (Map == MAP_FAILED) return false;
+		Header const *H = (Header const*)Map;
+		if (H->Magic != Magic || H->Version != Version || H->HeaderSize != sizeof(Header) || H->EntrySize != sizeof(Entry) ||
+		    sizeof(Header) + (std::size_t)H->Capacity * sizeof(Entry) > (std::size_t)Info.st_size) {
+			munmap(Map, Info.st_size);
+			errno = EPROTO;
+			return false;
+		}
+		m_Header = H;
+		m_Entries = (Entry const*)((char const*)Map + H->HeaderSize);
+		m_Size = Info.st_size;
+		return true;
+	}
+
+	/** @brief Copy a consistent reading into Out
+	 * @param MaxTries  Give up (returning false) after this many collisions with the writer
+	 */
+	bool Read(Reading &Out, unsigned MaxTries = 1000) const {
+		if (m_Header == nullptr) return false;
+		for (unsigned Try = 0; Try != MaxTries; Try++) {
+			uint32_t Before = m_Header->Sequence.load(std::memory_order_acquire);
+			if (Before & 1) continue;
+			uint32_t Count = std::min(m_Header->Count, m_Header->Capacity);
+			Out.Sensors.resize(Count);
+			Out.Time = m_Header->Time;
+			Out.Updates = m_Header->Updates;
+			std::memcpy(Out.Sensors.data(), m_Entries, Count * sizeof(Entry));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_Header->Sequence.load(std::memory_order_relaxed) == Before) return true;
+		}
+		return false;
+	}
+
+	/** @brief Read just one sensor's value (NaN if the sensor doesn't exist or the read kept colliding) */
+	float Value(uint32_t Sensor, unsigned MaxTries = 1000) const {
+		if (m_Header == nullptr) return NAN;
+		for (unsigned Try = 0; Try != MaxTries; Try++) {
+			uint32_t Before = m_Header->Sequence.load(std::memory_order_acquire);
+			if (Before & 1) continue;
+			float Result = (Sensor < m_Header->Count) ? m_Entries[Sensor].Value : NAN;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_Header->Sequence.load(std::memory_order_relaxed) == Before) return Result;
+		}
+		return NAN;
+	}
+
+	bool Open() const {
+		return m_Header != nullptr;
+	}
+};
+
+} //namespace SharedSnapshot
+
+#endif //SERVER_SHAREDSNAPSHOT_HPP_
@@ -0,0 +1,49 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Action Parse Test
+	Checks that the built-in actions only accept ramps with both
+	    ends in the same unit: kHz to kHz or % to % for @cpufreq,
+	    and no % at all for @pwm.
+****************************************************************/
+#include <string>
+#include "../Alerts/Actions.hpp"
+#include "TestCheck.hpp"
+
+static void Expect(char const *Text, bool Valid) {
+	NativeAction Action;
+	std::string Error;
+	Check(NativeAction::Parse(Text, Action, Error) == Valid, "'%s' was %s", Text, Valid ? "rejected" : "accepted");
+}
+
+int main() {
+	Expect("@cpufreq 2000000", true);
+	Expect("@cpufreq 50%", true);
+	Expect("@cpufreq 2000000:1000000@10", true);
+	Expect("@cpufreq 80%:40%@10", true);
+	Expect("@cpufreq 2000000:50%@10", false);
+	Expect("@cpufreq 50%:2000000@10", false);
+	Expect("@pwm hwmon2/pwm1 150:255@10", true);
+	Expect("@pwm hwmon2/pwm1 150:80%@10", false);
+	Expect("@pwm hwmon2/pwm1 50%", false);
+
+	//A % on FROM alone used to be taken for both ends
+	NativeAction Action;
+	std::string Error;
+	Check(NativeAction::Parse("@cpufreq 80%:40%@10", Action, Error) && Action.Percent, "'80%%:40%%@10' is not a percentage");
+	return Result();
+}
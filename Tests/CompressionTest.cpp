@@ -0,0 +1,94 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Compression Test
+	Encodes a noisy, drifting trace with a spike and runs of
+	    unreadable samples by deadband and by swinging-door, and
+	    checks that every decoded reading is within the
+	    tolerance of the original, that the highest and lowest
+	    readings survive exactly, that NaN stays NaN (and only
+	    there), and that points were actually dropped.
+****************************************************************/
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "../History/Compression.hpp"
+#include "TestCheck.hpp"
+
+/** @brief Deterministic noise in [-1, 1] */
+static float Noise(uint32_t &State) {
+	State = State * 1664525u + 1013904223u;
+	return (State >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+static void TestMethod(Compression::Method How, char const *Name) {
+	constexpr std::size_t Count = 4000, Sensors = 2;
+	float const Tolerances[Sensors] = {0.5f, 2.0f};
+	std::vector<double> Times(Count);
+	std::vector<float> Rows(Count * Sensors);
+	uint32_t State = 12345;
+	for (std::size_t i = 0; i != Count; i++) {
+		Times[i] = 1.7e9 + 0.5 * i + ((i % 7 == 0) ? 0.013 : 0);   //A jittery half-second tick
+		for (std::size_t s = 0; s != Sensors; s++) {
+			float V = 45 + 10 * std::sin(i / (300.0f + 100 * s)) + 0.3f * Noise(State);
+			if (i == 1234) V += 30;                                  //A spike: the highest reading
+			if (s == 0 && i >= 2000 && i < 2050) V = NAN;            //Unreadable for a while...
+			if (s == 1 && (i == 10 || i == Count - 1)) V = NAN;      //...or for one sample, at the very end too
+			Rows[i * Sensors + s] = V;
+		}
+	}
+	std::vector<unsigned char> Chunk;
+	Compression::Encode(Chunk, How, Tolerances, Times.data(), Rows.data(), Count, Sensors);
+	Compression::ChunkView View;
+	Check(View.Open(Chunk.data(), Chunk.size(), Sensors), "%s: the chunk doesn't open", Name);
+	Check(View.Points() < Count * Sensors / 4, "%s: kept %zu of %zu points", Name, View.Points(), Count * Sensors);
+
+	std::size_t i = 0;
+	float Highest[Sensors] = {-INFINITY, -INFINITY}, Lowest[Sensors] = {INFINITY, INFINITY};
+	View.ForEach(-INFINITY, INFINITY, [&](double Time, float const *Values) {
+		Check(std::fabs(Time - Times[i]) < 1e-3, "%s: sample %zu is at %f, not %f", Name, i, Time, Times[i]);
+		for (std::size_t s = 0; s != Sensors; s++) {
+			float Original = Rows[i * Sensors + s];
+			if (std::isnan(Original) || std::isnan(Values[s])) {
+				Check(std::isnan(Original) && std::isnan(Values[s]), "%s: sensor %zu sample %zu is %g, not %g", Name, s, i, Values[s], Original);
+				continue;
+			}
+			Check(std::fabs(Values[s] - Original) <= Tolerances[s] * 1.0001f, "%s: sensor %zu sample %zu is %g, %g off (tolerance %g)",
+			      Name, s, i, Values[s], Values[s] - Original, Tolerances[s]);
+			Highest[s] = std::max(Highest[s], Values[s]);
+			Lowest[s] = std::min(Lowest[s], Values[s]);
+		}
+		i++;
+	});
+	Check(i == Count, "%s: decoded %zu of %zu samples", Name, i, Count);
+	for (std::size_t s = 0; s != Sensors; s++) {
+		float High = -INFINITY, Low = INFINITY;
+		for (std::size_t k = 0; k != Count; k++) {
+			if (std::isnan(Rows[k * Sensors + s])) continue;
+			High = std::max(High, Rows[k * Sensors + s]);
+			Low = std::min(Low, Rows[k * Sensors + s]);
+		}
+		Check(Highest[s] == High, "%s: sensor %zu peaks at %g, not %g", Name, s, Highest[s], High);
+		Check(Lowest[s] == Low, "%s: sensor %zu bottoms out at %g, not %g", Name, s, Lowest[s], Low);
+	}
+}
+
+int main() {
+	TestMethod(Compression::Method::Deadband, "deadband");
+	TestMethod(Compression::Method::SwingingDoor, "swinging-door");
+	return Result();
+}
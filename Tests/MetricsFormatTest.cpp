@@ -0,0 +1,71 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Metrics Format Test
+	Scrapes a MetricsServer over loopback and checks that float
+	    readings are printed as the shortest text that reads back
+	    as the same float (45.1, not 45.099998474121094).
+****************************************************************/
+#include <string>
+#include <vector>
+#include "../Server/MetricsServer.hpp"
+#include "TestCheck.hpp"
+
+static void Expect(std::string const &Body, char const *Line) {
+	Check(Body.find(Line) != std::string::npos, "no '%s' in\n%s", Line, Body.c_str());
+}
+
+int main() {
+	EventLoop Loop;
+	MetricsServer Metrics(Loop);
+	unsigned Port = 0, First = 39100 + (unsigned)getpid() % 1000;   //Spread concurrent runs over the ports
+	for (unsigned p = First; Port == 0 && p != First + 50; p++)
+		if (Metrics.Listen(std::to_string(p))) Port = p;
+	Check(Port != 0, "no free port");
+	if (Port == 0) return Result();
+	Metrics.SetSensors({"Core 0", "Core 1"});
+	float Values[] = {45.1f, NAN}, Criticals[] = {87.3f, 100};
+	uint8_t Levels[] = {2, 0};
+	Metrics.Update(Values, Criticals, Levels);
+
+	int Fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	sockaddr_in Address;
+	std::memset(&Address, 0, sizeof(Address));
+	Address.sin_family = AF_INET;
+	Address.sin_port = htons(Port);
+	inet_pton(AF_INET, "127.0.0.1", &Address.sin_addr);
+	char const Request[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	if (connect(Fd, (sockaddr*)&Address, sizeof(Address)) != 0 || write(Fd, Request, sizeof(Request) - 1) < 0) {
+		Check(false, "cannot connect to port %u", Port);
+		return Result();
+	}
+	std::string Body;
+	for (int i = 0; i != 200; i++) {
+		Loop.RunOnce(10);
+		char Buffer[4096];
+		ssize_t N = recv(Fd, Buffer, sizeof(Buffer), MSG_DONTWAIT);
+		if (N == 0) break;
+		if (N > 0) Body.append(Buffer, N);
+	}
+	close(Fd);
+
+	Expect(Body, "safetemp_temperature_celsius{sensor=\"Core 0\"} 45.1\n");
+	Expect(Body, "safetemp_temperature_celsius{sensor=\"Core 1\"} NaN\n");
+	Expect(Body, "safetemp_critical_celsius{sensor=\"Core 0\"} 87.3\n");
+	Expect(Body, "safetemp_alert_state{sensor=\"Core 0\"} 2\n");
+	return Result();
+}
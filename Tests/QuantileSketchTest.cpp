@@ -0,0 +1,137 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+/****************************************************************
+Quantile Sketch Test
+	Feeds sketches temperature-like, wide-ranging and mixed-sign
+	    data and checks every percentile against the exact one
+	    from the sorted data: each must be within the sketch's
+	    relative accuracy.  Also checks that merging the sketches
+	    of two halves answers exactly as one sketch of the whole,
+	    and that folding under a small MaxBins keeps the high
+	    quantiles accurate.
+****************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "../History/QuantileSketch.hpp"
+#include "TestCheck.hpp"
+
+/** @brief Deterministic noise in [0, 1) */
+static double Uniform(uint32_t &State) {
+	State = State * 1664525u + 1013904223u;
+	return (State >> 8) / (double)(1 << 24);
+}
+
+/** @brief The value of rank Q * (N - 1), as the sketch defines its quantiles */
+static double Exact(std::vector<double> const &Sorted, double Q) {
+	return Sorted[(std::size_t)(Q * (Sorted.size() - 1))];
+}
+
+/** @brief Check every percentile from First to 99 (and the ends) against the data */
+static void CheckQuantiles(char const *Name, QuantileSketch const &Sketch, std::vector<double> Data, int First = 0) {
+	std::sort(Data.begin(), Data.end());
+	Check(Sketch.Count() == Data.size(), "%s: counted %llu of %zu values", Name, (unsigned long long)Sketch.Count(), Data.size());
+	Check(Sketch.Min() == Data.front() && Sketch.Max() == Data.back(), "%s: range is %g to %g, not %g to %g",
+	      Name, Sketch.Min(), Sketch.Max(), Data.front(), Data.back());
+	for (int p = First; p <= 100; p++) {
+		double Q = p / 100.0, Got = Sketch.Quantile(Q), Expected = Exact(Data, Q);
+		Check(std::fabs(Got - Expected) <= Sketch.Accuracy() * std::fabs(Expected) * (1 + 1e-9),
+		      "%s: quantile %.2f is %g, expected %g (accuracy %g)", Name, Q, Got, Expected, Sketch.Accuracy());
+	}
+}
+
+static void TestTemperatures() {
+	QuantileSketch Sketch;
+	std::vector<double> Data;
+	uint32_t State = 1;
+	for (int i = 0; i != 100000; i++) {
+		//Mostly idle around 40, sometimes busy up to 95
+		double V = (i % 10 == 0) ? 60 + 35 * Uniform(State) : 35 + 10 * Uniform(State);
+		Data.push_back(V);
+		Sketch.Add(V);
+	}
+	CheckQuantiles("temperatures", Sketch, Data);
+	Check(Sketch.Bins() < 200, "temperatures: %zu bins in use", Sketch.Bins());
+}
+
+static void TestWideRange() {
+	for (double Accuracy : {0.01, 0.05}) {
+		QuantileSketch Sketch(Accuracy);
+		std::vector<double> Data;
+		uint32_t State = 2;
+		for (int i = 0; i != 20000; i++) {
+			double V = std::exp(-5 + 15 * Uniform(State));     //1e-2 to 1e4
+			Data.push_back(V);
+			Sketch.Add(V);
+		}
+		CheckQuantiles(Accuracy == 0.01 ? "wide range (1%)" : "wide range (5%)", Sketch, Data);
+	}
+}
+
+static void TestMixedSigns() {
+	QuantileSketch Sketch;
+	std::vector<double> Data;
+	uint32_t State = 3;
+	for (int i = 0; i != 20000; i++) {
+		//Below and above zero, with exact zeros in between
+		double V = (i % 50 == 0) ? 0 : -30 + 80 * Uniform(State);
+		Data.push_back(V);
+		Sketch.Add(V);
+	}
+	CheckQuantiles("mixed signs", Sketch, Data);
+}
+
+static void TestMerge() {
+	QuantileSketch Whole, First, Second;
+	std::vector<double> Data;
+	uint32_t State = 4;
+	for (int i = 0; i != 10000; i++) {
+		double V = 20 + 80 * Uniform(State) * Uniform(State);
+		Data.push_back(V);
+		Whole.Add(V);
+		(i < 3000 ? First : Second).Add(V);
+	}
+	First.Merge(Second);
+	CheckQuantiles("merged", First, Data);
+	for (int p = 0; p <= 100; p++)
+		Check(First.Quantile(p / 100.0) == Whole.Quantile(p / 100.0), "merged: quantile %.2f is %g, but %g unmerged",
+		      p / 100.0, First.Quantile(p / 100.0), Whole.Quantile(p / 100.0));
+}
+
+static void TestFolding() {
+	//Values from 1e-3 to 1e3 need about 690 bins at 1%: keep only 200
+	QuantileSketch Sketch(QuantileSketch::DefaultAccuracy, 200);
+	std::vector<double> Data;
+	uint32_t State = 5;
+	for (int i = 0; i != 20000; i++) {
+		double V = std::exp(-7 + 14 * Uniform(State));
+		Data.push_back(V);
+		Sketch.Add(V);
+	}
+	Check(Sketch.Bins() <= 200, "folding: %zu bins in use, at most 200 allowed", Sketch.Bins());
+	//The top 200 bins cover a factor of about 55, down to the 71st percentile or so
+	CheckQuantiles("folding", Sketch, Data, 75);
+}
+
+int main() {
+	TestTemperatures();
+	TestWideRange();
+	TestMixedSigns();
+	TestMerge();
+	TestFolding();
+	return Result();
+}
@@ -0,0 +1,69 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Record Stream Test
+	Streams to stdout redirected into a pipe that nobody reads
+	    and checks that stdout is left blocking (its flags are
+	    shared with whoever else holds it), that writing queues
+	    and then drops records instead of blocking, and that the
+	    records come out intact once the pipe is read.
+****************************************************************/
+#include <string>
+#include <vector>
+#include "../Output/RecordStream.hpp"
+#include "TestCheck.hpp"
+
+int main() {
+	int Pipe[2];
+	if (pipe(Pipe) != 0) return 1;
+	int Saved = dup(STDOUT_FILENO);
+	dup2(Pipe[1], STDOUT_FILENO);
+	close(Pipe[1]);
+
+	RecordStream::Limits L;
+	L.BatchBytes = 1024;
+	L.MaxPending = 256 * 1024;
+	std::size_t Written = 0;
+	{
+		RecordStream Out(RecordStream::Format::CSV, L);
+		Check(Out.Open("-", {"Core 0", "Core 1"}), "opening stdout");
+		Check(!(fcntl(STDOUT_FILENO, F_GETFL) & O_NONBLOCK), "stdout is left blocking");
+		//Far more than the pipe holds: this must return, dropping what doesn't fit
+		float Values[] = {45.1f, 50.5f};
+		for (int i = 0; i != 100000; i++) Out.Write(1000 + i, Values, nullptr);
+		Check(Out.Dropped() > 0, "records are dropped once the pipe and the queue are full");
+
+		//Drain the pipe so that Finish() can write the rest of the queue
+		std::string Text;
+		char Buffer[65536];
+		ssize_t N;
+		fcntl(Pipe[0], F_SETFL, O_NONBLOCK);
+		for (;;) {
+			Out.Flush();
+			if ((N = read(Pipe[0], Buffer, sizeof(Buffer))) <= 0) break;
+			Text.append(Buffer, N);
+		}
+		Written = Text.size();
+		Check(Text.rfind("time,\"Core 0\",\"Core 1\"\n1000.000,45.1,50.5\n", 0) == 0, "records start with the header");
+		Check(Text.find("1001.000,45.1,50.5\n") != std::string::npos, "records are intact");
+	}
+	Check(Written > 0, "anything was written");
+	dup2(Saved, STDOUT_FILENO);
+	close(Saved);
+	close(Pipe[0]);
+	return Result();
+}
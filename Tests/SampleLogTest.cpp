@@ -0,0 +1,127 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sample Log Test
+	Checks that only one Writer at a time can log to a
+	    directory, and that the next one can once it is closed.
+	Then tears the last block of a segment, as a crash in the
+	    middle of a commit would, and checks that readers skip
+	    it and that the next Writer cuts it off and carries on
+	    in the same segment.
+****************************************************************/
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include "../History/SampleLog.hpp"
+#include "TestCheck.hpp"
+
+/** @brief Remove Dir and the files in it */
+static void RemoveDir(std::string const &Dir) {
+	if (DIR *D = opendir(Dir.c_str())) {
+		while (dirent *E = readdir(D))
+			if (E->d_name[0] != '.') unlink((Dir + "/" + E->d_name).c_str());
+		closedir(D);
+	}
+	rmdir(Dir.c_str());
+}
+
+static void TestLock(std::string const &Dir) {
+	std::vector<std::string> Names = {"Core 0", "Core 1"};
+	float Values[] = {40, 41};
+	{
+		SampleLog::Writer First, Second;
+		Check(First.Open(Dir, Names), "opening a new log");
+		Check(!Second.Open(Dir, Names), "a second writer is refused while the first has the directory");
+		First.Append(1, Values);
+	}
+	SampleLog::Writer Next;
+	Check(Next.Open(Dir, Names), "a writer can have the directory once the first has closed");
+	Next.Append(2, Values);
+	Next.Commit();
+	SampleLog::Reader R;
+	std::size_t Records = R.Open(Dir) ? R.ForEach(-INFINITY, INFINITY, [](SampleLog::Segment const &, double, float const *){}) : 0;
+	Check(Records == 2, "%zu records logged, expected 2", Records);
+}
+
+/** @brief Times and first values of every record in Dir */
+static std::vector<std::pair<double,float>> ReadAll(std::string const &Dir) {
+	std::vector<std::pair<double,float>> Out;
+	SampleLog::Reader R;
+	if (R.Open(Dir)) R.ForEach(-INFINITY, INFINITY, [&Out](SampleLog::Segment const &, double Time, float const *Values) {
+		Out.emplace_back(Time, Values[0]);
+	});
+	return Out;
+}
+
+static void TestTornBlock(std::string const &Dir) {
+	std::vector<std::string> Names = {"Core 0", "Core 1", "Core 2"};
+	SampleLog::Writer::Limits L;
+	L.BatchRecords = 4;
+	L.Sync = false;
+	{
+		SampleLog::Writer W(L);
+		Check(W.Open(Dir, Names), "opening the log to tear");
+		for (int t = 0; t != 10; t++) {
+			float Values[] = {(float)t, 1, 2};
+			W.Append(t, Values);
+		}
+		//Two full blocks (8 samples) and two samples committed on closing
+	}
+	std::string Path = SampleLog::SegmentPath(Dir, 1);
+	struct stat Before;
+	stat(Path.c_str(), &Before);
+	//Half a block: its header and the start of its records
+	SampleLog::BlockHeader B{SampleLog::BlockMagic, 4, ~4u, 0};
+	std::vector<unsigned char> Torn(sizeof(B) + SampleLog::RecordSize(Names.size()) * 2, 0x5a);
+	std::memcpy(Torn.data(), &B, sizeof(B));
+	int Fd = open(Path.c_str(), O_WRONLY | O_APPEND);
+	Check(Fd >= 0 && write(Fd, Torn.data(), Torn.size()) == (ssize_t)Torn.size(), "tearing %s", Path.c_str());
+	if (Fd >= 0) close(Fd);
+
+	auto Records = ReadAll(Dir);
+	Check(Records.size() == 10, "%zu records read past a torn block, expected 10", Records.size());
+
+	{
+		SampleLog::Writer W(L);
+		Check(W.Open(Dir, Names), "reopening the torn log");
+		struct stat After;
+		stat(Path.c_str(), &After);
+		Check(After.st_size == Before.st_size, "the torn block wasn't cut off (%lld bytes, expected %lld)",
+		      (long long)After.st_size, (long long)Before.st_size);
+		for (int t = 10; t != 15; t++) {
+			float Values[] = {(float)t, 1, 2};
+			W.Append(t, Values);
+		}
+	}
+	Check(SampleLog::ListSegments(Dir).size() == 1, "the writer started a new segment instead of resuming");
+	Records = ReadAll(Dir);
+	Check(Records.size() == 15, "%zu records after resuming, expected 15", Records.size());
+	for (std::size_t i = 0; i != Records.size(); i++)
+		Check(Records[i].first == i && Records[i].second == i, "record %zu is (%g, %g)", i, Records[i].first, Records[i].second);
+}
+
+int main() {
+	char Template[] = "/tmp/safetemp-log-XXXXXX";
+	if (mkdtemp(Template) == nullptr) return 1;
+	TestLock(std::string(Template) + "/lock");
+	RemoveDir(std::string(Template) + "/lock");
+	TestTornBlock(std::string(Template) + "/torn");
+	RemoveDir(std::string(Template) + "/torn");
+	RemoveDir(Template);
+	return Result();
+}
@@ -0,0 +1,146 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Sensor Server Test
+	Talks to a SensorServer over its Unix socket and checks
+	    that a client which sends its requests and then shuts
+	    down its end still gets every reply before the server
+	    closes the connection, and that a socket_sensor keeps
+	    its first sensor list (matching by name) when it
+	    reconnects to a daemon with different sensors.
+****************************************************************/
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sensors/sensors.h>   //SensorClass.hpp expects it, as in SafeTemp.cpp
+#include "../Server/SensorServer.hpp"
+#include "../Sensors/SocketSensor.hpp"
+#include "TestCheck.hpp"
+
+/** @brief A daemon serving one sample of Names on a thread of its own */
+class Daemon {
+private:
+	HistoryStore m_History;
+	EventLoop m_Loop;
+	SensorServer m_Server;
+	std::atomic<bool> m_Stop{false};
+	std::thread m_Thread;
+public:
+	Daemon(std::string const &Path, std::vector<std::string> const &Names, std::vector<float> const &Values)
+		: m_History(Names, 16), m_Server(m_Loop, m_History) {
+		m_History.Append(1000, Values);
+		Check(m_Server.Listen(Path), "listening on %s", Path.c_str());
+		m_Thread = std::thread([this]() { while (!m_Stop) m_Loop.RunOnce(10); });
+	}
+	~Daemon() {
+		m_Stop = true;
+		m_Thread.join();
+	}
+};
+
+/** @brief Connect to Path, send Request, shut down the sending side and collect everything until EOF */
+static std::string HalfClose(EventLoop &Loop, std::string const &Path, std::string const &Request) {
+	sockaddr_un Address;
+	std::memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	std::memcpy(Address.sun_path, Path.c_str(), Path.size() + 1);
+	int Fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	std::string Reply;
+	if (Fd < 0 || connect(Fd, (sockaddr*)&Address, sizeof(Address)) != 0 ||
+	    write(Fd, Request.data(), Request.size()) != (ssize_t)Request.size() || shutdown(Fd, SHUT_WR) != 0) {
+		Check(false, "cannot send to %s", Path.c_str());
+		if (Fd >= 0) close(Fd);
+		return Reply;
+	}
+	bool Closed = false;
+	for (int i = 0; i != 200 && !Closed; i++) {
+		Loop.RunOnce(10);
+		char Buffer[4096];
+		ssize_t N;
+		while ((N = recv(Fd, Buffer, sizeof(Buffer), MSG_DONTWAIT)) > 0) Reply.append(Buffer, N);
+		Closed = (N == 0);
+	}
+	Check(Closed, "the server never closed the half-closed connection");
+	close(Fd);
+	return Reply;
+}
+
+/** @brief The types of the messages in Reply */
+static std::vector<Protocol::MessageType> Messages(std::string const &Reply) {
+	Protocol::MessageBuffer In;
+	std::memcpy(In.Reserve(Reply.size()), Reply.data(), Reply.size());
+	In.Commit(Reply.size());
+	std::vector<Protocol::MessageType> Out;
+	Protocol::MessageType Type;
+	std::string_view Payload;
+	bool Error;
+	while (In.Next(Type, Payload, Error)) Out.push_back(Type);
+	Check(!Error, "the reply is corrupt");
+	return Out;
+}
+
+int main() {
+	char Template[] = "/tmp/safetemp-server-XXXXXX";
+	if (mkdtemp(Template) == nullptr) return 1;
+	std::string Path = std::string(Template) + "/socket";
+
+	HistoryStore History({"Core 0", "Core 1"}, 16);
+	History.Append(1000, std::vector<float>{40, 41});
+	History.Append(1001, std::vector<float>{42, 43});
+	EventLoop Loop;
+	{
+		SensorServer Server(Loop, History);
+		Check(Server.Listen(Path), "listening on %s", Path.c_str());
+
+		std::string Request;
+		Protocol::Writer(Request, Protocol::MessageType::Hello).Put(Protocol::Version);
+		Protocol::Writer(Request, Protocol::MessageType::GetHistory).Put(0.0).Put(1e12);
+		auto Got = Messages(HalfClose(Loop, Path, Request));
+		//Hello: the sensors and the latest snapshot; GetHistory: two samples and the end marker
+		std::vector<Protocol::MessageType> Expected = {Protocol::MessageType::Sensors, Protocol::MessageType::Snapshot,
+		                                               Protocol::MessageType::Snapshot, Protocol::MessageType::Snapshot,
+		                                               Protocol::MessageType::HistoryEnd};
+		Check(Got == Expected, "%zu messages in reply to a request followed by a shutdown, expected %zu", Got.size(), Expected.size());
+	}
+
+	//Restarted with one sensor gone, one new and the rest in another order
+	{
+		std::unique_ptr<socket_sensor> Sensor;
+		{
+			Daemon First(Path, {"Core 0", "Core 1", "Core 2"}, {40, 41, 42});
+			Sensor = std::make_unique<socket_sensor>(Path);
+			Check(Sensor->GetNumberOfSensors() == 3 && Sensor->GetTemperature(1u) == 41, "reading the first daemon");
+		}
+		Daemon Second(Path, {"Core 2", "Core 0", "GPU"}, {52, 50, 60});
+		auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (Sensor->GetTemperature(0u) != 50 && std::chrono::steady_clock::now() < Deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		Check(Sensor->GetNumberOfSensors() == 3 && Sensor->GetSensorName(2) == "Core 2", "the sensor list is kept");
+		Near("Core 0 after reconnecting", Sensor->GetTemperature(0u), 50);
+		Check(std::isnan(Sensor->GetTemperature(1u)), "Core 1, which is gone, reads %g", Sensor->GetTemperature(1u));
+		Near("Core 2 after reconnecting", Sensor->GetTemperature(2u), 52);
+		std::vector<float> Fetched;
+		Sensor->FetchHistory(0, 1e12, [&Fetched](double, float const *Values) { Fetched.assign(Values, Values + 3); });
+		Check(Fetched.size() == 3 && Fetched[0] == 50 && std::isnan(Fetched[1]) && Fetched[2] == 52, "history is matched by name too");
+	}
+	rmdir(Template);
+	return Result();
+}
@@ -0,0 +1,110 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Shared Snapshot Test
+	Checks that a second writer can't take over a segment while
+	    its writer is running, that a stale segment (writer gone)
+	    is replaced, that readers reject a header of the wrong
+	    size, and that a reader racing a writer thread never
+	    sees a torn snapshot.
+****************************************************************/
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include "../Server/SharedSnapshot.hpp"
+#include "TestCheck.hpp"
+
+/** @brief Leave a segment as a writer with the given pid and header size would have */
+static void Forge(std::string const &Name, uint32_t Pid, uint16_t HeaderSize) {
+	shm_unlink(Name.c_str());
+	int Fd = shm_open(Name.c_str(), O_CREAT | O_RDWR, 0644);
+	//Built at the documented offsets rather than through Header, which holds an atomic
+	unsigned char H[sizeof(SharedSnapshot::Header)] = {};
+	uint32_t EntrySize = sizeof(SharedSnapshot::Entry);
+	std::memcpy(H + 0, &SharedSnapshot::Magic, 4);
+	std::memcpy(H + 4, &SharedSnapshot::Version, 2);
+	std::memcpy(H + 6, &HeaderSize, 2);
+	std::memcpy(H + 12, &EntrySize, 4);
+	std::memcpy(H + 40, &Pid, 4);
+	if (Fd < 0 || pwrite(Fd, H, sizeof(H), 0) != (ssize_t)sizeof(H)) Check(false, "forging a segment");
+	if (Fd >= 0) close(Fd);
+}
+
+int main() {
+	std::string Name = "/safetemp-test-" + std::to_string(getpid());
+	std::vector<std::string> Sensors = {"Core 0", "Core 1"};
+	{
+		SharedSnapshot::Writer First, Second;
+		Check(First.Create(Name, Sensors), "creating a new segment");
+		Check(!Second.Create(Name, Sensors) && errno == EBUSY, "a second writer is refused while the first runs");
+		SharedSnapshot::Reader R;
+		Check(R.Open(Name), "reading the first writer's segment");
+	}
+
+	//A writer that has exited
+	pid_t Child = fork();
+	if (Child == 0) _exit(0);
+	waitpid(Child, nullptr, 0);
+	Forge(Name, Child, sizeof(SharedSnapshot::Header));
+	{
+		SharedSnapshot::Writer W;
+		Check(W.Create(Name, Sensors), "replacing a stale segment");
+	}
+
+	Forge(Name, 0, 32);
+	{
+		SharedSnapshot::Reader R;
+		Check(!R.Open(Name) && errno == EPROTO, "a header of the wrong size is rejected");
+	}
+
+	//Every reading sets all sensors to the update number: a torn copy mixes two of them
+	std::vector<std::string> Many(64);
+	for (std::size_t i = 0; i != Many.size(); i++) Many[i] = "Sensor " + std::to_string(i);
+	{
+		SharedSnapshot::Writer W;
+		SharedSnapshot::Reader R;
+		Check(W.Create(Name, Many) && R.Open(Name), "creating the segment to race");
+		std::atomic<bool> Done{false};
+		std::thread Publisher([&W, &Done, &Many]() {
+			std::vector<float> Values(Many.size());
+			for (uint32_t n = 1; n <= 200000; n++) {
+				std::fill(Values.begin(), Values.end(), (float)n);
+				W.Publish(n, Values.data(), nullptr, nullptr);
+			}
+			Done = true;
+		});
+		SharedSnapshot::Reading Copy;
+		unsigned Reads = 0, Torn = 0;
+		while (!Done) {
+			if (!R.Read(Copy)) continue;
+			Reads++;
+			bool Same = Copy.Sensors.size() == Many.size() && Copy.Time == (double)Copy.Updates;
+			for (auto const &E : Copy.Sensors) Same &= (E.Value == (float)Copy.Updates || Copy.Updates == 0);
+			if (!Same) Torn++;
+		}
+		Publisher.join();
+		Check(Reads > 0, "no reading got through while the writer ran");
+		Check(Torn == 0, "%u of %u readings were torn", Torn, Reads);
+		Check(R.Read(Copy) && Copy.Updates == 200000 && Copy.Sensors[63].Value == 200000, "the last reading is intact");
+	}
+	shm_unlink(Name.c_str());
+	return Result();
+}
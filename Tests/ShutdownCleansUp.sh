@@ -0,0 +1,36 @@
+#!/bin/sh
+# Shutdown Cleans Up
+#	Runs the daemon with --log, --listen, --shm and --output,
+#	    stops it with SIGTERM, and checks that every sample it
+#	    streamed also reached the log and that the socket and
+#	    the shared-memory segment were removed.
+#	Usage: ShutdownCleansUp.sh SAFETEMP-DAEMON
+
+DAEMON="$1"
+DIR=$(mktemp -d) || exit 1
+SHM=/safetemp-test-$$
+trap 'rm -rf "$DIR"; rm -f /dev/shm$SHM' EXIT
+
+#20 times real time: a sample every 50 ms
+"$DAEMON" --synthetic 2 --replay-speed 20 -w 1 --log "$DIR/log" --listen "$DIR/socket" --shm $SHM \
+	--output csv --output-file "$DIR/out.csv" > "$DIR/out" 2>&1 &
+PID=$!
+for i in $(seq 50); do
+	[ -S "$DIR/socket" ] && [ -e /dev/shm$SHM ] && break
+	sleep 0.1
+done
+sleep 0.5
+kill -TERM $PID
+wait $PID
+Status=$?
+if [ $Status -ne 0 ]; then echo "FAIL: exit status $Status"; cat "$DIR/out"; exit 1; fi
+
+if [ -e "$DIR/socket" ]; then echo "FAIL: the --listen socket was left behind"; exit 1; fi
+if [ -e /dev/shm$SHM ]; then echo "FAIL: the --shm segment was left behind"; exit 1; fi
+
+Streamed=$(($(wc -l < "$DIR/out.csv") - 1))   #less the header
+Logged=$("$DAEMON" --replay "$DIR/log" --replay-speed max 2>&1 >/dev/null | sed -n 's/^Played back \([0-9]*\) samples$/\1/p')
+if [ "$Streamed" -le 0 ] || [ "$Logged" != "$Streamed" ]; then
+	echo "FAIL: $Streamed samples streamed but ${Logged:-no} samples logged"; exit 1
+fi
+exit 0
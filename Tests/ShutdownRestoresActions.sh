@@ -0,0 +1,41 @@
+#!/bin/sh
+# Shutdown Restores Actions
+#	Starts the daemon against a fake --sysfs-root with an @cpufreq
+#	    action that fires straight away, stops it with SIGTERM once
+#	    the limit is written, and checks that the original
+#	    scaling_max_freq of every policy has been put back.
+#	Usage: ShutdownRestoresActions.sh SAFETEMP-DAEMON
+
+DAEMON="$1"
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+for P in 0 1; do
+	mkdir -p "$DIR/sys/devices/system/cpu/cpufreq/policy$P"
+	echo 3000000 > "$DIR/sys/devices/system/cpu/cpufreq/policy$P/cpuinfo_max_freq"
+	echo 2800000 > "$DIR/sys/devices/system/cpu/cpufreq/policy$P/scaling_max_freq"
+done
+echo 10 > "$DIR/critical"   #every synthetic sensor is above this
+
+"$DAEMON" --synthetic 2 --sysfs-root "$DIR/sys" -f "$DIR/critical" -C "@cpufreq 50%" -w 1 > "$DIR/out" 2>&1 &
+PID=$!
+
+Applied=0
+for i in $(seq 50); do
+	if [ "$(cat "$DIR/sys/devices/system/cpu/cpufreq/policy0/scaling_max_freq")" = 1500000 ]; then Applied=1; break; fi
+	sleep 0.1
+done
+if [ $Applied -ne 1 ]; then
+	echo "FAIL: the action was never applied"; kill -KILL $PID; cat "$DIR/out"; exit 1
+fi
+
+kill -TERM $PID
+wait $PID
+Status=$?
+if [ $Status -ge 128 ]; then echo "FAIL: killed by the signal (status $Status)"; exit 1; fi
+
+for P in 0 1; do
+	Value=$(cat "$DIR/sys/devices/system/cpu/cpufreq/policy$P/scaling_max_freq")
+	if [ "$Value" != 2800000 ]; then echo "FAIL: policy$P scaling_max_freq is $Value, expected 2800000"; exit 1; fi
+done
+exit 0
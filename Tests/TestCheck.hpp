@@ -0,0 +1,55 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Test Check
+	The pass/fail bookkeeping shared by the tests: Check() and
+	    Near() print "FAIL: ..." for every failed expectation,
+	    and main() returns Result() so that ctest sees it.
+	Messages go to stderr, which the tests never redirect.
+****************************************************************/
+#ifndef TESTS_TESTCHECK_HPP_
+#define TESTS_TESTCHECK_HPP_
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+static int Failures = 0;
+
+/** @brief Count a failure unless Ok (Format and the rest as for printf) */
+__attribute__((format(printf, 2, 3)))
+static void Check(bool Ok, char const *Format, ...) {
+	if (Ok) return;
+	std::va_list Args;
+	va_start(Args, Format);
+	std::fputs("FAIL: ", stderr);
+	std::vfprintf(stderr, Format, Args);
+	std::fputc('\n', stderr);
+	va_end(Args);
+	Failures++;
+}
+
+/** @brief Check that Got is within Tolerance of Expected */
+static void Near(char const *What, double Got, double Expected, double Tolerance = 1e-3) {
+	Check(std::fabs(Got - Expected) < Tolerance, "%s: got %g, expected %g", What, Got, Expected);
+}
+
+/** @brief Exit status for main() */
+static int Result() {
+	return Failures ? 1 : 0;
+}
+
+#endif //TESTS_TESTCHECK_HPP_
@@ -0,0 +1,120 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+/****************************************************************
+Thermal Predictor Test
+	Heats a synthetic sensor along a first-order curve, with
+	    noise and the quantization of a real sensor, and checks
+	    the fitted asymptote, time constant and time to a
+	    threshold against the analytic ones.  Also checks a
+	    curve that settles below the threshold, a change of load
+	    part way through, and the early fallback to the slope.
+****************************************************************/
+#include <cmath>
+#include <cstdint>
+#include "../History/ThermalPredictor.hpp"
+#include "TestCheck.hpp"
+
+/** @brief Deterministic noise in [-1, 1] */
+static double Noise(uint32_t &State) {
+	State = State * 1664525u + 1013904223u;
+	return (State >> 8) / (double)(1 << 23) - 1.0;
+}
+
+/** @brief T(t) = Asymptote - (Asymptote - Start) exp(-t / Tau) */
+struct Curve {
+	double Start, Asymptote, Tau;
+
+	double operator()(double t) const {
+		return Asymptote - (Asymptote - Start) * std::exp(-t / Tau);
+	}
+	/** @brief Seconds from Level to Threshold (INFINITY if never) */
+	double TimeTo(double Threshold, double Level) const {
+		if (Level >= Threshold) return 0;
+		if (Asymptote <= Threshold) return INFINITY;
+		return Tau * std::log((Asymptote - Level) / (Asymptote - Threshold));
+	}
+};
+
+/** @brief A reading of a sensor with 0.25 degree noise and 0.125 degree steps */
+static double Read(double True, uint32_t &State) {
+	return std::round((True + 0.25 * Noise(State)) * 8) / 8;
+}
+
+static void TestHeating() {
+	Curve Heat{40, 90, 120};
+	ThermalPredictor Predictor;
+	uint32_t State = 1;
+	double const Threshold = 80;
+	bool WasValid = false;
+	for (int t = 0; t <= 240; t++) {
+		Predictor.Add(t, Read(Heat(t), State));
+		if (t < 90 || t % 30 != 0) continue;
+		char What[64];
+		WasValid |= Predictor.Valid();
+		Check(Predictor.Valid(), "heating: no model after %d s", t);
+		std::snprintf(What, sizeof(What), "heating: asymptote after %d s", t);
+		Near(What, Predictor.Asymptote(), Heat.Asymptote, 0.05 * (Heat.Asymptote - Heat.Start));
+		std::snprintf(What, sizeof(What), "heating: time constant after %d s", t);
+		Near(What, Predictor.TimeConstant(), Heat.Tau, 0.1 * Heat.Tau);
+		double Expected = Heat.TimeTo(Threshold, Heat(t));
+		std::snprintf(What, sizeof(What), "heating: time to %g after %d s", Threshold, t);
+		Near(What, Predictor.TimeTo(Threshold, Heat(t)), Expected, std::max(0.1 * Expected, 5.0));
+	}
+	Check(WasValid, "heating: the model was never valid");
+	Check(Predictor.TimeTo(Threshold, Threshold + 1) == 0, "heating: no time left above the threshold");
+}
+
+static void TestSettlingBelow() {
+	Curve Heat{40, 70, 60};
+	ThermalPredictor Predictor;
+	uint32_t State = 2;
+	for (int t = 0; t <= 150; t++) Predictor.Add(t, Read(Heat(t), State));
+	Check(Predictor.Valid(), "settling: no model");
+	Near("settling: asymptote", Predictor.Asymptote(), Heat.Asymptote, 1);
+	Check(std::isinf(Predictor.TimeTo(80, Heat(150))), "settling: %g s to 80, but it settles at 70", Predictor.TimeTo(80, Heat(150)));
+}
+
+static void TestChangeOfLoad() {
+	//Idle for a long while, then a heavy load
+	Curve Idle{35, 45, 60}, Load{45, 95, 90};
+	ThermalPredictor Predictor;
+	uint32_t State = 3;
+	int t = 0;
+	for (; t != 1200; t++) Predictor.Add(t, Read(Idle(t), State));
+	Check(std::isinf(Predictor.TimeTo(90, Idle(t))), "load: %g s to 90 while idle", Predictor.TimeTo(90, Idle(t)));
+	for (int Since = 0; Since <= 150; Since++, t++) Predictor.Add(t, Read(Load(Since), State));
+	double Level = Load(150), Expected = Load.TimeTo(90, Level);
+	Near("load: time to 90 after the change", Predictor.TimeTo(90, Level), Expected, 0.15 * Expected);
+}
+
+static void TestEarlySlope() {
+	//Too few steps for a model: the change over the last step is extrapolated
+	ThermalPredictor Predictor;
+	for (int t = 0; t <= 25; t++) Predictor.Add(t, 40 + 0.5 * t);
+	Check(!Predictor.Valid(), "early: a model after 25 s");
+	Near("early: time to 60 at 0.5 degrees/s", Predictor.TimeTo(60, 52.5), 15, 0.1);
+	ThermalPredictor Cooling;
+	for (int t = 0; t <= 25; t++) Cooling.Add(t, 60 - 0.5 * t);
+	Check(std::isinf(Cooling.TimeTo(80, 47.5)), "early: %g s to 80 while cooling", Cooling.TimeTo(80, 47.5));
+}
+
+int main() {
+	TestHeating();
+	TestSettlingBelow();
+	TestChangeOfLoad();
+	TestEarlySlope();
+	return Result();
+}
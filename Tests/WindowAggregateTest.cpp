@@ -0,0 +1,93 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Window Aggregate Test
+	Checks that an unreadable (NaN) sample doesn't stick in any
+	    of the windowed aggregates: each must report the same as
+	    it would have without it once the window has moved on,
+	    and ignore it while it is inside.  With no data (an empty
+	    window, too few samples, or a sensor unreadable for longer
+	    than the window) every aggregate is NaN and no rule fires.
+****************************************************************/
+#include <cmath>
+#include <sstream>
+#include "../Alerts/RuleEngine.hpp"
+#include "TestCheck.hpp"
+
+int main() {
+	//One reading a second, 10 s windows: 40 up to t=50 (with a NaN at t=20), then 50
+	WindowAggregate Avg(AggregateKind::Avg, 10), Max(AggregateKind::Max, 10), Min(AggregateKind::Min, 10);
+	WindowAggregate Rate(AggregateKind::Rate, 10), Over(AggregateKind::CountOver, 10, 45), Ewma(AggregateKind::Ewma, 10);
+	WindowAggregate *All[] = {&Avg, &Max, &Min, &Rate, &Over, &Ewma};
+	for (int t = 0; t <= 100; t++) {
+		float Value = (t == 20) ? NAN : (t <= 50) ? 40.0f : 50.0f;
+		for (auto *W : All) W->Push(t, Value);
+		if (t == 20 || t == 25) {
+			//The NaN is inside the window: it is left out
+			Near("avg with a NaN in the window", Avg.Value(), 40);
+			Near("max with a NaN in the window", Max.Value(), 40);
+			Near("min with a NaN in the window", Min.Value(), 40);
+			Near("rate with a NaN in the window", Rate.Value(), 0);
+			Near("count_over with a NaN in the window", Over.Value(), 0);
+			Near("ewma with a NaN in the window", Ewma.Value(), 40);
+		}
+	}
+	Near("avg after a NaN", Avg.Value(), 50);
+	Near("max after a NaN", Max.Value(), 50);
+	Near("min after a NaN", Min.Value(), 50);
+	Near("rate after a NaN", Rate.Value(), 0);
+	Near("count_over after a NaN", Over.Value(), 10);
+	Check(std::isfinite(Ewma.Value()), "ewma after a NaN: got %g", Ewma.Value());
+
+	//A window of nothing but NaN empties, rather than keeping the last good readings
+	WindowAggregate Gone(AggregateKind::Avg, 10);
+	Gone.Push(0, 40);
+	for (int t = 1; t <= 20; t++) Gone.Push(t, NAN);
+	Check(std::isnan(Gone.Value()), "avg of a window of NaN: got %g, expected NaN", Gone.Value());
+
+	//Nothing to go on: NaN rather than 0
+	AggregateKind Kinds[] = {AggregateKind::Latest, AggregateKind::Avg, AggregateKind::Max, AggregateKind::Min, AggregateKind::Rate,
+	                         AggregateKind::CountOver, AggregateKind::Ewma, AggregateKind::StdDev, AggregateKind::Slope, AggregateKind::Accel};
+	for (AggregateKind K : Kinds) {
+		WindowAggregate Empty(K, 10), Stale(K, 10);
+		Check(std::isnan(Empty.Value()), "aggregate %d before any sample: got %g", (int)K, Empty.Value());
+		Stale.Push(0, 40);
+		for (int t = 1; t <= 5; t++) Stale.Push(t, 40);
+		for (int t = 6; t <= 20; t++) Stale.Push(t, NAN);
+		Check(std::isnan(Stale.Value()), "aggregate %d after a window of NaN: got %g", (int)K, Stale.Value());
+	}
+	WindowAggregate One(AggregateKind::StdDev, 10), OneRate(AggregateKind::Rate, 10);
+	One.Push(0, 40);
+	OneRate.Push(0, 40);
+	Check(std::isnan(One.Value()), "stddev of one sample: got %g", One.Value());
+	Check(std::isnan(OneRate.Value()), "rate of one sample: got %g", OneRate.Value());
+
+	//Rules on a sensor that goes unreadable at t=5 must not fire on the emptied windows
+	std::istringstream Text("avg(fan, 10) < 20\nmin(fan, 10) < 20\nstddev(fan) < 0.01\n");
+	RuleEngine Rules;
+	Check(Rules.Load(Text, "test"), "loading the rules");
+	Rules.Bind({"fan"});
+	for (int t = 0; t <= 30; t++) {
+		SensorSnapshot Snapshot;
+		Snapshot.Time = t;
+		Snapshot.Values = {(t < 5) ? 1000.0f + 10 * t : NAN};
+		for (auto const &F : Rules.Evaluate(Snapshot, {}))
+			Check(false, "rule %u fired at t=%d with %g", F.Rule, t, F.Value);
+	}
+
+	return Result();
+}
@@ -0,0 +1,407 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Query
+	Offline analytics over a sample log (--log DIR), e.g. p99 of
+	    the package temperature per hour over the last 30 days:
+	        safetemp-query -d DIR --from -30d -s "Package*" -g 1h --stats p99
+	    or the time each sensor spent above 90 degrees:
+	        safetemp-query -d DIR --stats above:90
+
+	Usage: safetemp-query -d DIR [options]
+	    --from TIME     start, inclusive (default: the start of the log)
+	    --to TIME       end, inclusive (default: now)
+	                    TIME is seconds since the epoch, "now",
+	                    -DURATION before now (e.g. -30d) or
+	                    YYYY-MM-DD[THH:MM[:SS]] in UTC
+	    -s GLOB         only sensors matching GLOB (repeatable)
+	    -g DURATION     one row per DURATION (s, m, h, d, w) and
+	                    sensor instead of one row per sensor
+	    --stats LIST    comma-separated count, min, max, avg, pNN
+	                    (percentile, e.g. p99.9) and above:TEMP
+	                    (seconds spent above TEMP); default
+	                    count,min,max,avg,p50,p99
+	    --format FMT    csv (default) or json
+	    -j N            worker threads (default: one per core)
+	    --max-gap SEC   longest interval one sample is counted for
+	                    by above: (default 60)
+
+	Percentiles come from a quantile sketch per sensor and
+	    group (History/QuantileSketch.hpp), so they are within
+	    1% of the true value and memory doesn't grow with the
+	    number of samples.
+
+	Segments are ruled out from their headers alone (by time
+	    and by sensor) before any block is read; the rest are
+	    checked and aggregated in parallel, a segment per
+	    worker, straight from the mapped files.
+****************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fnmatch.h>
+#include "../History/QuantileSketch.hpp"
+#include "../History/SampleLog.hpp"
+
+struct Stat {
+	enum Kind { Count, Min, Max, Avg, Percentile, Above } Type;
+	double Arg;                    ///<Percentile or temperature
+	std::string Label;
+};
+
+struct Query {
+	std::string Dir;
+	double From = -INFINITY, To = INFINITY;
+	double Bucket = 0;             ///<Seconds per group (0: one group)
+	std::vector<std::string> Globs;
+	std::vector<Stat> Stats;
+	std::vector<double> Thresholds; ///<Of the above: stats, in order
+	bool NeedSketch = false;       ///<Some stat is a percentile
+	double MaxGap = 60;
+	unsigned Threads = 0;
+	bool JSON = false;
+};
+
+/** @brief Everything gathered about one sensor in one group */
+struct Accumulator {
+	uint64_t Count = 0;
+	double Sum = 0;
+	float Min = INFINITY, Max = -INFINITY;
+	double First = INFINITY;       ///<Time of the earliest sample
+	std::vector<double> Above;     ///<Seconds above each threshold
+	QuantileSketch Sketch;         ///<For percentiles
+
+	void Merge(Accumulator &Other) {
+		Count += Other.Count;
+		Sum += Other.Sum;
+		Min = std::min(Min, Other.Min);
+		Max = std::max(Max, Other.Max);
+		First = std::min(First, Other.First);
+		Above.resize(std::max(Above.size(), Other.Above.size()));
+		for (std::size_t i = 0; i != Other.Above.size(); i++) Above[i] += Other.Above[i];
+		Sketch.Merge(Other.Sketch);
+	}
+};
+
+/** @brief Group (bucket number) -> accumulator per selected sensor */
+using Groups = std::map<int64_t, std::vector<Accumulator>>;
+
+/** @brief A segment that survived the header checks */
+struct Candidate {
+	std::unique_ptr<SampleLog::Segment> Segment;
+	std::vector<int> Sensor;       ///<Selected sensor of each column (-1: not selected)
+};
+
+/** @brief Parse "90", "15m", "1h", "30d", ... into seconds */
+static bool ParseDuration(char const *Text, double &Out) {
+	char *End;
+	double Value = strtod(Text, &End);
+	double Unit = 1;
+	if (*End == 'm') Unit = 60;
+	else if (*End == 'h') Unit = 3600;
+	else if (*End == 'd') Unit = 86400;
+	else if (*End == 'w') Unit = 7 * 86400;
+	else if (*End == 's') Unit = 1;
+	else if (*End != 0) return false;
+	if (End == Text || (*End != 0 && End[1] != 0) || !(Value >= 0)) return false;
+	Out = Value * Unit;
+	return true;
+}
+
+static bool ParseTime(char const *Text, double Now, double &Out) {
+	if (strcmp(Text, "now") == 0) {
+		Out = Now;
+		return true;
+	}
+	if (Text[0] == '-') {
+		double Ago;
+		if (!ParseDuration(Text + 1, Ago)) return false;
+		Out = Now - Ago;
+		return true;
+	}
+	for (char const *Format : {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"}) {
+		tm T;
+		std::memset(&T, 0, sizeof(T));
+		char const *End = strptime(Text, Format, &T);
+		if (End != nullptr && *End == 0) {
+			Out = (double)timegm(&T);
+			return true;
+		}
+	}
+	char *End;
+	Out = strtod(Text, &End);
+	return End != Text && *End == 0;
+}
+
+static bool ParseStats(std::string const &List, Query &Q) {
+	Q.Stats.clear();
+	Q.Thresholds.clear();
+	std::size_t Start = 0;
+	while (Start <= List.size()) {
+		std::size_t Comma = List.find(',', Start);
+		if (Comma == std::string::npos) Comma = List.size();
+		std::string Item = List.substr(Start, Comma - Start);
+		Start = Comma + 1;
+		char *End;
+		if (Item == "count") Q.Stats.push_back({Stat::Count, 0, Item});
+		else if (Item == "min") Q.Stats.push_back({Stat::Min, 0, Item});
+		else if (Item == "max") Q.Stats.push_back({Stat::Max, 0, Item});
+		else if (Item == "avg" || Item == "mean") Q.Stats.push_back({Stat::Avg, 0, "avg"});
+		else if (Item.size() > 1 && Item[0] == 'p') {
+			double P = strtod(Item.c_str() + 1, &End);
+			if (*End != 0 || !(P >= 0 && P <= 100)) return false;
+			Q.Stats.push_back({Stat::Percentile, P, Item});
+			Q.NeedSketch = true;
+		}
+		else if (Item.compare(0, 6, "above:") == 0) {
+			double T = strtod(Item.c_str() + 6, &End);
+			if (*End != 0 || End == Item.c_str() + 6) return false;
+			Q.Stats.push_back({Stat::Above, (double)Q.Thresholds.size(), "seconds_above_" + Item.substr(6)});
+			Q.Thresholds.push_back(T);
+		}
+		else return false;
+	}
+	return !Q.Stats.empty();
+}
+
+static bool Selected(Query const &Q, std::string const &Name) {
+	if (Q.Globs.empty()) return true;
+	for (auto const &Glob : Q.Globs)
+		if (fnmatch(Glob.c_str(), Name.c_str(), 0) == 0) return true;
+	return false;
+}
+
+/** @brief Map the segments that may hold selected samples, working out the selected sensors on the way */
+static std::vector<Candidate> Plan(Query const &Q, std::vector<std::string> &Sensors) {
+	std::vector<Candidate> Out;
+	std::vector<std::unique_ptr<SampleLog::Segment>> Headers;
+	for (uint64_t Sequence : SampleLog::ListSegments(Q.Dir)) {
+		std::string Error;
+		auto S = std::make_unique<SampleLog::Segment>();
+		if (S->Open(SampleLog::SegmentPath(Q.Dir, Sequence), Error, false)) Headers.push_back(std::move(S));
+		else std::fprintf(stderr, "Skipping %s\n", Error.c_str());
+	}
+	for (std::size_t i = 0; i != Headers.size(); i++) {
+		//A segment ends where the next one starts (NaN, for an empty segment, never rules one out)
+		if (Headers[i]->FirstTime() > Q.To) break;
+		if (i + 1 < Headers.size() && Headers[i+1]->FirstTime() < Q.From) continue;
+		Candidate C;
+		bool Any = false;
+		for (auto const &Name : Headers[i]->Names()) {
+			int Index = -1;
+			if (Selected(Q, Name)) {
+				auto IT = std::find(Sensors.begin(), Sensors.end(), Name);
+				Index = IT - Sensors.begin();
+				if (IT == Sensors.end()) Sensors.push_back(Name);
+				Any = true;
+			}
+			C.Sensor.push_back(Index);
+		}
+		if (!Any) continue;
+		C.Segment = std::move(Headers[i]);
+		Out.push_back(std::move(C));
+	}
+	return Out;
+}
+
+/** @brief Aggregate one segment into G */
+static void Scan(Query const &Q, Candidate &C, std::size_t NSensors, Groups &G) {
+	C.Segment->Index();
+	int64_t CurrentKey = 0;
+	std::vector<Accumulator> *Current = nullptr;
+	auto Account = [&](double Time, float const *Values, double Span) {
+		int64_t Key = (Q.Bucket > 0) ? (int64_t)std::floor(Time / Q.Bucket) : 0;
+		if (Current == nullptr || Key != CurrentKey) {
+			Current = &G[Key];
+			CurrentKey = Key;
+			if (Current->empty()) {
+				Current->resize(NSensors);
+				for (auto &A : *Current) A.Above.resize(Q.Thresholds.size());
+			}
+		}
+		for (std::size_t c = 0; c != C.Sensor.size(); c++) {
+			float V = Values[c];
+			if (C.Sensor[c] < 0 || std::isnan(V)) continue;
+			Accumulator &A = (*Current)[C.Sensor[c]];
+			A.Count++;
+			A.Sum += V;
+			A.Min = std::min(A.Min, V);
+			A.Max = std::max(A.Max, V);
+			A.First = std::min(A.First, Time);
+			for (std::size_t t = 0; t != Q.Thresholds.size(); t++)
+				if (V > Q.Thresholds[t]) A.Above[t] += Span;
+			if (Q.NeedSketch) A.Sketch.Add(V);
+		}
+	};
+	//A sample counts (for above:) until the next one, so each is accounted one step late
+	//(copied: a compressed segment decodes each sample into the same buffer)
+	double PrevTime = 0, Span = 0;
+	std::vector<float> Prev;
+	C.Segment->ForEach(Q.From, Q.To, [&](double Time, float const *Values) {
+		if (!Prev.empty()) {
+			Span = std::min(Time - PrevTime, Q.MaxGap);
+			Account(PrevTime, Prev.data(), Span);
+		}
+		PrevTime = Time;
+		Prev.assign(Values, Values + C.Sensor.size());
+	});
+	if (!Prev.empty()) Account(PrevTime, Prev.data(), Span);
+}
+
+static void PutNumber(double Value, bool JSON) {
+	if (std::isnan(Value) || std::isinf(Value)) std::fputs(JSON ? "null" : "", stdout);
+	else std::printf("%.10g", Value);
+}
+
+static void PutString(std::string const &Text, bool JSON) {
+	std::putchar('"');
+	for (char c : Text) {
+		if (c == '"') std::fputs(JSON ? "\\\"" : "\"\"", stdout);
+		else if (JSON && c == '\\') std::fputs("\\\\", stdout);
+		else if (JSON && (unsigned char)c < 0x20) std::printf("\\u%04x", (unsigned)c);
+		else std::putchar(c);
+	}
+	std::putchar('"');
+}
+
+static void Print(Query const &Q, std::vector<std::string> const &Sensors, Groups &G) {
+	bool First = true;
+	if (Q.JSON) std::puts("[");
+	else {
+		std::fputs("time,sensor", stdout);
+		for (auto const &S : Q.Stats) std::printf(",%s", S.Label.c_str());
+		std::putchar('\n');
+	}
+	for (auto &Group : G) {
+		for (std::size_t s = 0; s != Sensors.size(); s++) {
+			Accumulator &A = Group.second[s];
+			if (A.Count == 0) continue;
+			double Start = (Q.Bucket > 0) ? Group.first * Q.Bucket : A.First;
+			time_t Seconds = (time_t)std::floor(Start);
+			tm T;
+			gmtime_r(&Seconds, &T);
+			char Time[32];
+			strftime(Time, sizeof(Time), "%Y-%m-%dT%H:%M:%SZ", &T);
+			if (Q.JSON) {
+				std::printf("%s{\"time\":\"%s\",\"sensor\":", First ? "" : ",\n", Time);
+				PutString(Sensors[s], true);
+			}
+			else {
+				std::printf("%s,", Time);
+				PutString(Sensors[s], false);
+			}
+			First = false;
+			for (auto const &S : Q.Stats) {
+				double Value = NAN;
+				switch (S.Type) {
+				case Stat::Count:      Value = A.Count; break;
+				case Stat::Min:        Value = A.Min; break;
+				case Stat::Max:        Value = A.Max; break;
+				case Stat::Avg:        Value = A.Sum / A.Count; break;
+				case Stat::Percentile: Value = A.Sketch.Quantile(S.Arg / 100); break;
+				case Stat::Above:      Value = A.Above[(std::size_t)S.Arg]; break;
+				}
+				if (Q.JSON) std::printf(",\"%s\":", S.Label.c_str());
+				else std::putchar(',');
+				PutNumber(Value, Q.JSON);
+			}
+			if (Q.JSON) std::putchar('}');
+			else std::putchar('\n');
+		}
+	}
+	if (Q.JSON) std::puts(First ? "]" : "\n]");
+}
+
+static int Usage(char const *Name) {
+	std::fprintf(stderr, "Usage: %s -d DIR [--from TIME] [--to TIME] [-s GLOB]... [-g DURATION] [--stats LIST]\n"
+	                     "\t[--format csv|json] [-j THREADS] [--max-gap SECONDS]\n"
+	                     "TIME: seconds since the epoch, now, -DURATION (e.g. -30d) or YYYY-MM-DD[THH:MM[:SS]] (UTC)\n"
+	                     "LIST: comma-separated count, min, max, avg, pNN, above:TEMP\n", Name);
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	Query Q;
+	ParseStats("count,min,max,avg,p50,p99", Q);
+	double Now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	for (int i = 1; i < argc; i++) {
+		bool HasValue = i+1 < argc;
+		if (std::strcmp(argv[i], "-d") == 0 && HasValue) Q.Dir = argv[++i];
+		else if (std::strcmp(argv[i], "--from") == 0 && HasValue) {
+			if (!ParseTime(argv[++i], Now, Q.From)) return Usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--to") == 0 && HasValue) {
+			if (!ParseTime(argv[++i], Now, Q.To)) return Usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "-s") == 0 && HasValue) Q.Globs.push_back(argv[++i]);
+		else if (std::strcmp(argv[i], "-g") == 0 && HasValue) {
+			if (!ParseDuration(argv[++i], Q.Bucket)) return Usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--stats") == 0 && HasValue) {
+			if (!ParseStats(argv[++i], Q)) return Usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--format") == 0 && HasValue) {
+			std::string Format = argv[++i];
+			if (Format != "csv" && Format != "json") return Usage(argv[0]);
+			Q.JSON = (Format == "json");
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 && HasValue) Q.Threads = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--max-gap") == 0 && HasValue) {
+			if (!ParseDuration(argv[++i], Q.MaxGap)) return Usage(argv[0]);
+		}
+		else return Usage(argv[0]);
+	}
+	if (Q.Dir.empty()) return Usage(argv[0]);
+	if (Q.Threads == 0) Q.Threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<std::string> Sensors;
+	std::vector<Candidate> Work = Plan(Q, Sensors);
+	std::vector<Groups> Partial(std::min<std::size_t>(Q.Threads, std::max<std::size_t>(Work.size(), 1)));
+	std::atomic<std::size_t> Next(0);
+	std::vector<std::thread> Workers;
+	for (auto &G : Partial) {
+		Workers.emplace_back([&Q, &Work, &Next, &Sensors, &G]{
+			for (std::size_t i; (i = Next++) < Work.size();) {
+				Scan(Q, Work[i], Sensors.size(), G);
+				Work[i].Segment.reset();
+			}
+		});
+	}
+	for (auto &W : Workers) W.join();
+
+	Groups &All = Partial[0];
+	for (std::size_t p = 1; p < Partial.size(); p++) {
+		for (auto &Group : Partial[p]) {
+			auto &Into = All[Group.first];
+			if (Into.empty()) Into.resize(Sensors.size());
+			for (std::size_t s = 0; s != Sensors.size(); s++) Into[s].Merge(Group.second[s]);
+		}
+		Partial[p].clear();
+	}
+	Print(Q, Sensors, All);
+	return 0;
+}
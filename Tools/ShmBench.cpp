@@ -0,0 +1,132 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Shared Snapshot Benchmark
+	Compares how fast a local program can get the latest
+	    readings from a running daemon through the shared-memory
+	    segment (--shm) and through the Unix socket (--listen).
+
+	Usage: safetemp-shm-bench [-s NAME] [-c PATH] [-t SECONDS]
+	    -s  shared-memory segment (default /safetemp)
+	    -c  daemon socket (default: skip the socket benchmark)
+	    -t  seconds per benchmark (default 2)
+****************************************************************/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../Server/Protocol.hpp"
+#include "../Server/SharedSnapshot.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/** @brief Print the rate of Count operations over Elapsed */
+static void Report(char const *Name, unsigned long Count, Clock::duration Elapsed) {
+	double Seconds = std::chrono::duration<double>(Elapsed).count();
+	std::printf("%-8s %12lu reads  %14.0f reads/s  %10.1f ns/read\n", Name, Count, Count / Seconds, Seconds * 1e9 / Count);
+}
+
+static bool BenchShm(std::string const &Name, double Seconds) {
+	SharedSnapshot::Reader Shm;
+	if (!Shm.Open(Name)) {
+		std::fprintf(stderr, "Cannot open %s: %s\n", Name.c_str(), strerror(errno));
+		return false;
+	}
+	SharedSnapshot::Reading Out;
+	unsigned long Count = 0, Failed = 0;
+	Clock::time_point Start = Clock::now(), End = Start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(Seconds));
+	Clock::time_point Now;
+	do {
+		for (unsigned i = 0; i != 1024; i++) Failed += !Shm.Read(Out);
+		Count += 1024;
+	} while ((Now = Clock::now()) < End);
+	Report("shm", Count, Now - Start);
+	if (Failed) std::printf("         %lu reads collided with the writer too often\n", Failed);
+	std::printf("         %zu sensors, %llu updates published\n", Out.Sensors.size(), (unsigned long long)Out.Updates);
+	return true;
+}
+
+/** @brief One round trip: a Hello, answered with the sensor list and the latest snapshot */
+static bool RoundTrip(int Fd, Protocol::MessageBuffer &In, std::string &Out) {
+	Out.clear();
+	Protocol::Writer(Out, Protocol::MessageType::Hello).Put(Protocol::Version);
+	if (send(Fd, Out.data(), Out.size(), MSG_NOSIGNAL) != (ssize_t)Out.size()) return false;
+	while (true) {
+		char *Buffer = In.Reserve(65536);
+		ssize_t N = recv(Fd, Buffer, 65536, 0);
+		In.Commit(N > 0 ? N : 0);
+		if (N <= 0) return false;
+		Protocol::MessageType Type;
+		std::string_view Payload;
+		bool Error;
+		bool Done = false;
+		while (In.Next(Type, Payload, Error)) Done |= (Type == Protocol::MessageType::Snapshot);
+		if (Error) return false;
+		if (Done) return true;
+	}
+}
+
+static bool BenchSocket(std::string const &Path, double Seconds) {
+	sockaddr_un Address;
+	std::memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	std::strncpy(Address.sun_path, Path.c_str(), sizeof(Address.sun_path) - 1);
+	int Fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (Fd < 0 || connect(Fd, (sockaddr*)&Address, sizeof(Address)) != 0) {
+		std::fprintf(stderr, "Cannot connect to %s: %s\n", Path.c_str(), strerror(errno));
+		if (Fd >= 0) close(Fd);
+		return false;
+	}
+	Protocol::MessageBuffer In;
+	std::string Out;
+	unsigned long Count = 0;
+	Clock::time_point Start = Clock::now(), End = Start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(Seconds));
+	Clock::time_point Now;
+	do {
+		if (!RoundTrip(Fd, In, Out)) {
+			std::fprintf(stderr, "The daemon closed the connection\n");
+			close(Fd);
+			return false;
+		}
+		Count++;
+	} while ((Now = Clock::now()) < End);
+	close(Fd);
+	Report("socket", Count, Now - Start);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::string ShmName = "/safetemp", SocketPath;
+	double Seconds = 2;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "-s") == 0 && i+1 < argc) ShmName = argv[++i];
+		else if (std::strcmp(argv[i], "-c") == 0 && i+1 < argc) SocketPath = argv[++i];
+		else if (std::strcmp(argv[i], "-t") == 0 && i+1 < argc) Seconds = std::atof(argv[++i]);
+		else {
+			std::fprintf(stderr, "Usage: %s [-s SHM_NAME] [-c SOCKET_PATH] [-t SECONDS]\n", argv[0]);
+			return 1;
+		}
+	}
+	bool Ok = BenchShm(ShmName, Seconds);
+	if (SocketPath.length() > 0) Ok &= BenchSocket(SocketPath, Seconds);
+	return Ok ? 0 : 1;
+}
@@ -6,6 +6,7 @@
 #include <ctime>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 //TODO: I should make a separate structure for just temperature and time; otherwise, I'm storing too much extra detail for each temperature reading;
 /** @brief A simple temperature + name structure */
@@ -20,6 +21,12 @@ struct SensorLine {
 	std::time_t Time;
 };
 
+/** @brief One reading of every sensor, indexed by sensor id */
+struct SensorSnapshot {
+	double Time = 0;            ///<Seconds (any fixed epoch) at which the sensors were read
+	std::vector<float> Values;  ///<Temperature of each sensor
+};
+
 /** @brief A data structure for a point on the chart to be plotted */
 struct SensorDetailLine {
 	std::time_t Time;          ///<Time of current reading
@@ -0,0 +1,177 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Layered Chart Cache
+	Backend-agnostic bookkeeping for a rolling time chart that
+	    is drawn as two layers:
+	     -a static layer (axes, grid, title, key) which is only
+	      redrawn when the chart is resized or rescaled
+	     -a data layer which is scrolled left by whole columns
+	      as time advances; only the newest strip is drawn
+
+	Both the GTK (Cairo surfaces) and the ncurses (character
+	    cells) renderers plan their frames with ChartCache.
+****************************************************************/
+#ifndef UI_CHARTCACHE_HPP_
+#define UI_CHARTCACHE_HPP_
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/** @brief Everything which, when changed, invalidates the static layer */
+struct ChartScale {
+	int Columns = 0;                ///<Width of the plot area (pixels or character cells)
+	int Rows = 0;                   ///<Height of the plot area
+	float MinTemp = 0;              ///<Bottom of the temperature axis
+	float MaxTemp = 0;              ///<Top of the temperature axis
+	double SecondsPerColumn = 1;    ///<Horizontal resolution
+	unsigned long StyleKey = 0;     ///<Hash of anything else drawn in the static layer (series colours, key entries)
+
+	bool operator==(ChartScale const &Other) const {
+		return Columns == Other.Columns && Rows == Other.Rows &&
+		       MinTemp == Other.MinTemp && MaxTemp == Other.MaxTemp &&
+		       SecondsPerColumn == Other.SecondsPerColumn && StyleKey == Other.StyleKey;
+	}
+	bool operator!=(ChartScale const &Other) const {
+		return !(*this == Other);
+	}
+
+	/** @brief Round the temperature range outwards to multiples of Step so that small excursions don't rescale the chart */
+	void QuantizeTemps(float Step = 5.0f) {
+		MinTemp = std::floor(MinTemp / Step) * Step;
+		MaxTemp = std::ceil(MaxTemp / Step) * Step;
+		if (MaxTemp <= MinTemp) MaxTemp = MinTemp + Step;
+	}
+
+	/** @brief Vertical position (0 = top row) of a temperature */
+	double Row(float Temp) const {
+		return (Rows - 1) * (MaxTemp - Temp) / (MaxTemp - MinTemp);
+	}
+};
+
+/** @brief What has to be drawn for the next frame */
+struct ChartFrame {
+	bool RedrawStatic = false;   ///<Axes/grid/title/key must be redrawn
+	bool RedrawData = false;     ///<The data layer must be redrawn from scratch
+	int ScrollColumns = 0;       ///<Otherwise: scroll the data layer left by this many columns...
+	double StripStart = 0;       ///<...and draw the samples newer than this time
+	double RightEdge = 0;        ///<Time at the right edge of the plot area
+	double SecondsPerColumn = 1;
+	int Columns = 0;
+
+	/** @brief Horizontal position of a time in the plot area (may be fractional or negative) */
+	double Column(double Time) const {
+		return Columns - (RightEdge - Time) / SecondsPerColumn;
+	}
+	/** @brief Time at the left edge of the plot area */
+	double LeftEdge() const {
+		return RightEdge - Columns * SecondsPerColumn;
+	}
+	/** @brief Whether anything at all has to be redrawn */
+	bool Dirty() const {
+		return RedrawStatic || RedrawData || ScrollColumns > 0 || StripStart < RightEdge;
+	}
+};
+
+/** @brief Tracks which layers of a chart are still valid between frames */
+class ChartCache {
+private:
+	ChartScale m_Scale;
+	bool m_Valid = false;
+	long m_RightColumn = 0;     ///<Absolute index (time / SecondsPerColumn) of the rightmost column
+	double m_LastTime = 0;      ///<Newest sample already in the data layer
+public:
+	/** @brief Force a full redraw on the next frame */
+	void Invalidate() {
+		m_Valid = false;
+	}
+
+	/** @brief Plan the next frame
+	 * @param Scale       Scale the chart should be drawn at
+	 * @param NewestTime  Time of the newest sample
+	 */
+	ChartFrame Plan(ChartScale const &Scale, double NewestTime) {
+		ChartFrame Frame;
+		Frame.SecondsPerColumn = Scale.SecondsPerColumn;
+		Frame.Columns = Scale.Columns;
+		long NewRightColumn = (long)std::floor(NewestTime / Scale.SecondsPerColumn);
+		if (!m_Valid || Scale != m_Scale) {
+			Frame.RedrawStatic = true;
+			Frame.RedrawData = true;
+		}
+		else if (NewRightColumn - m_RightColumn >= Scale.Columns) {
+			Frame.RedrawData = true;
+		}
+		else if (NewRightColumn > m_RightColumn) {
+			Frame.ScrollColumns = (int)(NewRightColumn - m_RightColumn);
+		}
+		if (NewRightColumn < m_RightColumn && !Frame.RedrawData) //Clock went backwards
+			Frame.RedrawData = true;
+		m_Scale = Scale;
+		m_Valid = true;
+		m_RightColumn = Frame.RedrawData ? NewRightColumn : std::max(m_RightColumn,NewRightColumn);
+		Frame.RightEdge = (m_RightColumn + 1) * Scale.SecondsPerColumn;
+		Frame.StripStart = Frame.RedrawData ? Frame.LeftEdge() : m_LastTime;
+		if (Frame.StripStart >= NewestTime) Frame.StripStart = Frame.RightEdge; //Nothing new
+		m_LastTime = NewestTime;
+		return Frame;
+	}
+};
+
+/** @brief A fixed grid of cells stored column-major in a ring so that scrolling is O(rows * scrolled columns)
+ * @note Used as the ncurses data layer; column 0 is the leftmost visible column
+ */
+template <typename CellType>
+class ColumnRing {
+private:
+	std::vector<CellType> m_Cells;
+	int m_Columns = 0;
+	int m_Rows = 0;
+	int m_Head = 0;   ///<Physical index of the leftmost column
+	CellType m_Empty{};
+public:
+	void Resize(int Columns, int Rows) {
+		m_Columns = std::max(0,Columns);
+		m_Rows = std::max(0,Rows);
+		m_Head = 0;
+		m_Cells.assign((std::size_t)m_Columns * m_Rows, m_Empty);
+	}
+	void Clear() {
+		std::fill(m_Cells.begin(),m_Cells.end(),m_Empty);
+	}
+	/** @brief Scroll left by N columns, clearing the columns that appear on the right */
+	void Scroll(int N) {
+		if (N <= 0 || m_Columns == 0) return;
+		if (N >= m_Columns) { Clear(); return; }
+		for (int i = 0; i != N; i++) {
+			std::fill_n(m_Cells.begin() + (std::size_t)m_Head * m_Rows, m_Rows, m_Empty);
+			m_Head = (m_Head + 1) % m_Columns;
+		}
+	}
+	CellType &At(int Column, int Row) {
+		return m_Cells[(std::size_t)((m_Head + Column) % m_Columns) * m_Rows + Row];
+	}
+	/** @brief Set a cell, ignoring coordinates outside the grid */
+	void Set(int Column, int Row, CellType const &Value) {
+		if (Column < 0 || Row < 0 || Column >= m_Columns || Row >= m_Rows) return;
+		At(Column,Row) = Value;
+	}
+	int Columns() const { return m_Columns; }
+	int Rows() const { return m_Rows; }
+};
+
+#endif //UI_CHARTCACHE_HPP_
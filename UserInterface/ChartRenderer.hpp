@@ -0,0 +1,425 @@
+/*****************************************************************
+Copyright (c) 2015, Kevin Arlington Brooks
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*****************************************************************/
+
+/****************************************************************
+Chart Renderer
+	Renders the GTK temperature chart into a Cairo image
+	    surface on a worker thread.  The GTK main loop only
+	    posts render requests and blits the finished surface.
+
+	A request carries a generation number; any request made
+	    while a render is in flight supersedes it and the
+	    stale render is abandoned at the next checkpoint.
+
+	The chart shows a rolling window of the most recent
+	    NumDataPts samples and is drawn in two layers (see
+	    ChartCache.hpp): the axes/grid/key are cached until a
+	    resize or rescale, and the data layer is scrolled so
+	    that a frame normally only draws the newest strip.
+****************************************************************/
+#ifndef UI_CHARTRENDERER_HPP_
+#define UI_CHARTRENDERER_HPP_
+#if HAVE_GTK == 1
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtk/gtk.h>
+#include "../Types.hpp"
+#include "ChartCache.hpp"
+#include "GuiDataHandler.hpp"
+
+namespace GUI
+{
+	/** @brief The part of one sensor's history needed for a frame */
+	struct ChartSeries {
+		std::string Name;
+		unsigned int Colour;
+		std::vector<Point<float>> Points; ///<x = seconds since start, y = temperature
+	};
+
+	/** @brief Everything the worker needs to draw one frame */
+	struct ChartSnapshot {
+		int Width = 0;
+		int Height = 0;
+		ChartScale Scale;
+		ChartFrame Frame;
+		std::vector<ChartSeries> Series;
+	};
+
+	/** @brief Plot area margins (pixels) around the chart */
+	struct ChartMargins {
+		static constexpr int Left = 60;
+		static constexpr int Right = 170; ///<Room for the key
+		static constexpr int Top = 30;
+		static constexpr int Bottom = 45;
+	};
+
+	/** @brief Background chart renderer
+	 * @note Request() and TakeFinished() are called from the GTK main loop;
+	 *       everything else runs on the worker thread.
+	 */
+	class ChartRenderWorker {
+	private:
+		GUIDataHandler *m_Handle;                 ///<non-owning; must outlive the worker
+		GSourceFunc m_OnFinished = nullptr;       ///<idle callback posted to the main loop when a frame is ready
+		gpointer m_CallbackData = nullptr;
+		std::thread m_Worker;
+		std::mutex m_Lock;
+		std::condition_variable m_Wake;
+		std::atomic<unsigned long> m_Generation{0};
+		unsigned long m_RequestedGeneration = 0;
+		int m_RequestedWidth = 0, m_RequestedHeight = 0;
+		bool m_Stop = false;
+		cairo_surface_t *m_Finished = nullptr;    ///<owned until handed to TakeFinished()
+		ChartCache m_Cache;                       ///<worker thread only
+		cairo_surface_t *m_Static = nullptr;      ///<static layer (whole chart size)
+		cairo_surface_t *m_Data[2] = {nullptr, nullptr}; ///<data layer (plot area size), double-buffered for scrolling
+		int m_Current = 0;                        ///<which of m_Data is current
+
+		/** @brief Whether the render for Generation has been superseded */
+		bool Cancelled(unsigned long Generation) const {
+			return m_Generation.load(std::memory_order_relaxed) != Generation;
+		}
+
+		/** @brief Plan the next frame and copy the samples it needs
+		 * @note Holds the data handler lock only while copying.  On a full redraw the
+		 *       visible window is copied with points sharing a pixel column collapsed
+		 *       to their min/max; otherwise only the new strip (plus the sample before
+		 *       it, to join the line up) is copied.
+		 */
+		ChartSnapshot TakeSnapshot(int Width, int Height) {
+			ChartSnapshot Snap;
+			Snap.Width = Width;
+			Snap.Height = Height;
+			Snap.Scale.Columns = std::max(1, Width - ChartMargins::Left - ChartMargins::Right);
+			Snap.Scale.Rows = std::max(2, Height - ChartMargins::Top - ChartMargins::Bottom);
+
+			std::lock_guard<std::mutex> Guard(m_Handle->DataLock);
+			double const Span = (double)m_Handle->NumDataPts * std::max(1,m_Handle->CallInterval);
+			Snap.Scale.SecondsPerColumn = Span / Snap.Scale.Columns;
+
+			double Newest = 0;
+			unsigned long StyleKey = 5381;
+			for (unsigned i = 0; i != m_Handle->SensorNames.size(); i++) {
+				if (!m_Handle->SensorActive[i]) continue;
+				StyleKey = StyleKey * 33 + i;
+				StyleKey = StyleKey * 33 + m_Handle->SensorColours[i];
+				if (!m_Handle->Times[i].empty()) Newest = std::max(Newest,(double)m_Handle->Times[i].back());
+			}
+			Snap.Scale.StyleKey = StyleKey;
+
+			//Temperature range of the visible window
+			bool First = true;
+			std::vector<std::size_t> WindowStart(m_Handle->SensorNames.size(),0);
+			for (unsigned i = 0; i != m_Handle->SensorNames.size(); i++) {
+				if (!m_Handle->SensorActive[i]) continue;
+				std::vector<int> const &Times = m_Handle->Times[i];
+				std::vector<float> const &Values = m_Handle->SensorData[i];
+				WindowStart[i] = std::lower_bound(Times.begin(),Times.end(),Newest - Span) - Times.begin();
+				for (std::size_t j = WindowStart[i]; j < Values.size(); j++) {
+					if (First || Values[j] < Snap.Scale.MinTemp) Snap.Scale.MinTemp = Values[j];
+					if (First || Values[j] > Snap.Scale.MaxTemp) Snap.Scale.MaxTemp = Values[j];
+					First = false;
+				}
+			}
+			Snap.Scale.QuantizeTemps();
+			Snap.Frame = m_Cache.Plan(Snap.Scale,Newest);
+
+			for (unsigned i = 0; i != m_Handle->SensorNames.size(); i++) {
+				if (!m_Handle->SensorActive[i]) continue;
+				ChartSeries Series;
+				Series.Name = m_Handle->SensorNames[i];
+				Series.Colour = m_Handle->SensorColours[i];
+				std::vector<float> const &Values = m_Handle->SensorData[i];
+				std::vector<int> const &Times = m_Handle->Times[i];
+				if (!Snap.Frame.RedrawData) {
+					std::size_t j = std::upper_bound(Times.begin(),Times.end(),Snap.Frame.StripStart) - Times.begin();
+					for (j = (j > 0) ? j - 1 : 0; j < Values.size(); j++)
+						Series.Points.push_back({(float)Times[j],Values[j]});
+					Snap.Series.push_back(std::move(Series));
+					continue;
+				}
+				long Column = LONG_MIN;
+				Point<float> Lo, Hi;
+				for (std::size_t j = WindowStart[i]; j < Values.size(); j++) {
+					long ThisColumn = (long)std::floor(Snap.Frame.Column(Times[j]));
+					Point<float> Pt = {(float)Times[j], Values[j]};
+					if (ThisColumn != Column) {
+						if (Column != LONG_MIN) {
+							Series.Points.push_back(Lo);
+							if (Hi.x != Lo.x || Hi.y != Lo.y) Series.Points.push_back(Hi);
+						}
+						Column = ThisColumn;
+						Lo = Pt;
+						Hi = Pt;
+					}
+					else if (Pt.y < Lo.y) Lo = Pt;
+					else if (Pt.y > Hi.y) Hi = Pt;
+				}
+				if (Column != LONG_MIN) {
+					Series.Points.push_back(Lo);
+					if (Hi.x != Lo.x || Hi.y != Lo.y) Series.Points.push_back(Hi);
+				}
+				Snap.Series.push_back(std::move(Series));
+			}
+			return Snap;
+		}
+
+		/** @brief Set the Cairo source colour from a 0xRRGGBB value */
+		static void SetColour(cairo_t *cr, unsigned int Colour) {
+			cairo_set_source_rgb(cr,((Colour >> 16) & 0xFF) / 255.0,((Colour >> 8) & 0xFF) / 255.0,(Colour & 0xFF) / 255.0);
+		}
+
+		/** @brief Draw the static layer: background, grid, tick labels, title and key */
+		void DrawStatic(ChartSnapshot const &Snap) {
+			if (m_Static != nullptr) cairo_surface_destroy(m_Static);
+			m_Static = cairo_image_surface_create(CAIRO_FORMAT_RGB24, Snap.Width, Snap.Height);
+			cairo_t *cr = cairo_create(m_Static);
+			ChartScale const &Sc = Snap.Scale;
+			double const x0 = ChartMargins::Left;
+			double const y0 = ChartMargins::Top;
+			double const w = Sc.Columns;
+			double const h = Sc.Rows;
+			double const Span = Sc.SecondsPerColumn * Sc.Columns;
+			char Label[32];
+
+			cairo_set_source_rgb(cr,1,1,1);
+			cairo_paint(cr);
+			cairo_select_font_face(cr,"sans-serif",CAIRO_FONT_SLANT_NORMAL,CAIRO_FONT_WEIGHT_NORMAL);
+			cairo_set_font_size(cr,11);
+
+			//Grid and tick labels
+			double const Dash[] = {2.0, 3.0};
+			cairo_set_line_width(cr,1);
+			for (int i = 0; i <= 5; i++) {
+				double gy = y0 + h * i / 5.0;
+				double gx = x0 + w * i / 5.0;
+				cairo_set_source_rgb(cr,0.8,0.8,0.8);
+				cairo_set_dash(cr,Dash,2,0);
+				cairo_move_to(cr,x0,gy);
+				cairo_line_to(cr,x0 + w,gy);
+				cairo_move_to(cr,gx,y0);
+				cairo_line_to(cr,gx,y0 + h);
+				cairo_stroke(cr);
+				cairo_set_source_rgb(cr,0,0,0);
+				snprintf(Label,sizeof(Label),"%.1f",Sc.MaxTemp - (Sc.MaxTemp - Sc.MinTemp) * i / 5.0);
+				cairo_move_to(cr,x0 - 45,gy + 4);
+				cairo_show_text(cr,Label);
+				snprintf(Label,sizeof(Label),"%.0f",-Span + Span * i / 5.0);
+				cairo_move_to(cr,gx - 10,y0 + h + 15);
+				cairo_show_text(cr,Label);
+			}
+			cairo_set_dash(cr,nullptr,0,0);
+			cairo_set_source_rgb(cr,0,0,0);
+			cairo_rectangle(cr,x0,y0,w,h);
+			cairo_stroke(cr);
+
+			//Title and axis labels
+			cairo_set_font_size(cr,13);
+			cairo_move_to(cr,x0 + w / 2 - 90,y0 - 10);
+			cairo_show_text(cr,"Temperature vs Time plot");
+			cairo_set_font_size(cr,11);
+			cairo_move_to(cr,x0 + w / 2 - 70,y0 + h + 35);
+			cairo_show_text(cr,"Time (seconds before now)");
+			cairo_save(cr);
+			cairo_move_to(cr,15,y0 + h / 2 + 50);
+			cairo_rotate(cr,-M_PI / 2);
+			cairo_show_text(cr,"Temperature (°C)");
+			cairo_restore(cr);
+
+			//Key
+			cairo_set_line_width(cr,2);
+			for (unsigned i = 0; i != Snap.Series.size(); i++) {
+				double ky = y0 + 10 + 18 * i;
+				SetColour(cr,Snap.Series[i].Colour);
+				cairo_move_to(cr,x0 + w + 10,ky);
+				cairo_line_to(cr,x0 + w + 30,ky);
+				cairo_stroke(cr);
+				cairo_set_source_rgb(cr,0,0,0);
+				cairo_move_to(cr,x0 + w + 35,ky + 4);
+				cairo_show_text(cr,Snap.Series[i].Name.substr(0,20).c_str());
+			}
+			cairo_destroy(cr);
+		}
+
+		/** @brief Bring the data layer up to date (full redraw, or scroll + strip)
+		 * @returns false if a full redraw was superseded part-way through
+		 */
+		bool DrawData(ChartSnapshot const &Snap, unsigned long Generation) {
+			ChartScale const &Sc = Snap.Scale;
+			ChartFrame const &Fr = Snap.Frame;
+			if (Snap.Frame.RedrawStatic) {
+				for (auto &Layer : m_Data) {
+					if (Layer != nullptr) cairo_surface_destroy(Layer);
+					Layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, Sc.Columns, Sc.Rows);
+				}
+			}
+			cairo_t *cr;
+			if (Fr.RedrawData) {
+				cr = cairo_create(m_Data[m_Current]);
+				cairo_set_operator(cr,CAIRO_OPERATOR_CLEAR);
+				cairo_paint(cr);
+				cairo_set_operator(cr,CAIRO_OPERATOR_OVER);
+			}
+			else {
+				if (Fr.ScrollColumns > 0) {
+					//Cairo can't copy a surface onto itself, so scroll into the spare buffer
+					int const Next = 1 - m_Current;
+					cr = cairo_create(m_Data[Next]);
+					cairo_set_operator(cr,CAIRO_OPERATOR_SOURCE);
+					cairo_set_source_surface(cr,m_Data[m_Current],-Fr.ScrollColumns,0);
+					cairo_paint(cr);
+					cairo_set_operator(cr,CAIRO_OPERATOR_CLEAR);
+					cairo_rectangle(cr,Sc.Columns - Fr.ScrollColumns,0,Fr.ScrollColumns,Sc.Rows);
+					cairo_fill(cr);
+					cairo_set_operator(cr,CAIRO_OPERATOR_OVER);
+					m_Current = Next;
+				}
+				else {
+					cr = cairo_create(m_Data[m_Current]);
+				}
+				//Don't re-stroke what is already in the layer
+				cairo_rectangle(cr,std::floor(Fr.Column(Fr.StripStart)),0,Sc.Columns,Sc.Rows);
+				cairo_clip(cr);
+			}
+
+			cairo_set_line_width(cr,2);
+			for (auto const &S : Snap.Series) {
+				if (Fr.RedrawData && Cancelled(Generation)) {
+					cairo_destroy(cr);
+					return false;
+				}
+				SetColour(cr,S.Colour);
+				for (unsigned j = 0; j != S.Points.size(); j++) {
+					double x = Fr.Column(S.Points[j].x);
+					double y = Sc.Row(S.Points[j].y);
+					if (j == 0) cairo_move_to(cr,x,y);
+					else cairo_line_to(cr,x,y);
+				}
+				cairo_stroke(cr);
+			}
+			cairo_destroy(cr);
+			return true;
+		}
+
+		/** @brief Bring the layers up to date and compose them into a new image surface
+		 * @returns nullptr if the render was superseded part-way through
+		 */
+		cairo_surface_t *Render(ChartSnapshot const &Snap, unsigned long Generation) {
+			if (Snap.Frame.RedrawStatic) DrawStatic(Snap);
+			if (!DrawData(Snap,Generation)) {
+				m_Cache.Invalidate();
+				return nullptr;
+			}
+			cairo_surface_t *Surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, Snap.Width, Snap.Height);
+			cairo_t *cr = cairo_create(Surface);
+			cairo_set_source_surface(cr,m_Static,0,0);
+			cairo_paint(cr);
+			cairo_set_source_surface(cr,m_Data[m_Current],ChartMargins::Left,ChartMargins::Top);
+			cairo_paint(cr);
+			cairo_destroy(cr);
+			cairo_surface_flush(Surface);
+			return Surface;
+		}
+
+		void Run() {
+			std::unique_lock<std::mutex> Guard(m_Lock);
+			while (true) {
+				m_Wake.wait(Guard,[this]{ return m_Stop || m_RequestedGeneration != 0; });
+				if (m_Stop) return;
+				unsigned long Generation = m_RequestedGeneration;
+				int Width = m_RequestedWidth;
+				int Height = m_RequestedHeight;
+				m_RequestedGeneration = 0;
+				Guard.unlock();
+
+				cairo_surface_t *Surface = nullptr;
+				if (Width > 0 && Height > 0) {
+					ChartSnapshot Snap = TakeSnapshot(Width,Height);
+					if (!Cancelled(Generation))
+						Surface = Render(Snap,Generation);
+					else
+						m_Cache.Invalidate(); //The planned frame was never drawn
+				}
+
+				Guard.lock();
+				if (Surface != nullptr && Cancelled(Generation)) {
+					cairo_surface_destroy(Surface);
+					Surface = nullptr;
+				}
+				if (Surface != nullptr) {
+					if (m_Finished != nullptr) cairo_surface_destroy(m_Finished);
+					m_Finished = Surface;
+					if (m_OnFinished != nullptr) g_idle_add(m_OnFinished,m_CallbackData);
+				}
+			}
+		}
+	public:
+		ChartRenderWorker(GUIDataHandler *Handle) {
+			m_Handle = Handle;
+		}
+		~ChartRenderWorker() {
+			Stop();
+			if (m_Finished != nullptr) cairo_surface_destroy(m_Finished);
+			if (m_Static != nullptr) cairo_surface_destroy(m_Static);
+			for (auto Layer : m_Data)
+				if (Layer != nullptr) cairo_surface_destroy(Layer);
+		}
+
+		/** @brief Start the worker; OnFinished(Data) is posted with g_idle_add whenever a frame is ready */
+		void Start(GSourceFunc OnFinished, gpointer Data) {
+			m_OnFinished = OnFinished;
+			m_CallbackData = Data;
+			m_Worker = std::thread(&ChartRenderWorker::Run,this);
+		}
+
+		/** @brief Stop and join the worker thread; any in-flight render is abandoned */
+		void Stop() {
+			{
+				std::lock_guard<std::mutex> Guard(m_Lock);
+				m_Stop = true;
+				m_Generation++;
+			}
+			m_Wake.notify_one();
+			if (m_Worker.joinable()) m_Worker.join();
+		}
+
+		/** @brief Request a new frame, superseding any render in flight */
+		void Request(int Width, int Height) {
+			{
+				std::lock_guard<std::mutex> Guard(m_Lock);
+				m_RequestedGeneration = ++m_Generation;
+				m_RequestedWidth = Width;
+				m_RequestedHeight = Height;
+			}
+			m_Wake.notify_one();
+		}
+
+		/** @brief Take ownership of the newest finished frame (nullptr if none is waiting) */
+		cairo_surface_t *TakeFinished() {
+			std::lock_guard<std::mutex> Guard(m_Lock);
+			cairo_surface_t *ret = m_Finished;
+			m_Finished = nullptr;
+			return ret;
+		}
+	};
+}
+
+#endif
+#endif //UI_CHARTRENDERER_HPP_
@@ -1,9 +1,6 @@
 /**************************************************************
 Graphical User Interface
     KNOWN ISSUES:
-        -We do not restrict the graph data range.  As a result,
-            datapoints get progressively squeezed together in 
-            the x-axis as time progresses.
         -When loading a save configuration, we depend on the
             sensors being reported in the same order.  Otherwise
             the settings are mixed up.
@@ -14,9 +11,12 @@ Graphical User Interface
         -There is no debugger implemented as of yet
 **************************************************************/
 
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
+#if HAVE_GTK == 1
 #include <gtk/gtk.h>
 #include "GuiDataHandler.hpp"
+#include "ChartRenderer.hpp"
+#include "../Alerts/Actions.hpp"
+#include "../Alerts/AlertState.hpp"
 
 bool SaveGUIConfig(GUI::GUIDataHandler*);
 bool ReadGUIConfig(GUI::GUIDataHandler*);
@@ -188,7 +188,6 @@ namespace GUI
         std::vector<std::string> StringDatabase;
         std::vector<unsigned int> IntDatabase;
         public:
-        std::string FName;
         guint Width,Height;
         bool* prun;
 
@@ -230,6 +229,21 @@ namespace GUI
         return IntDatabase.size();
     };
 
+    /*
+    Global variables:
+        Objects: all the GTK GUI elements that we need to keep track of
+        Data: data associated with GTK GUI Element locations in 'Objects'
+        Renderer: background chart renderer (draws from 'Handle')
+        Actions: runs the sensors' alert actions (owned by main)
+        Alerts: alert level of each sensor (GTK thread only)
+    */
+    GObject** Objects = g_new(GObject*,3); //global object array
+    int2string Data; //global array database
+    GUIDataHandler Handle; //global data context
+    ChartRenderWorker Renderer(&Handle); //global chart render worker
+    AlertActions *Actions = nullptr; //alert command/action runner
+    AlertTracker Alerts; //per-sensor alert state machine
+
     /*
     GUI Terminate:
         Terminates the GUI program when called
@@ -242,12 +256,7 @@ namespace GUI
         int2string *IntData = (int2string*)ObjData[1];
         GUIDataHandler *DH = (GUIDataHandler*)ObjData[2];
 
-        FILE* tmpPng = fopen(IntData->FName.c_str(),"r");
-        if (tmpPng != NULL)
-        {
-            fclose(tmpPng);
-            remove(IntData->FName.c_str());
-        }
+        Renderer.Stop();
         *IntData->prun = 0;
         gtk_main_quit();
         gtk_widget_destroy((GtkWidget*)ObjData[0]);
@@ -255,14 +264,6 @@ namespace GUI
         SaveGUIConfig(DH);
     };
 
-    /*
-    Global variables:
-        Objects: all the GTK GUI elements that we need to keep track of
-        Data: data associated with GTK GUI Element locations in 'Objects'
-    */
-    GObject** Objects = g_new(GObject*,3); //global object array
-    int2string Data; //global array database
-    GUIDataHandler Handle; //global data context
 
     /*
     GUI KeyPress_CMD:
@@ -377,7 +378,8 @@ namespace GUI
     /*
     GUI UpdateTemps:
         Updates temperature readouts in LBL_TEMP objects
-            and executes designated commands when required
+            (coloured by alert level) and executes designated
+            commands when a sensor becomes critical
         -Takes: GtkWidget (unused), Object data
     */
     void UpdateTemps(gpointer data)
@@ -386,24 +388,50 @@ namespace GUI
         int2string *IntData = (int2string*)ObjData[1];
         GUIDataHandler *DH = (GUIDataHandler*)ObjData[2];
 
+        //Copy the latest reading of each sensor (the main thread appends, and the
+        //warm start and trimming move the data, under DataLock); NaN if there is none yet
+        static SensorSnapshot Snapshot;
+        Snapshot.Time = 0;
+        Snapshot.Values.assign(DH->SensorNames.size(),NAN);
+        {
+            std::lock_guard<std::mutex> Guard(DH->DataLock);
+            for (int i = 0; i < DH->SensorNames.size() && i < DH->SensorData.size(); i++)
+            {
+                if (DH->SensorData[i].empty() || DH->Times[i].empty()) continue;
+                Snapshot.Values[i] = DH->SensorData[i].back();
+                Snapshot.Time = std::max(Snapshot.Time,(double)DH->Times[i].back());
+            }
+        }
+        //Check every sensor against its critical temperature in one pass:
+        for (auto const &Change : Alerts.Update(Snapshot,DH->SensorCriticals))
+        {
+            if (Actions == nullptr) break;
+            std::string Key = DH->SensorNames[Change.Sensor] + std::to_string(Change.Sensor);
+            if (Change.To == AlertLevel::Critical)
+                Actions->Fire(Key,DH->SensorCommands[Change.Sensor],Change.Value,DH->SensorCriticals[Change.Sensor]);
+            else if (Change.From == AlertLevel::Critical)
+                Actions->Clear(Key);
+        }
+        for (int i = 0; i < DH->SensorNames.size() && Actions != nullptr; i++)
+        {
+            if (Alerts.Level(i) == AlertLevel::Critical)
+                Actions->Update(DH->SensorNames[i] + std::to_string(i),Snapshot.Values[i],DH->SensorCriticals[i]);
+        }
+
         //Update Temperature Labels:
         for (int i = 0; i < DH->SensorNames.size(); i++)
         {
-            std::string TempDat = std::to_string(DH->SensorData[i].back());
-            gtk_label_set_text((GtkLabel*)Objects[Data.Seek((DH->SensorNames[i] + (std::string(std::to_string(i))) + "LBL_TEMP").c_str())],std::to_string(DH->SensorData[i].back()).c_str());
-            if (DH->SensorData[i].back() >= DH->SensorCriticals[i])
+            if (std::isnan(Snapshot.Values[i])) continue; //Not read yet
+            std::string TempDat = std::to_string(Snapshot.Values[i]);
+            gtk_label_set_text((GtkLabel*)Objects[Data.Seek((DH->SensorNames[i] + (std::string(std::to_string(i))) + "LBL_TEMP").c_str())],TempDat.c_str());
+            if (Alerts.Level(i) == AlertLevel::Critical)
             {
                 const char *FMT = "<span foreground=\"#FF0000\" weight=\"heavy\">\%s</span>";
                 char *MKP = g_markup_printf_escaped(FMT,TempDat.c_str());
                 gtk_label_set_markup((GtkLabel*)Objects[Data.Seek((DH->SensorNames[i] + (std::string(std::to_string(i))) + "LBL_TEMP").c_str())],MKP);
 //                g_free(MKP); //this was causing a double-free issue
-                if (DH->SensorCommands[i].length() > 0)
-                {
-                    std::thread App(popen,DH->SensorCommands[i].c_str(),"r");
-                    App.detach();
-                }
             }
-            else if (DH->SensorData[i].back() >= DH->SensorCriticals[i]-5)
+            else if (Alerts.Level(i) != AlertLevel::Normal) //warning, or cooling down after an alert
             {
                 const char *FMT = "<span foreground=\"#FFA100\" weight=\"bold\">\%s</span>";
                 char *MKP = g_markup_printf_escaped(FMT,TempDat.c_str());
@@ -420,10 +448,26 @@ namespace GUI
         };
     };
 
+    /*
+    GUI BlitChart:
+        Displays the newest chart rendered by the Renderer worker.
+        Posted to the main loop by the worker; never renders itself.
+        -Takes: Object data (unused)
+    */
+    gboolean BlitChart(gpointer data)
+    {
+        cairo_surface_t* Surface = Renderer.TakeFinished();
+        if (Surface == NULL)
+            return G_SOURCE_REMOVE;
+        gtk_image_set_from_surface((GtkImage*)Objects[Data.Seek("Graph Surface")],Surface);
+        cairo_surface_destroy(Surface);
+        return G_SOURCE_REMOVE;
+    };
+
     /*
     GUI replot:
-        Re-draws the GNUPlot and sends a call to update
-            temperature readouts.
+        Requests a new chart from the render worker and sends a
+            call to update temperature readouts.
         -Takes: Container (unused), Object data
     */
     bool replot(gpointer data)
@@ -432,9 +476,12 @@ namespace GUI
         int2string *IntData = (int2string*)ObjData[1];
         GUIDataHandler *DH = (GUIDataHandler*)ObjData[2];
 
-        for (int i = 0; i < DH->SensorNames.size(); i++)
         {
-            Handle.SensorActive[i] = gtk_switch_get_active((GtkSwitch*)Objects[IntData->Seek((Handle.SensorNames[i] + (std::string(std::to_string(i))) + "COLLECT").c_str())]);
+            std::lock_guard<std::mutex> Guard(DH->DataLock);
+            for (int i = 0; i < DH->SensorNames.size(); i++)
+            {
+                DH->SensorActive[i] = gtk_switch_get_active((GtkSwitch*)Objects[IntData->Seek((DH->SensorNames[i] + (std::string(std::to_string(i))) + "COLLECT").c_str())]);
+            }
         }
 
         guint wid,hit;
@@ -443,101 +490,33 @@ namespace GUI
 
         IntData->Width = wid;
         IntData->Height = hit;
-
-        FILE *Gnuplot = popen("gnuplot","w");
-        if (Gnuplot == NULL)
-        {
-            fprintf(stderr,"[gnuplot]: unable to start program\n");
-            return false;
-        }
-        fprintf(Gnuplot,"set terminal pngcairo size %d,%d\n",wid,hit);
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set output '%s'\n",IntData->FName.c_str());
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set xrange [0<*:]\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set xlabel \"Time (seconds since program start)\"\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set ylabel \"Temperature (^OC)\"\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set grid\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set key on\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set key outside right\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set label \"Plotted with Gnuplot\" at screen 0.0,1.0 boxed offset 1,-1\n");
-        fflush(Gnuplot);
-        fprintf(Gnuplot,"set title \"Temperature vs Time plot\"\n");
-        fflush(Gnuplot);
-        for (int i = 0; i < Handle.SensorNames.size(); i++)
-        {
-            if (Handle.SensorActive[i])
-            {
-                std::string SensorName = Handle.SensorNames[i];
-                std::replace(SensorName.begin(),SensorName.end(),':','_');
-                std::replace(SensorName.begin(),SensorName.end(),' ','_');
-                fprintf(Gnuplot,"set style line %d lc rgb '#%.6X' lw 3 pt 7\n",i+1,Handle.SensorColours[i]);
-                fflush(Gnuplot);
-                fprintf(Gnuplot,"$%s << EOD\n",SensorName.c_str());
-                fflush(Gnuplot);
-                for (int j = 0; j < Handle.SensorData[i].size(); j++) //TODO: LIMIT TO 249 DATAPOINTS
-                {
-                    fprintf(Gnuplot,"%d %f\n",Handle.Times[i][j],Handle.SensorData[i][j]);
-                    fflush(Gnuplot);
-                }
-                fprintf(Gnuplot,"EOD\n");
-                fflush(Gnuplot);
-            }
-        };
-        bool NoPlotmLine = 1;
-        for (int i = 0; i < Handle.SensorNames.size(); i++)
-        {
-            if (Handle.SensorActive[i] && NoPlotmLine)
-            {
-                std::string SensorName = Handle.SensorNames[i];
-                std::replace(SensorName.begin(),SensorName.end(),':','_');
-                std::replace(SensorName.begin(),SensorName.end(),' ','_');
-                fprintf(Gnuplot," plot $%s title \"%s\" with linespoints ls %d",SensorName.c_str(),SensorName.c_str(),i+1);
-                NoPlotmLine = 0;
-            }
-            else if (Handle.SensorActive[i]) {
-                std::string SensorName = Handle.SensorNames[i];
-                std::replace(SensorName.begin(),SensorName.end(),':','_');
-                std::replace(SensorName.begin(),SensorName.end(),' ','_');
-                fprintf(Gnuplot,", $%s title \"%s\" with linespoints ls %d",SensorName.c_str(),SensorName.c_str(),i+1);
-                }
-        }
-        fprintf(Gnuplot,"\n");
-        fflush(Gnuplot);
-
-        pclose(Gnuplot);
-
-        gtk_image_set_from_file((GtkImage*)ObjData[IntData->Seek("Graph Surface")],IntData->FName.c_str());
-        gtk_widget_queue_draw((GtkWidget*)ObjData[IntData->Seek("Graph Surface")]);
+        Renderer.Request(wid,hit);
 
         UpdateTemps(data);
         return false;
     };
 
     /*
-    GUI CheckResize:
-        Checks if the window has been resized and calls replot if it has
-        -Takes: Widget (unused) and Object data.
+    GUI GraphResized:
+        "size-allocate" handler for the graph socket; requests a
+            new chart when the allocation has actually changed.
+            Any render still in flight for the old size is
+            cancelled by the new request.
+        -Takes: Widget (unused), new allocation, Object data
     */
-    bool CheckResize(gpointer data)
+    void GraphResized(GtkWidget* Widget, GtkAllocation* Allocation, gpointer data)
     {
         GObject** ObjData = (GObject**)data;
         int2string *IntData = (int2string*)ObjData[1];
-        GUIDataHandler *DH = (GUIDataHandler*)ObjData[2];
-
-        guint wid,hit;
-        wid = gtk_widget_get_allocated_width((GtkWidget*)ObjData[IntData->Seek("Graph Socket")]);
-        hit = gtk_widget_get_allocated_height((GtkWidget*)ObjData[IntData->Seek("Graph Socket")]);
 
+        guint wid = Allocation->width;
+        guint hit = Allocation->height;
         if (hit != IntData->Height || wid != IntData->Width)
-            replot(data);
-        return false;
+        {
+            IntData->Width = wid;
+            IntData->Height = hit;
+            Renderer.Request(wid,hit);
+        }
     };
 
     /*
@@ -618,28 +597,6 @@ namespace GUI
         Objects = (GObject**)realloc(Objects,(Data.size())*sizeof(GObject*));
         Objects[Data.Seek("Graph Socket Parent")] = gtk_builder_get_object(Builder,"GraphSocket_parent");
 
-        int FileNO = 0;
-        while (FileNO <= 256)
-        {
-            FileNO++;
-            std::string TmpFile = "SafeTemp";
-            TmpFile += std::to_string(FileNO);
-            TmpFile += ".png";
-            FILE* chk = fopen(TmpFile.c_str(),"r");
-            if (chk == NULL)
-            {
-                break;
-            }
-            fclose(chk);
-            if (FileNO > 255)
-            {
-                fprintf(stderr,"UNABLE TO PLOT GRAPH!\nFileNO < 256 failed\n");
-                break;
-            }
-        }
-
-        Data.FName = "/tmp/SafeTemp" + std::to_string(FileNO) + ".png";
-
         Data.Add("DataBox");
         Objects = (GObject**)realloc(Objects,(Data.size())*sizeof(GObject*));
         Objects[Data.Seek("DataBox")] = gtk_builder_get_object(Builder,"DataBox");
@@ -719,6 +676,11 @@ namespace GUI
         ErrorValue = g_signal_connect(Objects[Data.Seek("Toplevel")],"destroy",G_CALLBACK(Terminate),Objects);
         if (ErrorValue < 0) fprintf(stderr,"[Toplevel]: Failed to connect window handler\n");
 
+        ErrorValue = g_signal_connect(Objects[Data.Seek("Graph Socket")],"size-allocate",G_CALLBACK(GraphResized),Objects);
+        if (ErrorValue < 0) fprintf(stderr,"[Graph Socket]: Failed to connect resize handler\n");
+
+        Renderer.Start(BlitChart,Objects);
+
         gtk_widget_show_all((GtkWidget*)Objects[0]);
     };
 }
@@ -27,6 +27,7 @@ Graph Class
 //#include "WinMan.h"
 #ifndef UI_GRAPH_H_
 #define UI_GRAPH_H_
+#include <climits>
 #include <string>
 #include <vector>
 #include <math.h>
@@ -1,4 +1,10 @@
-#if HAVE_GTK == 1 && HAVE_GNUPLOT == 1
+#ifndef UI_GUIDATAHANDLER_HPP_
+#define UI_GUIDATAHANDLER_HPP_
+#if HAVE_GTK == 1
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <sys/time.h>
 namespace GUI
 {
@@ -21,15 +27,20 @@ namespace GUI
         std::vector<std::vector<int>> Times;
         std::vector<float> SensorCriticals; //critical temperatures
         std::vector<bool> SensorActive;
+        std::mutex DataLock; //guards the data vectors against the chart render worker
 
-        int NumDataPts = 250;
-        int CallInterval;
+        int NumDataPts = 250; //number of samples shown in the (rolling) graph
+        int CallInterval = 5; //seconds between samples
+        std::size_t MaxSamples = 0; //samples kept per sensor (0: all; see --history-budget)
 
         GUIDataHandler();
         void Harmonize();
         bool GetTimeTrigger(int);
         void AddData(float,unsigned int);
+        void Backfill(unsigned int,std::vector<double> const&,std::vector<float> const&);
         void clear();
+        private:
+        void Trim(unsigned int);
     };
 
     /*
@@ -98,8 +109,49 @@ namespace GUI
     void GUIDataHandler::AddData(float Data, unsigned int Index)
     {
         gettimeofday(&TV_timer,NULL);
+        std::lock_guard<std::mutex> Guard(DataLock);
         SensorData[Index].push_back(Data);
         Times[Index].push_back(TV_timer.tv_sec - StartTime);
+        Trim(Index);
+    };
+
+    /*
+    Backfill for GUIDataHandler
+        Inserts older temperature data (restored from the sample log)
+        ahead of the data collected for sensor 'Index' so far
+        -Takes: sensor index, wall-clock times (seconds since the epoch)
+                and temperature data, oldest first
+    */
+    void GUIDataHandler::Backfill(unsigned int Index, std::vector<double> const &WallTimes, std::vector<float> const &Data)
+    {
+        std::lock_guard<std::mutex> Guard(DataLock);
+        if (Index >= SensorData.size()) return;
+        std::vector<int> OldTimes;
+        std::vector<float> OldData;
+        for (std::size_t i = 0; i < WallTimes.size() && i < Data.size(); i++)
+        {
+            int Time = (int)(WallTimes[i] - StartTime);
+            if (!Times[Index].empty() && Time >= Times[Index].front()) break;
+            OldTimes.push_back(Time);
+            OldData.push_back(Data[i]);
+        }
+        Times[Index].insert(Times[Index].begin(),OldTimes.begin(),OldTimes.end());
+        SensorData[Index].insert(SensorData[Index].begin(),OldData.begin(),OldData.end());
+        Trim(Index);
+    };
+
+    /*
+    Trim for GUIDataHandler
+        Drops the oldest data of sensor 'Index' once it holds an
+        eighth more than MaxSamples (so that it isn't moved on
+        every sample); the caller holds DataLock
+    */
+    void GUIDataHandler::Trim(unsigned int Index)
+    {
+        if (MaxSamples == 0 || SensorData[Index].size() <= MaxSamples + MaxSamples / 8) return;
+        std::size_t Drop = SensorData[Index].size() - MaxSamples;
+        SensorData[Index].erase(SensorData[Index].begin(),SensorData[Index].begin() + Drop);
+        Times[Index].erase(Times[Index].begin(),Times[Index].begin() + std::min(Drop,Times[Index].size()));
     };
 
     /*
@@ -120,3 +172,4 @@ namespace GUI
     };
 }
 #endif
+#endif //UI_GUIDATAHANDLER_HPP_
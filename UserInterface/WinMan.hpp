@@ -44,6 +44,9 @@ Hybrid Window Library
 #define WINMAN_H_
 #include <memory>
 #include "../Types.hpp"
+#include "ChartCache.hpp"
+#include "../History/QuantileSketch.hpp"
+#include "../History/OnlineStats.hpp"
 
 #ifndef UI_HYBRID_WIN_H_
 #define UI_HYBRID_WIN_H_
@@ -106,6 +109,7 @@ public:
 void PrintHeaders(SubWindow &Win) {
 	const char* CurrentTemp = "Curr. T";
 	const char* CriticalTemp = "Crit. T";
+	const char* Spread = "p50 / p99";
 	const char* SName = "Sensor Name";
 	const char* SymbolTxt = "Symbol";
 	const char* ColTxt = "Colour";
@@ -113,6 +117,7 @@ void PrintHeaders(SubWindow &Win) {
 	mvwprintw(Win.GetHandle().get(),1,1,"%-8s | ",CurrentTemp);
 	wprintw(Win.GetHandle().get(),"%-16s  | ",SName);
 	wprintw(Win.GetHandle().get(),"%-8s | ",CriticalTemp);
+	wprintw(Win.GetHandle().get(),"%-11s | ",Spread);
 	wprintw(Win.GetHandle().get(),"%-6s | ",SymbolTxt);
 	wprintw(Win.GetHandle().get(),"%-6s | ",ColTxt);
 	wprintw(Win.GetHandle().get(),Cmd);
@@ -136,8 +141,10 @@ void CheckSetAttribute(SubWindow &Win, Selection const &Cursor, int i, int j) {
  * @param Cursor         The user's cursor location
  * @param ScrollPoint    Where the user's cursor is scrolled to in the UI (for lists of sensors greater than 5)
  * @param Opts           List of current SensorDetailLine objects to be printed
+ * @param Sketches       Distribution of each sensor's readings, for the p50/p99 column (read-only)
+ * @param Trends         Smoothed statistics of each sensor; a rise or fall of at least 0.5 degrees/minute is marked ^ or v
  */
-void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t ScrollPoint, std::vector<SensorPreferences> const &Opts) {
+void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t ScrollPoint, std::vector<SensorPreferences> const &Opts, std::vector<QuantileSketch> const &Sketches, SensorStats const &Trends) {
 	wmove(Win.GetHandle().get(),1,1);
 	unsigned nSensors = Opts.size();
 	WinSize WSize = Win.GetSize();
@@ -149,7 +156,8 @@ void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t Scroll
 		CheckSetAttribute(Win,Cursor,i,0);
 		mvwprintw(Win.GetHandle().get(), i+3, 1, "%8.2f",Opts[SensorNumber].GetTempData().Temp);
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
-		wprintw(Win.GetHandle().get(),"  | ");
+		double PerMinute = (SensorNumber < Trends.Size()) ? Trends[SensorNumber].Slope() * 60 : NAN;
+		wprintw(Win.GetHandle().get(),"%c | ",(PerMinute >= 0.5) ? '^' : (PerMinute <= -0.5) ? 'v' : ' ');
 		CheckSetAttribute(Win,Cursor,i,1);
 		wprintw(Win.GetHandle().get(),"%-16s",Opts[SensorNumber].GetFriendlyName().substr(0,16).c_str());
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
@@ -158,6 +166,11 @@ void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t Scroll
 		wprintw(Win.GetHandle().get(),"%8.2f",Opts[SensorNumber].GetCriticalTemp());
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
 		wprintw(Win.GetHandle().get()," | ");
+		if (SensorNumber < Sketches.size() && Sketches[SensorNumber].Count() > 0)
+			wprintw(Win.GetHandle().get(),"%5.1f/%5.1f",Sketches[SensorNumber].Quantile(0.5),Sketches[SensorNumber].Quantile(0.99));
+		else
+			wprintw(Win.GetHandle().get(),"%11s","-");
+		wprintw(Win.GetHandle().get()," | ");
 		CheckSetAttribute(Win,Cursor,i,3);
 		wprintw(Win.GetHandle().get(),"%6c",Opts[SensorNumber].GetSymbol());
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
@@ -167,8 +180,8 @@ void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t Scroll
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
 		wprintw(Win.GetHandle().get()," | ");
 		CheckSetAttribute(Win,Cursor,i,5);
-		wprintw(Win.GetHandle().get()," %s ",Opts[SensorNumber].GetCommand().substr(0,WSize.x - 60).c_str());
-		if (60 + Opts[SensorNumber].GetCommand().length() > WSize.x - 8)
+		wprintw(Win.GetHandle().get()," %s ",Opts[SensorNumber].GetCommand().substr(0,WSize.x - 74).c_str());
+		if (74 + Opts[SensorNumber].GetCommand().length() > WSize.x - 8)
 			wprintw(Win.GetHandle().get(),"...");
 		wattroff(Win.GetHandle().get(),A_STANDOUT);
 	}
@@ -176,23 +189,25 @@ void NCursesPrintUiToWindow(SubWindow &Win, Selection Cursor, std::size_t Scroll
 		mvwprintw(Win.GetHandle().get(), WSize.y-2, 1, "%-8s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%-16s  | ","  (...)  ");
 		wprintw(Win.GetHandle().get(), "%-8s | "," (...) ");
+		wprintw(Win.GetHandle().get(), "%-11s | ","   (...)");
 		wprintw(Win.GetHandle().get(), "%-6s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%-6s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%s "," (...) ");
 	}
 	else {
-		mvwprintw(Win.GetHandle().get(),WSize.y-2,1,"%-79s"," ");
+		mvwprintw(Win.GetHandle().get(),WSize.y-2,1,"%-93s"," ");
 	}
 	if (ScrollPoint > 0) {
 		mvwprintw(Win.GetHandle().get(), 2, 1, "%-8s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%-16s  | ","  (...)  ");
 		wprintw(Win.GetHandle().get(), "%-8s | "," (...) ");
+		wprintw(Win.GetHandle().get(), "%-11s | ","   (...)");
 		wprintw(Win.GetHandle().get(), "%-6s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%-6s | ","(...)");
 		wprintw(Win.GetHandle().get(), "%s "," (...) ");
 	}
 	else {
-		mvwprintw(Win.GetHandle().get(),2,1,"%-79s"," ");
+		mvwprintw(Win.GetHandle().get(),2,1,"%-93s"," ");
 	}
 }
 
@@ -293,6 +308,72 @@ void NCursesPrintGraphToWindow(SubWindow &Win, std::vector<SensorDetailLine> con
 	}
 }
 
+/** @brief A layered ncurses chart
+ * The axes are left in the window between frames and only redrawn on a resize
+ *   or rescale; plotted symbols live in a ColumnRing which is scrolled as time
+ *   advances, so a frame only plots the samples that arrived since the last one.
+ */
+class NCursesChart {
+private:
+	ChartCache m_Cache;
+	ColumnRing<char> m_Data;
+	static constexpr int Left = 13; ///<First plot column (the temperature axis is drawn at column 12)
+	static constexpr int Top = 3;   ///<Row of the topmost temperature label
+public:
+	/** @brief Force a full redraw (e.g. after the window has been cleared) */
+	void Invalidate() {
+		m_Cache.Invalidate();
+	}
+
+	/** @brief Draw the chart to the graph window
+	 * @param Win      The window
+	 * @param History  All sensor readings, oldest first
+	 * @param MinTemp  Minimum temperature in History
+	 * @param MaxTemp  Maximum temperature in History
+	 * @param dTime    Seconds per column
+	 */
+	void Draw(SubWindow &Win, std::vector<SensorDetailLine> const &History, float MinTemp, float MaxTemp, unsigned const dTime) {
+		if (dTime == 0 || History.empty()) return;
+		WinSize const WSize = Win.GetSize();
+		ChartScale Scale;
+		Scale.Columns = WSize.x - 2 - 12 - 10;
+		Scale.Rows = WSize.y - 7;
+		Scale.MinTemp = MinTemp;
+		Scale.MaxTemp = MaxTemp;
+		Scale.SecondsPerColumn = dTime;
+		Scale.QuantizeTemps();
+		if (Scale.Columns <= 0 || Scale.Rows <= 1) return;
+
+		ChartFrame const Frame = m_Cache.Plan(Scale,(double)History.back().Time);
+		if (!Frame.Dirty()) return;
+		if (Frame.RedrawStatic) {
+			m_Data.Resize(Scale.Columns,Scale.Rows);
+			NCursesPrintGraphAxes(Win,Scale.MinTemp,Scale.MaxTemp,(std::time_t)Frame.LeftEdge(),(std::time_t)Frame.RightEdge,dTime);
+		}
+		if (Frame.RedrawData)
+			m_Data.Clear();
+		else
+			m_Data.Scroll(Frame.ScrollColumns);
+
+		//Only the newest strip of samples has to be plotted
+		for (auto IT = History.rbegin(); IT != History.rend() && IT->Time >= Frame.StripStart; ++IT) {
+			int Column = (int)std::floor(Frame.Column((double)IT->Time));
+			int Row = (int)std::lround(Scale.Row(IT->TempData.Temp));
+			m_Data.Set(Column,Row,IT->Symbol);
+		}
+
+		if (Frame.RedrawData || Frame.ScrollColumns > 0)
+			NCursesPrintTimeAxis(Win, WSize.x - 2 - 12,(std::time_t)Frame.LeftEdge(),(std::time_t)Frame.RightEdge,dTime);
+		WINDOW *Handle = Win.GetHandle().get();
+		for (int c = 0; c != m_Data.Columns(); c++) {
+			for (int r = 0; r != m_Data.Rows(); r++) {
+				char Cell = m_Data.At(c,r);
+				mvwaddch(Handle,Top + r,Left + c,(Cell == 0) ? ' ' : Cell);
+			}
+		}
+	}
+};
+
 /**
  * @brief The global main window
  */